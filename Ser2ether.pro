@@ -10,11 +10,15 @@ CONFIG += c++17
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(bridge.pri)
+
 SOURCES += \
+    logqueue.cpp \
     main.cpp \
     widget.cpp
 
 HEADERS += \
+    logqueue.h \
     widget.h
 
 FORMS += \
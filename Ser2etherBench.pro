@@ -0,0 +1,26 @@
+# Load generator: runs a bridge channel between a pseudo-terminal and a
+# loopback UDP socket and reports throughput, latency, loss and CPU cost.
+# Needs no hardware, only a Unix system with pseudo-terminals.
+
+QT       = core
+CONFIG  += c++17 console
+CONFIG  -= app_bundle
+
+!unix: error("ser2ether-bench needs pseudo-terminals")
+
+TARGET = ser2ether-bench
+
+# Keep the build products apart from the other targets when building in-source
+MAKEFILE = Makefile.ser2ether-bench
+OBJECTS_DIR = .obj-ser2ether-bench
+MOC_DIR = .moc-ser2ether-bench
+
+include(bridge.pri)
+
+# The log queue of the GUI, for the log spam the bench can add
+SOURCES += \
+    bench.cpp \
+    logqueue.cpp
+
+HEADERS += \
+    logqueue.h
@@ -0,0 +1,33 @@
+# Regression check of the receive loops: sends bursts through a bridge
+# channel between a pseudo-terminal and a loopback UDP socket and counts
+# the datagrams and serial system calls each burst costs. Exits non-zero
+# when bytes are lost, empty datagrams are sent or reads pile up. The GUI
+# is built in too, on the offscreen platform, to check that each of its
+# buttons is dispatched once.
+
+QT       = core gui widgets
+CONFIG  += c++17 console
+CONFIG  -= app_bundle
+
+!linux: error("ser2ether-burst-check needs pseudo-terminals and /proc")
+
+TARGET = ser2ether-burst-check
+
+# Keep the build products apart from the other targets when building in-source
+MAKEFILE = Makefile.ser2ether-burst-check
+OBJECTS_DIR = .obj-ser2ether-burst-check
+MOC_DIR = .moc-ser2ether-burst-check
+
+include(bridge.pri)
+
+SOURCES += \
+    burstcheck.cpp \
+    logqueue.cpp \
+    widget.cpp
+
+HEADERS += \
+    logqueue.h \
+    widget.h
+
+FORMS += \
+    widget.ui
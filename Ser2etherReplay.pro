@@ -0,0 +1,26 @@
+# Replay tool: feeds a trace recorded by the bridge (record/path, --record)
+# into a serial port or a UDP socket for repeatable load tests.
+
+QT       = core network serialport
+CONFIG  += c++17 console
+CONFIG  -= app_bundle
+
+TARGET = ser2ether-replay
+
+# Keep the build products apart from the other targets when building in-source
+MAKEFILE = Makefile.ser2ether-replay
+OBJECTS_DIR = .obj-ser2ether-replay
+MOC_DIR = .moc-ser2ether-replay
+
+SOURCES += \
+    bridgesettings.cpp \
+    replay.cpp
+
+HEADERS += \
+    bridgesettings.h \
+    tracefile.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
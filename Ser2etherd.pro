@@ -0,0 +1,23 @@
+# Headless ser2ether daemon: runs the bridge on QCoreApplication and takes its
+# settings from the command line or a config file. Does not link QtWidgets.
+
+QT       = core
+CONFIG  += c++17 console
+CONFIG  -= app_bundle
+
+TARGET = ser2etherd
+
+# Keep the build products apart from the GUI target when building in-source
+MAKEFILE = Makefile.ser2etherd
+OBJECTS_DIR = .obj-ser2etherd
+MOC_DIR = .moc-ser2etherd
+
+include(bridge.pri)
+
+SOURCES += \
+    daemon.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
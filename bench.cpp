@@ -0,0 +1,884 @@
+#include "bridgemanager.h"
+#include "linkcodec.h"
+#include "logqueue.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSocketNotifier>
+#include <QThread>
+#include <QTimer>
+#include <QUdpSocket>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace {
+
+// Print an error to stderr and return the tool's exit code
+int fail(const QString &message)
+{
+    std::fprintf(stderr, "ser2ether-bench: %s\n", qPrintable(message));
+    return 1;
+}
+
+// Start of every generated frame. The magic lets the receiver find the
+// frames again in a stream that lost bytes, the stamp gives the latency.
+struct FrameHeader {
+    quint8 magic[2];
+    quint16 size;
+    quint32 sequence;
+    qint64 stamp;
+};
+
+constexpr quint8 FrameMagic[2] = {0xa5, 0x5a};
+
+// Traffic the generator produces
+enum Pattern {
+    ConstantPattern,    // frames evenly spread at the given rate
+    BurstPattern,       // the same rate, sent in bursts every BurstPeriod
+    TinyPattern,        // constant rate of header-only frames
+    MaxSizePattern,     // constant rate of frames as large as a datagram may be
+    TelemetryPattern    // constant rate of frames filled with sensor readings as text
+};
+
+constexpr qint64 BurstPeriod = 100 * 1000 * 1000;   // ns
+constexpr int MaxFrameSize = 1472;
+constexpr int MaxChannels = 32;
+
+// How often the log is drained and how much of it is kept, as in the GUI
+constexpr int LogFlushInterval = 100;   // ms
+constexpr int MaxLogText = 1024 * 1024; // characters
+
+// Processor time of the whole process in ns, the generator included
+qint64 processCpuTime()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (qint64(usage.ru_utime.tv_sec) + usage.ru_stime.tv_sec) * 1000000000
+           + (qint64(usage.ru_utime.tv_usec) + usage.ru_stime.tv_usec) * 1000;
+}
+
+// One direction through the bridge: what was sent, what came out
+struct Flow {
+    const char *name;
+    bool enabled = false;
+    quint32 nextSequence = 0;
+    quint64 sentFrames = 0;
+    quint64 receivedFrames = 0;
+    quint64 receivedBytes = 0;
+    quint64 resyncBytes = 0;
+    quint64 payloadBytes = 0;       // frame bytes on the UDP side
+    quint64 wireBytes = 0;          // datagram bytes carrying them, less with compression
+    QByteArray unsent;              // frame bytes the pty did not take yet
+    QByteArray inbox;               // received stream not parsed yet
+    std::vector<qint64> latencies;  // ns, one per received frame
+};
+
+// Merge the results of one direction of several channels
+void mergeFlow(Flow *total, const Flow &flow)
+{
+    total->enabled = flow.enabled;
+    total->sentFrames += flow.sentFrames;
+    total->receivedFrames += flow.receivedFrames;
+    total->receivedBytes += flow.receivedBytes;
+    total->resyncBytes += flow.resyncBytes;
+    total->payloadBytes += flow.payloadBytes;
+    total->wireBytes += flow.wireBytes;
+    total->latencies.insert(total->latencies.end(), flow.latencies.begin(), flow.latencies.end());
+}
+
+// One bridge channel under test: a pty standing in for its serial device,
+// a loopback UDP socket as its peer, and the traffic of both directions
+struct Channel {
+    int ptyMaster = -1;
+    std::unique_ptr<QUdpSocket> udpSocket;
+    quint16 bridgePort = 0;
+    BridgeEngine *engine = nullptr;
+    BridgeSettings settings;
+
+    // The bench codes its datagrams the way a peer with the link codec would
+    std::unique_ptr<LinkEncoder> encoder;
+    LinkDecoder decoder;
+
+    Flow serialToNetwork = {"serial-to-network"};
+    Flow networkToSerial = {"network-to-serial"};
+
+    ~Channel()
+    {
+        if (ptyMaster != -1)
+            ::close(ptyMaster);
+    }
+};
+
+// Feeds frames into both ends of every bridge channel, one end being a pty
+// standing in for the serial device, the other a loopback UDP socket
+class Bench
+{
+public:
+    Pattern pattern = ConstantPattern;
+    int frameSize = 64;
+    qint64 rate = 100000;           // bytes per second, direction and channel
+    qint64 duration = 10000000000;  // ns
+    bool json = false;
+    bool coded = false;
+
+    QHostAddress bridgeAddress = QHostAddress(QHostAddress::LocalHost);
+    std::vector<std::unique_ptr<Channel>> channels;
+
+    // Switching the line settings of the running channels back and forth,
+    // the way test rigs change baud rates between runs
+    BridgeManager *manager = nullptr;
+    qint64 switchInterval = 0;      // ms, 0 never switches
+    int threadCount = 1;            // 0 runs the channels on the main thread
+
+    // Log lines written on the main thread and drained into a bounded text,
+    // the way the GUI feeds its log view; with the channels on the main
+    // thread as well this is how forwarding ran before the engine
+    qint64 logRate = 0;             // lines per second, 0 writes none
+    LogQueue logQueue;
+    quint64 logLines = 0;
+    quint64 logDropped = 0;
+    QString logText;
+
+    void start();
+
+private:
+    void generate();
+    void sendFrame(Channel &channel, Flow &flow, qint64 now);
+    void switchLine();
+    void flushLog();
+    void fillTelemetry();
+    void sendDatagram(Channel &channel, const char *data, int size);
+    void flushPty(Channel &channel);
+    void readPty(Channel &channel);
+    void readUdp(Channel &channel);
+    void receive(Flow &flow, const char *data, int size, qint64 now);
+    void report();
+
+    struct Summary {
+        qint64 lostFrames;
+        double megabytesPerSecond;
+        qint64 p50, p99, p999;     // latency in us
+    };
+    Summary summarize(const Flow &flow) const;
+
+    QTimer tickTimer;
+    QTimer switchTimer;
+    QTimer logTimer;
+    QElapsedTimer clock;
+    qint64 cpuAtStart = 0;
+    qint64 elapsedAtEnd = 0;
+    char frame[MaxFrameSize];
+    quint32 telemetrySeed = 1;
+    char readBuffer[65536];
+};
+
+// This function is called once every bridge channel is open
+void Bench::start()
+{
+    // Reading end of both flows of every channel
+    for (const std::unique_ptr<Channel> &entry : channels) {
+        Channel *channel = entry.get();
+        QSocketNotifier *notifier = new QSocketNotifier(channel->ptyMaster, QSocketNotifier::Read, channel->udpSocket.get());
+        QObject::connect(notifier, &QSocketNotifier::activated, [this, channel] { readPty(*channel); });
+        QObject::connect(channel->udpSocket.get(), &QUdpSocket::readyRead, [this, channel] { readUdp(*channel); });
+        if (channel->encoder) {
+            QObject::connect(channel->encoder.get(), &LinkEncoder::datagramReady, [this, channel](const char *data, int size) {
+                sendDatagram(*channel, data, size);
+            });
+        }
+    }
+
+    // Frame bytes that never change
+    std::memset(frame, 0x55, sizeof(frame));
+
+    // The generator catches up with the schedule every millisecond
+    tickTimer.setTimerType(Qt::PreciseTimer);
+    tickTimer.setInterval(1);
+    QObject::connect(&tickTimer, &QTimer::timeout, [this] { generate(); });
+
+    // Switch the baud rate while the traffic runs
+    if (switchInterval > 0) {
+        switchTimer.setInterval(int(switchInterval));
+        QObject::connect(&switchTimer, &QTimer::timeout, [this] { switchLine(); });
+        switchTimer.start();
+    }
+
+    // Drain the log like the GUI does
+    if (logRate > 0) {
+        logTimer.setInterval(LogFlushInterval);
+        QObject::connect(&logTimer, &QTimer::timeout, [this] { flushLog(); });
+        logTimer.start();
+    }
+
+    cpuAtStart = processCpuTime();
+    clock.start();
+    tickTimer.start();
+}
+
+// This function is called every switch interval to flip the baud rate of the channels
+void Bench::switchLine()
+{
+    for (const std::unique_ptr<Channel> &channel : channels) {
+        channel->settings.baudRate = channel->settings.baudRate == 4000000 ? 2000000 : 4000000;
+        manager->reconfigureChannel(channel->engine, channel->settings);
+    }
+}
+
+// This function is called periodically to move the log lines into the text,
+// formatted as the GUI shows them
+void Bench::flushLog()
+{
+    LogQueue::Entry entry;
+    while (logQueue.pop(&entry)) {
+        logText += QDateTime::fromMSecsSinceEpoch(entry.time).toString(QStringLiteral("hh:mm:ss.zzz "));
+        logText += QStringLiteral("[INFO] %1\n").arg(entry.text);
+    }
+    logDropped += logQueue.takeDropped();
+
+    // Keep the newest lines, as the view's block limit does
+    if (logText.size() > MaxLogText)
+        logText.remove(0, logText.size() - MaxLogText / 2);
+}
+
+// This function is called every tick to send the frames that are due
+void Bench::generate()
+{
+    const qint64 elapsed = clock.nsecsElapsed();
+    if (elapsed >= duration) {
+        // Give what is in flight a moment to arrive, then report
+        tickTimer.stop();
+        switchTimer.stop();
+        logTimer.stop();
+        for (const std::unique_ptr<Channel> &channel : channels) {
+            if (channel->encoder)
+                channel->encoder->flush();
+        }
+        elapsedAtEnd = elapsed;
+        QTimer::singleShot(500, [this] { report(); });
+        return;
+    }
+
+    // Frames the schedule asks for by now
+    const quint64 framesPerSecond = quint64(qMax<qint64>(1, rate / frameSize));
+    quint64 due;
+    if (pattern == BurstPattern) {
+        const quint64 framesPerBurst = qMax<quint64>(1, framesPerSecond * BurstPeriod / 1000000000);
+        due = quint64(elapsed / BurstPeriod + 1) * framesPerBurst;
+    } else {
+        due = quint64(double(elapsed) * framesPerSecond / 1e9);
+    }
+
+    // Log lines due by now, as a chatty bridge would write them
+    const quint64 linesDue = quint64(double(elapsed) * double(logRate) / 1e9);
+    for (; logLines < linesDue; ++logLines)
+        logQueue.push(LogQueue::Info, QStringLiteral("Frame %1 forwarded").arg(logLines));
+
+    for (const std::unique_ptr<Channel> &channel : channels) {
+        flushPty(*channel);
+        for (Flow *flow : {&channel->serialToNetwork, &channel->networkToSerial}) {
+            // A pty that is full holds the generator back instead of growing the backlog
+            while (flow->enabled && flow->sentFrames < due && flow->unsent.isEmpty())
+                sendFrame(*channel, *flow, BridgeStats::now());
+        }
+    }
+}
+
+// This function is called to send one frame into the bridge
+void Bench::sendFrame(Channel &channel, Flow &flow, qint64 now)
+{
+    FrameHeader header;
+    std::memcpy(header.magic, FrameMagic, sizeof(header.magic));
+    header.size = quint16(frameSize);
+    header.sequence = flow.nextSequence++;
+    header.stamp = now;
+    std::memcpy(frame, &header, sizeof(header));
+    if (pattern == TelemetryPattern)
+        fillTelemetry();
+    ++flow.sentFrames;
+
+    if (&flow == &channel.networkToSerial) {
+        flow.payloadBytes += quint64(frameSize);
+        if (channel.encoder)
+            channel.encoder->append(frame, frameSize, now);
+        else
+            sendDatagram(channel, frame, frameSize);
+        return;
+    }
+
+    // The pty is a stream; what it does not take now goes out with the next tick
+    const ssize_t written = ::write(channel.ptyMaster, frame, size_t(frameSize));
+    const int taken = written > 0 ? int(written) : 0;
+    if (taken < frameSize)
+        flow.unsent.append(frame + taken, frameSize - taken);
+}
+
+// This function is called to fill a frame after its header with readings
+// like a sensor would print them: the same keys, slowly changing values
+void Bench::fillTelemetry()
+{
+    char line[64];
+    int position = int(sizeof(FrameHeader));
+    while (position < frameSize) {
+        telemetrySeed = telemetrySeed * 1103515245 + 12345;
+        const quint32 noise = telemetrySeed >> 16;
+        const int length = std::snprintf(line, sizeof(line), "T=%d.%u;H=%u;P=101%u.%u;V=3.%02u\r\n",
+                                         21 + int(noise % 3), noise % 10, 40 + (noise >> 2) % 20,
+                                         (noise >> 4) % 4, (noise >> 6) % 10, 20 + (noise >> 8) % 15);
+        const int taken = qMin(length, frameSize - position);
+        std::memcpy(frame + position, line, size_t(taken));
+        position += taken;
+    }
+}
+
+// This function is called to send a datagram to the bridge
+void Bench::sendDatagram(Channel &channel, const char *data, int size)
+{
+    channel.udpSocket->writeDatagram(data, size, bridgeAddress, channel.bridgePort);
+    channel.networkToSerial.wireBytes += quint64(size);
+}
+
+// This function is called to retry the bytes the pty did not take
+void Bench::flushPty(Channel &channel)
+{
+    QByteArray &unsent = channel.serialToNetwork.unsent;
+    if (unsent.isEmpty())
+        return;
+    const ssize_t written = ::write(channel.ptyMaster, unsent.constData(), size_t(unsent.size()));
+    if (written > 0)
+        unsent.remove(0, int(written));
+}
+
+// This function is called when the bridge wrote to the serial port
+void Bench::readPty(Channel &channel)
+{
+    ssize_t size;
+    while ((size = ::read(channel.ptyMaster, readBuffer, sizeof(readBuffer))) > 0)
+        receive(channel.networkToSerial, readBuffer, int(size), BridgeStats::now());
+}
+
+// This function is called when the bridge sent datagrams
+void Bench::readUdp(Channel &channel)
+{
+    Flow &flow = channel.serialToNetwork;
+    while (channel.udpSocket->hasPendingDatagrams()) {
+        const qint64 size = channel.udpSocket->readDatagram(readBuffer, sizeof(readBuffer));
+        if (size <= 0)
+            continue;
+        const qint64 now = BridgeStats::now();
+        flow.wireBytes += quint64(size);
+
+        // Coded datagrams carry several frames or pieces of frames
+        if (coded && channel.decoder.decode(readBuffer, int(size)) == LinkDecoder::Decoded) {
+            for (const LinkDecoder::Record &record : channel.decoder.records()) {
+                flow.payloadBytes += quint64(record.size);
+                receive(flow, record.data, record.size, now);
+            }
+            continue;
+        }
+        flow.payloadBytes += quint64(size);
+        receive(flow, readBuffer, int(size), now);
+    }
+}
+
+// This function is called to cut received data into frames; both ends are
+// treated as streams since serial framing may cut datagrams anywhere
+void Bench::receive(Flow &flow, const char *data, int size, qint64 now)
+{
+    flow.inbox.append(data, size);
+
+    int position = 0;
+    while (flow.inbox.size() - position >= int(sizeof(FrameHeader))) {
+        FrameHeader header;
+        std::memcpy(&header, flow.inbox.constData() + position, sizeof(header));
+        if (std::memcmp(header.magic, FrameMagic, sizeof(header.magic)) != 0 || header.size != frameSize) {
+            // Part of a frame was lost, look for the next one
+            ++position;
+            ++flow.resyncBytes;
+            continue;
+        }
+        if (flow.inbox.size() - position < frameSize)
+            break;
+
+        flow.latencies.push_back(now - header.stamp);
+        ++flow.receivedFrames;
+        flow.receivedBytes += quint64(frameSize);
+        position += frameSize;
+    }
+    flow.inbox.remove(0, position);
+}
+
+// This function is called to summarize one direction
+Bench::Summary Bench::summarize(const Flow &flow) const
+{
+    std::vector<qint64> latencies = flow.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double fraction) {
+        if (latencies.empty())
+            return qint64(0);
+        return latencies[std::min(latencies.size() - 1, size_t(double(latencies.size()) * fraction))] / 1000;
+    };
+
+    Summary summary;
+    summary.lostFrames = qint64(flow.sentFrames) - qint64(flow.receivedFrames);
+    summary.megabytesPerSecond = double(flow.receivedBytes) / 1e6 / (double(elapsedAtEnd) / 1e9);
+    summary.p50 = percentile(0.5);
+    summary.p99 = percentile(0.99);
+    summary.p999 = percentile(0.999);
+    return summary;
+}
+
+// This function is called at the end of the run to print the results and quit
+void Bench::report()
+{
+    const qint64 cpu = processCpuTime() - cpuAtStart;
+
+    // Both directions summed over the channels; what the bridge itself
+    // dropped, as opposed to what the pty or the socket lost
+    Flow serialToNetwork = {"serial-to-network"};
+    Flow networkToSerial = {"network-to-serial"};
+    quint64 bridgeDrops = 0;
+    quint64 switches = 0;
+    quint64 switchTime[BridgeStats::LatencyBuckets] = {};
+    for (const std::unique_ptr<Channel> &channel : channels) {
+        mergeFlow(&serialToNetwork, channel->serialToNetwork);
+        mergeFlow(&networkToSerial, channel->networkToSerial);
+        const BridgeStats::Snapshot stats = channel->engine->statistics().snapshot();
+        bridgeDrops += stats.serialToUdp.drops + stats.udpToSerial.drops;
+        switches += stats.reconfigures;
+        for (int i = 0; i < BridgeStats::LatencyBuckets; ++i)
+            switchTime[i] += stats.reconfigureTime[i];
+    }
+    const double megabytes = double(serialToNetwork.receivedBytes + networkToSerial.receivedBytes) / 1e6;
+    const double cpuPerMegabyte = megabytes > 0 ? double(cpu) / 1e6 / megabytes : 0.0;
+
+    // Latency of every channel on its own, to see whether some fall behind
+    QJsonArray perChannel;
+    if (channels.size() > 1) {
+        for (size_t i = 0; i < channels.size(); ++i) {
+            QJsonArray channelFlows;
+            if (!json)
+                std::printf("channel %2d", int(i));
+            for (const Flow *flow : {&channels[i]->serialToNetwork, &channels[i]->networkToSerial}) {
+                if (!flow->enabled)
+                    continue;
+                const Summary summary = summarize(*flow);
+                if (json) {
+                    QJsonObject object;
+                    object.insert(QStringLiteral("direction"), QString::fromLatin1(flow->name));
+                    object.insert(QStringLiteral("lostFrames"), summary.lostFrames);
+                    object.insert(QStringLiteral("mbPerSecond"), summary.megabytesPerSecond);
+                    object.insert(QStringLiteral("p50"), summary.p50);
+                    object.insert(QStringLiteral("p99"), summary.p99);
+                    channelFlows.append(object);
+                } else {
+                    std::printf(", %s %.3f MB/s, latency p50 %lld us, p99 %lld us", flow->name,
+                                summary.megabytesPerSecond, static_cast<long long>(summary.p50),
+                                static_cast<long long>(summary.p99));
+                }
+            }
+            if (json)
+                perChannel.append(channelFlows);
+            else
+                std::printf("\n");
+        }
+    }
+
+    QJsonArray flows;
+    for (const Flow *flow : {&serialToNetwork, &networkToSerial}) {
+        if (!flow->enabled)
+            continue;
+        const Summary summary = summarize(*flow);
+        const double wireRatio = flow->payloadBytes != 0 ? double(flow->wireBytes) / double(flow->payloadBytes) : 1.0;
+
+        if (json) {
+            QJsonObject object;
+            object.insert(QStringLiteral("direction"), QString::fromLatin1(flow->name));
+            object.insert(QStringLiteral("sentFrames"), qint64(flow->sentFrames));
+            object.insert(QStringLiteral("receivedFrames"), qint64(flow->receivedFrames));
+            object.insert(QStringLiteral("lostFrames"), summary.lostFrames);
+            object.insert(QStringLiteral("resyncBytes"), qint64(flow->resyncBytes));
+            object.insert(QStringLiteral("mbPerSecond"), summary.megabytesPerSecond);
+            object.insert(QStringLiteral("p50"), summary.p50);
+            object.insert(QStringLiteral("p99"), summary.p99);
+            object.insert(QStringLiteral("p999"), summary.p999);
+            object.insert(QStringLiteral("wireBytes"), qint64(flow->wireBytes));
+            object.insert(QStringLiteral("wireRatio"), wireRatio);
+            flows.append(object);
+        } else {
+            std::printf("%-18s %8llu frames, %6lld lost, %8.3f MB/s, latency p50 %lld us, p99 %lld us, p99.9 %lld us, "
+                        "wire %.3f of payload\n",
+                        flow->name, static_cast<unsigned long long>(flow->receivedFrames),
+                        static_cast<long long>(summary.lostFrames), summary.megabytesPerSecond,
+                        static_cast<long long>(summary.p50), static_cast<long long>(summary.p99),
+                        static_cast<long long>(summary.p999), wireRatio);
+        }
+    }
+
+    if (json) {
+        QJsonObject object;
+        object.insert(QStringLiteral("backend"),
+                      channels.front()->settings.backend == BridgeSettings::LinuxBackend ? QStringLiteral("linux")
+                                                                                          : QStringLiteral("qt"));
+        object.insert(QStringLiteral("frameSize"), frameSize);
+        object.insert(QStringLiteral("rate"), rate);
+        object.insert(QStringLiteral("coded"), coded);
+        object.insert(QStringLiteral("channels"), int(channels.size()));
+        object.insert(QStringLiteral("threads"), threadCount);
+        if (logRate > 0) {
+            object.insert(QStringLiteral("logRate"), logRate);
+            object.insert(QStringLiteral("logDropped"), qint64(logDropped));
+        }
+        object.insert(QStringLiteral("flows"), flows);
+        if (!perChannel.isEmpty())
+            object.insert(QStringLiteral("perChannel"), perChannel);
+        object.insert(QStringLiteral("cpuMsPerMb"), cpuPerMegabyte);
+        object.insert(QStringLiteral("bridgeDrops"), qint64(bridgeDrops));
+        if (switches != 0) {
+            object.insert(QStringLiteral("switches"), qint64(switches));
+            object.insert(QStringLiteral("switchP50Us"),
+                          qint64(BridgeStats::percentile(switchTime, BridgeStats::LatencyBuckets, 0.5)));
+            object.insert(QStringLiteral("switchP99Us"),
+                          qint64(BridgeStats::percentile(switchTime, BridgeStats::LatencyBuckets, 0.99)));
+        }
+        std::printf("%s\n", QJsonDocument(object).toJson(QJsonDocument::Compact).constData());
+    } else {
+        std::printf("cpu %.1f ms for %.3f MB, %.2f ms per MB (generator included), %llu frames dropped by the bridge\n",
+                    double(cpu) / 1e6, megabytes, cpuPerMegabyte, static_cast<unsigned long long>(bridgeDrops));
+        if (logRate > 0) {
+            std::printf("%lld log lines per second with the channels on %s, %llu lines dropped\n",
+                        static_cast<long long>(logRate), threadCount == 0 ? "the main thread" : "worker threads",
+                        static_cast<unsigned long long>(logDropped));
+        }
+        if (switches != 0) {
+            std::printf("%llu baud rate switches, changeover p50 %llu us, p99 %llu us\n",
+                        static_cast<unsigned long long>(switches),
+                        static_cast<unsigned long long>(BridgeStats::percentile(switchTime, BridgeStats::LatencyBuckets, 0.5)),
+                        static_cast<unsigned long long>(BridgeStats::percentile(switchTime, BridgeStats::LatencyBuckets, 0.99)));
+        }
+    }
+    std::fflush(stdout);
+    QCoreApplication::quit();
+}
+
+// Microbenchmark of the destination lookup: parsing the address and port
+// text for every chunk, as the GUI once did with its line edits, against the
+// endpoint the engine resolves once. Each way runs with and without the send,
+// the best of three rounds counts.
+int runDestinationBenchmark(int chunkSize, bool json)
+{
+    constexpr qint64 Chunks = 200000;
+    constexpr int Rounds = 3;
+
+    // Datagrams go to a loopback socket that never reads them
+    QUdpSocket sink;
+    if (!sink.bind(QHostAddress(QHostAddress::LocalHost), 0))
+        return fail(QStringLiteral("Cannot bind the UDP sink: %1").arg(sink.errorString()));
+    QUdpSocket sender;
+    const QString hostText = QStringLiteral("127.0.0.1");
+    const QString portText = QString::number(sink.localPort());
+    const QByteArray payload(chunkSize, 0x55);
+    const UdpEndpoint cached(QHostAddress(hostText), portText.toUShort());
+
+    // CPU time of the best round in ns; the port goes to a volatile so that
+    // the lookups cannot be optimized away
+    volatile quint16 lastPort = 0;
+    auto measure = [&](bool perChunk, bool send) {
+        qint64 best = 0;
+        for (int round = 0; round < Rounds; ++round) {
+            const qint64 started = processCpuTime();
+            for (qint64 i = 0; i < Chunks; ++i) {
+                const UdpEndpoint endpoint = perChunk ? UdpEndpoint(QHostAddress(hostText), portText.toUShort()) : cached;
+                if (send)
+                    sender.writeDatagram(payload.constData(), chunkSize, endpoint.address(), endpoint.port());
+                lastPort = endpoint.port();
+            }
+            const qint64 cpu = processCpuTime() - started;
+            if (round == 0 || cpu < best)
+                best = cpu;
+        }
+        return best;
+    };
+
+    struct Result {
+        const char *name;
+        qint64 cpu;
+    };
+    const Result results[] = {
+        {"per-chunk lookup", measure(true, false)},
+        {"cached endpoint", measure(false, false)},
+        {"per-chunk lookup + send", measure(true, true)},
+        {"cached endpoint + send", measure(false, true)},
+    };
+
+    const double bytes = double(Chunks) * chunkSize;
+    QJsonArray runs;
+    for (const Result &result : results) {
+        if (json) {
+            QJsonObject object;
+            object.insert(QStringLiteral("name"), QString::fromLatin1(result.name));
+            object.insert(QStringLiteral("nsPerChunk"), double(result.cpu) / Chunks);
+            object.insert(QStringLiteral("nsPerByte"), double(result.cpu) / bytes);
+            runs.append(object);
+        } else {
+            std::printf("%-24s %8.1f ns per chunk, %6.3f ns per byte\n", result.name,
+                        double(result.cpu) / Chunks, double(result.cpu) / bytes);
+        }
+    }
+    if (json) {
+        QJsonObject object;
+        object.insert(QStringLiteral("chunkSize"), chunkSize);
+        object.insert(QStringLiteral("chunks"), Chunks);
+        object.insert(QStringLiteral("runs"), runs);
+        std::printf("%s\n", QJsonDocument(object).toJson(QJsonDocument::Compact).constData());
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("ser2ether-bench"));
+    QCoreApplication::setApplicationVersion(QStringLiteral("1.0.0"));
+
+    // Describe the command line
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Measure a bridge channel between a pseudo-terminal and loopback UDP"));
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    const QCommandLineOption patternOption(QStringLiteral("pattern"),
+                                           QStringLiteral("Traffic: constant, burst, tiny, max or telemetry."),
+                                           QStringLiteral("name"));
+    const QCommandLineOption directionOption(QStringLiteral("direction"),
+                                             QStringLiteral("serial-to-network, network-to-serial or both."),
+                                             QStringLiteral("direction"));
+    const QCommandLineOption rateOption(QStringLiteral("rate"),
+                                        QStringLiteral("Bytes per second, direction and channel."),
+                                        QStringLiteral("bytes"));
+    const QCommandLineOption frameSizeOption(QStringLiteral("frame-size"),
+                                             QStringLiteral("Frame size for the constant, burst and telemetry patterns."),
+                                             QStringLiteral("bytes"));
+    const QCommandLineOption durationOption(QStringLiteral("duration"),
+                                            QStringLiteral("Seconds of traffic."),
+                                            QStringLiteral("seconds"));
+    const QCommandLineOption backendOption(QStringLiteral("backend"),
+                                           QStringLiteral("I/O backend of the bridge: qt or linux."),
+                                           QStringLiteral("name"));
+    const QCommandLineOption framingOption(QStringLiteral("framing"),
+                                           QStringLiteral("Serial to UDP framing of the bridge: raw, size, idle, delimiter or fixed."),
+                                           QStringLiteral("mode"));
+    const QCommandLineOption bridgePortOption(QStringLiteral("bridge-port"),
+                                              QStringLiteral("Local UDP port of the first channel, the next ones count up from it."),
+                                              QStringLiteral("port"));
+    const QCommandLineOption channelsOption(QStringLiteral("channels"),
+                                            QStringLiteral("Bridge channels run at once, each over its own pty pair."),
+                                            QStringLiteral("count"));
+    const QCommandLineOption threadsOption(QStringLiteral("threads"),
+                                           QStringLiteral("Worker threads of the bridge channels, 0 runs them on the main thread."),
+                                           QStringLiteral("count"));
+    const QCommandLineOption logSpamOption(QStringLiteral("log-spam"),
+                                           QStringLiteral("Write log lines on the main thread while the traffic runs, as many per second."),
+                                           QStringLiteral("lines"));
+    const QCommandLineOption aggregateOption(QStringLiteral("aggregate"),
+                                             QStringLiteral("Run the link codec with aggregation on both ends."));
+    const QCommandLineOption compressOption(QStringLiteral("compress"),
+                                            QStringLiteral("Run the link codec with compression on both ends."));
+    const QCommandLineOption dictionaryOption(QStringLiteral("dictionary"),
+                                              QStringLiteral("Compression dictionary of the link codec."),
+                                              QStringLiteral("file"));
+    const QCommandLineOption sequenceOption(QStringLiteral("sequence"),
+                                            QStringLiteral("Run the link codec with sequence numbers on both ends."));
+    const QCommandLineOption switchEveryOption(QStringLiteral("switch-every"),
+                                               QStringLiteral("Switch the baud rate of the channels while the traffic runs, every given ms."),
+                                               QStringLiteral("ms"));
+    const QCommandLineOption microOption(QStringLiteral("micro"),
+                                        QStringLiteral("Run a microbenchmark instead of the channels: destination."),
+                                        QStringLiteral("name"));
+    const QCommandLineOption jsonOption(QStringLiteral("json"),
+                                        QStringLiteral("Print the results as one JSON line."));
+    parser.addOptions({patternOption, directionOption, rateOption, frameSizeOption, durationOption,
+                       backendOption, framingOption, bridgePortOption, channelsOption, threadsOption, logSpamOption, aggregateOption, compressOption,
+                       dictionaryOption, sequenceOption, switchEveryOption, microOption, jsonOption});
+    parser.process(a);
+
+    Bench bench;
+    bench.json = parser.isSet(jsonOption);
+
+    // Traffic pattern and its frame size
+    const QString pattern = parser.value(patternOption).trimmed().toLower();
+    if (pattern.isEmpty() || pattern == QLatin1String("constant"))
+        bench.pattern = ConstantPattern;
+    else if (pattern == QLatin1String("burst"))
+        bench.pattern = BurstPattern;
+    else if (pattern == QLatin1String("tiny"))
+        bench.pattern = TinyPattern;
+    else if (pattern == QLatin1String("max"))
+        bench.pattern = MaxSizePattern;
+    else if (pattern == QLatin1String("telemetry"))
+        bench.pattern = TelemetryPattern;
+    else
+        return fail(QStringLiteral("Invalid pattern %1").arg(parser.value(patternOption)));
+
+    bool ok = true;
+    if (bench.pattern == TinyPattern) {
+        bench.frameSize = int(sizeof(FrameHeader));
+    } else if (bench.pattern == MaxSizePattern) {
+        bench.frameSize = MaxFrameSize;
+    } else if (parser.isSet(frameSizeOption)) {
+        bench.frameSize = parser.value(frameSizeOption).toInt(&ok);
+        if (!ok || bench.frameSize < int(sizeof(FrameHeader)) || bench.frameSize > MaxFrameSize)
+            return fail(QStringLiteral("Frame size must be %1 to %2 bytes").arg(int(sizeof(FrameHeader))).arg(MaxFrameSize));
+    }
+
+    // Microbenchmarks need no channel, they use the frame size as chunk size
+    if (parser.isSet(microOption)) {
+        if (parser.value(microOption) != QLatin1String("destination"))
+            return fail(QStringLiteral("Invalid microbenchmark %1").arg(parser.value(microOption)));
+        return runDestinationBenchmark(bench.frameSize, bench.json);
+    }
+
+    if (parser.isSet(rateOption)) {
+        bench.rate = parser.value(rateOption).toLongLong(&ok);
+        if (!ok || bench.rate <= 0)
+            return fail(QStringLiteral("Invalid rate %1").arg(parser.value(rateOption)));
+    }
+    if (parser.isSet(durationOption)) {
+        const double seconds = parser.value(durationOption).toDouble(&ok);
+        if (!ok || seconds <= 0)
+            return fail(QStringLiteral("Invalid duration %1").arg(parser.value(durationOption)));
+        bench.duration = qint64(seconds * 1e9);
+    }
+
+    const QString direction = parser.value(directionOption).trimmed().toLower();
+    const bool serialToNetwork = direction.isEmpty() || direction == QLatin1String("both")
+                                 || direction == QLatin1String("serial-to-network");
+    const bool networkToSerial = direction.isEmpty() || direction == QLatin1String("both")
+                                 || direction == QLatin1String("network-to-serial");
+    if (!serialToNetwork && !networkToSerial)
+        return fail(QStringLiteral("Invalid direction %1").arg(parser.value(directionOption)));
+
+    int channelCount = 1;
+    if (parser.isSet(channelsOption)) {
+        channelCount = parser.value(channelsOption).toInt(&ok);
+        if (!ok || channelCount < 1 || channelCount > MaxChannels)
+            return fail(QStringLiteral("Channels must be 1 to %1").arg(MaxChannels));
+    }
+    bench.threadCount = qMin(channelCount, qMax(1, QThread::idealThreadCount()));
+    if (parser.isSet(threadsOption)) {
+        bench.threadCount = parser.value(threadsOption).toInt(&ok);
+        if (!ok || bench.threadCount < 0)
+            return fail(QStringLiteral("Invalid thread count %1").arg(parser.value(threadsOption)));
+    }
+    if (parser.isSet(logSpamOption)) {
+        bench.logRate = parser.value(logSpamOption).toLongLong(&ok);
+        if (!ok || bench.logRate <= 0)
+            return fail(QStringLiteral("Invalid log rate %1").arg(parser.value(logSpamOption)));
+    }
+
+    // Settings of the channels under test; the rest are the bridge defaults
+    BridgeSettings settings;
+    settings.baudRate = 4000000;
+    settings.localPort = 47001;
+    settings.framing.maxSize = MaxFrameSize;
+    if (parser.isSet(bridgePortOption)) {
+        settings.localPort = parser.value(bridgePortOption).toUShort(&ok);
+        if (!ok || settings.localPort == 0 || settings.localPort > 65536 - channelCount)
+            return fail(QStringLiteral("Invalid bridge port %1").arg(parser.value(bridgePortOption)));
+    }
+    if (parser.isSet(backendOption) && !BridgeSettings::parseBackend(parser.value(backendOption), &settings.backend))
+        return fail(QStringLiteral("Invalid backend %1").arg(parser.value(backendOption)));
+    if (parser.isSet(framingOption) && !BridgeSettings::parseFramingMode(parser.value(framingOption), &settings.framing.mode))
+        return fail(QStringLiteral("Invalid framing %1").arg(parser.value(framingOption)));
+
+    // The link codec runs in the bridge and, as its peer, in the bench
+    settings.codec.aggregate = parser.isSet(aggregateOption);
+    settings.codec.compress = parser.isSet(compressOption);
+    settings.codec.dictionary = parser.value(dictionaryOption);
+    settings.codec.sequence = parser.isSet(sequenceOption);
+    QByteArray dictionary;
+    if (settings.codec.isEnabled()) {
+        QString dictionaryError;
+        if (!settings.codec.dictionary.isEmpty()
+            && !LinkCodec::loadDictionary(settings.codec.dictionary, &dictionary, &dictionaryError))
+            return fail(QStringLiteral("Cannot read %1: %2").arg(settings.codec.dictionary, dictionaryError));
+        bench.coded = true;
+    }
+    settings.destinationIp = QStringLiteral("127.0.0.1");
+
+    if (parser.isSet(switchEveryOption)) {
+        bench.switchInterval = parser.value(switchEveryOption).toLongLong(&ok);
+        if (!ok || bench.switchInterval <= 0)
+            return fail(QStringLiteral("Invalid switch interval %1").arg(parser.value(switchEveryOption)));
+    }
+
+    // Every channel gets a pty pair, a UDP peer and the next bridge port
+    for (int i = 0; i < channelCount; ++i) {
+        std::unique_ptr<Channel> channel(new Channel);
+        channel->serialToNetwork.enabled = serialToNetwork;
+        channel->networkToSerial.enabled = networkToSerial;
+        channel->settings = settings;
+        channel->settings.localPort = quint16(settings.localPort + i);
+        channel->bridgePort = channel->settings.localPort;
+        if (bench.coded) {
+            channel->encoder.reset(new LinkEncoder);
+            channel->encoder->configure(settings.codec, dictionary);
+            channel->decoder.setDictionary(dictionary);
+        }
+
+        // The pty stands in for the serial device: the bridge opens the slave,
+        // the bench reads and writes the master
+        channel->ptyMaster = posix_openpt(O_RDWR | O_NOCTTY);
+        if (channel->ptyMaster < 0 || grantpt(channel->ptyMaster) != 0 || unlockpt(channel->ptyMaster) != 0)
+            return fail(QStringLiteral("Cannot create a pseudo-terminal: %1").arg(QString::fromLocal8Bit(std::strerror(errno))));
+        fcntl(channel->ptyMaster, F_SETFL, fcntl(channel->ptyMaster, F_GETFL) | O_NONBLOCK);
+        channel->settings.portName = QString::fromLocal8Bit(ptsname(channel->ptyMaster));
+
+        // The UDP peer of the bridge, on an ephemeral loopback port
+        channel->udpSocket.reset(new QUdpSocket);
+        if (!channel->udpSocket->bind(QHostAddress(QHostAddress::LocalHost), 0))
+            return fail(QStringLiteral("Cannot bind the UDP peer: %1").arg(channel->udpSocket->errorString()));
+        channel->udpSocket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, 4 * 1024 * 1024);
+        channel->settings.destinationPort = channel->udpSocket->localPort();
+
+        bench.channels.push_back(std::move(channel));
+    }
+
+    // Run the channels on worker threads, as the daemon does, or on the main
+    // thread, and start the traffic once all of them are open
+    BridgeManager manager(bench.threadCount);
+    bench.manager = &manager;
+    int pendingChannels = channelCount;
+    for (const std::unique_ptr<Channel> &channel : bench.channels) {
+        channel->engine = manager.addChannel();
+        QObject::connect(channel->engine, &BridgeEngine::errorMessage, &a, [](const QString &message) {
+            std::fprintf(stderr, "ser2ether-bench: %s\n", qPrintable(message));
+        });
+        QObject::connect(channel->engine, &BridgeEngine::bridgeOpenFailed, &a, [] {
+            QCoreApplication::exit(1);
+        });
+        QObject::connect(channel->engine, &BridgeEngine::bridgeOpened, &a, [&bench, &pendingChannels] {
+            if (--pendingChannels == 0)
+                bench.start();
+        });
+        manager.openChannel(channel->engine, channel->settings);
+    }
+
+    return a.exec();
+}
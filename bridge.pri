@@ -0,0 +1,58 @@
+# Bridge engine sources shared by the GUI and the headless daemon.
+# Only needs core, network and serialport; never pulls in QtWidgets.
+
+QT += core network serialport
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/bridgeengine.cpp \
+    $$PWD/bridgemanager.cpp \
+    $$PWD/bridgesettings.cpp \
+    $$PWD/bridgestats.cpp \
+    $$PWD/framering.cpp \
+    $$PWD/latencytracer.cpp \
+    $$PWD/linkcodec.cpp \
+    $$PWD/lz4block.cpp \
+    $$PWD/modbusgateway.cpp \
+    $$PWD/networkio.cpp \
+    $$PWD/packetizer.cpp \
+    $$PWD/profiles.cpp \
+    $$PWD/serialio.cpp \
+    $$PWD/serialports.cpp \
+    $$PWD/tracerecorder.cpp \
+    $$PWD/transmitpacer.cpp \
+    $$PWD/trafficmonitor.cpp
+
+HEADERS += \
+    $$PWD/bridgeengine.h \
+    $$PWD/bridgemanager.h \
+    $$PWD/bridgesettings.h \
+    $$PWD/bridgestats.h \
+    $$PWD/framering.h \
+    $$PWD/latencytrace.h \
+    $$PWD/latencytracer.h \
+    $$PWD/linkcodec.h \
+    $$PWD/lz4block.h \
+    $$PWD/modbusgateway.h \
+    $$PWD/networkio.h \
+    $$PWD/packetizer.h \
+    $$PWD/profiles.h \
+    $$PWD/serialio.h \
+    $$PWD/serialports.h \
+    $$PWD/tracefile.h \
+    $$PWD/tracerecorder.h \
+    $$PWD/transmitpacer.h \
+    $$PWD/trafficmonitor.h
+
+# Linux fast path (termios2, epoll, recvmmsg/sendmmsg), selected at run time
+# with the "linux" backend; build with CONFIG+=no_linux_fastpath to leave it out
+linux:!no_linux_fastpath {
+    DEFINES += SER2ETHER_LINUX_FASTPATH
+
+    SOURCES += \
+        $$PWD/linuxio.cpp
+
+    HEADERS += \
+        $$PWD/linuxio.h
+}
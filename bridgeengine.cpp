@@ -0,0 +1,1368 @@
+#include "bridgeengine.h"
+
+#ifdef SER2ETHER_LINUX_FASTPATH
+#include "linuxio.h"
+#endif
+
+#include <QHostInfo>
+#include <QThread>
+#include <QtMath>
+
+#include <cstring>
+
+namespace {
+
+// Whether two settings name the same serial device
+bool sameSerialDevice(const BridgeSettings &a, const BridgeSettings &b)
+{
+    if (a.pty.enabled || b.pty.enabled)
+        return a.pty.enabled == b.pty.enabled && a.pty.link == b.pty.link;
+    return a.deviceId.isEmpty() && b.deviceId.isEmpty() ? a.portName == b.portName : a.deviceId == b.deviceId;
+}
+
+// Whether two settings open the same serial port the same way
+bool sameSerialPort(const BridgeSettings &a, const BridgeSettings &b)
+{
+    return sameSerialDevice(a, b) && a.baudRate == b.baudRate && a.dataBits == b.dataBits
+           && a.parity == b.parity && a.stopBits == b.stopBits && a.flowControl == b.flowControl;
+}
+
+// Whether two settings open the network side the same way; the destination
+// is applied on the fly, except as the group of a multicast socket
+bool sameNetwork(const BridgeSettings &a, const BridgeSettings &b)
+{
+    if (a.transport == BridgeSettings::MulticastTransport && a.destinationIp != b.destinationIp)
+        return false;
+    return a.localPort == b.localPort && a.multicastTtl == b.multicastTtl
+           && a.tcp.clientQueueLimit == b.tcp.clientQueueLimit
+           && a.tcp.reconnectMin == b.tcp.reconnectMin && a.tcp.reconnectMax == b.tcp.reconnectMax;
+}
+
+bool sameFraming(const BridgeSettings &a, const BridgeSettings &b)
+{
+    return a.framing.mode == b.framing.mode && a.framing.maxSize == b.framing.maxSize
+           && a.framing.idleCharacters == b.framing.idleCharacters && a.framing.delimiter == b.framing.delimiter
+           && a.framing.fixedLength == b.framing.fixedLength && a.framing.flushTimeout == b.framing.flushTimeout;
+}
+
+bool sameModbus(const BridgeSettings &a, const BridgeSettings &b)
+{
+    return a.modbus.timeout == b.modbus.timeout && a.modbus.turnaround == b.modbus.turnaround
+           && a.modbus.broadcastDelay == b.modbus.broadcastDelay && a.modbus.cacheTtl == b.modbus.cacheTtl
+           && a.modbus.queueLimit == b.modbus.queueLimit;
+}
+
+bool sameTransmit(const BridgeSettings &a, const BridgeSettings &b)
+{
+    return a.transmit.frameGap == b.transmit.frameGap && a.transmit.fifoSize == b.transmit.fifoSize
+           && a.transmit.rs485 == b.transmit.rs485 && a.transmit.rtsBefore == b.transmit.rtsBefore
+           && a.transmit.rtsAfter == b.transmit.rtsAfter;
+}
+
+bool sameCodec(const BridgeSettings &a, const BridgeSettings &b)
+{
+    return a.codec.aggregate == b.codec.aggregate && a.codec.compress == b.codec.compress
+           && a.codec.maxDelay == b.codec.maxDelay && a.codec.maxSize == b.codec.maxSize
+           && a.codec.dictionary == b.codec.dictionary && a.codec.sequence == b.codec.sequence
+           && a.codec.reorderHold == b.codec.reorderHold && a.codec.reorderWindow == b.codec.reorderWindow;
+}
+
+} // namespace
+
+
+BridgeEngine::BridgeEngine(QThread *portThread, QObject *parent)
+    : QObject(parent)
+{
+    // The settings travel through queued connections
+    qRegisterMetaType<BridgeSettings>("BridgeSettings");
+    qRegisterMetaType<TrafficTap::Sampling>("TrafficTap::Sampling");
+
+    // Create the packetizer that cuts the serial stream into datagrams
+    packetizer = new Packetizer(this);
+
+    // Connect the packetizer to the writeNetworkData() slot
+    connect(packetizer, &Packetizer::packetReady, this, &BridgeEngine::writeNetworkData);
+
+    // Create the encoder of the link codec; it sends whole datagrams itself
+    encoder = new LinkEncoder(this);
+    connect(encoder, &LinkEncoder::datagramReady, this, &BridgeEngine::sendDatagram);
+    reorderer = new LinkReorderer(this);
+    connect(reorderer, &LinkReorderer::datagramReady, this, &BridgeEngine::forwardHeldDatagram);
+
+    // Create the transmit pacer; its timer resumes the serial queue
+    pacer = new TransmitPacer(this);
+    connect(pacer, &TransmitPacer::wakeup, this, [this] { handleBytesWritten(0); });
+
+    // Create the Modbus gateway; it puts frames on the bus and answers the clients
+    gateway = new ModbusGateway(this);
+    connect(gateway, &ModbusGateway::serialFrameReady, this, &BridgeEngine::writeSerialFrame);
+    connect(gateway, &ModbusGateway::replyReady, this, &BridgeEngine::sendGatewayReply);
+
+    // Retry a lost serial port after a delay, or as soon as a device shows up
+    reconnectTimer = new QTimer(this);
+    reconnectTimer->setSingleShot(true);
+    connect(reconnectTimer, &QTimer::timeout, this, &BridgeEngine::reconnectSerial);
+
+    // Devices are enumerated on the port thread only; the watcher goes with
+    // that thread and talks to us through queued signals
+    portWatcher = new PortWatcher;
+    portWatcher->moveToThread(portThread);
+    connect(portThread, &QThread::finished, portWatcher, &QObject::deleteLater);
+    connect(portWatcher, &PortWatcher::changed, this, &BridgeEngine::reconnectSerial);
+    connect(portWatcher, &PortWatcher::portFound, this, &BridgeEngine::handlePortFound);
+
+    // Repeat the line state of a virtual port to the peer
+    lineStateTimer = new QTimer(this);
+    lineStateTimer->setInterval(LineStateInterval);
+    connect(lineStateTimer, &QTimer::timeout, this, &BridgeEngine::sendLineState);
+
+    // Create the trace recorder; its writer thread reports failures here
+    recorder = new TraceRecorder(this);
+    connect(recorder, &TraceRecorder::errorMessage, this, &BridgeEngine::errorMessage);
+    latency = new LatencyTracer(this);
+    connect(latency, &LatencyTracer::errorMessage, this, &BridgeEngine::errorMessage);
+
+    // Start with the Qt backend and UDP; children follow the engine to its thread
+    createBackend(BridgeSettings::QtBackend, BridgeSettings::UdpTransport, false);
+}
+
+BridgeEngine::~BridgeEngine()
+{
+    closeBridge();
+}
+
+// This slot is called by the controller to open the serial port and bind the UDP socket
+void BridgeEngine::openBridge(const BridgeSettings &newSettings)
+{
+    // If the bridge is already open, do nothing
+    if (bridgeOpen)
+        return;
+
+    settings = newSettings;
+    keepStreamOrdered();
+
+    // A virtual port goes by its link; otherwise look the device up by its
+    // identity if one is given, and open once the answer is in. Opening
+    // again meanwhile asks again.
+    if (settings.pty.enabled) {
+        settings.portName = settings.pty.link;
+    } else if (!settings.deviceId.isEmpty()) {
+        lookUpSerialPort(OpenLookup);
+        return;
+    }
+    startBridge();
+}
+
+// This function is called to open the bridge with the settings, once the
+// serial port is known
+void BridgeEngine::startBridge()
+{
+    // Switch the I/O backend, the transport or to a virtual port if asked for
+    if ((settings.backend != backend || settings.transport != transport || settings.pty.enabled != ptyMode)
+        && !createBackend(settings.backend, settings.transport, settings.pty.enabled)) {
+        emit errorMessage(tr("The Linux I/O backend and virtual ports are not available in this build"));
+        emit bridgeOpenFailed(settings.portName);
+        return;
+    }
+
+    // Set up the link codec first; without its dictionary the peer could not be understood
+    if (!configureCodec()) {
+        emit bridgeOpenFailed(settings.portName);
+        return;
+    }
+
+    // Try to open the serial port with its settings
+    if (!serialIo->open(settings)) {
+        emit errorMessage(tr("Failed to open serial port %1, error: %2")
+                              .arg(settings.portName).arg(serialIo->errorString()));
+        emit bridgeOpenFailed(settings.portName);
+        return;
+    }
+    stats.setLineErrorsCounted(serialIo->countsLineErrors());
+    pacer->reset();
+    configurePacer();
+
+    // Bind the UDP socket, listen for TCP clients or connect to the TCP server
+    if (!networkIo->open(settings)) {
+        emit errorMessage(tr("Failed to open the network side on port %1, error: %2")
+                              .arg(settings.localPort).arg(networkIo->errorString()));
+    }
+
+    // Set up the framing of the serial stream
+    configureFraming();
+
+    // Size the serial queue so that a datagram always fits while the queue
+    // is below the limit
+    serialQueue.resetForLimit(settings.queue.highWater, MaxDatagramSize);
+
+    // Resolve the destination once, not per datagram
+    setDestination(settings.destinationIp, settings.destinationPort);
+
+    // Count this session from zero
+    stats.reset();
+
+    // Record the session if asked to; the bridge runs even when the trace cannot be written
+    QString recordError;
+    if (!settings.record.path.isEmpty() && !recorder->start(settings.record, &recordError))
+        emit errorMessage(tr("Failed to record a trace to %1, error: %2").arg(settings.record.path, recordError));
+    if (!settings.tracing.path.isEmpty() && !latency->start(settings.tracing.path, &recordError))
+        emit errorMessage(tr("Failed to write a latency trace to %1, error: %2").arg(settings.tracing.path, recordError));
+
+    // Tell the peer what the virtual port starts with
+    haveLineState = false;
+    lineStatePending = false;
+    if (sendsLineState()) {
+        sendLineState();
+        lineStateTimer->start();
+    }
+
+    bridgeOpen = true;
+    emit bridgeOpened(settings.portName);
+}
+
+// This slot is called to switch to other settings while the bridge runs,
+// reopening only the parts whose settings changed
+void BridgeEngine::reconfigureBridge(const BridgeSettings &newSettings)
+{
+    if (!bridgeOpen) {
+        openBridge(newSettings);
+        return;
+    }
+
+    // Another backend, transport, protocol or kind of port changes everything
+    if (newSettings.backend != settings.backend || newSettings.transport != settings.transport
+        || newSettings.protocol != settings.protocol || newSettings.pty.enabled != settings.pty.enabled) {
+        // Observers see the bridge open again, or failing to; it is not
+        // reported closed in between
+        releaseBridge();
+        openBridge(newSettings);
+        return;
+    }
+
+    const qint64 started = BridgeStats::now();
+    const BridgeSettings old = settings;
+    settings = newSettings;
+    keepStreamOrdered();
+    if (settings.pty.enabled)
+        settings.portName = settings.pty.link;
+    QStringList reopened;
+
+    // Serial side: other line settings for the same device are committed to
+    // the open port, which neither drops what its driver holds nor waits for
+    // a reopen; only another device, or a backend refusing the switch,
+    // reopens the port. What is queued for it stays queued either way.
+    const bool serialChanged = !sameSerialPort(old, settings);
+    bool lineSwitched = false;
+    if (serialChanged && sameSerialDevice(old, settings) && serialIo->isOpen()) {
+        packetizer->flush();
+        lineSwitched = serialIo->reconfigure(settings);
+        if (lineSwitched) {
+            settings.portName = old.portName;
+            configurePacer();
+            reopened.append(tr("serial line"));
+        }
+    }
+    if (serialChanged && !lineSwitched) {
+        packetizer->flush();
+        if (serialIo->isOpen())
+            serialIo->close();
+        pacer->reset();
+        serialDown = false;
+        portLookup = NoLookup;
+        reconnectTimer->stop();
+        QMetaObject::invokeMethod(portWatcher, &PortWatcher::stop, Qt::QueuedConnection);
+
+        if (!settings.pty.enabled && !settings.deviceId.isEmpty()) {
+            // Wait for the answer of the port watcher as for a lost port
+            // coming back; the network side keeps running meanwhile
+            serialDown = true;
+            reconnectDelay = settings.reconnect.delayMin;
+            if (settings.reconnect.enabled)
+                QMetaObject::invokeMethod(portWatcher, &PortWatcher::start, Qt::QueuedConnection);
+            lookUpSerialPort(ReconnectLookup);
+        } else if (serialIo->open(settings)) {
+            stats.setLineErrorsCounted(serialIo->countsLineErrors());
+            configurePacer();
+            haveLineState = false;
+            handleBytesWritten(0);
+        } else {
+            emit errorMessage(tr("Failed to open serial port %1, error: %2")
+                                  .arg(settings.portName).arg(serialIo->errorString()));
+            if (!settings.reconnect.enabled) {
+                closeBridge();
+                return;
+            }
+            waitForSerialPort();
+        }
+        reopened.append(tr("serial port"));
+    } else if (!serialChanged) {
+        // Keep the name the device was found under
+        settings.portName = old.portName;
+    }
+
+    // Transmit pacing applies from the next frame; a closed port gets it on reconnect
+    if (!sameTransmit(old, settings)) {
+        if (!serialChanged && serialIo->isOpen()) {
+            configurePacer();
+            handleBytesWritten(0);
+        }
+        reopened.append(tr("transmit pacing"));
+    }
+
+    // Network side
+    if (!sameNetwork(old, settings)) {
+        networkIo->close();
+        if (!networkIo->open(settings)) {
+            emit errorMessage(tr("Failed to open the network side on port %1, error: %2")
+                                  .arg(settings.localPort).arg(networkIo->errorString()));
+        }
+        reopened.append(tr("network"));
+    }
+    if (settings.destinationIp != old.destinationIp || settings.destinationPort != old.destinationPort) {
+        setDestination(settings.destinationIp, settings.destinationPort);
+        reopened.append(tr("destination"));
+    }
+    if (settings.lineControl != old.lineControl) {
+        lineStateTimer->stop();
+        if (sendsLineState()) {
+            sendLineState();
+            lineStateTimer->start();
+        }
+        reopened.append(tr("line control"));
+    }
+
+    // Framing follows the line speed, the Modbus gateway its own settings
+    const bool framingChanged = settings.protocol == BridgeSettings::ModbusProtocol
+                                    ? !sameModbus(old, settings)
+                                    : !sameFraming(old, settings);
+    if (serialChanged || framingChanged) {
+        packetizer->flush();
+        configureFraming();
+        reopened.append(tr("framing"));
+    } else {
+        settings.framing = old.framing;
+    }
+
+    // The codec sends what it holds with the old settings first
+    if (!sameCodec(old, settings)) {
+        encoder->flush();
+        if (!configureCodec()) {
+            closeBridge();
+            return;
+        }
+        reopened.append(tr("link codec"));
+    }
+
+    // A higher limit needs a larger ring, which starts out empty; a lower one
+    // simply applies from the next datagram
+    if (settings.queue.highWater != old.queue.highWater) {
+        if (settings.queue.highWater > old.queue.highWater) {
+            serialQueue.resetForLimit(settings.queue.highWater, MaxDatagramSize);
+            stats.setQueueDepth(0, 0);
+            udpReadsPaused = false;
+            reorderer->setBlocked(false);
+        }
+        reopened.append(tr("serial queue"));
+    }
+
+    // A new trace file starts a new trace
+    if (settings.record.path != old.record.path || settings.record.segmentSize != old.record.segmentSize
+        || settings.record.segments != old.record.segments) {
+        recorder->stop();
+        QString recordError;
+        if (!settings.record.path.isEmpty() && !recorder->start(settings.record, &recordError))
+            emit errorMessage(tr("Failed to record a trace to %1, error: %2").arg(settings.record.path, recordError));
+        reopened.append(tr("trace"));
+    }
+    if (settings.tracing.path != old.tracing.path) {
+        stopLatencyTrace();
+        QString traceError;
+        if (!settings.tracing.path.isEmpty() && !latency->start(settings.tracing.path, &traceError))
+            emit errorMessage(tr("Failed to write a latency trace to %1, error: %2").arg(settings.tracing.path, traceError));
+        reopened.append(tr("latency trace"));
+    }
+
+    // Count how long the switch took, for the statistics and the bench
+    if (reopened.isEmpty()) {
+        emit infoMessage(tr("Settings applied, nothing changed"));
+        return;
+    }
+    const quint64 elapsed = quint64(BridgeStats::now() - started) / 1000;
+    stats.reconfigures.add();
+    stats.reconfigureTime.add(elapsed);
+    emit infoMessage(tr("Settings applied in %1 us, reopened: %2").arg(elapsed).arg(reopened.join(QStringLiteral(", "))));
+}
+
+// This slot is called by the controller to close both sides of the bridge
+void BridgeEngine::closeBridge()
+{
+    // If the bridge is not open, only forget an open waiting for its port
+    if (!bridgeOpen) {
+        portLookup = NoLookup;
+        return;
+    }
+    releaseBridge();
+    emit bridgeClosed();
+}
+
+// Function to close both sides of the open bridge without reporting it
+void BridgeEngine::releaseBridge()
+{
+    bridgeOpen = false;
+
+    // Stop waiting for a lost serial port
+    serialDown = false;
+    portLookup = NoLookup;
+    reconnectTimer->stop();
+    QMetaObject::invokeMethod(portWatcher, &PortWatcher::stop, Qt::QueuedConnection);
+    lineStateTimer->stop();
+    lineStatePending = false;
+
+    // Send what the packetizer and the codec still hold, then close the serial
+    // port and the network side
+    packetizer->flush();
+    encoder->flush();
+    if (serialIo->isOpen())
+        serialIo->close();
+    networkIo->close();
+    pacer->reset();
+
+    // Write out what the trace ring still holds
+    if (recorder->isEnabled()) {
+        recorder->stop();
+        if (recorder->droppedRecords() != 0)
+            emit infoMessage(tr("%1 packets were missing from the trace, the disk fell behind")
+                                 .arg(recorder->droppedRecords()));
+    }
+    stopLatencyTrace();
+
+    // Drop the requests still waiting for the bus
+    if (settings.protocol == BridgeSettings::ModbusProtocol) {
+        const ModbusGateway::Counters &counters = gateway->counters();
+        emit infoMessage(tr("Modbus gateway: %1 requests, %2 answered from the cache, %3 timeouts, "
+                            "%4 CRC errors, %5 refused while busy")
+                             .arg(counters.requests).arg(counters.cacheHits).arg(counters.timeouts)
+                             .arg(counters.crcErrors).arg(counters.busyReplies));
+        gateway->reset();
+    }
+
+    // Report how much the codec saved
+    if (codecActive) {
+        const LinkEncoder::Counters &counters = encoder->counters();
+        emit infoMessage(tr("Link codec: %1 packets sent in %2 datagrams, %3 bytes as %4, %5 corrupt datagrams received")
+                             .arg(counters.packets).arg(counters.datagrams).arg(counters.payloadBytes)
+                             .arg(counters.wireBytes).arg(corruptDatagrams));
+        const BridgeStats::Snapshot snapshot = stats.snapshot();
+        if (snapshot.sequence.lost + snapshot.sequence.late + snapshot.sequence.duplicates + snapshot.sequence.reordered != 0) {
+            emit infoMessage(tr("Sequence numbers: %1 lost, %2 late, %3 duplicates, %4 reordered, jitter %5 us")
+                                 .arg(snapshot.sequence.lost).arg(snapshot.sequence.late)
+                                 .arg(snapshot.sequence.duplicates).arg(snapshot.sequence.reordered)
+                                 .arg(snapshot.sequence.jitter));
+        }
+        reorderer->clear();
+    }
+
+    // Report how accurately the transmit pacer kept its deadlines
+    if (settings.transmit.isEnabled()) {
+        const BridgeStats::Snapshot snapshot = stats.snapshot();
+        emit infoMessage(tr("Transmit pacing: %1 timer wakeups, late by %2 us at the median and %3 us at the 99th percentile, "
+                            "UART still sending %4 times when RTS was due to drop")
+                             .arg(snapshot.pacing.wakeups)
+                             .arg(BridgeStats::percentile(snapshot.pacing.lateness, BridgeStats::LatencyBuckets, 0.5))
+                             .arg(BridgeStats::percentile(snapshot.pacing.lateness, BridgeStats::LatencyBuckets, 0.99))
+                             .arg(snapshot.pacing.lineBusy));
+    }
+
+    // Report how the session went; the counters stay readable until the next open
+    const quint64 droppedFrames = stats.udpToSerial.drops.load();
+    if (droppedFrames != 0)
+        emit infoMessage(tr("%1 frames were dropped by the serial queue").arg(droppedFrames));
+    emit infoMessage(tr("Forwarded %1 packets with %2 buffer allocations")
+                         .arg(stats.serialToUdp.datagrams.load() + stats.udpToSerial.datagrams.load())
+                         .arg(serialQueue.allocationCount() + packetizer->allocationCount()));
+
+    // Drop what is still queued for the serial port
+    serialQueue.clear();
+    stats.setQueueDepth(0, 0);
+    udpReadsPaused = false;
+
+    // Drop the resolved destination, it is resolved again on the next open
+    if (hostLookupId != -1) {
+        QHostInfo::abortHostLookup(hostLookupId);
+        hostLookupId = -1;
+    }
+    destination = UdpEndpoint();
+}
+
+// This slot is called to change where serial data is sent to
+void BridgeEngine::setDestination(const QString &host, quint16 port)
+{
+    settings.destinationIp = host;
+    settings.destinationPort = port;
+
+    // A TCP client reconnects to the new server by itself
+    networkIo->setDestination(host, port);
+
+    // Forget about a lookup that is still running for a previous host
+    if (hostLookupId != -1) {
+        QHostInfo::abortHostLookup(hostLookupId);
+        hostLookupId = -1;
+    }
+
+    // A literal address needs no lookup, swap the endpoint right away
+    QHostAddress address;
+    if (address.setAddress(host)) {
+        destination = UdpEndpoint(address, port);
+        return;
+    }
+
+    // Resolve host names asynchronously; keep sending to the old endpoint until
+    // the new one is known
+    hostLookupId = QHostInfo::lookupHost(host, this, [this, host, port](const QHostInfo &info) {
+        if (info.lookupId() != hostLookupId)
+            return;
+        hostLookupId = -1;
+
+        // The socket is bound to IPv4, so prefer an IPv4 result
+        const QList<QHostAddress> addresses = info.addresses();
+        for (const QHostAddress &address : addresses) {
+            if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+                destination = UdpEndpoint(address, port);
+                emit infoMessage(tr("Destination %1 resolved to %2").arg(host, address.toString()));
+                return;
+            }
+        }
+        emit errorMessage(tr("Failed to resolve destination %1: %2").arg(host, info.errorString()));
+    });
+}
+
+// This slot is called by the controller to open or close the traffic monitor
+void BridgeEngine::setTrafficMonitor(bool enabled, const TrafficTap::Sampling &sampling)
+{
+    tap.configure(enabled, sampling);
+}
+
+// This slot is called when data is available on the serial port
+void BridgeEngine::readSerialData()
+{
+    // Read straight into the reused buffer and hand it to the packetizer,
+    // which calls writeNetworkData() per datagram
+    qint64 size;
+    qint64 readStart = latency->isEnabled() ? BridgeStats::now() : 0;
+    while ((size = serialIo->read(serialReadBuffer, sizeof(serialReadBuffer))) > 0) {
+        const qint64 stamp = BridgeStats::now();
+        if (latency->isEnabled()) {
+            latency->trace(LatencyTrace::SerialRead, readStart, stamp, int(size));
+            readStart = stamp;
+        }
+        stats.serialToUdp.chunks.add();
+        stats.serialToUdp.bytes.add(quint64(size));
+        stats.serialToUdp.chunkSizes.add(quint64(size));
+        if (tap.isEnabled())
+            tap.capture(TrafficTap::SerialToUdp, serialReadBuffer, int(size));
+        if (recorder->isEnabled())
+            recorder->record(TraceFile::SerialToNetwork, serialReadBuffer, int(size), stamp);
+        packetizer->append(serialReadBuffer, int(size), stamp);
+    }
+}
+
+// This function is called to find room for a datagram in the serial queue
+char *BridgeEngine::reserveSerialQueue(int size)
+{
+    const qint64 highWater = settings.queue.highWater;
+
+    switch (settings.queue.policy) {
+    case BridgeSettings::DropOldest: {
+        // Drop the oldest frames until the new one fits under the limit
+        while (!serialQueue.isEmpty() && serialQueue.bytes() + size > highWater) {
+            serialQueue.dropFront();
+            stats.udpToSerial.drops.add();
+        }
+        char *slot;
+        while (!(slot = serialQueue.reserve(size)) && !serialQueue.isEmpty()) {
+            serialQueue.dropFront();
+            stats.udpToSerial.drops.add();
+        }
+        return slot;
+    }
+    case BridgeSettings::DropNewest:
+        // Refuse the new frame when it does not fit under the limit
+        if (serialQueue.bytes() + size > highWater)
+            return nullptr;
+        return serialQueue.reserve(size);
+    case BridgeSettings::PauseReads:
+        // Reads are paused once the queue is full, so at most one datagram
+        // goes over the limit; the ring has room for it
+        return serialQueue.reserve(size);
+    }
+    return nullptr;
+}
+
+// This function is called to hand queued data to the serial port
+void BridgeEngine::pumpSerialQueue()
+{
+    const bool pacing = pacer->isEnabled();
+    const qint64 now = pacing ? BridgeStats::now() : 0;
+
+    // What is queued for a virtual port nobody has open goes nowhere, as on
+    // a line without a listener; it is dropped, not counted as delivered
+    if (!serialDown && !serialIo->hasReader()) {
+        while (!serialQueue.isEmpty()) {
+            serialQueue.dropFront();
+            stats.udpToSerial.drops.add();
+        }
+    }
+
+    // Keep only a small window in the backend's own buffer so that the queue
+    // limit really bounds memory and latency; nothing moves while the port is down
+    while (!serialDown && !serialQueue.isEmpty() && serialIo->bytesToWrite() < SerialWriteWindow) {
+        int size;
+        const char *data = serialQueue.head(&size);
+        const qint64 stamp = serialQueue.headStamp();
+
+        // The pacer holds the frame back for the gap, the RS-485 turnaround or
+        // a full FIFO, and wakes us up when it may go on
+        int chunk = size;
+        if (pacing) {
+            chunk = qMin(size, pacer->allowance(now, !serialQueue.headStarted()));
+            if (chunk == 0)
+                break;
+        }
+
+        const qint64 writeStart = latency->isEnabled() ? BridgeStats::now() : 0;
+        const qint64 written = serialIo->write(data, chunk);
+        if (written <= 0)
+            break;
+        serialQueue.consume(int(written));
+        if (pacing)
+            pacer->sent(now, int(written), written == size);
+
+        stats.udpToSerial.chunks.add();
+        stats.udpToSerial.chunkSizes.add(quint64(written));
+
+        // A datagram counts as delivered once its last byte went to the port
+        if (written == size)
+            stats.udpToSerial.latency.add(quint64(BridgeStats::now() - stamp) / 1000);
+
+        // The wait in the queue ends where the write of the frame's last byte starts
+        if (latency->isEnabled()) {
+            const qint64 writeEnd = BridgeStats::now();
+            latency->trace(LatencyTrace::SerialWrite, writeStart, writeEnd, int(written));
+            if (written == size) {
+                latency->trace(LatencyTrace::SerialQueue, stamp, writeStart, int(written));
+                latency->trace(LatencyTrace::NetworkToSerial, stamp, writeEnd, int(written));
+            }
+            if (serialWriteReturnedAt == 0)
+                serialWriteReturnedAt = writeEnd;
+        }
+    }
+    stats.setQueueDepth(serialQueue.bytes(), serialQueue.frames());
+}
+
+// This slot is called when the serial port has written data to the line
+void BridgeEngine::handleBytesWritten(qint64 bytes)
+{
+    // Time the backend took to pass on what write() accepted; the termios
+    // backend hands it to the driver right away and reports no bytes
+    if (bytes > 0 && serialWriteReturnedAt != 0 && latency->isEnabled()) {
+        latency->trace(LatencyTrace::SerialDrain, serialWriteReturnedAt, BridgeStats::now(), int(bytes));
+        serialWriteReturnedAt = 0;
+    }
+
+    pumpSerialQueue();
+
+    // A line state of the peer waits for the data queued before it
+    if (lineStatePending && serialQueue.isEmpty() && serialIo->bytesToWrite() == 0)
+        applyLineState();
+
+    // Resume reading UDP once the queue is down to half its limit
+    if (udpReadsPaused && !lineStatePending && serialQueue.bytes() <= settings.queue.highWater / 2) {
+        udpReadsPaused = false;
+        reorderer->setBlocked(false);
+        readNetworkData();
+    }
+}
+
+// This slot is called when data is available on the network side
+void BridgeEngine::readNetworkData()
+{
+    udpDrainScheduled = false;
+    if (latency->isEnabled())
+        networkReadableAt = BridgeStats::now();
+
+    // Modbus requests go through the gateway's queue, not straight to the port
+    if (settings.protocol == BridgeSettings::ModbusProtocol) {
+        readGatewayRequests();
+        return;
+    }
+
+    // Coded datagrams are split into their packets first
+    if (codecActive) {
+        readCodedDatagrams();
+        return;
+    }
+
+    // Drain the pending datagrams, but only up to a cap per wakeup so that a
+    // UDP burst cannot starve the serial direction
+    int datagrams = 0;
+    while (!udpReadsPaused && networkIo->hasPendingDatagrams()) {
+        if (datagrams == MaxDatagramsPerWakeup) {
+            // Come back for the rest after the other events had their turn
+            if (!udpDrainScheduled) {
+                udpDrainScheduled = true;
+                QMetaObject::invokeMethod(this, &BridgeEngine::readNetworkData, Qt::QueuedConnection);
+            }
+            return;
+        }
+
+        ++datagrams;
+        const qint64 pendingSize = networkIo->pendingDatagramSize();
+        const int size = pendingSize > 0 ? int(pendingSize) : 0;
+
+        // Find room in the serial queue and read the datagram straight into it
+        char *slot = reserveSerialQueue(size);
+        if (!slot) {
+            if (settings.queue.policy == BridgeSettings::PauseReads) {
+                // Leave the datagram in the socket until the queue drained
+                udpReadsPaused = true;
+                return;
+            }
+
+            // The queue policy refused the datagram, discard it
+            networkIo->skipDatagram();
+            stats.udpToSerial.drops.add();
+            continue;
+        }
+
+        // Skip empty and failed reads, the reservation is simply not committed
+        const qint64 read = networkIo->readDatagram(slot, size);
+        if (read <= 0)
+            continue;
+
+        // Neither is the line state of a virtual port peer, which is no data
+        SerialLineState lineState;
+        if (settings.lineControl && LinkCodec::decodeLineState(slot, int(read), &lineState)) {
+            receiveLineState(lineState);
+            continue;
+        }
+
+        const qint64 stamp = BridgeStats::now();
+        serialQueue.commit(int(read), stamp);
+        if (latency->isEnabled()) {
+            latency->trace(LatencyTrace::NetworkRead, networkReadableAt, stamp, int(read));
+            networkReadableAt = stamp;
+        }
+        stats.udpToSerial.datagrams.add();
+        stats.udpToSerial.bytes.add(quint64(read));
+        stats.udpToSerial.datagramSizes.add(quint64(read));
+        if (tap.isEnabled())
+            tap.capture(TrafficTap::UdpToSerial, slot, int(read));
+        if (recorder->isEnabled())
+            recorder->record(TraceFile::NetworkToSerial, slot, int(read), stamp);
+
+        // Move as much as the window allows to the serial port
+        pumpSerialQueue();
+
+        // Stop taking UDP data until the serial port caught up
+        if (settings.queue.policy == BridgeSettings::PauseReads
+            && serialQueue.bytes() >= settings.queue.highWater)
+            udpReadsPaused = true;
+    }
+}
+
+// This function is called to send a packet to the network side
+void BridgeEngine::writeNetworkData(const char *data, int size)
+{
+    if (latency->isEnabled())
+        latency->trace(LatencyTrace::Framing, packetizer->packetTime(), BridgeStats::now(), size);
+
+    // In gateway mode every serial frame is a slave's answer
+    if (settings.protocol == BridgeSettings::ModbusProtocol) {
+        gateway->handleResponse(data, size);
+        return;
+    }
+
+    // The link codec packs the packet into its next datagram
+    if (codecActive) {
+        encoder->append(data, size, packetizer->packetTime());
+        return;
+    }
+
+    sendDatagram(data, size, packetizer->packetTime());
+}
+
+// This slot is called to send a datagram to the destination; readTime is
+// when its oldest byte was read from the serial port
+void BridgeEngine::sendDatagram(const char *data, int size, qint64 readTime)
+{
+    // Drop the data while the destination is still being resolved
+    if (networkIo->needsEndpoint() && !destination.isValid()) {
+        stats.serialToUdp.drops.add();
+        return;
+    }
+
+    // Send the data to the cached destination endpoint
+    const qint64 sendStart = latency->isEnabled() ? BridgeStats::now() : 0;
+    if (networkIo->writeDatagram(data, size, destination) < 0) {
+        stats.serialToUdp.drops.add();
+        return;
+    }
+    const qint64 sent = BridgeStats::now();
+    stats.serialToUdp.datagrams.add();
+    stats.serialToUdp.datagramSizes.add(quint64(size));
+    stats.serialToUdp.latency.add(quint64(sent - readTime) / 1000);
+    if (latency->isEnabled()) {
+        latency->trace(LatencyTrace::NetworkSend, sendStart, sent, size);
+        latency->trace(LatencyTrace::SerialToNetwork, readTime, sent, size);
+    }
+}
+
+// This function is called to split the datagrams of a coded peer into packets
+// for the serial queue
+void BridgeEngine::readCodedDatagrams()
+{
+    // The same cap per wakeup as for raw datagrams
+    int datagrams = 0;
+    while (!udpReadsPaused && networkIo->hasPendingDatagrams()) {
+        if (datagrams == MaxDatagramsPerWakeup) {
+            if (!udpDrainScheduled) {
+                udpDrainScheduled = true;
+                QMetaObject::invokeMethod(this, &BridgeEngine::readNetworkData, Qt::QueuedConnection);
+            }
+            return;
+        }
+        ++datagrams;
+
+        // Datagrams are read into the buffer and decoded from there; what a
+        // raw peer sends is queued as it is
+        const qint64 read = networkIo->readDatagram(codecReadBuffer, sizeof(codecReadBuffer));
+        if (read <= 0)
+            continue;
+        SerialLineState lineState;
+        if (settings.lineControl && LinkCodec::decodeLineState(codecReadBuffer, int(read), &lineState)) {
+            receiveLineState(lineState);
+            continue;
+        }
+        const qint64 stamp = BridgeStats::now();
+        stats.udpToSerial.datagrams.add();
+        stats.udpToSerial.datagramSizes.add(quint64(read));
+        if (latency->isEnabled()) {
+            latency->trace(LatencyTrace::NetworkRead, networkReadableAt, stamp, int(read));
+            networkReadableAt = stamp;
+        }
+
+        const LinkDecoder::Result result = decoder.decode(codecReadBuffer, int(read));
+        if (result == LinkDecoder::Corrupt) {
+            ++corruptDatagrams;
+            stats.udpToSerial.drops.add();
+            continue;
+        }
+
+        // A sequenced datagram that overtook others waits for them; the one
+        // next in line goes first, then the held ones that follow it
+        if (result != LinkDecoder::Decoded || !decoder.isSequenced()) {
+            queueDecodedRecords(result, decoder, codecReadBuffer, int(read), stamp);
+            pauseWhenQueueFull();
+        } else if (reorderer->arrive(decoder.sequence(), decoder.sendTime(), codecReadBuffer, int(read))) {
+            queueDecodedRecords(result, decoder, codecReadBuffer, int(read), stamp);
+            pauseWhenQueueFull();
+            reorderer->release();
+        }
+    }
+}
+
+// This function is called after a decoded datagram was queued for the serial
+// port. Over the limit, reads stop until the port caught up, and so do the
+// held datagrams, which are checked one by one as the reorderer releases
+// them; the ring has room for one decoded datagram over the limit.
+void BridgeEngine::pauseWhenQueueFull()
+{
+    if (settings.queue.policy != BridgeSettings::PauseReads || serialQueue.bytes() < settings.queue.highWater)
+        return;
+    udpReadsPaused = true;
+    reorderer->setBlocked(true);
+}
+
+// This function is called to hand the Modbus requests read from the network to the gateway
+void BridgeEngine::readGatewayRequests()
+{
+    // The gateway bounds its own queue, so reads never pause; the cap per
+    // wakeup still applies
+    int datagrams = 0;
+    while (networkIo->hasPendingDatagrams()) {
+        if (datagrams == MaxDatagramsPerWakeup) {
+            if (!udpDrainScheduled) {
+                udpDrainScheduled = true;
+                QMetaObject::invokeMethod(this, &BridgeEngine::readNetworkData, Qt::QueuedConnection);
+            }
+            return;
+        }
+        ++datagrams;
+
+        NetworkPeer from;
+        const qint64 read = networkIo->readDatagramFrom(gatewayReadBuffer, sizeof(gatewayReadBuffer), &from);
+        if (read <= 0)
+            continue;
+        const qint64 stamp = BridgeStats::now();
+        stats.udpToSerial.datagrams.add();
+        stats.udpToSerial.bytes.add(quint64(read));
+        stats.udpToSerial.datagramSizes.add(quint64(read));
+        if (latency->isEnabled()) {
+            latency->trace(LatencyTrace::NetworkRead, networkReadableAt, stamp, int(read));
+            networkReadableAt = stamp;
+        }
+        if (tap.isEnabled())
+            tap.capture(TrafficTap::UdpToSerial, gatewayReadBuffer, int(read));
+        if (recorder->isEnabled())
+            recorder->record(TraceFile::NetworkToSerial, gatewayReadBuffer, int(read), stamp);
+
+        gateway->handleRequest(from, gatewayReadBuffer, int(read), networkIo->isStream());
+    }
+}
+
+// This function is called to queue the packets of a datagram for the serial port
+void BridgeEngine::queueDecodedRecords(LinkDecoder::Result result, const LinkDecoder &decoded,
+                                       const char *data, int size, qint64 stamp)
+{
+    // What a raw peer sends is one packet as it is
+    const LinkDecoder::Record raw = {data, size};
+    const LinkDecoder::Record *records = result == LinkDecoder::Decoded ? decoded.records().constData() : &raw;
+    const int recordCount = result == LinkDecoder::Decoded ? decoded.records().size() : 1;
+    for (int i = 0; i < recordCount; ++i) {
+        stats.udpToSerial.bytes.add(quint64(records[i].size));
+        if (tap.isEnabled())
+            tap.capture(TrafficTap::UdpToSerial, records[i].data, records[i].size);
+        if (recorder->isEnabled())
+            recorder->record(TraceFile::NetworkToSerial, records[i].data, records[i].size, stamp);
+        writeSerialFrame(records[i].data, records[i].size);
+    }
+}
+
+// This slot is called when the reorderer lets a held datagram go
+void BridgeEngine::forwardHeldDatagram(const char *data, int size)
+{
+    const LinkDecoder::Result result = heldDecoder.decode(data, size);
+    if (result == LinkDecoder::Decoded)
+        queueDecodedRecords(result, heldDecoder, data, size, BridgeStats::now());
+    pauseWhenQueueFull();
+}
+
+// This slot is called to queue a whole frame for the serial port, e.g. when
+// the gateway puts an RTU frame on the bus
+void BridgeEngine::writeSerialFrame(const char *data, int size)
+{
+    char *slot = reserveSerialQueue(size);
+    if (!slot) {
+        stats.udpToSerial.drops.add();
+        return;
+    }
+    std::memcpy(slot, data, size_t(size));
+    serialQueue.commit(size, BridgeStats::now());
+    pumpSerialQueue();
+}
+
+// This slot is called when the gateway answers a client
+void BridgeEngine::sendGatewayReply(const NetworkPeer &to, const char *data, int size)
+{
+    const qint64 sendStart = latency->isEnabled() ? BridgeStats::now() : 0;
+    if (networkIo->writeDatagramTo(data, size, to) < 0) {
+        stats.serialToUdp.drops.add();
+        return;
+    }
+    if (latency->isEnabled())
+        latency->trace(LatencyTrace::NetworkSend, sendStart, BridgeStats::now(), size);
+    stats.serialToUdp.datagrams.add();
+    stats.serialToUdp.datagramSizes.add(quint64(size));
+}
+
+// This slot is called when the application on the virtual port changed the
+// line settings, opened or closed the port
+void BridgeEngine::handleLineStateChanged()
+{
+    SerialLineState state;
+    if (!serialIo->lineState(&state))
+        return;
+    emit infoMessage(tr("Virtual port %1: %2").arg(settings.pty.link, state.toString()));
+
+    // What the application wrote before the change goes out first
+    if (sendsLineState()) {
+        packetizer->flush();
+        encoder->flush();
+        sendLineState();
+    }
+}
+
+// Whether this end tells the peer the line state of its virtual port; only
+// datagrams keep it apart from the data
+bool BridgeEngine::sendsLineState() const
+{
+    return settings.pty.enabled && settings.lineControl && settings.protocol == BridgeSettings::RawProtocol
+           && !networkIo->isStream();
+}
+
+// This slot is called to send the line state of the virtual port, on a change
+// and every LineStateInterval
+void BridgeEngine::sendLineState()
+{
+    SerialLineState state;
+    if (!sendsLineState() || !serialIo->lineState(&state))
+        return;
+    if (networkIo->needsEndpoint() && !destination.isValid())
+        return;
+
+    char datagram[LinkCodec::LineStateSize];
+    LinkCodec::encodeLineState(state, datagram);
+    networkIo->writeDatagram(datagram, sizeof(datagram), destination);
+}
+
+// This function is called with the line state a virtual port peer sent
+void BridgeEngine::receiveLineState(const SerialLineState &state)
+{
+    // A virtual port has no line to apply it to, and repeats change nothing
+    if (settings.pty.enabled || lineStatePending || (haveLineState && state == appliedLineState))
+        return;
+    pendingLineState = state;
+    lineStatePending = true;
+
+    // Data the peer sent before the change still goes out the old way; take
+    // no more datagrams until it did
+    if (!serialQueue.isEmpty() || serialIo->bytesToWrite() > 0) {
+        udpReadsPaused = true;
+        return;
+    }
+    applyLineState();
+}
+
+// This function is called to apply the peer's line state to the serial port
+void BridgeEngine::applyLineState()
+{
+    lineStatePending = false;
+    const SerialLineState &state = pendingLineState;
+
+    // A hang up keeps the baud rate, and data bits and parity only come
+    // along where the peer's kernel let them be seen
+    BridgeSettings line = settings;
+    if (state.baudRate != 0)
+        line.baudRate = state.baudRate;
+    if (state.hasDataFormat) {
+        line.dataBits = state.dataBits;
+        line.parity = state.parity;
+    }
+    line.stopBits = state.stopBits;
+    line.flowControl = state.flowControl;
+
+    // Switched in place like a reconfigure; a port that is down gets them on reconnect
+    if (!sameSerialPort(settings, line)) {
+        if (serialIo->isOpen() && !serialIo->reconfigure(line)) {
+            emit errorMessage(tr("Failed to apply the line state of the peer, %1: %2")
+                                  .arg(state.toString(), serialIo->errorString()));
+        } else {
+            packetizer->flush();
+            settings = line;
+            if (serialIo->isOpen())
+                configurePacer();
+            configureFraming();
+        }
+    }
+
+    // RTS stays with the flow control or the RS-485 direction when they drive it
+    if (serialIo->isOpen()) {
+        serialIo->setDataTerminalReady(state.dataTerminalReady);
+        if (!settings.transmit.rs485 && settings.flowControl != QSerialPort::HardwareControl)
+            serialIo->setRequestToSend(state.requestToSend);
+    }
+    appliedLineState = state;
+    haveLineState = true;
+    emit infoMessage(tr("Line state from the peer: %1").arg(state.toString()));
+}
+
+// This slot is called when the serial device has gone away
+void BridgeEngine::handleSerialError(const QString &message)
+{
+    // The loss was already handled, or the bridge is gone meanwhile
+    if (!bridgeOpen || serialDown)
+        return;
+
+    stats.serialErrors.add();
+    emit errorMessage(tr("Serial port error: %1").arg(message));
+
+    // Without reconnecting, close the bridge and let the controller decide
+    if (!settings.reconnect.enabled) {
+        closeBridge();
+        return;
+    }
+
+    // Close only the serial side; the network side keeps running and what it
+    // receives waits in the serial queue, under the queue policy
+    packetizer->flush();
+    serialIo->close();
+    pacer->reset();
+    waitForSerialPort();
+}
+
+// This function is called to keep retrying the closed serial port until it is back
+void BridgeEngine::waitForSerialPort()
+{
+    serialDown = true;
+    reconnectDelay = settings.reconnect.delayMin;
+    QMetaObject::invokeMethod(portWatcher, &PortWatcher::start, Qt::QueuedConnection);
+    scheduleReconnect();
+}
+
+// This function is called to retry the serial port later, backing off exponentially
+void BridgeEngine::scheduleReconnect()
+{
+    emit infoMessage(tr("Serial port %1 is not available, retrying in %2 ms")
+                         .arg(settings.portName).arg(reconnectDelay));
+    reconnectTimer->start(reconnectDelay);
+    reconnectDelay = qMin(reconnectDelay * 2, settings.reconnect.delayMax);
+}
+
+// This slot is called to try reopening a lost serial port
+void BridgeEngine::reconnectSerial()
+{
+    if (!serialDown)
+        return;
+    reconnectTimer->stop();
+
+    // Follow the device to whatever name it came back under
+    if (!settings.deviceId.isEmpty()) {
+        lookUpSerialPort(ReconnectLookup);
+        return;
+    }
+    reopenSerial(settings.portName);
+}
+
+// This function is called to reopen the lost serial port under the given name,
+// empty when the device is not plugged in
+void BridgeEngine::reopenSerial(const QString &portName)
+{
+    BridgeSettings attempt = settings;
+    attempt.portName = portName;
+    if (portName.isEmpty() || !serialIo->open(attempt)) {
+        // Without reconnecting, which only a switch of the device gets here
+        // with, the bridge closes as it would have right away
+        if (!settings.reconnect.enabled) {
+            emit errorMessage(tr("Failed to open serial port %1, error: %2")
+                                  .arg(settings.portName)
+                                  .arg(portName.isEmpty() ? tr("the device is not plugged in") : serialIo->errorString()));
+            closeBridge();
+            return;
+        }
+        scheduleReconnect();
+        return;
+    }
+
+    serialDown = false;
+    QMetaObject::invokeMethod(portWatcher, &PortWatcher::stop, Qt::QueuedConnection);
+    settings.portName = attempt.portName;
+    stats.setLineErrorsCounted(serialIo->countsLineErrors());
+    configurePacer();
+
+    // The modem lines of the peer come again with its next line state
+    haveLineState = false;
+    emit infoMessage(tr("Serial port %1 reconnected, %2 bytes were waiting for it")
+                         .arg(settings.portName).arg(serialQueue.bytes()));
+
+    // Hand over what queued up while the port was gone
+    handleBytesWritten(0);
+}
+
+// This function is called to ask the port watcher where the device is; an
+// answer to an earlier question is ignored from now on
+void BridgeEngine::lookUpSerialPort(PortLookup purpose)
+{
+    portLookup = purpose;
+    const quint64 lookup = ++portLookupId;
+    const QString identity = settings.deviceId;
+    const QString preferredName = settings.portName;
+    QMetaObject::invokeMethod(portWatcher, [watcher = portWatcher, lookup, identity, preferredName] {
+        watcher->find(lookup, identity, preferredName);
+    }, Qt::QueuedConnection);
+}
+
+// This slot is called with the port the device was found on
+void BridgeEngine::handlePortFound(quint64 lookup, const QString &portName)
+{
+    if (lookup != portLookupId || portLookup == NoLookup)
+        return;
+    const PortLookup purpose = portLookup;
+    portLookup = NoLookup;
+
+    // A device that is not plugged in is tried under the configured name,
+    // which fails the open as before
+    if (purpose == OpenLookup) {
+        if (!portName.isEmpty())
+            settings.portName = portName;
+        startBridge();
+        return;
+    }
+    if (serialDown)
+        reopenSerial(portName);
+}
+
+// This function is called to hold a TCP stream back instead of dropping
+// pieces of it: a dropped chunk would corrupt the ordered byte stream, so
+// the queue of a stream transport always pauses reading when it is full
+void BridgeEngine::keepStreamOrdered()
+{
+    if (settings.transport != BridgeSettings::TcpServerTransport
+        && settings.transport != BridgeSettings::TcpClientTransport)
+        return;
+    if (settings.queue.policy != BridgeSettings::PauseReads) {
+        emit infoMessage(tr("The serial queue of a TCP transport pauses reading when full, it does not drop"));
+        settings.queue.policy = BridgeSettings::PauseReads;
+    }
+}
+
+// This function is called to hand the transmit settings of the open port to the pacer
+void BridgeEngine::configurePacer()
+{
+    if (!pacer->configure(settings, serialIo, &stats.pacing))
+        emit errorMessage(tr("Failed to drive RTS of serial port %1 for RS-485, error: %2")
+                              .arg(settings.portName).arg(serialIo->errorString()));
+}
+
+// This function is called to report the latency trace per stage and close it
+void BridgeEngine::stopLatencyTrace()
+{
+    if (!latency->isEnabled())
+        return;
+    latency->stop();
+    serialWriteReturnedAt = 0;
+
+    QStringList stages;
+    for (int i = 0; i < LatencyTrace::StageCount; ++i) {
+        const LatencyTrace::Stage stage = LatencyTrace::Stage(i);
+        if (latency->eventCount(stage) != 0) {
+            stages.append(tr("%1 %2/%3 us").arg(QString::fromLatin1(LatencyTrace::stageName(stage)))
+                              .arg(latency->percentile(stage, 0.5)).arg(latency->percentile(stage, 0.99)));
+        }
+    }
+    emit infoMessage(tr("Latency trace, p50/p99 per stage: %1").arg(stages.join(QStringLiteral(", "))));
+    if (latency->droppedEvents() != 0)
+        emit infoMessage(tr("%1 events were missing from the latency trace, the disk fell behind")
+                             .arg(latency->droppedEvents()));
+}
+
+// This function is called to set up the framing of the serial stream
+void BridgeEngine::configureFraming()
+{
+    // A Modbus gateway cuts RTU frames on the 3.5 character silence, which
+    // the standard fixes at 1.75 ms above 19200 baud
+    if (settings.protocol == BridgeSettings::ModbusProtocol) {
+        const double characterTime = settings.bitsPerCharacter() * 1000.0 / qMax(1, settings.baudRate);
+        settings.framing.mode = BridgeSettings::IdleFraming;
+        settings.framing.idleCharacters = qMax(3.5, 1.75 / characterTime);
+        settings.framing.maxSize = ModbusGateway::MaxRtuSize;
+        settings.framing.flushTimeout = qCeil((ModbusGateway::MaxRtuSize + settings.framing.idleCharacters) * characterTime) + 1;
+        gateway->configure(settings);
+    }
+
+    packetizer->configure(settings);
+}
+
+// This function is called to set up the link codec; returns false when its
+// dictionary cannot be read
+bool BridgeEngine::configureCodec()
+{
+    encoder->clear();
+    corruptDatagrams = 0;
+
+    // The codec works on raw datagrams; a stream has no datagrams to pack and
+    // the Modbus gateway has its own framing
+    codecActive = settings.codec.isEnabled() && settings.protocol == BridgeSettings::RawProtocol
+                  && !networkIo->isStream();
+    if (!codecActive) {
+        if (settings.codec.isEnabled())
+            emit infoMessage(tr("The link codec only applies to raw data over UDP, it is off"));
+        return true;
+    }
+
+    QByteArray dictionary;
+    QString dictionaryError;
+    if (!settings.codec.dictionary.isEmpty()
+        && !LinkCodec::loadDictionary(settings.codec.dictionary, &dictionary, &dictionaryError)) {
+        emit errorMessage(tr("Failed to read the codec dictionary %1, error: %2")
+                              .arg(settings.codec.dictionary, dictionaryError));
+        codecActive = false;
+        return false;
+    }
+    encoder->configure(settings.codec, dictionary);
+    decoder.setDictionary(dictionary);
+    heldDecoder.setDictionary(dictionary);
+
+    // Sequenced datagrams are tracked whether or not this end numbers its own
+    reorderer->configure(settings.codec, &stats.sequence);
+    return true;
+}
+
+// This function is called to create the serial and network backends
+bool BridgeEngine::createBackend(BridgeSettings::Backend newBackend, BridgeSettings::Transport newTransport, bool pty)
+{
+#ifndef SER2ETHER_LINUX_FASTPATH
+    if (newBackend == BridgeSettings::LinuxBackend || pty)
+        return false;
+#endif
+
+    delete serialIo;
+    delete networkIo;
+
+#ifdef SER2ETHER_LINUX_FASTPATH
+    // A virtual port shares the epoll set with either backend
+    if (pty) {
+        if (!epollLoop)
+            epollLoop = new EpollLoop(this);
+        serialIo = new PtySerialIo(epollLoop, this);
+    } else if (newBackend == BridgeSettings::LinuxBackend) {
+        // The descriptors share one epoll set
+        if (!epollLoop)
+            epollLoop = new EpollLoop(this);
+        serialIo = new TermiosSerialIo(epollLoop, this);
+    } else
+#endif
+    {
+        serialIo = new QtSerialIo(this);
+    }
+
+    // TCP always goes through Qt; UDP takes the batched path with the Linux backend
+    switch (newTransport) {
+    case BridgeSettings::TcpServerTransport:
+        networkIo = new TcpServerIo(this);
+        break;
+    case BridgeSettings::TcpClientTransport:
+        networkIo = new TcpClientIo(this);
+        break;
+    case BridgeSettings::UdpTransport:
+    case BridgeSettings::MulticastTransport:
+#ifdef SER2ETHER_LINUX_FASTPATH
+        if (newBackend == BridgeSettings::LinuxBackend) {
+            networkIo = new MmsgDatagramIo(epollLoop, this);
+            break;
+        }
+#endif
+        networkIo = new UdpIo(this);
+        break;
+    }
+    backend = newBackend;
+    transport = newTransport;
+    ptyMode = pty;
+
+    // Connect the serial side
+    connect(serialIo, &SerialIo::readyRead, this, &BridgeEngine::readSerialData);
+    connect(serialIo, &SerialIo::bytesWritten, this, &BridgeEngine::handleBytesWritten);
+    connect(serialIo, &SerialIo::fatalError, this, &BridgeEngine::handleSerialError);
+    connect(serialIo, &SerialIo::lineError, this, [this] { stats.lineErrors.add(); });
+    connect(serialIo, &SerialIo::lineStateChanged, this, &BridgeEngine::handleLineStateChanged);
+
+    // Connect the network side
+    connect(networkIo, &NetworkIo::readyRead, this, &BridgeEngine::readNetworkData);
+    connect(networkIo, &NetworkIo::infoMessage, this, &BridgeEngine::infoMessage);
+    connect(networkIo, &NetworkIo::datagramsDropped, this, [this](int count) { stats.serialToUdp.drops.add(quint64(count)); });
+    connect(networkIo, &NetworkIo::datagramsTruncated, this, [this](int count) { stats.udpToSerial.drops.add(quint64(count)); });
+    connect(networkIo, &NetworkIo::connectionClosed, gateway, &ModbusGateway::dropConnection);
+    // The gateway rejects a connection while the engine is still reading from
+    // the transport, so the socket is closed once that wakeup has finished
+    connect(gateway, &ModbusGateway::connectionRejected, networkIo, &NetworkIo::closeConnection, Qt::QueuedConnection);
+    return true;
+}
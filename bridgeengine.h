@@ -0,0 +1,191 @@
+#ifndef BRIDGEENGINE_H
+#define BRIDGEENGINE_H
+
+#include "bridgesettings.h"
+#include "bridgestats.h"
+#include "framering.h"
+#include "latencytracer.h"
+#include "linkcodec.h"
+#include "modbusgateway.h"
+#include "networkio.h"
+#include "packetizer.h"
+#include "serialio.h"
+#include "serialports.h"
+#include "tracerecorder.h"
+#include "trafficmonitor.h"
+#include "transmitpacer.h"
+
+#include <QObject>
+#include <QTimer>
+
+class EpollLoop;
+class QThread;
+
+// Owns the serial and UDP sides and forwards data between them.
+// Meant to live on its own thread; talk to it only through queued signals.
+class BridgeEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BridgeEngine(QThread *portThread, QObject *parent = nullptr);
+    ~BridgeEngine();
+
+    // Safe to read from any thread
+    const BridgeStats &statistics() const { return stats; }
+
+    // Records of the traffic monitor, drained by a TrafficFormatter
+    TrafficTap *trafficTap() { return &tap; }
+
+public slots:
+    void openBridge(const BridgeSettings &settings);
+    void reconfigureBridge(const BridgeSettings &settings);
+    void closeBridge();
+    void setDestination(const QString &host, quint16 port);
+    void setTrafficMonitor(bool enabled, const TrafficTap::Sampling &sampling);
+
+signals:
+    void bridgeOpened(const QString &portName);
+    void bridgeOpenFailed(const QString &portName);
+    void bridgeClosed();
+    void infoMessage(const QString &message);
+    void errorMessage(const QString &message);
+
+private:
+    // What a lookup of the serial device is for
+    enum PortLookup {
+        NoLookup,
+        OpenLookup,
+        ReconnectLookup
+    };
+
+    void readSerialData();
+    char *reserveSerialQueue(int size);
+    void pumpSerialQueue();
+    void handleBytesWritten(qint64 bytes);
+    void readNetworkData();
+    void writeNetworkData(const char *data, int size);
+    void sendDatagram(const char *data, int size, qint64 readTime);
+    void readCodedDatagrams();
+    void queueDecodedRecords(LinkDecoder::Result result, const LinkDecoder &decoded,
+                             const char *data, int size, qint64 stamp);
+    void forwardHeldDatagram(const char *data, int size);
+    void pauseWhenQueueFull();
+    void readGatewayRequests();
+    void writeSerialFrame(const char *data, int size);
+    void sendGatewayReply(const NetworkPeer &to, const char *data, int size);
+    void handleSerialError(const QString &message);
+    void handleLineStateChanged();
+    bool sendsLineState() const;
+    void sendLineState();
+    void receiveLineState(const SerialLineState &state);
+    void applyLineState();
+    void startBridge();
+    void waitForSerialPort();
+    void reconnectSerial();
+    void reopenSerial(const QString &portName);
+    void scheduleReconnect();
+    void lookUpSerialPort(PortLookup purpose);
+    void handlePortFound(quint64 lookup, const QString &portName);
+    void configureFraming();
+    bool configureCodec();
+    void configurePacer();
+    void keepStreamOrdered();
+    void stopLatencyTrace();
+    void releaseBridge();
+    bool createBackend(BridgeSettings::Backend backend, BridgeSettings::Transport transport, bool pty);
+
+    // Upper bound of datagrams forwarded per UDP wakeup
+    static constexpr int MaxDatagramsPerWakeup = 64;
+
+    // Bytes handed to the serial backend ahead of the line; the rest waits in our queue
+    static constexpr qint64 SerialWriteWindow = 4096;
+
+    // Largest UDP payload the serial queue must be able to take in one piece
+    static constexpr int MaxDatagramSize = 65536;
+
+    // How often a virtual port repeats its line state, in case one was lost
+    static constexpr int LineStateInterval = 1000;
+
+    SerialIo *serialIo = nullptr;
+    NetworkIo *networkIo = nullptr;
+    BridgeSettings::Backend backend = BridgeSettings::QtBackend;
+    BridgeSettings::Transport transport = BridgeSettings::UdpTransport;
+    bool ptyMode = false;
+    EpollLoop *epollLoop = nullptr;
+    Packetizer *packetizer;
+    BridgeSettings settings;
+    bool bridgeOpen = false;
+    bool udpDrainScheduled = false;
+
+    // Serial reads land here and go to the packetizer without a copy
+    char serialReadBuffer[Packetizer::MaxAppendSize];
+
+    // Bounded queue of UDP data waiting for the serial port; datagrams are
+    // read straight into it and written to the port straight out of it
+    FrameRing serialQueue;
+    bool udpReadsPaused = false;
+
+    // Paces the queue onto the line when the transmit settings ask for it
+    TransmitPacer *pacer;
+
+    // In Modbus gateway mode requests are read here and go to the serial
+    // queue one RTU frame at a time, as the gateway schedules them
+    ModbusGateway *gateway;
+    char gatewayReadBuffer[Packetizer::MaxAppendSize];
+
+    // With the link codec on, serial packets go through the encoder and
+    // datagrams are read here to be split into packets for the serial queue;
+    // sequenced ones may wait in the reorderer, and come out of it through
+    // a decoder of their own
+    LinkEncoder *encoder;
+    LinkDecoder decoder;
+    LinkReorderer *reorderer;
+    LinkDecoder heldDecoder;
+    bool codecActive = false;
+    quint64 corruptDatagrams = 0;
+    char codecReadBuffer[MaxDatagramSize];
+
+    // Counters of both directions, updated on the hot path
+    BridgeStats stats;
+
+    // While the serial device is gone the network side keeps running; the
+    // port is retried with a backoff and whenever devices come or go
+    bool serialDown = false;
+    QTimer *reconnectTimer;
+    int reconnectDelay = 0;
+    PortWatcher *portWatcher;
+
+    // A device given by its identity is looked up on the port watcher's
+    // thread; the answer finishes opening the bridge or reconnecting the port
+    PortLookup portLookup = NoLookup;
+    quint64 portLookupId = 0;
+
+    // Line control: a virtual port repeats its line state to the peer; a real
+    // port applies the peer's once the data queued before it went out, and
+    // takes no datagrams meanwhile
+    QTimer *lineStateTimer;
+    SerialLineState appliedLineState;
+    bool haveLineState = false;
+    SerialLineState pendingLineState;
+    bool lineStatePending = false;
+
+    // Copies sampled packets for the traffic monitor while it is open
+    TrafficTap tap;
+
+    // Copies every packet into the binary trace while recording
+    TraceRecorder *recorder;
+
+    // Stamps every stage of every packet while the latency trace is on; the
+    // network wakeup and the oldest serial write not yet reported written
+    // start the stages that span several calls
+    LatencyTracer *latency;
+    qint64 networkReadableAt = 0;
+    qint64 serialWriteReturnedAt = 0;
+
+    // Destination used by writeNetworkData(), resolved off the hot path
+    UdpEndpoint destination;
+    int hostLookupId = -1;
+};
+
+#endif // BRIDGEENGINE_H
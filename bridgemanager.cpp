@@ -0,0 +1,77 @@
+#include "bridgemanager.h"
+
+
+BridgeManager::BridgeManager(int threadCount, QObject *parent)
+    : QObject(parent)
+{
+    // Start the worker threads, each running its own event loop
+    for (int i = 0; i < threadCount; ++i) {
+        QThread *thread = new QThread(this);
+        thread->setObjectName(QStringLiteral("bridge-%1").arg(i));
+        thread->start();
+        threads.append(thread);
+    }
+
+    portThread = new QThread(this);
+    portThread->setObjectName(QStringLiteral("bridge-ports"));
+    portThread->start();
+}
+
+BridgeManager::~BridgeManager()
+{
+    // Stop the worker threads; the engines close their ports when they are
+    // deleted on their own thread
+    for (QThread *thread : qAsConst(threads)) {
+        thread->quit();
+        thread->wait();
+    }
+
+    // Channels on our own thread close before their port watchers go
+    if (threads.isEmpty())
+        qDeleteAll(engines);
+
+    // The port watchers of the engines go last, with their thread
+    portThread->quit();
+    portThread->wait();
+}
+
+// This function is called to create a channel on the next worker thread
+BridgeEngine *BridgeManager::addChannel()
+{
+    BridgeEngine *engine = new BridgeEngine(portThread);
+    if (threads.isEmpty()) {
+        engines.append(engine);
+        return engine;
+    }
+
+    // Channels are spread round-robin over the worker threads; the engine
+    // moves to its thread together with its ports
+    QThread *thread = threads.at(engines.size() % threads.size());
+    engine->moveToThread(thread);
+    connect(thread, &QThread::finished, engine, &QObject::deleteLater);
+
+    engines.append(engine);
+    return engine;
+}
+
+// This function is called to open a channel on its own thread
+void BridgeManager::openChannel(BridgeEngine *engine, const BridgeSettings &settings)
+{
+    QMetaObject::invokeMethod(engine, [engine, settings] {
+        engine->openBridge(settings);
+    }, Qt::QueuedConnection);
+}
+
+// This function is called to switch a running channel to other settings
+void BridgeManager::reconfigureChannel(BridgeEngine *engine, const BridgeSettings &settings)
+{
+    QMetaObject::invokeMethod(engine, [engine, settings] {
+        engine->reconfigureBridge(settings);
+    }, Qt::QueuedConnection);
+}
+
+// This function is called to close a channel on its own thread
+void BridgeManager::closeChannel(BridgeEngine *engine)
+{
+    QMetaObject::invokeMethod(engine, &BridgeEngine::closeBridge, Qt::QueuedConnection);
+}
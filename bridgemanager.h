@@ -0,0 +1,38 @@
+#ifndef BRIDGEMANAGER_H
+#define BRIDGEMANAGER_H
+
+#include "bridgeengine.h"
+
+#include <QObject>
+#include <QThread>
+#include <QVector>
+
+// Runs any number of bridge channels, each a BridgeEngine with its own serial
+// port and UDP socket, spread round-robin over a fixed pool of worker threads.
+// Serial devices are looked up on one more thread, shared by the channels, so
+// that enumerating them never stalls a worker. Without worker threads the
+// channels run on the thread that created the manager, the way forwarding
+// ran on the GUI thread before; the benchmark compares the two.
+class BridgeManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BridgeManager(int threadCount, QObject *parent = nullptr);
+    ~BridgeManager();
+
+    BridgeEngine *addChannel();
+    void openChannel(BridgeEngine *engine, const BridgeSettings &settings);
+    void reconfigureChannel(BridgeEngine *engine, const BridgeSettings &settings);
+    void closeChannel(BridgeEngine *engine);
+
+    int threadCount() const { return threads.size(); }
+    const QVector<BridgeEngine *> &channels() const { return engines; }
+
+private:
+    QVector<QThread *> threads;
+    QThread *portThread;
+    QVector<BridgeEngine *> engines;
+};
+
+#endif // BRIDGEMANAGER_H
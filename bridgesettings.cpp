@@ -0,0 +1,540 @@
+#include "bridgesettings.h"
+
+#include <QCoreApplication>
+#include <QSettings>
+
+namespace {
+
+// Names of the enum values as the config file spells them, the reverse of
+// the parse helpers
+const char *dataBitsName(QSerialPort::DataBits dataBits)
+{
+    switch (dataBits) {
+    case QSerialPort::Data5: return "5";
+    case QSerialPort::Data6: return "6";
+    case QSerialPort::Data7: return "7";
+    default: return "8";
+    }
+}
+
+const char *parityName(QSerialPort::Parity parity)
+{
+    switch (parity) {
+    case QSerialPort::EvenParity: return "even";
+    case QSerialPort::OddParity: return "odd";
+    case QSerialPort::MarkParity: return "mark";
+    case QSerialPort::SpaceParity: return "space";
+    default: return "none";
+    }
+}
+
+const char *stopBitsName(QSerialPort::StopBits stopBits)
+{
+    switch (stopBits) {
+    case QSerialPort::OneAndHalfStop: return "1.5";
+    case QSerialPort::TwoStop: return "2";
+    default: return "1";
+    }
+}
+
+const char *flowControlName(QSerialPort::FlowControl flowControl)
+{
+    switch (flowControl) {
+    case QSerialPort::HardwareControl: return "rtscts";
+    case QSerialPort::SoftwareControl: return "xonxoff";
+    default: return "none";
+    }
+}
+
+const char *const framingModeNames[] = {"raw", "size", "idle", "delimiter", "fixed"};
+const char *const queuePolicyNames[] = {"drop-oldest", "drop-newest", "pause"};
+const char *const backendNames[] = {"qt", "linux"};
+const char *const transportNames[] = {"udp", "multicast", "tcp-server", "tcp-client"};
+const char *const protocolNames[] = {"raw", "modbus"};
+
+} // namespace
+
+
+// Function to read the settings from a config file
+bool BridgeSettings::load(QSettings &store, QString *errorString)
+{
+    // Report a bad value to the caller
+    auto fail = [&store, errorString](const QString &key) {
+        if (errorString) {
+            *errorString = QCoreApplication::translate("BridgeSettings", "Invalid value \"%1\" for %2")
+                               .arg(store.value(key).toString(), key);
+        }
+        return false;
+    };
+
+    // Refuse files written by a newer version rather than half understand them
+    if (store.contains(QStringLiteral("profile/version"))) {
+        bool ok = false;
+        const int version = store.value(QStringLiteral("profile/version")).toInt(&ok);
+        if (!ok || version < 1)
+            return fail(QStringLiteral("profile/version"));
+        if (version > FormatVersion) {
+            if (errorString) {
+                *errorString = QCoreApplication::translate("BridgeSettings", "Format version %1 is newer than this program supports (%2)")
+                                   .arg(version).arg(FormatVersion);
+            }
+            return false;
+        }
+    }
+
+    // I/O backend
+    if (store.contains(QStringLiteral("bridge/backend"))
+        && !parseBackend(store.value(QStringLiteral("bridge/backend")).toString(), &backend))
+        return fail(QStringLiteral("bridge/backend"));
+
+    // Serial side
+    portName = store.value(QStringLiteral("serial/port"), portName).toString();
+    deviceId = store.value(QStringLiteral("serial/deviceId"), deviceId).toString();
+
+    bool ok = true;
+    if (store.contains(QStringLiteral("serial/baudRate"))) {
+        baudRate = store.value(QStringLiteral("serial/baudRate")).toInt(&ok);
+        if (!ok || baudRate <= 0)
+            return fail(QStringLiteral("serial/baudRate"));
+    }
+    if (store.contains(QStringLiteral("serial/dataBits"))
+        && !parseDataBits(store.value(QStringLiteral("serial/dataBits")).toString(), &dataBits))
+        return fail(QStringLiteral("serial/dataBits"));
+    if (store.contains(QStringLiteral("serial/parity"))
+        && !parseParity(store.value(QStringLiteral("serial/parity")).toString(), &parity))
+        return fail(QStringLiteral("serial/parity"));
+    if (store.contains(QStringLiteral("serial/stopBits"))
+        && !parseStopBits(store.value(QStringLiteral("serial/stopBits")).toString(), &stopBits))
+        return fail(QStringLiteral("serial/stopBits"));
+    if (store.contains(QStringLiteral("serial/flowControl"))
+        && !parseFlowControl(store.value(QStringLiteral("serial/flowControl")).toString(), &flowControl))
+        return fail(QStringLiteral("serial/flowControl"));
+    reconnect.enabled = store.value(QStringLiteral("serial/reconnect"), reconnect.enabled).toBool();
+    if (store.contains(QStringLiteral("serial/reconnectMin"))) {
+        reconnect.delayMin = store.value(QStringLiteral("serial/reconnectMin")).toInt(&ok);
+        if (!ok || reconnect.delayMin <= 0)
+            return fail(QStringLiteral("serial/reconnectMin"));
+    }
+    if (store.contains(QStringLiteral("serial/reconnectMax"))) {
+        reconnect.delayMax = store.value(QStringLiteral("serial/reconnectMax")).toInt(&ok);
+        if (!ok || reconnect.delayMax < reconnect.delayMin)
+            return fail(QStringLiteral("serial/reconnectMax"));
+    }
+    lineControl = store.value(QStringLiteral("serial/lineControl"), lineControl).toBool();
+    pty.enabled = store.value(QStringLiteral("pty/enabled"), pty.enabled).toBool();
+    pty.link = store.value(QStringLiteral("pty/link"), pty.link).toString();
+    if (pty.link.isEmpty())
+        return fail(QStringLiteral("pty/link"));
+
+    // Network side
+    if (store.contains(QStringLiteral("bridge/transport"))
+        && !parseTransport(store.value(QStringLiteral("bridge/transport")).toString(), &transport))
+        return fail(QStringLiteral("bridge/transport"));
+    if (store.contains(QStringLiteral("udp/localPort"))) {
+        localPort = store.value(QStringLiteral("udp/localPort")).toString().toUShort(&ok);
+        if (!ok)
+            return fail(QStringLiteral("udp/localPort"));
+    }
+    destinationIp = store.value(QStringLiteral("udp/destinationIp"), destinationIp).toString();
+    if (store.contains(QStringLiteral("udp/destinationPort"))) {
+        destinationPort = store.value(QStringLiteral("udp/destinationPort")).toString().toUShort(&ok);
+        if (!ok)
+            return fail(QStringLiteral("udp/destinationPort"));
+    }
+    if (store.contains(QStringLiteral("udp/multicastTtl"))) {
+        multicastTtl = store.value(QStringLiteral("udp/multicastTtl")).toInt(&ok);
+        if (!ok || multicastTtl < 0 || multicastTtl > 255)
+            return fail(QStringLiteral("udp/multicastTtl"));
+    }
+    if (store.contains(QStringLiteral("tcp/clientQueueLimit"))) {
+        tcp.clientQueueLimit = store.value(QStringLiteral("tcp/clientQueueLimit")).toInt(&ok);
+        if (!ok || tcp.clientQueueLimit <= 0)
+            return fail(QStringLiteral("tcp/clientQueueLimit"));
+    }
+    if (store.contains(QStringLiteral("tcp/reconnectMin"))) {
+        tcp.reconnectMin = store.value(QStringLiteral("tcp/reconnectMin")).toInt(&ok);
+        if (!ok || tcp.reconnectMin <= 0)
+            return fail(QStringLiteral("tcp/reconnectMin"));
+    }
+    if (store.contains(QStringLiteral("tcp/reconnectMax"))) {
+        tcp.reconnectMax = store.value(QStringLiteral("tcp/reconnectMax")).toInt(&ok);
+        if (!ok || tcp.reconnectMax < tcp.reconnectMin)
+            return fail(QStringLiteral("tcp/reconnectMax"));
+    }
+
+    // Modbus gateway
+    if (store.contains(QStringLiteral("bridge/protocol"))
+        && !parseProtocol(store.value(QStringLiteral("bridge/protocol")).toString(), &protocol))
+        return fail(QStringLiteral("bridge/protocol"));
+    if (store.contains(QStringLiteral("modbus/timeout"))) {
+        modbus.timeout = store.value(QStringLiteral("modbus/timeout")).toInt(&ok);
+        if (!ok || modbus.timeout <= 0)
+            return fail(QStringLiteral("modbus/timeout"));
+    }
+    if (store.contains(QStringLiteral("modbus/turnaround"))) {
+        modbus.turnaround = store.value(QStringLiteral("modbus/turnaround")).toInt(&ok);
+        if (!ok || modbus.turnaround < 0)
+            return fail(QStringLiteral("modbus/turnaround"));
+    }
+    if (store.contains(QStringLiteral("modbus/broadcastDelay"))) {
+        modbus.broadcastDelay = store.value(QStringLiteral("modbus/broadcastDelay")).toInt(&ok);
+        if (!ok || modbus.broadcastDelay < 0)
+            return fail(QStringLiteral("modbus/broadcastDelay"));
+    }
+    if (store.contains(QStringLiteral("modbus/cacheTtl"))) {
+        modbus.cacheTtl = store.value(QStringLiteral("modbus/cacheTtl")).toInt(&ok);
+        if (!ok || modbus.cacheTtl < 0)
+            return fail(QStringLiteral("modbus/cacheTtl"));
+    }
+    if (store.contains(QStringLiteral("modbus/queueLimit"))) {
+        modbus.queueLimit = store.value(QStringLiteral("modbus/queueLimit")).toInt(&ok);
+        if (!ok || modbus.queueLimit <= 0)
+            return fail(QStringLiteral("modbus/queueLimit"));
+    }
+
+    // Link codec
+    codec.aggregate = store.value(QStringLiteral("codec/aggregate"), codec.aggregate).toBool();
+    codec.compress = store.value(QStringLiteral("codec/compress"), codec.compress).toBool();
+    if (store.contains(QStringLiteral("codec/maxDelay"))) {
+        codec.maxDelay = store.value(QStringLiteral("codec/maxDelay")).toInt(&ok);
+        if (!ok || codec.maxDelay < 0)
+            return fail(QStringLiteral("codec/maxDelay"));
+    }
+    if (store.contains(QStringLiteral("codec/maxSize"))) {
+        codec.maxSize = store.value(QStringLiteral("codec/maxSize")).toInt(&ok);
+        if (!ok || codec.maxSize < 16 || codec.maxSize > 65507)
+            return fail(QStringLiteral("codec/maxSize"));
+    }
+    codec.dictionary = store.value(QStringLiteral("codec/dictionary"), codec.dictionary).toString();
+    codec.sequence = store.value(QStringLiteral("codec/sequence"), codec.sequence).toBool();
+    if (store.contains(QStringLiteral("codec/reorderHold"))) {
+        codec.reorderHold = store.value(QStringLiteral("codec/reorderHold")).toInt(&ok);
+        if (!ok || codec.reorderHold < 0)
+            return fail(QStringLiteral("codec/reorderHold"));
+    }
+    if (store.contains(QStringLiteral("codec/reorderWindow"))) {
+        codec.reorderWindow = store.value(QStringLiteral("codec/reorderWindow")).toInt(&ok);
+        if (!ok || codec.reorderWindow < 1 || codec.reorderWindow > 256)
+            return fail(QStringLiteral("codec/reorderWindow"));
+    }
+
+    // Framing
+    if (store.contains(QStringLiteral("framing/mode"))
+        && !parseFramingMode(store.value(QStringLiteral("framing/mode")).toString(), &framing.mode))
+        return fail(QStringLiteral("framing/mode"));
+    if (store.contains(QStringLiteral("framing/maxSize"))) {
+        framing.maxSize = store.value(QStringLiteral("framing/maxSize")).toInt(&ok);
+        if (!ok || framing.maxSize <= 0 || framing.maxSize > 65507)
+            return fail(QStringLiteral("framing/maxSize"));
+    }
+    if (store.contains(QStringLiteral("framing/idleCharacters"))) {
+        framing.idleCharacters = store.value(QStringLiteral("framing/idleCharacters")).toDouble(&ok);
+        if (!ok || framing.idleCharacters <= 0)
+            return fail(QStringLiteral("framing/idleCharacters"));
+    }
+    if (store.contains(QStringLiteral("framing/delimiter"))
+        && !parseDelimiter(store.value(QStringLiteral("framing/delimiter")).toString(), &framing.delimiter))
+        return fail(QStringLiteral("framing/delimiter"));
+    if (store.contains(QStringLiteral("framing/fixedLength"))) {
+        framing.fixedLength = store.value(QStringLiteral("framing/fixedLength")).toInt(&ok);
+        if (!ok || framing.fixedLength <= 0)
+            return fail(QStringLiteral("framing/fixedLength"));
+    }
+    if (store.contains(QStringLiteral("framing/flushTimeout"))) {
+        framing.flushTimeout = store.value(QStringLiteral("framing/flushTimeout")).toInt(&ok);
+        if (!ok || framing.flushTimeout <= 0)
+            return fail(QStringLiteral("framing/flushTimeout"));
+    }
+
+    // Serial egress queue
+    if (store.contains(QStringLiteral("queue/highWater"))) {
+        queue.highWater = store.value(QStringLiteral("queue/highWater")).toInt(&ok);
+        if (!ok || queue.highWater <= 0)
+            return fail(QStringLiteral("queue/highWater"));
+    }
+    if (store.contains(QStringLiteral("queue/policy"))
+        && !parseQueuePolicy(store.value(QStringLiteral("queue/policy")).toString(), &queue.policy))
+        return fail(QStringLiteral("queue/policy"));
+
+    // Transmit pacing
+    if (store.contains(QStringLiteral("transmit/frameGap"))) {
+        transmit.frameGap = store.value(QStringLiteral("transmit/frameGap")).toInt(&ok);
+        if (!ok || transmit.frameGap < 0)
+            return fail(QStringLiteral("transmit/frameGap"));
+    }
+    if (store.contains(QStringLiteral("transmit/fifoSize"))) {
+        transmit.fifoSize = store.value(QStringLiteral("transmit/fifoSize")).toInt(&ok);
+        if (!ok || transmit.fifoSize < 0)
+            return fail(QStringLiteral("transmit/fifoSize"));
+    }
+    transmit.rs485 = store.value(QStringLiteral("transmit/rs485"), transmit.rs485).toBool();
+    if (store.contains(QStringLiteral("transmit/rtsBefore"))) {
+        transmit.rtsBefore = store.value(QStringLiteral("transmit/rtsBefore")).toInt(&ok);
+        if (!ok || transmit.rtsBefore < 0)
+            return fail(QStringLiteral("transmit/rtsBefore"));
+    }
+    if (store.contains(QStringLiteral("transmit/rtsAfter"))) {
+        transmit.rtsAfter = store.value(QStringLiteral("transmit/rtsAfter")).toInt(&ok);
+        if (!ok || transmit.rtsAfter < 0)
+            return fail(QStringLiteral("transmit/rtsAfter"));
+    }
+
+    // Trace recording
+    record.path = store.value(QStringLiteral("record/path"), record.path).toString();
+    if (store.contains(QStringLiteral("record/segmentSize"))) {
+        record.segmentSize = store.value(QStringLiteral("record/segmentSize")).toLongLong(&ok);
+        if (!ok || record.segmentSize < 65536)
+            return fail(QStringLiteral("record/segmentSize"));
+    }
+    if (store.contains(QStringLiteral("record/segments"))) {
+        record.segments = store.value(QStringLiteral("record/segments")).toInt(&ok);
+        if (!ok || record.segments < 0)
+            return fail(QStringLiteral("record/segments"));
+    }
+
+    // Latency tracing
+    tracing.path = store.value(QStringLiteral("tracing/path"), tracing.path).toString();
+
+    return true;
+}
+
+// Function to write the settings to a config file
+void BridgeSettings::save(QSettings &store) const
+{
+    store.setValue(QStringLiteral("profile/version"), FormatVersion);
+
+    store.setValue(QStringLiteral("bridge/backend"), QString::fromLatin1(backendNames[backend]));
+    store.setValue(QStringLiteral("bridge/transport"), QString::fromLatin1(transportNames[transport]));
+    store.setValue(QStringLiteral("bridge/protocol"), QString::fromLatin1(protocolNames[protocol]));
+
+    store.setValue(QStringLiteral("serial/port"), portName);
+    store.setValue(QStringLiteral("serial/deviceId"), deviceId);
+    store.setValue(QStringLiteral("serial/baudRate"), baudRate);
+    store.setValue(QStringLiteral("serial/dataBits"), QString::fromLatin1(dataBitsName(dataBits)));
+    store.setValue(QStringLiteral("serial/parity"), QString::fromLatin1(parityName(parity)));
+    store.setValue(QStringLiteral("serial/stopBits"), QString::fromLatin1(stopBitsName(stopBits)));
+    store.setValue(QStringLiteral("serial/flowControl"), QString::fromLatin1(flowControlName(flowControl)));
+    store.setValue(QStringLiteral("serial/reconnect"), reconnect.enabled);
+    store.setValue(QStringLiteral("serial/reconnectMin"), reconnect.delayMin);
+    store.setValue(QStringLiteral("serial/reconnectMax"), reconnect.delayMax);
+    store.setValue(QStringLiteral("serial/lineControl"), lineControl);
+    store.setValue(QStringLiteral("pty/enabled"), pty.enabled);
+    store.setValue(QStringLiteral("pty/link"), pty.link);
+
+    store.setValue(QStringLiteral("udp/localPort"), localPort);
+    store.setValue(QStringLiteral("udp/destinationIp"), destinationIp);
+    store.setValue(QStringLiteral("udp/destinationPort"), destinationPort);
+    store.setValue(QStringLiteral("udp/multicastTtl"), multicastTtl);
+    store.setValue(QStringLiteral("tcp/clientQueueLimit"), tcp.clientQueueLimit);
+    store.setValue(QStringLiteral("tcp/reconnectMin"), tcp.reconnectMin);
+    store.setValue(QStringLiteral("tcp/reconnectMax"), tcp.reconnectMax);
+
+    store.setValue(QStringLiteral("modbus/timeout"), modbus.timeout);
+    store.setValue(QStringLiteral("modbus/turnaround"), modbus.turnaround);
+    store.setValue(QStringLiteral("modbus/broadcastDelay"), modbus.broadcastDelay);
+    store.setValue(QStringLiteral("modbus/cacheTtl"), modbus.cacheTtl);
+    store.setValue(QStringLiteral("modbus/queueLimit"), modbus.queueLimit);
+
+    store.setValue(QStringLiteral("codec/aggregate"), codec.aggregate);
+    store.setValue(QStringLiteral("codec/compress"), codec.compress);
+    store.setValue(QStringLiteral("codec/maxDelay"), codec.maxDelay);
+    store.setValue(QStringLiteral("codec/maxSize"), codec.maxSize);
+    store.setValue(QStringLiteral("codec/dictionary"), codec.dictionary);
+    store.setValue(QStringLiteral("codec/sequence"), codec.sequence);
+    store.setValue(QStringLiteral("codec/reorderHold"), codec.reorderHold);
+    store.setValue(QStringLiteral("codec/reorderWindow"), codec.reorderWindow);
+
+    store.setValue(QStringLiteral("framing/mode"), QString::fromLatin1(framingModeNames[framing.mode]));
+    store.setValue(QStringLiteral("framing/maxSize"), framing.maxSize);
+    store.setValue(QStringLiteral("framing/idleCharacters"), framing.idleCharacters);
+    store.setValue(QStringLiteral("framing/delimiter"), QString::fromLatin1(framing.delimiter.toHex()));
+    store.setValue(QStringLiteral("framing/fixedLength"), framing.fixedLength);
+    store.setValue(QStringLiteral("framing/flushTimeout"), framing.flushTimeout);
+
+    store.setValue(QStringLiteral("queue/highWater"), queue.highWater);
+    store.setValue(QStringLiteral("queue/policy"), QString::fromLatin1(queuePolicyNames[queue.policy]));
+
+    store.setValue(QStringLiteral("transmit/frameGap"), transmit.frameGap);
+    store.setValue(QStringLiteral("transmit/fifoSize"), transmit.fifoSize);
+    store.setValue(QStringLiteral("transmit/rs485"), transmit.rs485);
+    store.setValue(QStringLiteral("transmit/rtsBefore"), transmit.rtsBefore);
+    store.setValue(QStringLiteral("transmit/rtsAfter"), transmit.rtsAfter);
+
+    store.setValue(QStringLiteral("record/path"), record.path);
+    store.setValue(QStringLiteral("record/segmentSize"), record.segmentSize);
+    store.setValue(QStringLiteral("record/segments"), record.segments);
+
+    store.setValue(QStringLiteral("tracing/path"), tracing.path);
+}
+
+// Function to compute the bits per character: start bit, data, parity and stop bits
+double BridgeSettings::bitsPerCharacter() const
+{
+    double bits = 1 + int(dataBits);
+    if (parity != QSerialPort::NoParity)
+        bits += 1;
+    if (stopBits == QSerialPort::OneAndHalfStop)
+        bits += 1.5;
+    else if (stopBits == QSerialPort::TwoStop)
+        bits += 2;
+    else
+        bits += 1;
+    return bits;
+}
+
+// Function to parse the data bits ("5" to "8")
+bool BridgeSettings::parseDataBits(const QString &text, QSerialPort::DataBits *dataBits)
+{
+    bool ok = false;
+    const int value = text.trimmed().toInt(&ok);
+    if (!ok || value < 5 || value > 8)
+        return false;
+
+    *dataBits = static_cast<QSerialPort::DataBits>(value);
+    return true;
+}
+
+// Function to parse the parity ("none", "even", "odd", "mark" or "space")
+bool BridgeSettings::parseParity(const QString &text, QSerialPort::Parity *parity)
+{
+    const QString value = text.trimmed().toLower();
+    if (value == QLatin1String("none"))
+        *parity = QSerialPort::NoParity;
+    else if (value == QLatin1String("even"))
+        *parity = QSerialPort::EvenParity;
+    else if (value == QLatin1String("odd"))
+        *parity = QSerialPort::OddParity;
+    else if (value == QLatin1String("mark"))
+        *parity = QSerialPort::MarkParity;
+    else if (value == QLatin1String("space"))
+        *parity = QSerialPort::SpaceParity;
+    else
+        return false;
+    return true;
+}
+
+// Function to parse the stop bits ("1", "1.5" or "2")
+bool BridgeSettings::parseStopBits(const QString &text, QSerialPort::StopBits *stopBits)
+{
+    const QString value = text.trimmed();
+    if (value == QLatin1String("1"))
+        *stopBits = QSerialPort::OneStop;
+    else if (value == QLatin1String("1.5"))
+        *stopBits = QSerialPort::OneAndHalfStop;
+    else if (value == QLatin1String("2"))
+        *stopBits = QSerialPort::TwoStop;
+    else
+        return false;
+    return true;
+}
+
+// Function to parse the flow control ("none", "rtscts" or "xonxoff")
+bool BridgeSettings::parseFlowControl(const QString &text, QSerialPort::FlowControl *flowControl)
+{
+    const QString value = text.trimmed().toLower();
+    if (value == QLatin1String("none"))
+        *flowControl = QSerialPort::NoFlowControl;
+    else if (value == QLatin1String("rtscts"))
+        *flowControl = QSerialPort::HardwareControl;
+    else if (value == QLatin1String("xonxoff"))
+        *flowControl = QSerialPort::SoftwareControl;
+    else
+        return false;
+    return true;
+}
+
+// Function to parse the framing mode ("raw", "size", "idle", "delimiter" or "fixed")
+bool BridgeSettings::parseFramingMode(const QString &text, FramingMode *mode)
+{
+    const QString value = text.trimmed().toLower();
+    if (value == QLatin1String("raw"))
+        *mode = RawFraming;
+    else if (value == QLatin1String("size"))
+        *mode = SizeFraming;
+    else if (value == QLatin1String("idle"))
+        *mode = IdleFraming;
+    else if (value == QLatin1String("delimiter"))
+        *mode = DelimiterFraming;
+    else if (value == QLatin1String("fixed"))
+        *mode = FixedFraming;
+    else
+        return false;
+    return true;
+}
+
+// Function to parse a delimiter given as hex bytes, e.g. "0d0a" or "0D 0A"
+bool BridgeSettings::parseDelimiter(const QString &text, QByteArray *delimiter)
+{
+    QString hex = text;
+    hex.remove(QLatin1Char(' '));
+    if (hex.isEmpty() || hex.size() % 2 != 0)
+        return false;
+
+    // fromHex() silently skips bad characters, so check them first
+    for (const QChar c : hex) {
+        const char ch = c.toLower().toLatin1();
+        if (!((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f')))
+            return false;
+    }
+
+    *delimiter = QByteArray::fromHex(hex.toLatin1());
+    return true;
+}
+
+// Function to parse the queue policy ("drop-oldest", "drop-newest" or "pause")
+bool BridgeSettings::parseQueuePolicy(const QString &text, QueuePolicy *policy)
+{
+    const QString value = text.trimmed().toLower();
+    if (value == QLatin1String("drop-oldest"))
+        *policy = DropOldest;
+    else if (value == QLatin1String("drop-newest"))
+        *policy = DropNewest;
+    else if (value == QLatin1String("pause"))
+        *policy = PauseReads;
+    else
+        return false;
+    return true;
+}
+
+// Function to parse the I/O backend ("qt" or "linux")
+bool BridgeSettings::parseBackend(const QString &text, Backend *backend)
+{
+    const QString value = text.trimmed().toLower();
+    if (value == QLatin1String("qt"))
+        *backend = QtBackend;
+    else if (value == QLatin1String("linux"))
+        *backend = LinuxBackend;
+    else
+        return false;
+    return true;
+}
+
+// Function to parse the network transport ("udp", "multicast", "tcp-server" or "tcp-client")
+bool BridgeSettings::parseTransport(const QString &text, Transport *transport)
+{
+    const QString value = text.trimmed().toLower();
+    if (value == QLatin1String("udp"))
+        *transport = UdpTransport;
+    else if (value == QLatin1String("multicast"))
+        *transport = MulticastTransport;
+    else if (value == QLatin1String("tcp-server"))
+        *transport = TcpServerTransport;
+    else if (value == QLatin1String("tcp-client"))
+        *transport = TcpClientTransport;
+    else
+        return false;
+    return true;
+}
+
+// Function to parse the protocol ("raw" or "modbus")
+bool BridgeSettings::parseProtocol(const QString &text, Protocol *protocol)
+{
+    const QString value = text.trimmed().toLower();
+    if (value == QLatin1String("raw"))
+        *protocol = RawProtocol;
+    else if (value == QLatin1String("modbus"))
+        *protocol = ModbusProtocol;
+    else
+        return false;
+    return true;
+}
@@ -0,0 +1,186 @@
+#ifndef BRIDGESETTINGS_H
+#define BRIDGESETTINGS_H
+
+#include <QMetaType>
+#include <QString>
+#include <QtSerialPort>
+
+class QSettings;
+
+// Everything the bridge engine needs to open both sides of the bridge.
+// Filled in by the controller (GUI or otherwise) and handed over by value.
+struct BridgeSettings
+{
+    // I/O backend; the Linux one is only there in builds with SER2ETHER_LINUX_FASTPATH
+    enum Backend {
+        QtBackend,          // QSerialPort and QUdpSocket
+        LinuxBackend        // termios2, epoll and recvmmsg/sendmmsg
+    };
+    Backend backend = QtBackend;
+
+    // Serial side; with a device id the port is looked up by it on open and
+    // on every reconnect, so the device may come back under another name
+    QString portName;
+    QString deviceId;   // serial number or vid:pid, see serialPortIdentity()
+    qint32 baudRate = QSerialPort::Baud9600;
+    QSerialPort::DataBits dataBits = QSerialPort::Data8;
+    QSerialPort::Parity parity = QSerialPort::NoParity;
+    QSerialPort::StopBits stopBits = QSerialPort::OneStop;
+    QSerialPort::FlowControl flowControl = QSerialPort::NoFlowControl;
+
+    // Reopening the serial port after the device went away; the network side
+    // keeps running and its data waits in the serial queue meanwhile
+    struct Reconnect {
+        bool enabled = true;
+        int delayMin = 500;     // first reconnect delay in ms
+        int delayMax = 30000;   // longest reconnect delay in ms
+    } reconnect;
+
+    // Virtual serial port, Linux only: instead of opening portName the bridge
+    // creates a pseudo-terminal that applications on this host open under the link
+    struct Pty {
+        bool enabled = false;
+        QString link = QStringLiteral("/dev/ttyS2E0");
+    } pty;
+
+    // Line settings and modem lines across a datagram transport: a virtual
+    // port sends what its application set, a real port applies what it
+    // receives; the peer needs it too, see linkcodec.h
+    bool lineControl = false;
+
+    // Network side; the ports and the destination mean slightly different
+    // things per transport, see the comments
+    enum Transport {
+        UdpTransport,       // unicast or broadcast to the destination
+        MulticastTransport, // the destination is a group joined on the local port
+        TcpServerTransport, // listen on the local port, fan out to every client
+        TcpClientTransport  // connect to the destination, reconnect with backoff
+    };
+    Transport transport = UdpTransport;
+    quint16 localPort = 1234;
+    QString destinationIp = QStringLiteral("127.0.0.1");
+    quint16 destinationPort = 1234;
+    int multicastTtl = 1;
+
+    // Limits of the TCP transports
+    struct Tcp {
+        int clientQueueLimit = 256 * 1024;  // bytes a client may lag behind before it is dropped
+        int reconnectMin = 500;             // first reconnect delay in ms
+        int reconnectMax = 30000;           // longest reconnect delay in ms
+    } tcp;
+
+    // What the bridge carries
+    enum Protocol {
+        RawProtocol,        // the bytes as they are, cut by the framing below
+        ModbusProtocol      // gateway between Modbus RTU on the serial side and MBAP on the network side
+    };
+    Protocol protocol = RawProtocol;
+
+    // Modbus gateway; the serial side is framed on the RTU silence whatever
+    // the framing settings say
+    struct Modbus {
+        int timeout = 1000;         // ms a slave may take to answer
+        int turnaround = 5;         // ms of bus silence after an answer before the next request
+        int broadcastDelay = 100;   // ms the slaves get to process a broadcast
+        int cacheTtl = 250;         // ms an answer to a read is reused; 0 disables the cache
+        int queueLimit = 64;        // requests waiting for the bus before clients are told it is busy
+    } modbus;
+
+    // Link codec of the datagram transports, see linkcodec.h; both ends need
+    // the same dictionary, and an end with the codec off sees coded datagrams
+    // as raw bytes
+    struct Codec {
+        bool aggregate = false;     // pack several serial packets into one datagram
+        bool compress = false;      // LZ4 compress datagrams that get smaller by it
+        int maxDelay = 10;          // ms the first packet of a datagram may wait for more
+        int maxSize = 1472;         // bytes of an aggregated datagram before compression
+        QString dictionary;         // file of typical traffic to compress against; empty for none
+        bool sequence = false;      // number and stamp the datagrams, for loss, order and jitter
+        int reorderHold = 5;        // ms an early datagram waits for the ones before it; 0 keeps arrival order
+        int reorderWindow = 16;     // datagrams held back at most
+
+        bool isEnabled() const { return aggregate || compress || sequence; }
+    } codec;
+
+    // How the serial byte stream is cut into datagrams
+    enum FramingMode {
+        RawFraming,         // one datagram per serial read
+        SizeFraming,        // fill datagrams up to maxSize
+        IdleFraming,        // end a datagram after an inter-character gap
+        DelimiterFraming,   // end a datagram after the delimiter
+        FixedFraming        // datagrams of exactly fixedLength bytes
+    };
+    struct Framing {
+        FramingMode mode = RawFraming;
+        int maxSize = 1472;             // upper bound in every mode
+        double idleCharacters = 3.5;    // idle gap in character times
+        QByteArray delimiter = QByteArray("\r\n");
+        int fixedLength = 8;
+        int flushTimeout = 20;          // ms a partial datagram may wait
+    } framing;
+
+    // What to do with UDP data when the serial line cannot keep up
+    enum QueuePolicy {
+        DropOldest,     // discard the oldest queued frames
+        DropNewest,     // discard the frame that does not fit
+        PauseReads      // stop reading UDP until the queue drained
+    };
+    struct Queue {
+        int highWater = 64 * 1024;      // bytes queued for the serial port
+        QueuePolicy policy = DropOldest;
+    } queue;
+
+    // Pacing of the serial line for slow devices, e.g. on RS-485 with small
+    // UART FIFOs; frames are whatever one datagram or gateway request brought
+    struct Transmit {
+        int frameGap = 0;       // us of idle line kept between two frames
+        int fifoSize = 0;       // bytes handed to the driver ahead of the line; 0 does not pace
+        bool rs485 = false;     // raise RTS while a frame goes out, for the transceiver direction
+        int rtsBefore = 0;      // us from raising RTS to the first bit
+        int rtsAfter = 0;       // us from the last bit to dropping RTS
+
+        bool isEnabled() const { return frameGap > 0 || fifoSize > 0 || rs485; }
+    } transmit;
+
+    // Binary trace of everything the bridge forwards, see tracefile.h
+    struct Record {
+        QString path;                           // segments are numbered after it; empty records nothing
+        qint64 segmentSize = 64 * 1024 * 1024;  // bytes per segment file before rotating
+        int segments = 8;                       // newest segments kept; 0 keeps them all
+    } record;
+
+    // Per-stage latency trace, see latencytracer.h
+    struct Tracing {
+        QString path;       // .json for Chrome trace JSON, anything else binary; empty traces nothing
+    } tracing;
+
+    // Number of bits one character occupies on the line
+    double bitsPerCharacter() const;
+
+    // Version of the config file format, written as profile/version; files
+    // without one are taken as version 1
+    static constexpr int FormatVersion = 1;
+
+    // Read the settings from a config file, keeping the current values for
+    // missing keys; returns false and fills errorString on a bad value
+    bool load(QSettings &store, QString *errorString = nullptr);
+
+    // Write every setting to a config file, in the form load() reads
+    void save(QSettings &store) const;
+
+    // Text to enum helpers shared by the config file and the command line
+    static bool parseDataBits(const QString &text, QSerialPort::DataBits *dataBits);
+    static bool parseParity(const QString &text, QSerialPort::Parity *parity);
+    static bool parseStopBits(const QString &text, QSerialPort::StopBits *stopBits);
+    static bool parseFlowControl(const QString &text, QSerialPort::FlowControl *flowControl);
+    static bool parseFramingMode(const QString &text, FramingMode *mode);
+    static bool parseDelimiter(const QString &text, QByteArray *delimiter);
+    static bool parseQueuePolicy(const QString &text, QueuePolicy *policy);
+    static bool parseBackend(const QString &text, Backend *backend);
+    static bool parseTransport(const QString &text, Transport *transport);
+    static bool parseProtocol(const QString &text, Protocol *protocol);
+};
+
+Q_DECLARE_METATYPE(BridgeSettings)
+
+#endif // BRIDGESETTINGS_H
@@ -0,0 +1,196 @@
+#include "bridgestats.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <chrono>
+
+namespace {
+
+void copyCounters(const std::atomic<quint64> *from, quint64 *to, int count)
+{
+    for (int i = 0; i < count; ++i)
+        to[i] = from[i].load(std::memory_order_relaxed);
+}
+
+void clearCounters(std::atomic<quint64> *counters, int count)
+{
+    for (int i = 0; i < count; ++i)
+        counters[i].store(0, std::memory_order_relaxed);
+}
+
+BridgeStats::DirectionSnapshot snapshotOf(const BridgeStats::Direction &direction)
+{
+    BridgeStats::DirectionSnapshot snapshot;
+    snapshot.bytes = direction.bytes.load();
+    snapshot.datagrams = direction.datagrams.load();
+    snapshot.chunks = direction.chunks.load();
+    snapshot.drops = direction.drops.load();
+    copyCounters(direction.chunkSizes.buckets, snapshot.chunkSizes, BridgeStats::SizeBuckets);
+    copyCounters(direction.datagramSizes.buckets, snapshot.datagramSizes, BridgeStats::SizeBuckets);
+    copyCounters(direction.latency.buckets, snapshot.latency, BridgeStats::LatencyBuckets);
+    return snapshot;
+}
+
+void resetDirection(BridgeStats::Direction &direction)
+{
+    direction.bytes.value.store(0, std::memory_order_relaxed);
+    direction.datagrams.value.store(0, std::memory_order_relaxed);
+    direction.chunks.value.store(0, std::memory_order_relaxed);
+    direction.drops.value.store(0, std::memory_order_relaxed);
+    clearCounters(direction.chunkSizes.buckets, BridgeStats::SizeBuckets);
+    clearCounters(direction.datagramSizes.buckets, BridgeStats::SizeBuckets);
+    clearCounters(direction.latency.buckets, BridgeStats::LatencyBuckets);
+}
+
+QJsonArray arrayOf(const quint64 *buckets, int count)
+{
+    QJsonArray array;
+    for (int i = 0; i < count; ++i)
+        array.append(qint64(buckets[i]));
+    return array;
+}
+
+QJsonObject jsonOf(const BridgeStats::DirectionSnapshot &direction)
+{
+    QJsonObject object;
+    object.insert(QStringLiteral("bytes"), qint64(direction.bytes));
+    object.insert(QStringLiteral("datagrams"), qint64(direction.datagrams));
+    object.insert(QStringLiteral("chunks"), qint64(direction.chunks));
+    object.insert(QStringLiteral("drops"), qint64(direction.drops));
+    object.insert(QStringLiteral("chunkSizes"), arrayOf(direction.chunkSizes, BridgeStats::SizeBuckets));
+    object.insert(QStringLiteral("datagramSizes"), arrayOf(direction.datagramSizes, BridgeStats::SizeBuckets));
+    object.insert(QStringLiteral("latencyUs"), arrayOf(direction.latency, BridgeStats::LatencyBuckets));
+    object.insert(QStringLiteral("latencyP50Us"),
+                  qint64(BridgeStats::percentile(direction.latency, BridgeStats::LatencyBuckets, 0.5)));
+    object.insert(QStringLiteral("latencyP99Us"),
+                  qint64(BridgeStats::percentile(direction.latency, BridgeStats::LatencyBuckets, 0.99)));
+    return object;
+}
+
+} // namespace
+
+// This function is called by the engine whenever the serial queue changed
+void BridgeStats::setQueueDepth(qint64 bytes, int frames)
+{
+    // Only the engine thread writes, so the peak needs no compare-and-swap
+    queueBytes.store(quint64(bytes), std::memory_order_relaxed);
+    queueFrames.store(quint64(frames), std::memory_order_relaxed);
+    if (quint64(bytes) > queuePeakBytes.load(std::memory_order_relaxed))
+        queuePeakBytes.store(quint64(bytes), std::memory_order_relaxed);
+}
+
+// This function is called when the bridge opens to start counting from zero
+void BridgeStats::reset()
+{
+    resetDirection(serialToUdp);
+    resetDirection(udpToSerial);
+    serialErrors.value.store(0, std::memory_order_relaxed);
+    lineErrors.value.store(0, std::memory_order_relaxed);
+    queueBytes.store(0, std::memory_order_relaxed);
+    queueFrames.store(0, std::memory_order_relaxed);
+    queuePeakBytes.store(0, std::memory_order_relaxed);
+    sequence.lost.value.store(0, std::memory_order_relaxed);
+    sequence.late.value.store(0, std::memory_order_relaxed);
+    sequence.duplicates.value.store(0, std::memory_order_relaxed);
+    sequence.reordered.value.store(0, std::memory_order_relaxed);
+    sequence.jitter.store(0, std::memory_order_relaxed);
+    pacing.wakeups.value.store(0, std::memory_order_relaxed);
+    pacing.lineBusy.value.store(0, std::memory_order_relaxed);
+    clearCounters(pacing.lateness.buckets, LatencyBuckets);
+    reconfigures.value.store(0, std::memory_order_relaxed);
+    clearCounters(reconfigureTime.buckets, LatencyBuckets);
+}
+
+// This function is called from any thread to read all the counters
+BridgeStats::Snapshot BridgeStats::snapshot() const
+{
+    // The counters are read one by one, so a snapshot taken while the engine
+    // forwards is only consistent per counter, which is fine for monitoring
+    Snapshot snapshot;
+    snapshot.time = now();
+    snapshot.serialToUdp = snapshotOf(serialToUdp);
+    snapshot.udpToSerial = snapshotOf(udpToSerial);
+    snapshot.queueBytes = queueBytes.load(std::memory_order_relaxed);
+    snapshot.queueFrames = queueFrames.load(std::memory_order_relaxed);
+    snapshot.queuePeakBytes = queuePeakBytes.load(std::memory_order_relaxed);
+    snapshot.serialErrors = serialErrors.load();
+    snapshot.lineErrors = lineErrors.load();
+    snapshot.lineErrorsCounted = lineErrorsCounted.load(std::memory_order_relaxed);
+    snapshot.sequence.lost = sequence.lost.load();
+    snapshot.sequence.late = sequence.late.load();
+    snapshot.sequence.duplicates = sequence.duplicates.load();
+    snapshot.sequence.reordered = sequence.reordered.load();
+    snapshot.sequence.jitter = sequence.jitter.load(std::memory_order_relaxed);
+    snapshot.pacing.wakeups = pacing.wakeups.load();
+    snapshot.pacing.lineBusy = pacing.lineBusy.load();
+    copyCounters(pacing.lateness.buckets, snapshot.pacing.lateness, LatencyBuckets);
+    snapshot.reconfigures = reconfigures.load();
+    copyCounters(reconfigureTime.buckets, snapshot.reconfigureTime, LatencyBuckets);
+    return snapshot;
+}
+
+qint64 BridgeStats::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+quint64 BridgeStats::percentile(const quint64 *buckets, int count, double fraction)
+{
+    quint64 total = 0;
+    for (int i = 0; i < count; ++i)
+        total += buckets[i];
+    if (total == 0)
+        return 0;
+
+    // Walk up the buckets until the fraction of the samples is covered
+    const quint64 wanted = quint64(fraction * double(total - 1)) + 1;
+    quint64 seen = 0;
+    for (int i = 0; i < count; ++i) {
+        seen += buckets[i];
+        if (seen >= wanted)
+            return i == 0 ? 0 : (quint64(1) << i) - 1;
+    }
+    return (quint64(1) << (count - 1)) - 1;
+}
+
+// This function is called to turn a snapshot into one line of JSON
+QByteArray BridgeStats::Snapshot::toJson(const QString &channel) const
+{
+    QJsonObject object;
+    if (!channel.isEmpty())
+        object.insert(QStringLiteral("channel"), channel);
+    object.insert(QStringLiteral("serialToUdp"), jsonOf(serialToUdp));
+    object.insert(QStringLiteral("udpToSerial"), jsonOf(udpToSerial));
+    object.insert(QStringLiteral("queueBytes"), qint64(queueBytes));
+    object.insert(QStringLiteral("queueFrames"), qint64(queueFrames));
+    object.insert(QStringLiteral("queuePeakBytes"), qint64(queuePeakBytes));
+    object.insert(QStringLiteral("serialErrors"), qint64(serialErrors));
+    object.insert(QStringLiteral("lineErrors"), lineErrorsCounted ? QJsonValue(qint64(lineErrors)) : QJsonValue());
+
+    QJsonObject sequenceObject;
+    sequenceObject.insert(QStringLiteral("lost"), qint64(sequence.lost));
+    sequenceObject.insert(QStringLiteral("late"), qint64(sequence.late));
+    sequenceObject.insert(QStringLiteral("duplicates"), qint64(sequence.duplicates));
+    sequenceObject.insert(QStringLiteral("reordered"), qint64(sequence.reordered));
+    sequenceObject.insert(QStringLiteral("jitterUs"), qint64(sequence.jitter));
+    object.insert(QStringLiteral("sequence"), sequenceObject);
+
+    QJsonObject pacingObject;
+    pacingObject.insert(QStringLiteral("wakeups"), qint64(pacing.wakeups));
+    pacingObject.insert(QStringLiteral("lineBusy"), qint64(pacing.lineBusy));
+    pacingObject.insert(QStringLiteral("latenessUs"), arrayOf(pacing.lateness, LatencyBuckets));
+    pacingObject.insert(QStringLiteral("latenessP50Us"), qint64(percentile(pacing.lateness, LatencyBuckets, 0.5)));
+    pacingObject.insert(QStringLiteral("latenessP99Us"), qint64(percentile(pacing.lateness, LatencyBuckets, 0.99)));
+    object.insert(QStringLiteral("pacing"), pacingObject);
+
+    QJsonObject reconfigureObject;
+    reconfigureObject.insert(QStringLiteral("count"), qint64(reconfigures));
+    reconfigureObject.insert(QStringLiteral("timeUs"), arrayOf(reconfigureTime, LatencyBuckets));
+    reconfigureObject.insert(QStringLiteral("timeP50Us"), qint64(percentile(reconfigureTime, LatencyBuckets, 0.5)));
+    reconfigureObject.insert(QStringLiteral("timeP99Us"), qint64(percentile(reconfigureTime, LatencyBuckets, 0.99)));
+    object.insert(QStringLiteral("reconfigure"), reconfigureObject);
+    return QJsonDocument(object).toJson(QJsonDocument::Compact);
+}
@@ -0,0 +1,147 @@
+#ifndef BRIDGESTATS_H
+#define BRIDGESTATS_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtAlgorithms>
+#include <QtGlobal>
+
+#include <atomic>
+
+// Live counters of one bridge. The engine thread updates them with relaxed
+// atomic adds, which cost about as much as a plain increment; any other
+// thread may take a snapshot at any time without locking.
+class BridgeStats
+{
+public:
+    // Size buckets: 0, 1, 2-3, 4-7, ..., 32768-65535, 65536 and up
+    static constexpr int SizeBuckets = 18;
+
+    // Latency buckets in microseconds, same power of two scheme up to ~8 s
+    static constexpr int LatencyBuckets = 24;
+
+    struct Counter {
+        std::atomic<quint64> value{0};
+
+        void add(quint64 amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+        quint64 load() const { return value.load(std::memory_order_relaxed); }
+    };
+
+    template <int Buckets>
+    struct Histogram {
+        std::atomic<quint64> buckets[Buckets] = {};
+
+        void add(quint64 value) { buckets[bucketOf(value, Buckets)].fetch_add(1, std::memory_order_relaxed); }
+    };
+
+    // Counters of one forwarding direction. Chunks are serial reads for
+    // serial to UDP and serial writes for UDP to serial.
+    struct Direction {
+        Counter bytes;
+        Counter datagrams;
+        Counter chunks;
+        Counter drops;
+        Histogram<SizeBuckets> chunkSizes;
+        Histogram<SizeBuckets> datagramSizes;
+        Histogram<LatencyBuckets> latency;
+    };
+
+    struct DirectionSnapshot {
+        quint64 bytes = 0;
+        quint64 datagrams = 0;
+        quint64 chunks = 0;
+        quint64 drops = 0;
+        quint64 chunkSizes[SizeBuckets] = {};
+        quint64 datagramSizes[SizeBuckets] = {};
+        quint64 latency[LatencyBuckets] = {};
+    };
+
+    // Sequence numbers of a peer with the link codec, see LinkReorderer.
+    // Lost counts the numbers the stream moved past; those that turn up
+    // afterwards count as late as well.
+    struct Sequence {
+        Counter lost;
+        Counter late;
+        Counter duplicates;
+        Counter reordered;              // datagrams that came after one sent later
+        std::atomic<quint64> jitter{0}; // one-way jitter in us, as in RFC 3550
+    };
+
+    struct SequenceSnapshot {
+        quint64 lost = 0;
+        quint64 late = 0;
+        quint64 duplicates = 0;
+        quint64 reordered = 0;
+        quint64 jitter = 0;
+    };
+
+    // Serial transmit pacer, see TransmitPacer: its timer wakeups and how late
+    // they came, and how often the UART was still sending when the line model
+    // said the frame was out
+    struct Pacing {
+        Counter wakeups;
+        Counter lineBusy;
+        Histogram<LatencyBuckets> lateness;
+    };
+
+    struct PacingSnapshot {
+        quint64 wakeups = 0;
+        quint64 lineBusy = 0;
+        quint64 lateness[LatencyBuckets] = {};
+    };
+
+    struct Snapshot {
+        qint64 time = 0;
+        DirectionSnapshot serialToUdp;
+        DirectionSnapshot udpToSerial;
+        quint64 queueBytes = 0;
+        quint64 queueFrames = 0;
+        quint64 queuePeakBytes = 0;
+        quint64 serialErrors = 0;
+        quint64 lineErrors = 0;
+        bool lineErrorsCounted = true;  // false when the serial backend cannot see them
+        SequenceSnapshot sequence;
+        PacingSnapshot pacing;
+        quint64 reconfigures = 0;
+        quint64 reconfigureTime[LatencyBuckets] = {};
+
+        QByteArray toJson(const QString &channel = QString()) const;
+    };
+
+    Direction serialToUdp;
+    Direction udpToSerial;
+    Counter serialErrors;
+    Counter lineErrors;                 // parity, framing and break errors
+    Sequence sequence;
+    Pacing pacing;
+
+    // Settings switched while the bridge ran, and how long each switch took in us
+    Counter reconfigures;
+    Histogram<LatencyBuckets> reconfigureTime;
+
+    void setQueueDepth(qint64 bytes, int frames);
+    void setLineErrorsCounted(bool counted) { lineErrorsCounted.store(counted, std::memory_order_relaxed); }
+    void reset();
+    Snapshot snapshot() const;
+
+    // Monotonic time in nanoseconds used for all the latency stamps
+    static qint64 now();
+
+    static int bucketOf(quint64 value, int buckets)
+    {
+        // The bucket is the bit width of the value
+        const int width = value == 0 ? 0 : 64 - qCountLeadingZeroBits(value);
+        return qMin(width, buckets - 1);
+    }
+
+    // Upper bound of the bucket holding the given fraction of the samples
+    static quint64 percentile(const quint64 *buckets, int count, double fraction);
+
+private:
+    std::atomic<quint64> queueBytes{0};
+    std::atomic<quint64> queueFrames{0};
+    std::atomic<quint64> queuePeakBytes{0};
+    std::atomic<bool> lineErrorsCounted{true};
+};
+
+#endif // BRIDGESTATS_H
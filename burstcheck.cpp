@@ -0,0 +1,494 @@
+#include "bridgemanager.h"
+#include "framering.h"
+#include "widget.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QUdpSocket>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int BurstTimeout = 2000;      // ms for a burst to come out of the bridge
+constexpr int SettleTime = 20;          // ms the engine gets to finish after the last byte
+constexpr int MaxBurstSize = 65536;
+constexpr int MaxDatagramSize = 1472;
+
+// Serial reads a datagram may cost: the read that returns it and the one
+// that finds the device drained. The wakeup slack covers the reads and
+// writes the event dispatcher does on its own wakeup descriptor.
+constexpr quint64 ReadsPerDatagram = 2;
+constexpr quint64 WritesPerDatagram = 2;
+constexpr quint64 WakeupSlack = 4;
+
+// Limits of the serial queue check: small, so that the ring wraps often
+constexpr int QueueLimit = 4096;
+constexpr int QueueFrameSize = 1472;
+constexpr int QueueSteps = 1000000;
+
+// Print an error to stderr and return the tool's exit code
+int fail(const QString &message)
+{
+    std::fprintf(stderr, "ser2ether-burst-check: %s\n", qPrintable(message));
+    return 1;
+}
+
+// Byte at a position of the test stream; the prime period shows any
+// byte that was lost, repeated or moved
+char streamByte(quint64 position)
+{
+    return char(position % 251);
+}
+
+// Read and write system calls of one thread. Linux counts read(2) and
+// write(2) there but not socket sends and receives, so on the engine
+// thread they are the serial I/O plus the dispatcher's own wakeups.
+struct IoCount {
+    quint64 reads = 0;
+    quint64 writes = 0;
+};
+
+// Function to read the system call counters of a thread of this process
+bool readIoCount(qint64 threadId, IoCount *count)
+{
+    QFile file(QStringLiteral("/proc/self/task/%1/io").arg(threadId));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const auto lines = file.readAll().split('\n');
+    for (const QByteArray &line : lines) {
+        if (line.startsWith("syscr:"))
+            count->reads = line.mid(6).trimmed().toULongLong();
+        else if (line.startsWith("syscw:"))
+            count->writes = line.mid(6).trimmed().toULongLong();
+    }
+    return true;
+}
+
+// Function to check that the serial queue never refuses a frame while it
+// is below its limit, whatever the mix of frame sizes, partly written
+// frames and wrap points; returns the number of refused frames
+int checkSerialQueue()
+{
+    FrameRing ring;
+    ring.resetForLimit(QueueLimit, QueueFrameSize);
+
+    quint32 seed = 1;
+    auto random = [&seed](int range) {
+        seed = seed * 1103515245 + 12345;
+        return int((seed >> 8) % quint32(range));
+    };
+
+    int refused = 0;
+    for (int step = 0; step < QueueSteps; ++step) {
+        // Mostly tiny frames, which fill the frame table, or full ones
+        const int size = random(4) == 0 ? QueueFrameSize - random(8) : 1 + random(16);
+        if (random(2) == 0 && ring.bytes() + size <= QueueLimit) {
+            if (!ring.reserve(size)) {
+                ++refused;
+                continue;
+            }
+            ring.commit(1 + random(size), step);
+            continue;
+        }
+
+        // Write part of the oldest frame out, or drop it
+        int headSize = 0;
+        if (ring.head(&headSize) == nullptr)
+            continue;
+        if (random(4) == 0)
+            ring.dropFront();
+        else
+            ring.consume(1 + random(headSize));
+    }
+    std::printf("serial queue: %d steps, %d frames refused below the limit\n", QueueSteps, refused);
+    return refused;
+}
+
+// Function to check that each Open and Close click in the GUI reaches its
+// handler once; a second connect of the same button would ask the engine
+// twice. Returns the number of buttons that did not dispatch exactly once.
+int checkWidgetDispatch()
+{
+    Widget widget;
+
+    // Count the requests instead of handing them to the engine, so that
+    // the check never opens a real serial port
+    int opens = 0;
+    int closes = 0;
+    QObject::disconnect(&widget, &Widget::openBridgeRequested, nullptr, nullptr);
+    QObject::disconnect(&widget, &Widget::closeBridgeRequested, nullptr, nullptr);
+    QObject::connect(&widget, &Widget::openBridgeRequested, [&opens] { ++opens; });
+    QObject::connect(&widget, &Widget::closeBridgeRequested, [&closes] { ++closes; });
+
+    int failed = 0;
+    const QList<QPushButton *> buttons = widget.findChildren<QPushButton *>();
+    for (QPushButton *button : buttons) {
+        int *count = button->text() == QLatin1String("Open") ? &opens
+                   : button->text() == QLatin1String("Close") ? &closes : nullptr;
+        if (count == nullptr)
+            continue;
+
+        // Close is only enabled while a bridge runs
+        button->setEnabled(true);
+        const int before = *count;
+        button->click();
+        const int dispatched = *count - before;
+        std::printf("widget: %s button dispatched %d time(s)\n", qPrintable(button->text()), dispatched);
+        if (dispatched != 1)
+            ++failed;
+    }
+    if (opens == 0 || closes == 0) {
+        std::printf("widget: Open or Close button not found\n");
+        ++failed;
+    }
+    return failed;
+}
+
+// Sends bursts through a bridge channel between a pty and a loopback UDP
+// peer and checks what comes out: every byte once and in order, no empty
+// datagram, and a bounded number of serial system calls per datagram
+class BurstCheck
+{
+public:
+    int bursts = 20;
+    int burstSize = 4096;
+    int datagrams = 64;
+    int datagramSize = 256;
+
+    int ptyMaster = -1;
+    QUdpSocket peer;
+    quint16 bridgePort = 0;
+    qint64 engineThread = 0;
+
+    ~BurstCheck()
+    {
+        if (ptyMaster != -1)
+            ::close(ptyMaster);
+    }
+
+    int run();
+
+private:
+    bool checkSerialBurst(int burst);
+    bool checkNetworkBurst();
+    bool writePty(const char *data, int size);
+    void settle();
+
+    quint64 serialPosition = 0;
+    quint64 networkPosition = 0;
+    char buffer[MaxBurstSize];
+};
+
+// This function is called once the bridge is open to run every check
+int BurstCheck::run()
+{
+    int failures = 0;
+    for (int burst = 0; burst < bursts; ++burst) {
+        if (!checkSerialBurst(burst))
+            ++failures;
+    }
+    if (!checkNetworkBurst())
+        ++failures;
+
+    if (failures != 0) {
+        std::printf("FAILED: %d of %d bursts\n", failures, bursts + 1);
+        return 1;
+    }
+    std::printf("passed: %d serial bursts, 1 network burst\n", bursts);
+    return 0;
+}
+
+// This function is called to send one burst into the pty and collect the
+// datagrams it turns into
+bool BurstCheck::checkSerialBurst(int burst)
+{
+    for (int i = 0; i < burstSize; ++i)
+        buffer[i] = streamByte(serialPosition + quint64(i));
+
+    IoCount before;
+    IoCount after;
+    readIoCount(engineThread, &before);
+    if (!writePty(buffer, burstSize)) {
+        std::printf("burst %d: the pty took no more bytes\n", burst);
+        return false;
+    }
+
+    // Collect the datagrams until the burst is complete, then give the
+    // engine a moment so that anything it sends after that is counted too
+    int received = 0;
+    int datagramCount = 0;
+    int emptyDatagrams = 0;
+    bool intact = true;
+    QElapsedTimer clock;
+    clock.start();
+    auto collect = [&] {
+        char datagram[MaxBurstSize];
+        while (peer.hasPendingDatagrams()) {
+            const qint64 size = peer.readDatagram(datagram, sizeof(datagram));
+            if (size < 0)
+                break;
+            ++datagramCount;
+            if (size == 0) {
+                ++emptyDatagrams;
+                continue;
+            }
+            for (qint64 i = 0; i < size; ++i) {
+                if (datagram[i] != streamByte(serialPosition + quint64(received)))
+                    intact = false;
+                ++received;
+            }
+        }
+    };
+    while (received < burstSize && clock.elapsed() < BurstTimeout) {
+        peer.waitForReadyRead(int(BurstTimeout - clock.elapsed()));
+        collect();
+    }
+    settle();
+    collect();
+    readIoCount(engineThread, &after);
+    serialPosition += quint64(received);
+
+    const quint64 reads = after.reads - before.reads;
+    const quint64 writes = after.writes - before.writes;
+    const quint64 readLimit = ReadsPerDatagram * quint64(datagramCount) + WakeupSlack;
+    std::printf("burst %d: %d of %d bytes in %d datagrams, %d empty, %llu reads, %llu writes\n",
+                burst, received, burstSize, datagramCount, emptyDatagrams,
+                static_cast<unsigned long long>(reads), static_cast<unsigned long long>(writes));
+
+    bool ok = true;
+    if (received != burstSize || !intact) {
+        std::printf("burst %d: the bytes did not arrive intact\n", burst);
+        ok = false;
+    }
+    if (emptyDatagrams != 0) {
+        std::printf("burst %d: the bridge sent empty datagrams\n", burst);
+        ok = false;
+    }
+    if (reads > readLimit) {
+        std::printf("burst %d: more than %llu reads for %d datagrams\n", burst,
+                    static_cast<unsigned long long>(readLimit), datagramCount);
+        ok = false;
+    }
+    return ok;
+}
+
+// This function is called to send a burst of datagrams to the bridge and
+// read them back from the pty
+bool BurstCheck::checkNetworkBurst()
+{
+    IoCount before;
+    IoCount after;
+    readIoCount(engineThread, &before);
+
+    // All datagrams go out at once, faster than the bridge is woken up
+    char datagram[MaxDatagramSize];
+    for (int i = 0; i < datagrams; ++i) {
+        for (int j = 0; j < datagramSize; ++j)
+            datagram[j] = streamByte(networkPosition + quint64(i) * quint64(datagramSize) + quint64(j));
+        peer.writeDatagram(datagram, datagramSize, QHostAddress(QHostAddress::LocalHost), bridgePort);
+    }
+
+    const int expected = datagrams * datagramSize;
+    int received = 0;
+    bool intact = true;
+    QElapsedTimer clock;
+    clock.start();
+    while (received < expected && clock.elapsed() < BurstTimeout) {
+        pollfd readable = {ptyMaster, POLLIN, 0};
+        if (poll(&readable, 1, int(BurstTimeout - clock.elapsed())) <= 0)
+            continue;
+        ssize_t size;
+        while ((size = ::read(ptyMaster, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t i = 0; i < size; ++i) {
+                if (buffer[i] != streamByte(networkPosition + quint64(received)))
+                    intact = false;
+                ++received;
+            }
+        }
+    }
+    settle();
+    readIoCount(engineThread, &after);
+    networkPosition += quint64(received);
+
+    const quint64 reads = after.reads - before.reads;
+    const quint64 writes = after.writes - before.writes;
+    const quint64 writeLimit = WritesPerDatagram * quint64(datagrams) + WakeupSlack;
+    std::printf("network burst: %d datagrams, %d of %d bytes on the pty, %llu reads, %llu writes\n",
+                datagrams, received, expected,
+                static_cast<unsigned long long>(reads), static_cast<unsigned long long>(writes));
+
+    bool ok = true;
+    if (received != expected || !intact) {
+        std::printf("network burst: the datagrams did not arrive intact\n");
+        ok = false;
+    }
+    if (writes > writeLimit) {
+        std::printf("network burst: more than %llu writes for %d datagrams\n",
+                    static_cast<unsigned long long>(writeLimit), datagrams);
+        ok = false;
+    }
+    return ok;
+}
+
+// Function to write all of a burst into the pty, waiting while it is full
+bool BurstCheck::writePty(const char *data, int size)
+{
+    int written = 0;
+    while (written < size) {
+        const ssize_t result = ::write(ptyMaster, data + written, size_t(size - written));
+        if (result > 0) {
+            written += int(result);
+            continue;
+        }
+        if (result < 0 && errno != EAGAIN && errno != EINTR)
+            return false;
+        pollfd writable = {ptyMaster, POLLOUT, 0};
+        if (poll(&writable, 1, BurstTimeout) <= 0)
+            return false;
+    }
+    return true;
+}
+
+// Function to let the engine finish what the last bytes started
+void BurstCheck::settle()
+{
+    usleep(SettleTime * 1000);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // The GUI check needs no display
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication a(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("ser2ether-burst-check"));
+    QCoreApplication::setApplicationVersion(QStringLiteral("1.0.0"));
+
+    // Describe the command line
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Count datagrams and system calls per burst through a bridge channel"));
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    const QCommandLineOption backendOption(QStringLiteral("backend"),
+                                           QStringLiteral("I/O backend of the bridge: qt or linux."),
+                                           QStringLiteral("name"));
+    const QCommandLineOption burstsOption(QStringLiteral("bursts"),
+                                          QStringLiteral("Serial bursts to send."),
+                                          QStringLiteral("count"));
+    const QCommandLineOption burstSizeOption(QStringLiteral("burst-size"),
+                                             QStringLiteral("Bytes of a serial burst."),
+                                             QStringLiteral("bytes"));
+    const QCommandLineOption datagramsOption(QStringLiteral("datagrams"),
+                                             QStringLiteral("Datagrams of the network burst."),
+                                             QStringLiteral("count"));
+    const QCommandLineOption datagramSizeOption(QStringLiteral("datagram-size"),
+                                                QStringLiteral("Bytes of a datagram of the network burst."),
+                                                QStringLiteral("bytes"));
+    const QCommandLineOption bridgePortOption(QStringLiteral("bridge-port"),
+                                              QStringLiteral("Local UDP port of the bridge."),
+                                              QStringLiteral("port"));
+    parser.addOptions({backendOption, burstsOption, burstSizeOption, datagramsOption, datagramSizeOption, bridgePortOption});
+    parser.process(a);
+
+    // The serial queue is checked on its own first
+    if (checkSerialQueue() != 0) {
+        std::printf("FAILED: the serial queue refused frames below its limit\n");
+        return 1;
+    }
+    if (checkWidgetDispatch() != 0) {
+        std::printf("FAILED: a GUI button did not reach its handler exactly once\n");
+        return 1;
+    }
+
+    BurstCheck check;
+    bool ok = true;
+    if (parser.isSet(burstsOption)) {
+        check.bursts = parser.value(burstsOption).toInt(&ok);
+        if (!ok || check.bursts < 1)
+            return fail(QStringLiteral("Invalid burst count %1").arg(parser.value(burstsOption)));
+    }
+    if (parser.isSet(burstSizeOption)) {
+        check.burstSize = parser.value(burstSizeOption).toInt(&ok);
+        if (!ok || check.burstSize < 1 || check.burstSize > MaxBurstSize)
+            return fail(QStringLiteral("Burst size must be 1 to %1 bytes").arg(MaxBurstSize));
+    }
+    if (parser.isSet(datagramsOption)) {
+        check.datagrams = parser.value(datagramsOption).toInt(&ok);
+        if (!ok || check.datagrams < 1)
+            return fail(QStringLiteral("Invalid datagram count %1").arg(parser.value(datagramsOption)));
+    }
+    if (parser.isSet(datagramSizeOption)) {
+        check.datagramSize = parser.value(datagramSizeOption).toInt(&ok);
+        if (!ok || check.datagramSize < 1 || check.datagramSize > MaxDatagramSize)
+            return fail(QStringLiteral("Datagram size must be 1 to %1 bytes").arg(MaxDatagramSize));
+    }
+
+    // One datagram per serial read, so the datagrams show how the bridge read
+    BridgeSettings settings;
+    settings.baudRate = 4000000;
+    settings.localPort = 47101;
+    settings.framing.mode = BridgeSettings::RawFraming;
+    settings.destinationIp = QStringLiteral("127.0.0.1");
+    if (parser.isSet(bridgePortOption)) {
+        settings.localPort = parser.value(bridgePortOption).toUShort(&ok);
+        if (!ok || settings.localPort == 0)
+            return fail(QStringLiteral("Invalid bridge port %1").arg(parser.value(bridgePortOption)));
+    }
+    if (parser.isSet(backendOption) && !BridgeSettings::parseBackend(parser.value(backendOption), &settings.backend))
+        return fail(QStringLiteral("Invalid backend %1").arg(parser.value(backendOption)));
+    check.bridgePort = settings.localPort;
+
+    // The pty stands in for the serial device: the bridge opens the slave,
+    // the check reads and writes the master
+    check.ptyMaster = posix_openpt(O_RDWR | O_NOCTTY);
+    if (check.ptyMaster < 0 || grantpt(check.ptyMaster) != 0 || unlockpt(check.ptyMaster) != 0)
+        return fail(QStringLiteral("Cannot create a pseudo-terminal: %1").arg(QString::fromLocal8Bit(std::strerror(errno))));
+    fcntl(check.ptyMaster, F_SETFL, fcntl(check.ptyMaster, F_GETFL) | O_NONBLOCK);
+    settings.portName = QString::fromLocal8Bit(ptsname(check.ptyMaster));
+
+    // The UDP peer of the bridge, on an ephemeral loopback port
+    if (!check.peer.bind(QHostAddress(QHostAddress::LocalHost), 0))
+        return fail(QStringLiteral("Cannot bind the UDP peer: %1").arg(check.peer.errorString()));
+    check.peer.setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, 4 * 1024 * 1024);
+    settings.destinationPort = check.peer.localPort();
+
+    // The channel runs on its own worker thread, so that its system calls
+    // are counted apart from those of the check
+    BridgeManager manager(1);
+    BridgeEngine *engine = manager.addChannel();
+    QObject::connect(engine, &BridgeEngine::errorMessage, &a, [](const QString &message) {
+        std::fprintf(stderr, "ser2ether-burst-check: %s\n", qPrintable(message));
+    });
+    QObject::connect(engine, &BridgeEngine::bridgeOpenFailed, &a, [] {
+        QCoreApplication::exit(1);
+    });
+    QObject::connect(engine, &BridgeEngine::bridgeOpened, &a, [&check, engine] {
+        QMetaObject::invokeMethod(engine, [&check] {
+            check.engineThread = qint64(syscall(SYS_gettid));
+        }, Qt::BlockingQueuedConnection);
+        IoCount count;
+        if (!readIoCount(check.engineThread, &count)) {
+            QCoreApplication::exit(fail(QStringLiteral("Cannot read the I/O counters of the engine thread")));
+            return;
+        }
+        QCoreApplication::exit(check.run());
+    });
+    manager.openChannel(engine, settings);
+
+    return a.exec();
+}
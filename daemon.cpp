@@ -0,0 +1,608 @@
+#include "bridgemanager.h"
+#include "profiles.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSet>
+#include <QSettings>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <cerrno>
+#include <cstdio>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+// Print an error to stderr and return the daemon exit code
+static int fail(const QString &message)
+{
+    std::fprintf(stderr, "ser2etherd: %s\n", qPrintable(message));
+    return 1;
+}
+
+// Name a channel in the output by its port, or by its device while it has no port name
+static QString channelName(const BridgeSettings &settings)
+{
+    if (settings.pty.enabled)
+        return settings.pty.link;
+    return settings.portName.isEmpty() ? settings.deviceId : settings.portName;
+}
+
+#ifdef Q_OS_UNIX
+// Pipe through which the signal handler wakes up the event loop
+static int signalPipe[2] = {-1, -1};
+
+// Pass the signal on to the event loop; only async-signal-safe calls here
+static void handleStopSignal(int signal)
+{
+    const int savedErrno = errno;
+    const char number = char(signal);
+    if (::write(signalPipe[1], &number, 1) < 0) {
+        // The pipe is full, a stop is pending anyway
+    }
+    errno = savedErrno;
+}
+
+// Have SIGTERM and SIGINT quit the event loop instead of killing the
+// process, so that the channels close as on any other exit
+static bool watchStopSignals(QObject *context)
+{
+    if (::pipe(signalPipe) != 0)
+        return false;
+    for (int fd : signalPipe) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    QSocketNotifier *notifier = new QSocketNotifier(signalPipe[0], QSocketNotifier::Read, context);
+    QObject::connect(notifier, &QSocketNotifier::activated, context, [] {
+        char number = 0;
+        while (::read(signalPipe[0], &number, 1) > 0) {
+        }
+        std::fprintf(stderr, "[INFO] Stopping on signal %d\n", int(number));
+        QCoreApplication::quit();
+    });
+
+    struct sigaction action = {};
+    action.sa_handler = handleStopSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    return sigaction(SIGTERM, &action, nullptr) == 0 && sigaction(SIGINT, &action, nullptr) == 0;
+}
+#endif
+
+// Report a bad command line value
+static bool invalid(const QCommandLineParser &parser, const QString &option, QString *errorString)
+{
+    *errorString = QStringLiteral("Invalid value %1 for --%2").arg(parser.value(option), option);
+    return false;
+}
+
+// Override the settings of a channel with the options given on the command line
+static bool applyCommandLine(const QCommandLineParser &parser, BridgeSettings *settings, QString *errorString)
+{
+    bool ok = true;
+    if (parser.isSet(QStringLiteral("backend"))
+        && !BridgeSettings::parseBackend(parser.value(QStringLiteral("backend")), &settings->backend))
+        return invalid(parser, QStringLiteral("backend"), errorString);
+    if (parser.isSet(QStringLiteral("port")))
+        settings->portName = parser.value(QStringLiteral("port"));
+    if (parser.isSet(QStringLiteral("device-id")))
+        settings->deviceId = parser.value(QStringLiteral("device-id"));
+    if (parser.isSet(QStringLiteral("no-reconnect")))
+        settings->reconnect.enabled = false;
+    if (parser.isSet(QStringLiteral("pty"))) {
+        settings->pty.enabled = true;
+        settings->pty.link = parser.value(QStringLiteral("pty"));
+        if (settings->pty.link.isEmpty())
+            return invalid(parser, QStringLiteral("pty"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("line-control")))
+        settings->lineControl = true;
+    if (parser.isSet(QStringLiteral("baud"))) {
+        settings->baudRate = parser.value(QStringLiteral("baud")).toInt(&ok);
+        if (!ok || settings->baudRate <= 0)
+            return invalid(parser, QStringLiteral("baud"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("data-bits"))
+        && !BridgeSettings::parseDataBits(parser.value(QStringLiteral("data-bits")), &settings->dataBits))
+        return invalid(parser, QStringLiteral("data-bits"), errorString);
+    if (parser.isSet(QStringLiteral("parity"))
+        && !BridgeSettings::parseParity(parser.value(QStringLiteral("parity")), &settings->parity))
+        return invalid(parser, QStringLiteral("parity"), errorString);
+    if (parser.isSet(QStringLiteral("stop-bits"))
+        && !BridgeSettings::parseStopBits(parser.value(QStringLiteral("stop-bits")), &settings->stopBits))
+        return invalid(parser, QStringLiteral("stop-bits"), errorString);
+    if (parser.isSet(QStringLiteral("flow-control"))
+        && !BridgeSettings::parseFlowControl(parser.value(QStringLiteral("flow-control")), &settings->flowControl))
+        return invalid(parser, QStringLiteral("flow-control"), errorString);
+    if (parser.isSet(QStringLiteral("local-port"))) {
+        settings->localPort = parser.value(QStringLiteral("local-port")).toUShort(&ok);
+        if (!ok)
+            return invalid(parser, QStringLiteral("local-port"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("destination-ip")))
+        settings->destinationIp = parser.value(QStringLiteral("destination-ip"));
+    if (parser.isSet(QStringLiteral("destination-port"))) {
+        settings->destinationPort = parser.value(QStringLiteral("destination-port")).toUShort(&ok);
+        if (!ok)
+            return invalid(parser, QStringLiteral("destination-port"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("transport"))
+        && !BridgeSettings::parseTransport(parser.value(QStringLiteral("transport")), &settings->transport))
+        return invalid(parser, QStringLiteral("transport"), errorString);
+    if (parser.isSet(QStringLiteral("multicast-ttl"))) {
+        settings->multicastTtl = parser.value(QStringLiteral("multicast-ttl")).toInt(&ok);
+        if (!ok || settings->multicastTtl < 0 || settings->multicastTtl > 255)
+            return invalid(parser, QStringLiteral("multicast-ttl"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("client-queue-limit"))) {
+        settings->tcp.clientQueueLimit = parser.value(QStringLiteral("client-queue-limit")).toInt(&ok);
+        if (!ok || settings->tcp.clientQueueLimit <= 0)
+            return invalid(parser, QStringLiteral("client-queue-limit"), errorString);
+    }
+
+    if (parser.isSet(QStringLiteral("protocol"))
+        && !BridgeSettings::parseProtocol(parser.value(QStringLiteral("protocol")), &settings->protocol))
+        return invalid(parser, QStringLiteral("protocol"), errorString);
+    if (parser.isSet(QStringLiteral("modbus-timeout"))) {
+        settings->modbus.timeout = parser.value(QStringLiteral("modbus-timeout")).toInt(&ok);
+        if (!ok || settings->modbus.timeout <= 0)
+            return invalid(parser, QStringLiteral("modbus-timeout"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("modbus-cache-ttl"))) {
+        settings->modbus.cacheTtl = parser.value(QStringLiteral("modbus-cache-ttl")).toInt(&ok);
+        if (!ok || settings->modbus.cacheTtl < 0)
+            return invalid(parser, QStringLiteral("modbus-cache-ttl"), errorString);
+    }
+
+    if (parser.isSet(QStringLiteral("aggregate")))
+        settings->codec.aggregate = true;
+    if (parser.isSet(QStringLiteral("compress")))
+        settings->codec.compress = true;
+    if (parser.isSet(QStringLiteral("codec-delay"))) {
+        settings->codec.maxDelay = parser.value(QStringLiteral("codec-delay")).toInt(&ok);
+        if (!ok || settings->codec.maxDelay < 0)
+            return invalid(parser, QStringLiteral("codec-delay"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("codec-dictionary")))
+        settings->codec.dictionary = parser.value(QStringLiteral("codec-dictionary"));
+    if (parser.isSet(QStringLiteral("sequence")))
+        settings->codec.sequence = true;
+    if (parser.isSet(QStringLiteral("reorder-hold"))) {
+        settings->codec.reorderHold = parser.value(QStringLiteral("reorder-hold")).toInt(&ok);
+        if (!ok || settings->codec.reorderHold < 0)
+            return invalid(parser, QStringLiteral("reorder-hold"), errorString);
+    }
+
+    if (parser.isSet(QStringLiteral("framing"))
+        && !BridgeSettings::parseFramingMode(parser.value(QStringLiteral("framing")), &settings->framing.mode))
+        return invalid(parser, QStringLiteral("framing"), errorString);
+    if (parser.isSet(QStringLiteral("max-size"))) {
+        settings->framing.maxSize = parser.value(QStringLiteral("max-size")).toInt(&ok);
+        if (!ok || settings->framing.maxSize <= 0 || settings->framing.maxSize > 65507)
+            return invalid(parser, QStringLiteral("max-size"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("idle-chars"))) {
+        settings->framing.idleCharacters = parser.value(QStringLiteral("idle-chars")).toDouble(&ok);
+        if (!ok || settings->framing.idleCharacters <= 0)
+            return invalid(parser, QStringLiteral("idle-chars"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("delimiter"))
+        && !BridgeSettings::parseDelimiter(parser.value(QStringLiteral("delimiter")), &settings->framing.delimiter))
+        return invalid(parser, QStringLiteral("delimiter"), errorString);
+    if (parser.isSet(QStringLiteral("fixed-length"))) {
+        settings->framing.fixedLength = parser.value(QStringLiteral("fixed-length")).toInt(&ok);
+        if (!ok || settings->framing.fixedLength <= 0)
+            return invalid(parser, QStringLiteral("fixed-length"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("flush-timeout"))) {
+        settings->framing.flushTimeout = parser.value(QStringLiteral("flush-timeout")).toInt(&ok);
+        if (!ok || settings->framing.flushTimeout <= 0)
+            return invalid(parser, QStringLiteral("flush-timeout"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("queue-limit"))) {
+        settings->queue.highWater = parser.value(QStringLiteral("queue-limit")).toInt(&ok);
+        if (!ok || settings->queue.highWater <= 0)
+            return invalid(parser, QStringLiteral("queue-limit"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("queue-policy"))
+        && !BridgeSettings::parseQueuePolicy(parser.value(QStringLiteral("queue-policy")), &settings->queue.policy))
+        return invalid(parser, QStringLiteral("queue-policy"), errorString);
+    if (parser.isSet(QStringLiteral("frame-gap"))) {
+        settings->transmit.frameGap = parser.value(QStringLiteral("frame-gap")).toInt(&ok);
+        if (!ok || settings->transmit.frameGap < 0)
+            return invalid(parser, QStringLiteral("frame-gap"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("tx-fifo"))) {
+        settings->transmit.fifoSize = parser.value(QStringLiteral("tx-fifo")).toInt(&ok);
+        if (!ok || settings->transmit.fifoSize < 0)
+            return invalid(parser, QStringLiteral("tx-fifo"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("rs485")))
+        settings->transmit.rs485 = true;
+    if (parser.isSet(QStringLiteral("rts-before"))) {
+        settings->transmit.rtsBefore = parser.value(QStringLiteral("rts-before")).toInt(&ok);
+        if (!ok || settings->transmit.rtsBefore < 0)
+            return invalid(parser, QStringLiteral("rts-before"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("rts-after"))) {
+        settings->transmit.rtsAfter = parser.value(QStringLiteral("rts-after")).toInt(&ok);
+        if (!ok || settings->transmit.rtsAfter < 0)
+            return invalid(parser, QStringLiteral("rts-after"), errorString);
+    }
+
+    if (parser.isSet(QStringLiteral("record")))
+        settings->record.path = parser.value(QStringLiteral("record"));
+    if (parser.isSet(QStringLiteral("record-segment-size"))) {
+        settings->record.segmentSize = parser.value(QStringLiteral("record-segment-size")).toLongLong(&ok);
+        if (!ok || settings->record.segmentSize < 65536)
+            return invalid(parser, QStringLiteral("record-segment-size"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("record-segments"))) {
+        settings->record.segments = parser.value(QStringLiteral("record-segments")).toInt(&ok);
+        if (!ok || settings->record.segments < 0)
+            return invalid(parser, QStringLiteral("record-segments"), errorString);
+    }
+    if (parser.isSet(QStringLiteral("trace-latency")))
+        settings->tracing.path = parser.value(QStringLiteral("trace-latency"));
+
+    return true;
+}
+
+// Read the settings of one channel: its config file, if any, then the command line
+static bool loadChannel(const QCommandLineParser &parser, const QString &configFile,
+                        BridgeSettings *settings, QString *errorString)
+{
+    BridgeSettings loaded;
+
+    // Read the config file first
+    if (!configFile.isEmpty()) {
+        QSettings store(configFile, QSettings::IniFormat);
+        if (store.status() != QSettings::NoError) {
+            *errorString = QStringLiteral("Cannot read config file %1").arg(configFile);
+            return false;
+        }
+        if (!loaded.load(store, errorString)) {
+            *errorString = QStringLiteral("%1: %2").arg(configFile, *errorString);
+            return false;
+        }
+    }
+
+    // Then let the command line override it
+    if (!applyCommandLine(parser, &loaded, errorString))
+        return false;
+
+    if (loaded.portName.isEmpty() && loaded.deviceId.isEmpty() && !loaded.pty.enabled) {
+        *errorString = QStringLiteral("No serial port given, use --port, --device-id, --pty, a config file or a profile");
+        return false;
+    }
+    *settings = loaded;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("ser2etherd"));
+    QCoreApplication::setApplicationVersion(QStringLiteral("1.0.0"));
+
+    // Describe the command line; every option overrides the config files
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Headless serial <-> UDP bridge"));
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    const QCommandLineOption configOption({QStringLiteral("c"), QStringLiteral("config")},
+                                          QStringLiteral("Run a channel with the settings from the INI <file>; repeat for more channels."),
+                                          QStringLiteral("file"));
+    const QCommandLineOption profileOption(QStringLiteral("profile"),
+                                           QStringLiteral("Run a channel with a saved profile, as the GUI saves them; repeat for more channels."),
+                                           QStringLiteral("name"));
+    const QCommandLineOption saveProfileOption(QStringLiteral("save-profile"),
+                                               QStringLiteral("Save the settings of the channel as a profile before starting it."),
+                                               QStringLiteral("name"));
+    const QCommandLineOption watchConfigOption(QStringLiteral("watch-config"),
+                                               QStringLiteral("Apply edits of the config files and profiles while running, reopening only what changed."));
+    const QCommandLineOption threadsOption(QStringLiteral("threads"),
+                                           QStringLiteral("Number of worker threads the channels are spread over."),
+                                           QStringLiteral("count"));
+    const QCommandLineOption backendOption(QStringLiteral("backend"),
+                                           QStringLiteral("I/O backend: qt, or linux for the termios/epoll fast path."),
+                                           QStringLiteral("name"));
+    const QCommandLineOption transportOption(QStringLiteral("transport"),
+                                             QStringLiteral("Network transport: udp, multicast, tcp-server or tcp-client."),
+                                             QStringLiteral("name"));
+    const QCommandLineOption multicastTtlOption(QStringLiteral("multicast-ttl"),
+                                                QStringLiteral("Time to live of multicast datagrams."),
+                                                QStringLiteral("hops"));
+    const QCommandLineOption clientQueueLimitOption(QStringLiteral("client-queue-limit"),
+                                                    QStringLiteral("Bytes a TCP peer may lag behind before its connection is dropped."),
+                                                    QStringLiteral("bytes"));
+    const QCommandLineOption portOption({QStringLiteral("p"), QStringLiteral("port")},
+                                        QStringLiteral("Serial port name, e.g. ttyUSB0."),
+                                        QStringLiteral("name"));
+    const QCommandLineOption deviceIdOption(QStringLiteral("device-id"),
+                                            QStringLiteral("Find the serial port by the device's serial number or vid:pid, also after replugging."),
+                                            QStringLiteral("id"));
+    const QCommandLineOption noReconnectOption(QStringLiteral("no-reconnect"),
+                                               QStringLiteral("Close the channel when its serial device goes away instead of waiting for it."));
+    const QCommandLineOption ptyOption(QStringLiteral("pty"),
+                                       QStringLiteral("Create a virtual serial port for applications on this host under <link>, e.g. /dev/ttyS2E0, instead of opening a port."),
+                                       QStringLiteral("link"));
+    const QCommandLineOption lineControlOption(QStringLiteral("line-control"),
+                                               QStringLiteral("Send the line settings and modem lines of a virtual port to the peer, or apply the peer's to the serial port."));
+    const QCommandLineOption baudOption({QStringLiteral("b"), QStringLiteral("baud")},
+                                        QStringLiteral("Baud rate."),
+                                        QStringLiteral("rate"));
+    const QCommandLineOption dataBitsOption(QStringLiteral("data-bits"),
+                                            QStringLiteral("Data bits: 5, 6, 7 or 8."),
+                                            QStringLiteral("bits"));
+    const QCommandLineOption parityOption(QStringLiteral("parity"),
+                                          QStringLiteral("Parity: none, even, odd, mark or space."),
+                                          QStringLiteral("parity"));
+    const QCommandLineOption stopBitsOption(QStringLiteral("stop-bits"),
+                                            QStringLiteral("Stop bits: 1, 1.5 or 2."),
+                                            QStringLiteral("bits"));
+    const QCommandLineOption flowControlOption(QStringLiteral("flow-control"),
+                                               QStringLiteral("Flow control: none, rtscts or xonxoff."),
+                                               QStringLiteral("mode"));
+    const QCommandLineOption localPortOption(QStringLiteral("local-port"),
+                                             QStringLiteral("Local UDP port to listen on."),
+                                             QStringLiteral("port"));
+    const QCommandLineOption destinationIpOption(QStringLiteral("destination-ip"),
+                                                 QStringLiteral("Destination IP address."),
+                                                 QStringLiteral("address"));
+    const QCommandLineOption destinationPortOption(QStringLiteral("destination-port"),
+                                                   QStringLiteral("Destination UDP port."),
+                                                   QStringLiteral("port"));
+    const QCommandLineOption protocolOption(QStringLiteral("protocol"),
+                                            QStringLiteral("What the bridge carries: raw, or modbus to translate Modbus TCP/UDP to RTU."),
+                                            QStringLiteral("name"));
+    const QCommandLineOption modbusTimeoutOption(QStringLiteral("modbus-timeout"),
+                                                 QStringLiteral("Time a Modbus slave may take to answer, in ms."),
+                                                 QStringLiteral("ms"));
+    const QCommandLineOption modbusCacheTtlOption(QStringLiteral("modbus-cache-ttl"),
+                                                  QStringLiteral("Time a Modbus read answer is reused, in ms; 0 disables the cache."),
+                                                  QStringLiteral("ms"));
+    const QCommandLineOption aggregateOption(QStringLiteral("aggregate"),
+                                             QStringLiteral("Pack several serial packets into one datagram; the peer needs the link codec too."));
+    const QCommandLineOption compressOption(QStringLiteral("compress"),
+                                            QStringLiteral("LZ4 compress the datagrams; the peer needs the link codec too."));
+    const QCommandLineOption codecDelayOption(QStringLiteral("codec-delay"),
+                                              QStringLiteral("Longest wait of a packet for others to share its datagram, in ms."),
+                                              QStringLiteral("ms"));
+    const QCommandLineOption codecDictionaryOption(QStringLiteral("codec-dictionary"),
+                                                   QStringLiteral("File of typical traffic to compress against, the same on both ends."),
+                                                   QStringLiteral("file"));
+    const QCommandLineOption sequenceOption(QStringLiteral("sequence"),
+                                            QStringLiteral("Number and stamp the datagrams so that the peer can count losses and restore the order."));
+    const QCommandLineOption reorderHoldOption(QStringLiteral("reorder-hold"),
+                                               QStringLiteral("Longest wait of an early datagram for the ones sent before it, in ms; 0 keeps the arrival order."),
+                                               QStringLiteral("ms"));
+    const QCommandLineOption framingOption(QStringLiteral("framing"),
+                                           QStringLiteral("Serial to UDP framing: raw, size, idle, delimiter or fixed."),
+                                           QStringLiteral("mode"));
+    const QCommandLineOption maxSizeOption(QStringLiteral("max-size"),
+                                           QStringLiteral("Maximum datagram size in bytes."),
+                                           QStringLiteral("bytes"));
+    const QCommandLineOption idleCharactersOption(QStringLiteral("idle-chars"),
+                                                  QStringLiteral("Idle gap ending a datagram, in character times."),
+                                                  QStringLiteral("chars"));
+    const QCommandLineOption delimiterOption(QStringLiteral("delimiter"),
+                                             QStringLiteral("Delimiter ending a datagram, as hex bytes."),
+                                             QStringLiteral("hex"));
+    const QCommandLineOption fixedLengthOption(QStringLiteral("fixed-length"),
+                                               QStringLiteral("Datagram length for fixed framing."),
+                                               QStringLiteral("bytes"));
+    const QCommandLineOption flushTimeoutOption(QStringLiteral("flush-timeout"),
+                                                QStringLiteral("Longest wait for a partial datagram, in ms."),
+                                                QStringLiteral("ms"));
+    const QCommandLineOption queueLimitOption(QStringLiteral("queue-limit"),
+                                              QStringLiteral("Bytes queued for the serial port before the policy applies."),
+                                              QStringLiteral("bytes"));
+    const QCommandLineOption queuePolicyOption(QStringLiteral("queue-policy"),
+                                               QStringLiteral("Serial queue policy: drop-oldest, drop-newest or pause."),
+                                               QStringLiteral("policy"));
+    const QCommandLineOption frameGapOption(QStringLiteral("frame-gap"),
+                                            QStringLiteral("Idle line kept between two frames sent to the serial port, in us."),
+                                            QStringLiteral("us"));
+    const QCommandLineOption txFifoOption(QStringLiteral("tx-fifo"),
+                                          QStringLiteral("Bytes handed to the serial driver ahead of the line, e.g. the UART FIFO size; 0 does not pace."),
+                                          QStringLiteral("bytes"));
+    const QCommandLineOption rs485Option(QStringLiteral("rs485"),
+                                         QStringLiteral("Raise RTS while a frame is sent, for the direction of an RS-485 transceiver."));
+    const QCommandLineOption rtsBeforeOption(QStringLiteral("rts-before"),
+                                             QStringLiteral("Time from raising RTS to the first bit of a frame, in us."),
+                                             QStringLiteral("us"));
+    const QCommandLineOption rtsAfterOption(QStringLiteral("rts-after"),
+                                            QStringLiteral("Time from the last bit of a frame to dropping RTS, in us."),
+                                            QStringLiteral("us"));
+    const QCommandLineOption statsIntervalOption(QStringLiteral("stats-interval"),
+                                                 QStringLiteral("Print the counters of every channel as a JSON line to stdout every given seconds."),
+                                                 QStringLiteral("seconds"));
+    const QCommandLineOption recordOption(QStringLiteral("record"),
+                                          QStringLiteral("Record a binary trace of both directions; segments are numbered after <file>."),
+                                          QStringLiteral("file"));
+    const QCommandLineOption recordSegmentSizeOption(QStringLiteral("record-segment-size"),
+                                                     QStringLiteral("Bytes per trace segment before rotating."),
+                                                     QStringLiteral("bytes"));
+    const QCommandLineOption recordSegmentsOption(QStringLiteral("record-segments"),
+                                                  QStringLiteral("Newest trace segments kept, 0 keeps them all."),
+                                                  QStringLiteral("count"));
+    const QCommandLineOption traceLatencyOption(QStringLiteral("trace-latency"),
+                                                QStringLiteral("Trace the latency of every stage of every packet; a .json <file> is Chrome trace JSON, anything else binary."),
+                                                QStringLiteral("file"));
+    parser.addOptions({configOption, profileOption, saveProfileOption, watchConfigOption, threadsOption, statsIntervalOption, backendOption, portOption, deviceIdOption, noReconnectOption, ptyOption, lineControlOption, baudOption, dataBitsOption, parityOption,
+                       stopBitsOption, flowControlOption, localPortOption,
+                       destinationIpOption, destinationPortOption,
+                       transportOption, multicastTtlOption, clientQueueLimitOption,
+                       protocolOption, modbusTimeoutOption, modbusCacheTtlOption,
+                       aggregateOption, compressOption, codecDelayOption, codecDictionaryOption,
+                       sequenceOption, reorderHoldOption,
+                       framingOption, maxSizeOption, idleCharactersOption,
+                       delimiterOption, fixedLengthOption, flushTimeoutOption,
+                       queueLimitOption, queuePolicyOption,
+                       frameGapOption, txFifoOption, rs485Option, rtsBeforeOption, rtsAfterOption,
+                       recordOption, recordSegmentSizeOption, recordSegmentsOption, traceLatencyOption});
+    parser.process(a);
+
+    // Every config file is one channel; without one, the command line alone
+    // describes a single channel
+    QStringList configFiles = parser.values(configOption);
+    const QStringList profiles = parser.values(profileOption);
+    for (const QString &profile : profiles) {
+        if (!Profiles::isValidName(profile) || !QFileInfo::exists(Profiles::path(profile)))
+            return fail(QStringLiteral("There is no profile \"%1\" in %2").arg(profile, Profiles::directory()));
+        configFiles.append(Profiles::path(profile));
+    }
+    if (configFiles.isEmpty())
+        configFiles.append(QString());
+
+    QVector<BridgeSettings> channels;
+    QString errorString;
+    for (const QString &configFile : qAsConst(configFiles)) {
+        BridgeSettings settings;
+        if (!loadChannel(parser, configFile, &settings, &errorString))
+            return fail(errorString);
+        channels.append(settings);
+    }
+
+    // Keep the effective settings of the channel as a profile for the GUI or the next run
+    if (parser.isSet(saveProfileOption)) {
+        if (channels.size() != 1)
+            return fail(QStringLiteral("--save-profile takes one channel"));
+        if (!Profiles::save(parser.value(saveProfileOption), channels.first(), &errorString))
+            return fail(errorString);
+    }
+
+    // Channels recording into the same files would corrupt each other's trace
+    if (parser.isSet(recordOption) && channels.size() > 1)
+        return fail(QStringLiteral("--record takes one channel, set record/path in each config file instead"));
+
+    // Spread the channels over the worker threads
+    int threadCount = qMin(channels.size(), QThread::idealThreadCount());
+    if (parser.isSet(threadsOption)) {
+        bool ok = false;
+        threadCount = parser.value(threadsOption).toInt(&ok);
+        if (!ok || threadCount <= 0)
+            return fail(QStringLiteral("Invalid thread count %1").arg(parser.value(threadsOption)));
+    }
+    BridgeManager manager(threadCount);
+
+    int statsInterval = 0;
+    if (parser.isSet(statsIntervalOption)) {
+        bool ok = false;
+        statsInterval = parser.value(statsIntervalOption).toInt(&ok);
+        if (!ok || statsInterval <= 0)
+            return fail(QStringLiteral("Invalid statistics interval %1").arg(parser.value(statsIntervalOption)));
+    }
+
+    // Leave with an error once no channel is running any more, so that a
+    // supervisor can restart us; the state is kept per engine, as a reloaded
+    // channel may report being opened again or failing to
+    QSet<BridgeEngine *> pendingChannels;
+    QSet<BridgeEngine *> runningChannels;
+    bool stopping = false;
+    auto checkRunning = [&pendingChannels, &runningChannels, &stopping] {
+        if (!stopping && pendingChannels.isEmpty() && runningChannels.isEmpty())
+            QCoreApplication::exit(1);
+    };
+
+    for (const BridgeSettings &settings : qAsConst(channels)) {
+        BridgeEngine *engine = manager.addChannel();
+        const QByteArray channel = channelName(settings).toLocal8Bit();
+
+        // Print the engine messages tagged with the channel
+        QObject::connect(engine, &BridgeEngine::infoMessage, &a, [channel](const QString &message) {
+            std::fprintf(stderr, "[INFO] %s: %s\n", channel.constData(), qPrintable(message));
+        });
+        QObject::connect(engine, &BridgeEngine::errorMessage, &a, [channel](const QString &message) {
+            std::fprintf(stderr, "[ERROR] %s: %s\n", channel.constData(), qPrintable(message));
+        });
+
+        // Keep track of the channels that are up
+        pendingChannels.insert(engine);
+        QObject::connect(engine, &BridgeEngine::bridgeOpened, &a, [&, engine, channel] {
+            pendingChannels.remove(engine);
+            runningChannels.insert(engine);
+            std::fprintf(stderr, "[INFO] %s: Serial port opened\n", channel.constData());
+        });
+        QObject::connect(engine, &BridgeEngine::bridgeOpenFailed, &a, [&, engine] {
+            pendingChannels.remove(engine);
+            runningChannels.remove(engine);
+            checkRunning();
+        });
+        QObject::connect(engine, &BridgeEngine::bridgeClosed, &a, [&, engine] {
+            runningChannels.remove(engine);
+            checkRunning();
+        });
+
+        manager.openChannel(engine, settings);
+    }
+
+    // Follow edits of the config files; a changed channel keeps running and
+    // only reopens the parts whose settings changed
+    QFileSystemWatcher configWatcher;
+    if (parser.isSet(watchConfigOption)) {
+        for (const QString &configFile : qAsConst(configFiles)) {
+            if (!configFile.isEmpty())
+                configWatcher.addPath(configFile);
+        }
+        QObject::connect(&configWatcher, &QFileSystemWatcher::fileChanged, &a, [&](const QString &changed) {
+            // Editors replace the file rather than write it, which ends the watch
+            if (!configWatcher.files().contains(changed))
+                configWatcher.addPath(changed);
+
+            for (int i = 0; i < configFiles.size(); ++i) {
+                if (configFiles.at(i) != changed)
+                    continue;
+                BridgeSettings settings;
+                QString reloadError;
+                if (!loadChannel(parser, changed, &settings, &reloadError)) {
+                    std::fprintf(stderr, "[ERROR] %s: %s, keeping the running settings\n",
+                                 qPrintable(channelName(channels.at(i))), qPrintable(reloadError));
+                    continue;
+                }
+                channels[i] = settings;
+                manager.reconfigureChannel(manager.channels().at(i), settings);
+            }
+        });
+    }
+
+    // Dump the counters periodically for monitoring tools; the counters are
+    // atomics, so they are read here without bothering the worker threads
+    QTimer statsTimer;
+    if (statsInterval > 0) {
+        QObject::connect(&statsTimer, &QTimer::timeout, &a, [&manager, &channels] {
+            for (int i = 0; i < channels.size(); ++i) {
+                const BridgeStats &stats = manager.channels().at(i)->statistics();
+                const QByteArray line = stats.snapshot().toJson(channelName(channels.at(i)));
+                std::fprintf(stdout, "%s\n", line.constData());
+            }
+            std::fflush(stdout);
+        });
+        statsTimer.start(statsInterval * 1000);
+    }
+
+    // Close the channels on their threads before leaving, which stops the
+    // trace recorders and flushes the latency traces; a channel closing now
+    // is no reason to exit with an error
+    QObject::connect(&a, &QCoreApplication::aboutToQuit, [&manager, &stopping] {
+        stopping = true;
+        for (BridgeEngine *engine : manager.channels())
+            QMetaObject::invokeMethod(engine, &BridgeEngine::closeBridge, Qt::BlockingQueuedConnection);
+    });
+#ifdef Q_OS_UNIX
+    if (!watchStopSignals(&a))
+        std::fprintf(stderr, "[ERROR] Cannot watch for SIGTERM and SIGINT, stopping will not close the channels\n");
+#endif
+
+    return a.exec();
+}
@@ -0,0 +1,129 @@
+#include "framering.h"
+
+
+// This function is called to size the ring; the only place it allocates
+void FrameRing::reset(int capacity, int maxFrames)
+{
+    if (capacity != storageSize) {
+        storage.reset(new char[capacity]);
+        storageSize = capacity;
+        ++allocations;
+    }
+    if (maxFrames != frameTableSize) {
+        frameTable.reset(new Frame[maxFrames]);
+        frameTableSize = maxFrames;
+        ++allocations;
+    }
+    clear();
+}
+
+// This function is called to size the ring so that a frame of up to
+// maxFrameSize bytes is never refused while less than limit bytes are queued.
+// The partly written oldest frame may hold up to one frame more than bytes()
+// counts, and free space split at the wrap point needs two frames more to
+// keep one of its parts large enough. Every frame has at least one byte, so
+// there can be no more frames than bytes.
+void FrameRing::resetForLimit(int limit, int maxFrameSize)
+{
+    reset(limit + 3 * maxFrameSize, limit + 1);
+}
+
+// This function is called to drop all the frames
+void FrameRing::clear()
+{
+    frameHead = 0;
+    frameCount = 0;
+    headConsumed = 0;
+    queuedBytes = 0;
+    reservedOffset = -1;
+}
+
+// This function is called to get contiguous space for the next frame
+char *FrameRing::reserve(int size)
+{
+    reservedOffset = -1;
+    if (frameCount == frameTableSize || size > storageSize)
+        return nullptr;
+
+    // An empty ring starts over at the beginning
+    if (frameCount == 0) {
+        reservedOffset = 0;
+        return storage.get();
+    }
+
+    const Frame &first = frameTable[frameHead];
+    const Frame &last = frameTable[(frameHead + frameCount - 1) % frameTableSize];
+    const int tail = last.offset + last.size;
+
+    if (last.offset >= first.offset) {
+        // Free space is [tail, end) and [0, first)
+        if (storageSize - tail >= size)
+            reservedOffset = tail;
+        else if (first.offset >= size)
+            reservedOffset = 0;
+    } else {
+        // Already wrapped, free space is [tail, first)
+        if (first.offset - tail >= size)
+            reservedOffset = tail;
+    }
+
+    return reservedOffset == -1 ? nullptr : storage.get() + reservedOffset;
+}
+
+// This function is called to publish the frame written into the reserved space
+void FrameRing::commit(int size, qint64 stamp)
+{
+    Q_ASSERT(reservedOffset != -1);
+
+    frameTable[(frameHead + frameCount) % frameTableSize] = {reservedOffset, size, stamp};
+    ++frameCount;
+    queuedBytes += size;
+    reservedOffset = -1;
+}
+
+// This function is called to get the unconsumed bytes of the oldest frame
+const char *FrameRing::head(int *size) const
+{
+    if (frameCount == 0) {
+        *size = 0;
+        return nullptr;
+    }
+
+    const Frame &first = frameTable[frameHead];
+    *size = first.size - headConsumed;
+    return storage.get() + first.offset + headConsumed;
+}
+
+// This function is called to get the stamp the oldest frame was committed with
+qint64 FrameRing::headStamp() const
+{
+    return frameCount == 0 ? 0 : frameTable[frameHead].stamp;
+}
+
+// This function is called once bytes of the oldest frame have been written out
+void FrameRing::consume(int size)
+{
+    headConsumed += size;
+    queuedBytes -= size;
+    if (headConsumed >= frameTable[frameHead].size)
+        popFront();
+}
+
+// This function is called to discard the oldest frame; returns its dropped bytes
+int FrameRing::dropFront()
+{
+    const int dropped = frameTable[frameHead].size - headConsumed;
+    queuedBytes -= dropped;
+    popFront();
+    return dropped;
+}
+
+// This function is called to remove the oldest frame from the table
+void FrameRing::popFront()
+{
+    frameHead = (frameHead + 1) % frameTableSize;
+    --frameCount;
+    headConsumed = 0;
+    if (frameCount == 0)
+        frameHead = 0;
+}
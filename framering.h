@@ -0,0 +1,63 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <QtGlobal>
+
+#include <memory>
+
+// Preallocated ring of variable-sized frames. Producers reserve contiguous
+// space and read straight into it, consumers write straight out of it, and
+// nothing is allocated once the ring has been sized.
+class FrameRing
+{
+public:
+    FrameRing() = default;
+
+    void reset(int capacity, int maxFrames);
+    void resetForLimit(int limit, int maxFrameSize);
+    void clear();
+
+    // Contiguous space for a frame of up to size bytes, or nullptr when full;
+    // commit() publishes the frame with the number of bytes actually used and
+    // a caller defined stamp, such as its arrival time
+    char *reserve(int size);
+    void commit(int size, qint64 stamp = 0);
+
+    bool isEmpty() const { return frameCount == 0; }
+    int frames() const { return frameCount; }
+    qint64 bytes() const { return queuedBytes; }
+
+    // Unconsumed part of the oldest frame; consume() takes bytes off it and
+    // dropFront() discards the rest of it
+    const char *head(int *size) const;
+    qint64 headStamp() const;
+    bool headStarted() const { return headConsumed != 0; }
+    void consume(int size);
+    int dropFront();
+
+    quint64 allocationCount() const { return allocations; }
+
+private:
+    struct Frame {
+        int offset;
+        int size;
+        qint64 stamp;
+    };
+
+    void popFront();
+
+    std::unique_ptr<char[]> storage;
+    std::unique_ptr<Frame[]> frameTable;
+    int storageSize = 0;
+    int frameTableSize = 0;
+
+    int frameHead = 0;
+    int frameCount = 0;
+    int headConsumed = 0;
+    qint64 queuedBytes = 0;
+
+    int reservedOffset = -1;
+    quint64 allocations = 0;
+};
+
+#endif // FRAMERING_H
@@ -0,0 +1,63 @@
+#ifndef LATENCYTRACE_H
+#define LATENCYTRACE_H
+
+#include <QtGlobal>
+
+// Stages of the latency trace and its binary file layout. Every event is
+// one stage one chunk, packet or datagram went through, from start to end
+// on the monotonic clock of BridgeStats::now(). The per-direction totals
+// span the stages of their packet, so a timeline shows them nested.
+//
+// A binary trace is a FileHeader followed by Events, in host byte order
+// like the packet trace in tracefile.h.
+namespace LatencyTrace {
+
+constexpr char Magic[8] = {'S', '2', 'E', 'L', 'A', 'T', 'E', 'N'};
+constexpr quint16 Version = 1;
+
+enum Stage : quint8 {
+    // Serial to network
+    SerialRead,         // readyRead, or the previous read, until read() returned; per chunk
+    Framing,            // first byte of a packet read until the packetizer emitted it
+    NetworkSend,        // writeDatagram() call, per datagram
+    SerialToNetwork,    // first byte of a datagram read until it was sent
+
+    // Network to serial
+    NetworkRead,        // readyRead, or the previous read, until the datagram was read
+    SerialQueue,        // datagram queued until the write() of its last byte
+    SerialWrite,        // write() call, per call
+    SerialDrain,        // write() returned until the backend reported the bytes written
+    NetworkToSerial,    // datagram read until its last byte went to write()
+
+    StageCount
+};
+
+struct FileHeader {
+    char magic[8];
+    quint16 version;
+    quint16 headerSize;     // events start here, newer versions may grow the header
+    quint16 eventSize;      // bytes per event, likewise
+    quint16 reserved;
+    qint64 startTime;       // ms since the epoch when the trace started
+    qint64 startStamp;      // monotonic ns at the same moment
+};
+
+struct Event {
+    qint64 start;           // monotonic ns
+    qint64 end;
+    quint32 size;           // bytes of the chunk, packet or datagram
+    quint8 stage;
+    quint8 reserved[3];
+};
+
+static_assert(sizeof(FileHeader) == 32, "the latency trace header layout is fixed");
+static_assert(sizeof(Event) == 24, "the latency trace event layout is fixed");
+
+inline bool isSerialToNetwork(Stage stage) { return stage < NetworkRead; }
+
+// Name of a stage in the Chrome trace and in the reports
+const char *stageName(Stage stage);
+
+} // namespace LatencyTrace
+
+#endif // LATENCYTRACE_H
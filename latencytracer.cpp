@@ -0,0 +1,238 @@
+#include "latencytracer.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QThread>
+
+#include <cstring>
+
+namespace {
+
+// Timeline rows of the Chrome trace, one per direction
+constexpr int SerialToNetworkRow = 1;
+constexpr int NetworkToSerialRow = 2;
+
+// Function to append a monotonic stamp as us since the start of the trace
+void appendMicroseconds(QByteArray &json, qint64 nanoseconds)
+{
+    json += QByteArray::number(double(nanoseconds) / 1000.0, 'f', 3);
+}
+
+} // namespace
+
+const char *LatencyTrace::stageName(Stage stage)
+{
+    switch (stage) {
+    case SerialRead:
+        return "serial read";
+    case Framing:
+        return "framing";
+    case NetworkSend:
+        return "network send";
+    case SerialToNetwork:
+        return "serial to network";
+    case NetworkRead:
+        return "network read";
+    case SerialQueue:
+        return "serial queue";
+    case SerialWrite:
+        return "serial write";
+    case SerialDrain:
+        return "serial drain";
+    case NetworkToSerial:
+        return "network to serial";
+    case StageCount:
+        break;
+    }
+    return "unknown";
+}
+
+
+LatencyTracer::LatencyTracer(QObject *parent)
+    : QObject(parent)
+{
+}
+
+LatencyTracer::~LatencyTracer()
+{
+    stop();
+}
+
+// This function is called on the engine thread when the bridge opens with a latency trace path
+bool LatencyTracer::start(const QString &path, QString *errorString)
+{
+    stop();
+
+    chromeFormat = path.endsWith(QLatin1String(".json"), Qt::CaseInsensitive);
+    startTime = QDateTime::currentMSecsSinceEpoch();
+    startStamp = BridgeStats::now();
+
+    // Open the file here so that a bad path is reported right away
+    traceFile.setFileName(path);
+    if (!traceFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered) || !writeHeader()) {
+        *errorString = traceFile.errorString();
+        traceFile.close();
+        return false;
+    }
+
+    // The ring is only allocated while tracing
+    if (!ring)
+        ring.reset(new LatencyTrace::Event[RingEvents]);
+    writePosition.store(0, std::memory_order_relaxed);
+    readPosition.store(0, std::memory_order_relaxed);
+    dropped.store(0, std::memory_order_relaxed);
+    stopRequested.store(false, std::memory_order_relaxed);
+    std::memset(durations, 0, sizeof(durations));
+
+    writer = QThread::create([this] { writeLoop(); });
+    writer->setObjectName(QStringLiteral("latency-writer"));
+    writer->start();
+
+    tracing = true;
+    return true;
+}
+
+// This function is called on the engine thread to write out what is left and stop
+void LatencyTracer::stop()
+{
+    if (!writer)
+        return;
+
+    tracing = false;
+    stopRequested.store(true, std::memory_order_release);
+    writer->wait();
+    delete writer;
+    writer = nullptr;
+}
+
+// This function is called on the engine thread with every stage while tracing
+void LatencyTracer::trace(LatencyTrace::Stage stage, qint64 start, qint64 end, int size)
+{
+    const quint64 duration = quint64(qMax<qint64>(0, end - start)) / 1000;
+    ++durations[stage][BridgeStats::bucketOf(duration, BridgeStats::LatencyBuckets)];
+
+    // Drop the event rather than wait when the writer is behind
+    const quint64 write = writePosition.load(std::memory_order_relaxed);
+    if (write - readPosition.load(std::memory_order_acquire) == RingEvents) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    LatencyTrace::Event &event = ring[write % RingEvents];
+    event.start = start;
+    event.end = end;
+    event.size = quint32(size);
+    event.stage = stage;
+    std::memset(event.reserved, 0, sizeof(event.reserved));
+    writePosition.store(write + 1, std::memory_order_release);
+}
+
+quint64 LatencyTracer::percentile(LatencyTrace::Stage stage, double fraction) const
+{
+    return BridgeStats::percentile(durations[stage], BridgeStats::LatencyBuckets, fraction);
+}
+
+quint64 LatencyTracer::eventCount(LatencyTrace::Stage stage) const
+{
+    quint64 count = 0;
+    for (int i = 0; i < BridgeStats::LatencyBuckets; ++i)
+        count += durations[stage][i];
+    return count;
+}
+
+// This function runs on the writer thread until stop() and the ring is empty
+void LatencyTracer::writeLoop()
+{
+    // Reserved once, the JSON buffer keeps its capacity from batch to batch
+    if (chromeFormat)
+        json.reserve(JsonReserve);
+
+    for (;;) {
+        // Look at the stop flag first so that nothing published before it is lost
+        const bool stopping = stopRequested.load(std::memory_order_acquire);
+        const quint64 read = readPosition.load(std::memory_order_relaxed);
+        const quint64 write = writePosition.load(std::memory_order_acquire);
+        if (read == write) {
+            if (stopping)
+                break;
+            QThread::msleep(WriterIdleMs);
+            continue;
+        }
+
+        // Everything that accumulated goes out in at most two batches, the
+        // second one only when it wraps around the end of the ring
+        const quint64 offset = read % RingEvents;
+        const int first = int(qMin(write - read, RingEvents - offset));
+        const int second = int(write - read) - first;
+        if (!writeEvents(ring.get() + offset, first) || (second > 0 && !writeEvents(ring.get(), second))) {
+            emit errorMessage(tr("Latency trace stopped, cannot write %1: %2")
+                                  .arg(traceFile.fileName(), traceFile.errorString()));
+            break;
+        }
+        readPosition.store(write, std::memory_order_release);
+    }
+
+    // Close the event array of a Chrome trace
+    if (chromeFormat)
+        traceFile.write("\n]\n");
+    traceFile.close();
+}
+
+// This function is called to start the file: the binary header, or the
+// names of the process and of the timeline rows of a Chrome trace
+bool LatencyTracer::writeHeader()
+{
+    if (chromeFormat) {
+        const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+        QByteArray header = "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + pid
+                            + ",\"args\":{\"name\":\"ser2ether\"}},\n";
+        header += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":"
+                  + QByteArray::number(SerialToNetworkRow) + ",\"args\":{\"name\":\"serial to network\"}},\n";
+        header += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":"
+                  + QByteArray::number(NetworkToSerialRow) + ",\"args\":{\"name\":\"network to serial\"}}";
+        return traceFile.write(header) == header.size();
+    }
+
+    LatencyTrace::FileHeader header;
+    std::memcpy(header.magic, LatencyTrace::Magic, sizeof(header.magic));
+    header.version = LatencyTrace::Version;
+    header.headerSize = sizeof(header);
+    header.eventSize = sizeof(LatencyTrace::Event);
+    header.reserved = 0;
+    header.startTime = startTime;
+    header.startStamp = startStamp;
+    return traceFile.write(reinterpret_cast<const char *>(&header), sizeof(header)) == qint64(sizeof(header));
+}
+
+// This function is called on the writer thread to write a batch of events
+bool LatencyTracer::writeEvents(const LatencyTrace::Event *events, int count)
+{
+    // The binary format is the ring as it is
+    if (!chromeFormat) {
+        const qint64 size = qint64(count) * qint64(sizeof(LatencyTrace::Event));
+        return traceFile.write(reinterpret_cast<const char *>(events), size) == size;
+    }
+
+    // Complete events with the time since the start of the trace, each after
+    // the comma that ends the one before; truncating keeps the reserved buffer
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    json.truncate(0);
+    for (int i = 0; i < count; ++i) {
+        const LatencyTrace::Event &event = events[i];
+        const LatencyTrace::Stage stage = LatencyTrace::Stage(event.stage);
+        json += ",\n{\"name\":\"";
+        json += LatencyTrace::stageName(stage);
+        json += "\",\"ph\":\"X\",\"pid\":";
+        json += pid;
+        json += ",\"tid\":";
+        json += QByteArray::number(LatencyTrace::isSerialToNetwork(stage) ? SerialToNetworkRow : NetworkToSerialRow);
+        json += ",\"ts\":";
+        appendMicroseconds(json, event.start - startStamp);
+        json += ",\"dur\":";
+        appendMicroseconds(json, event.end - event.start);
+        json += ",\"args\":{\"bytes\":";
+        json += QByteArray::number(event.size);
+        json += "}}";
+    }
+    return traceFile.write(json) == json.size();
+}
@@ -0,0 +1,79 @@
+#ifndef LATENCYTRACER_H
+#define LATENCYTRACER_H
+
+#include "bridgestats.h"
+#include "latencytrace.h"
+
+#include <QFile>
+#include <QObject>
+
+#include <atomic>
+#include <memory>
+
+class QThread;
+
+// Writes the per-stage latency trace of a channel (see latencytrace.h). The
+// engine thread only stores fixed-size events into a single-producer,
+// single-consumer ring, which costs two stores and a release; a writer
+// thread turns what accumulated into Chrome trace JSON (a path ending in
+// .json, for chrome://tracing or Perfetto) or appends it to the binary file
+// as is. The engine thread also keeps a histogram per stage for the report.
+class LatencyTracer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LatencyTracer(QObject *parent = nullptr);
+    ~LatencyTracer();
+
+    // Engine thread only; the hot path checks isEnabled() and nothing else
+    // while nothing is traced
+    bool isEnabled() const { return tracing; }
+    bool start(const QString &path, QString *errorString);
+    void stop();
+    void trace(LatencyTrace::Stage stage, qint64 start, qint64 end, int size);
+
+    // Duration of a stage in us below which the given fraction of its
+    // events fell, and how many there were, since start()
+    quint64 percentile(LatencyTrace::Stage stage, double fraction) const;
+    quint64 eventCount(LatencyTrace::Stage stage) const;
+
+    // Events lost because the writer fell behind, since start()
+    quint64 droppedEvents() const { return dropped.load(std::memory_order_relaxed); }
+
+signals:
+    // Emitted from the writer thread
+    void errorMessage(const QString &message);
+
+private:
+    static constexpr quint64 RingEvents = 65536;
+
+    // How long the writer sleeps when the ring was empty
+    static constexpr unsigned long WriterIdleMs = 10;
+
+    // Initial capacity of the JSON buffer, about a thousand events
+    static constexpr int JsonReserve = 128 * 1024;
+
+    void writeLoop();
+    bool writeHeader();
+    bool writeEvents(const LatencyTrace::Event *events, int count);
+
+    bool tracing = false;
+    bool chromeFormat = false;
+    qint64 startTime = 0;
+    qint64 startStamp = 0;
+    quint64 durations[LatencyTrace::StageCount][BridgeStats::LatencyBuckets] = {};
+
+    std::unique_ptr<LatencyTrace::Event[]> ring;
+    std::atomic<quint64> writePosition{0};
+    std::atomic<quint64> readPosition{0};
+    std::atomic<quint64> dropped{0};
+
+    // Writer thread only
+    QThread *writer = nullptr;
+    std::atomic<bool> stopRequested{false};
+    QFile traceFile;
+    QByteArray json;
+};
+
+#endif // LATENCYTRACER_H
@@ -0,0 +1,489 @@
+#include "linkcodec.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QtEndian>
+
+#include <climits>
+#include <cstring>
+
+namespace {
+
+// Records smaller than this rarely get any smaller
+constexpr int MinCompressSize = 32;
+
+int varintSize(quint32 value)
+{
+    int size = 1;
+    for (; value >= 0x80; value >>= 7)
+        ++size;
+    return size;
+}
+
+char *writeVarint(char *out, quint32 value)
+{
+    for (; value >= 0x80; value >>= 7)
+        *out++ = char((value & 0x7f) | 0x80);
+    *out++ = char(value);
+    return out;
+}
+
+// Function to read a varint of at most 32 bits
+bool readVarint(const char *&in, const char *end, quint32 *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (in == end)
+            return false;
+        const quint8 byte = quint8(*in++);
+        *value |= quint32(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+
+// Function to read the dictionary file of the codec
+bool LinkCodec::loadDictionary(const QString &path, QByteArray *dictionary, QString *errorString)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorString)
+            *errorString = file.errorString();
+        return false;
+    }
+    *dictionary = file.readAll();
+    if (dictionary->size() > Lz4::MaxDistance)
+        *dictionary = dictionary->right(Lz4::MaxDistance);
+    return true;
+}
+
+// Function to write the line state datagram of a virtual port
+void LinkCodec::encodeLineState(const SerialLineState &state, char *out)
+{
+    std::memcpy(out, Magic, sizeof(Magic));
+    out[3] = char((Version << 4) | LineControl);
+    qToLittleEndian<quint32>(quint32(state.baudRate), out + 4);
+    out[8] = char(state.dataBits);
+    out[9] = char(state.parity);
+    out[10] = char(state.stopBits);
+    out[11] = char(state.flowControl);
+    out[12] = char((state.dataTerminalReady ? 0x01 : 0) | (state.requestToSend ? 0x02 : 0)
+                   | (state.hasDataFormat ? 0x04 : 0));
+}
+
+// Function to read a line state datagram; anything else, including values
+// out of range, is left to the data path
+bool LinkCodec::decodeLineState(const char *data, int size, SerialLineState *state)
+{
+    if (size != LineStateSize || std::memcmp(data, Magic, sizeof(Magic)) != 0
+        || quint8(data[3]) != quint8((Version << 4) | LineControl))
+        return false;
+
+    const quint32 baudRate = qFromLittleEndian<quint32>(data + 4);
+    const int dataBits = quint8(data[8]);
+    const int parity = quint8(data[9]);
+    const int stopBits = quint8(data[10]);
+    const int flowControl = quint8(data[11]);
+    const quint8 lines = quint8(data[12]);
+    if (baudRate > quint32(INT_MAX) || dataBits < QSerialPort::Data5 || dataBits > QSerialPort::Data8
+        || parity == 1 || parity > QSerialPort::MarkParity
+        || stopBits < QSerialPort::OneStop || stopBits > QSerialPort::OneAndHalfStop
+        || flowControl > QSerialPort::SoftwareControl || (lines & ~0x07) != 0)
+        return false;
+
+    state->baudRate = qint32(baudRate);
+    state->dataBits = QSerialPort::DataBits(dataBits);
+    state->parity = QSerialPort::Parity(parity);
+    state->stopBits = QSerialPort::StopBits(stopBits);
+    state->flowControl = QSerialPort::FlowControl(flowControl);
+    state->dataTerminalReady = (lines & 0x01) != 0;
+    state->requestToSend = (lines & 0x02) != 0;
+    state->hasDataFormat = (lines & 0x04) != 0;
+    return true;
+}
+
+
+LinkEncoder::LinkEncoder(QObject *parent)
+    : QObject(parent)
+{
+    // Fires when the oldest packet has waited for the aggregation delay
+    delayTimer = new QTimer(this);
+    delayTimer->setSingleShot(true);
+    delayTimer->setTimerType(Qt::PreciseTimer);
+    connect(delayTimer, &QTimer::timeout, this, &LinkEncoder::flush);
+}
+
+// This function is called to apply the codec settings when the bridge opens
+void LinkEncoder::configure(const BridgeSettings::Codec &newCodec, const QByteArray &dictionary)
+{
+    clear();
+    codec = newCodec;
+    headerSize = LinkCodec::HeaderSize + (codec.sequence ? LinkCodec::SequenceSize : 0);
+    codec.maxSize = qMax(headerSize + 1, codec.maxSize);
+    nextSequence = 0;
+    delayTimer->setInterval(qMax(0, codec.maxDelay));
+    compressor.setDictionary(dictionary.constData(), dictionary.size());
+    count = Counters();
+
+    // Reserve a full datagram plus one large packet up front
+    records.reserve(codec.maxSize + LinkCodec::MaxPayloadSize);
+    datagram.reserve(headerSize + 5 + Lz4::compressBound(codec.maxSize + LinkCodec::MaxPayloadSize));
+}
+
+// This function is called with every packet for the network side
+void LinkEncoder::append(const char *data, int size, qint64 readTime)
+{
+    // Send what is waiting first if the packet would not fit beside it
+    const int recordSize = varintSize(quint32(size)) + size;
+    if (!records.isEmpty() && headerSize + records.size() + recordSize > codec.maxSize)
+        flush();
+
+    // The delay and the read time belong to the oldest packet
+    if (records.isEmpty()) {
+        recordsTime = readTime;
+        if (codec.aggregate)
+            delayTimer->start();
+    }
+
+    char length[5];
+    records.append(length, int(writeVarint(length, quint32(size)) - length));
+    records.append(data, size);
+    ++count.packets;
+    count.payloadBytes += quint64(size);
+
+    // Without aggregation every packet is a datagram of its own
+    if (!codec.aggregate || headerSize + records.size() >= codec.maxSize)
+        flush();
+}
+
+// This slot is called to send the waiting packets as one datagram
+void LinkEncoder::flush()
+{
+    delayTimer->stop();
+    if (records.isEmpty())
+        return;
+
+    // Compress only when it pays off, the header included
+    quint8 flags = quint8(LinkCodec::Version << 4);
+    datagram.resize(headerSize);
+    if (codec.compress && records.size() >= MinCompressSize) {
+        const int sizeBytes = varintSize(quint32(records.size()));
+        datagram.resize(headerSize + sizeBytes + Lz4::compressBound(records.size()));
+        char *out = writeVarint(datagram.data() + headerSize, quint32(records.size()));
+        const int compressed = compressor.compress(records.constData(), records.size(), out,
+                                                   records.size() - sizeBytes - 1);
+        if (compressed > 0) {
+            flags |= LinkCodec::Compressed;
+            datagram.resize(headerSize + sizeBytes + compressed);
+        } else {
+            datagram.resize(headerSize);
+        }
+    }
+    if (!(flags & LinkCodec::Compressed))
+        datagram.append(records);
+    std::memcpy(datagram.data(), LinkCodec::Magic, sizeof(LinkCodec::Magic));
+
+    // The send time only has to be on one clock for the jitter, so the low
+    // 32 bits of the monotonic clock do
+    if (codec.sequence) {
+        flags |= LinkCodec::Sequenced;
+        qToLittleEndian<quint32>(nextSequence++, datagram.data() + LinkCodec::HeaderSize);
+        qToLittleEndian<quint32>(quint32(BridgeStats::now() / 1000), datagram.data() + LinkCodec::HeaderSize + 4);
+    }
+    datagram[3] = char(flags);
+
+    // Keep the reserved capacity
+    records.resize(0);
+    ++count.datagrams;
+    count.wireBytes += quint64(datagram.size());
+    emit datagramReady(datagram.constData(), datagram.size(), recordsTime);
+}
+
+// This function is called to drop the waiting packets
+void LinkEncoder::clear()
+{
+    delayTimer->stop();
+    records.resize(0);
+}
+
+
+LinkDecoder::LinkDecoder()
+{
+    payload.reserve(LinkCodec::MaxPayloadSize);
+}
+
+void LinkDecoder::setDictionary(const QByteArray &newDictionary)
+{
+    dictionary = newDictionary.right(Lz4::MaxDistance);
+}
+
+// Function to split a datagram into its packets
+LinkDecoder::Result LinkDecoder::decode(const char *data, int size)
+{
+    decoded.clear();
+    sequenced = false;
+
+    // Anything without our header, or with flags we do not know, is a raw packet
+    if (size < LinkCodec::HeaderSize || std::memcmp(data, LinkCodec::Magic, sizeof(LinkCodec::Magic)) != 0)
+        return RawDatagram;
+    const quint8 flags = quint8(data[3]);
+    if ((flags >> 4) != LinkCodec::Version || (flags & 0x0f & ~(LinkCodec::Compressed | LinkCodec::Sequenced)) != 0)
+        return RawDatagram;
+
+    const char *in = data + LinkCodec::HeaderSize;
+    const char *end = data + size;
+    if (flags & LinkCodec::Sequenced) {
+        if (end - in < LinkCodec::SequenceSize)
+            return Corrupt;
+        sequenced = true;
+        sequenceNumber = qFromLittleEndian<quint32>(in);
+        sendTimeUs = qFromLittleEndian<quint32>(in + 4);
+        in += LinkCodec::SequenceSize;
+    }
+    if (flags & LinkCodec::Compressed) {
+        quint32 rawSize;
+        if (!readVarint(in, end, &rawSize) || rawSize > quint32(LinkCodec::MaxPayloadSize))
+            return Corrupt;
+        payload.resize(int(rawSize));
+        if (Lz4::decompress(in, int(end - in), payload.data(), payload.size(),
+                            dictionary.constData(), dictionary.size()) != int(rawSize))
+            return Corrupt;
+        in = payload.constData();
+        end = in + payload.size();
+    }
+
+    // Records; empty ones carry nothing and are left out
+    while (in != end) {
+        quint32 length;
+        if (!readVarint(in, end, &length) || length > quint32(end - in))
+            return Corrupt;
+        if (length != 0)
+            decoded.append({in, int(length)});
+        in += length;
+    }
+    return Decoded;
+}
+
+
+LinkReorderer::LinkReorderer(QObject *parent)
+    : QObject(parent)
+{
+    // Fires when the oldest held datagram has waited for the hold time
+    holdTimer = new QTimer(this);
+    holdTimer->setSingleShot(true);
+    holdTimer->setTimerType(Qt::PreciseTimer);
+    connect(holdTimer, &QTimer::timeout, this, &LinkReorderer::expire);
+}
+
+// This function is called to apply the codec settings when the bridge opens
+void LinkReorderer::configure(const BridgeSettings::Codec &codec, BridgeStats::Sequence *newCounters)
+{
+    counters = newCounters;
+    reordering = codec.reorderHold > 0;
+    holdTime = codec.reorderHold;
+
+    // Reserve the slots and room for a typical datagram in each; a larger
+    // one grows its slot once
+    held.resize(reordering ? qMax(1, codec.reorderWindow) : 0);
+    for (Slot &slot : held)
+        slot.data.reserve(codec.maxSize + LinkCodec::HeaderSize + LinkCodec::SequenceSize);
+    clear();
+}
+
+// This function is called to forget the stream, e.g. when the bridge closes
+void LinkReorderer::clear()
+{
+    holdTimer->stop();
+    for (Slot &slot : held)
+        slot.used = false;
+    heldCount = 0;
+    blocked = false;
+    started = false;
+    seen = 0;
+    haveTransit = false;
+    jitter = 0;
+}
+
+// This function is called with every sequenced datagram
+bool LinkReorderer::arrive(quint32 sequence, quint32 sendTime, const char *data, int size)
+{
+    // The first datagram, or one of a peer that started over, begins the stream
+    qint32 distance = qint32(sequence - expected);
+    if (!started || distance > ResyncDistance || distance < -ResyncDistance) {
+        clear();
+        started = true;
+        expected = sequence;
+        highest = sequence;
+        distance = 0;
+    }
+
+    // Behind the expected number: a copy of one that came, or one given up on
+    if (distance < 0) {
+        const int back = -distance;
+        if (back <= 64 && (seen >> (back - 1)) & 1) {
+            counters->duplicates.add();
+            return false;
+        }
+        if (back <= 64)
+            seen |= quint64(1) << (back - 1);
+        counters->late.add();
+        counters->reordered.add();
+        measureJitter(sendTime);
+
+        // Forwarding it now would put it after the ones sent later
+        return !reordering;
+    }
+
+    if (qint32(sequence - highest) < 0)
+        counters->reordered.add();
+    else
+        highest = sequence;
+
+    // Next in line
+    if (distance == 0) {
+        measureJitter(sendTime);
+        advance(true);
+        return true;
+    }
+
+    // Without reordering a gap is given up on right away
+    if (!reordering) {
+        measureJitter(sendTime);
+        counters->lost.add(quint64(distance));
+        while (distance-- > 0)
+            advance(false);
+        advance(true);
+        return true;
+    }
+
+    // Too far ahead for the window: give up on as many as it takes to make room
+    const qint64 now = BridgeStats::now();
+    while (qint32(sequence - expected) >= held.size()) {
+        Slot &slot = held[int(expected % quint32(held.size()))];
+        if (slot.used && slot.sequence == expected) {
+            slot.used = false;
+            --heldCount;
+            advance(true);
+            emit datagramReady(slot.data.constData(), slot.data.size());
+        } else {
+            counters->lost.add();
+            advance(false);
+        }
+    }
+    measureJitter(sendTime);
+    if (sequence == expected) {
+        advance(true);
+        return true;
+    }
+
+    // Hold it until the ones before it came or the hold time is up
+    Slot &slot = held[int(sequence % quint32(held.size()))];
+    if (slot.used) {
+        counters->duplicates.add();
+        return false;
+    }
+    slot.data.resize(size);
+    std::memcpy(slot.data.data(), data, size_t(size));
+    slot.sequence = sequence;
+    slot.deadline = now + qint64(holdTime) * 1000000;
+    slot.used = true;
+    ++heldCount;
+    if (!holdTimer->isActive())
+        holdTimer->start(holdTime);
+    return false;
+}
+
+// This function is called to forward the held datagrams that are next in line
+void LinkReorderer::release()
+{
+    while (!blocked && heldCount > 0) {
+        Slot &slot = held[int(expected % quint32(held.size()))];
+        if (!slot.used || slot.sequence != expected)
+            break;
+        slot.used = false;
+        --heldCount;
+        advance(true);
+        emit datagramReady(slot.data.constData(), slot.data.size());
+    }
+    if (heldCount == 0)
+        holdTimer->stop();
+}
+
+// This slot is called when a held datagram may have waited long enough
+void LinkReorderer::expire()
+{
+    // Give up on the gap before the next held datagram as long as any held
+    // datagram is overdue
+    if (blocked)
+        return;
+    const qint64 now = BridgeStats::now();
+    for (;;) {
+        qint64 oldest = 0;
+        for (const Slot &slot : qAsConst(held)) {
+            if (slot.used && (oldest == 0 || slot.deadline < oldest))
+                oldest = slot.deadline;
+        }
+        if (heldCount == 0 || oldest > now)
+            break;
+
+        while (!held[int(expected % quint32(held.size()))].used) {
+            counters->lost.add();
+            advance(false);
+        }
+        release();
+        if (blocked)
+            return;
+    }
+    restartHoldTimer(now);
+}
+
+// This function is called to hold back or resume the held datagrams; the
+// hold time of those overdue meanwhile is up right after resuming
+void LinkReorderer::setBlocked(bool newBlocked)
+{
+    blocked = newBlocked;
+    if (blocked) {
+        holdTimer->stop();
+        return;
+    }
+    release();
+    if (!blocked)
+        restartHoldTimer(BridgeStats::now());
+}
+
+// This function is called to wait for the oldest held datagram's deadline
+void LinkReorderer::restartHoldTimer(qint64 now)
+{
+    qint64 oldest = 0;
+    for (const Slot &slot : qAsConst(held)) {
+        if (slot.used && (oldest == 0 || slot.deadline < oldest))
+            oldest = slot.deadline;
+    }
+    if (heldCount != 0)
+        holdTimer->start(int(qMax<qint64>(1, (oldest - now + 999999) / 1000000)));
+}
+
+// This function is called to move past the expected number
+void LinkReorderer::advance(bool received)
+{
+    seen = (seen << 1) | (received ? 1 : 0);
+    ++expected;
+}
+
+// Function to update the one-way jitter as in RFC 3550, from the difference
+// of the transit times of consecutive datagrams; the clocks need not agree
+void LinkReorderer::measureJitter(quint32 sendTime)
+{
+    const qint32 transit = qint32(quint32(BridgeStats::now() / 1000) - sendTime);
+    if (haveTransit) {
+        const double difference = qAbs(double(transit) - double(lastTransit));
+        jitter += (difference - jitter) / 16;
+        counters->jitter.store(quint64(jitter), std::memory_order_relaxed);
+    }
+    haveTransit = true;
+    lastTransit = transit;
+}
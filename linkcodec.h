@@ -0,0 +1,216 @@
+#ifndef LINKCODEC_H
+#define LINKCODEC_H
+
+#include "bridgesettings.h"
+#include "bridgestats.h"
+#include "lz4block.h"
+#include "serialio.h"
+
+#include <QByteArray>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+// Optional coding of the datagrams on the UDP side for slow or metered
+// uplinks: several serial packets share one datagram, and the datagram is
+// LZ4 compressed when that makes it smaller. A coded datagram is
+//
+//   'S' '2' 'E' flags       flags: format version in the high nibble,
+//                           bit 0 set when the records are compressed,
+//                           bit 1 when a sequence number follows
+//   [sequence send-time]    only when sequenced: two 32-bit little endian
+//                           numbers, the datagram's number and the send
+//                           time in us on the sender's clock
+//   [varint size]           only when compressed: size of the records,
+//                           followed by them as one LZ4 block
+//   records                 varint length and the packet, repeated
+//
+// Varints are LEB128. A datagram without the header is a raw packet, so an
+// end with the codec on still takes what a plain raw peer sends.
+//
+// With line control on, a virtual port also sends the line state its
+// application set, as a datagram of its own with flags bit 2 set and
+//
+//   baud rate               32-bit little endian, 0 after a hang up
+//   data bits, parity,      one byte each, numbered like QSerialPort's
+//   stop bits, flow control enums
+//   lines                   bit 0 DTR, bit 1 RTS, bit 2 set when data bits
+//                           and parity are known
+namespace LinkCodec {
+
+constexpr char Magic[3] = {'S', '2', 'E'};
+constexpr quint8 Version = 1;
+constexpr quint8 Compressed = 0x01;
+constexpr quint8 Sequenced = 0x02;
+constexpr quint8 LineControl = 0x04;
+constexpr int HeaderSize = 4;
+constexpr int SequenceSize = 8;
+constexpr int LineStateSize = HeaderSize + 9;
+
+// Largest size of the records of one datagram once decompressed
+constexpr int MaxPayloadSize = 65536;
+
+// Read a dictionary file; only its last Lz4::MaxDistance bytes are kept,
+// the part both compressor and decompressor use
+bool loadDictionary(const QString &path, QByteArray *dictionary, QString *errorString);
+
+// Write the line state datagram into out, which has room for LineStateSize
+// bytes, and tell a datagram that is one apart from data
+void encodeLineState(const SerialLineState &state, char *out);
+bool decodeLineState(const char *data, int size, SerialLineState *state);
+
+} // namespace LinkCodec
+
+// Sending half of the codec: collects packets until the datagram is full or
+// the first packet has waited for the delay, then emits the datagram.
+class LinkEncoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Counters {
+        quint64 packets = 0;
+        quint64 datagrams = 0;
+        quint64 payloadBytes = 0;   // packet bytes that went in
+        quint64 wireBytes = 0;      // datagram bytes that came out
+    };
+
+    explicit LinkEncoder(QObject *parent = nullptr);
+
+    void configure(const BridgeSettings::Codec &codec, const QByteArray &dictionary);
+    void append(const char *data, int size, qint64 readTime = 0);
+    void flush();
+    void clear();
+
+    const Counters &counters() const { return count; }
+
+signals:
+    // The data is only valid during the emission; readTime is the one of the
+    // oldest packet in the datagram
+    void datagramReady(const char *data, int size, qint64 readTime);
+
+private:
+    BridgeSettings::Codec codec;
+    Lz4::Compressor compressor;
+    QTimer *delayTimer;
+
+    // Records waiting for the datagram, and the datagram, both reused
+    QByteArray records;
+    QByteArray datagram;
+    qint64 recordsTime = 0;
+
+    // The header grows by the sequence number when there is one
+    int headerSize = LinkCodec::HeaderSize;
+    quint32 nextSequence = 0;
+
+    Counters count;
+};
+
+// Receiving half of the codec: splits a datagram back into its packets.
+class LinkDecoder
+{
+public:
+    enum Result {
+        RawDatagram,    // no codec header, the datagram is a packet as it is
+        Decoded,        // records() holds the packets
+        Corrupt         // a codec header, but the rest does not decode
+    };
+
+    struct Record {
+        const char *data;
+        int size;
+    };
+
+    LinkDecoder();
+
+    void setDictionary(const QByteArray &dictionary);
+
+    // The records point into the datagram or into the decoder and are valid
+    // until the next call
+    Result decode(const char *data, int size);
+    const QVector<Record> &records() const { return decoded; }
+
+    // Sequence number and send time of the last decoded datagram, if it had them
+    bool isSequenced() const { return sequenced; }
+    quint32 sequence() const { return sequenceNumber; }
+    quint32 sendTime() const { return sendTimeUs; }
+
+private:
+    QByteArray dictionary;
+    QByteArray payload;
+    QVector<Record> decoded;
+    bool sequenced = false;
+    quint32 sequenceNumber = 0;
+    quint32 sendTimeUs = 0;
+};
+
+// Receiving end of the sequence numbers: counts losses, duplicates and
+// jitter, and with a hold time puts datagrams that overtook others back in
+// order. An early datagram waits in a slot reserved up front until the ones
+// before it came or the hold time is up; then the missing ones are given up
+// and, should they still come, dropped as late.
+class LinkReorderer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LinkReorderer(QObject *parent = nullptr);
+
+    void configure(const BridgeSettings::Codec &codec, BridgeStats::Sequence *counters);
+    void clear();
+
+    // Called with every sequenced datagram as it arrives; returns true when
+    // it is next in line and to be forwarded right away, after which
+    // release() hands over the held datagrams that follow it
+    bool arrive(quint32 sequence, quint32 sendTime, const char *data, int size);
+    void release();
+
+    // While blocked nothing held is handed over and no gap is given up on,
+    // e.g. while the serial queue is over its limit; unblocking catches up
+    void setBlocked(bool blocked);
+
+    int heldDatagrams() const { return heldCount; }
+
+signals:
+    // The data is only valid during the emission
+    void datagramReady(const char *data, int size);
+
+private:
+    struct Slot {
+        QByteArray data;
+        quint32 sequence = 0;
+        qint64 deadline = 0;
+        bool used = false;
+    };
+
+    // Numbers this far from the expected one mean the peer started over
+    static constexpr qint32 ResyncDistance = 1 << 16;
+
+    void expire();
+    void advance(bool received);
+    void restartHoldTimer(qint64 now);
+    void measureJitter(quint32 sendTime);
+
+    bool reordering = false;
+    bool blocked = false;
+    int holdTime = 0;
+    QVector<Slot> held;
+    int heldCount = 0;
+    QTimer *holdTimer;
+
+    // Next number to forward, the highest one seen, and which of the 64
+    // numbers before the expected one came, to tell duplicates from late ones
+    bool started = false;
+    quint32 expected = 0;
+    quint32 highest = 0;
+    quint64 seen = 0;
+
+    // Relative transit times for the jitter, in us
+    bool haveTransit = false;
+    qint32 lastTransit = 0;
+    double jitter = 0;
+
+    BridgeStats::Sequence *counters = nullptr;
+};
+
+#endif // LINKCODEC_H
@@ -0,0 +1,1000 @@
+#include "linuxio.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+// termios2 and BOTHER come from the kernel headers; <termios.h> must not be
+// included in this file as its struct termios clashes with them
+#include <asm/termbits.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+// Function to put raw mode and the line settings into a termios2, on top of
+// what it holds; fails only on settings termios cannot express
+bool buildTermios(const BridgeSettings &settings, struct termios2 &tio)
+{
+    // Raw mode: no line editing, no translation, no signals
+    tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL
+                     | IXON | IXOFF | IXANY | INPCK);
+    tio.c_oflag &= ~OPOST;
+    tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    tio.c_cflag &= ~(CSIZE | PARENB | PARODD | CMSPAR | CSTOPB | CRTSCTS
+                     | CBAUD | (CBAUD << IBSHIFT));
+    tio.c_cflag |= CREAD | CLOCAL;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+
+    // Any baud rate, not just the Bxxx constants
+    tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    tio.c_ispeed = speed_t(settings.baudRate);
+    tio.c_ospeed = speed_t(settings.baudRate);
+
+    // Data bits
+    switch (settings.dataBits) {
+    case QSerialPort::Data5: tio.c_cflag |= CS5; break;
+    case QSerialPort::Data6: tio.c_cflag |= CS6; break;
+    case QSerialPort::Data7: tio.c_cflag |= CS7; break;
+    default: tio.c_cflag |= CS8; break;
+    }
+
+    // Parity; mark and space use the sticky parity bit
+    switch (settings.parity) {
+    case QSerialPort::EvenParity: tio.c_cflag |= PARENB; break;
+    case QSerialPort::OddParity: tio.c_cflag |= PARENB | PARODD; break;
+    case QSerialPort::MarkParity: tio.c_cflag |= PARENB | CMSPAR | PARODD; break;
+    case QSerialPort::SpaceParity: tio.c_cflag |= PARENB | CMSPAR; break;
+    default: break;
+    }
+    if (settings.parity != QSerialPort::NoParity)
+        tio.c_iflag |= INPCK;
+
+    // Stop bits
+    if (settings.stopBits == QSerialPort::OneAndHalfStop)
+        return false;
+    if (settings.stopBits == QSerialPort::TwoStop)
+        tio.c_cflag |= CSTOPB;
+
+    // Flow control
+    if (settings.flowControl == QSerialPort::HardwareControl)
+        tio.c_cflag |= CRTSCTS;
+    else if (settings.flowControl == QSerialPort::SoftwareControl)
+        tio.c_iflag |= IXON | IXOFF;
+    return true;
+}
+
+} // namespace
+
+
+EpollLoop::EpollLoop(QObject *parent)
+    : QObject(parent)
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd == -1)
+        return;
+
+    // The epoll descriptor becomes readable whenever one of its members is ready
+    notifier = new QSocketNotifier(epollFd, QSocketNotifier::Read, this);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    connect(notifier, &QSocketNotifier::activated, this, &EpollLoop::dispatch);
+#else
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(dispatch()));
+#endif
+}
+
+EpollLoop::~EpollLoop()
+{
+    if (epollFd != -1)
+        ::close(epollFd);
+}
+
+// This function is called to watch a descriptor
+bool EpollLoop::add(int fd, quint32 events, const Handler &handler)
+{
+    epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+    if (epollFd == -1 || epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1)
+        return false;
+
+    handlers.insert(fd, handler);
+    return true;
+}
+
+// This function is called to change the events watched on a descriptor
+bool EpollLoop::modify(int fd, quint32 events)
+{
+    epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+    return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+// This function is called to stop watching a descriptor
+void EpollLoop::remove(int fd)
+{
+    if (handlers.remove(fd) != 0)
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+// This slot is called when any watched descriptor is ready
+void EpollLoop::dispatch()
+{
+    epoll_event events[16];
+    const int count = epoll_wait(epollFd, events, 16, 0);
+
+    for (int i = 0; i < count; ++i) {
+        // A handler may remove descriptors, so look every one up again and
+        // call a copy of the handler
+        const auto it = handlers.constFind(events[i].data.fd);
+        if (it == handlers.constEnd())
+            continue;
+        const Handler handler = it.value();
+        handler(events[i].events);
+    }
+}
+
+
+struct TermiosSerialIo::LineConfig
+{
+    struct termios2 tio;
+};
+
+TermiosSerialIo::TermiosSerialIo(EpollLoop *loop, QObject *parent)
+    : SerialIo(parent)
+    , loop(loop)
+    , line(new LineConfig)
+{
+}
+
+TermiosSerialIo::~TermiosSerialIo()
+{
+    close();
+}
+
+// This function is called to open the tty and commit its settings
+bool TermiosSerialIo::open(const BridgeSettings &settings)
+{
+    close();
+
+    // Accept both "ttyUSB0" and "/dev/ttyUSB0"
+    const QString path = settings.portName.startsWith(QLatin1Char('/'))
+                             ? settings.portName
+                             : QStringLiteral("/dev/") + settings.portName;
+    fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1) {
+        setError(qt_error_string(errno));
+        return false;
+    }
+
+    // Claim the tty exclusively, like QSerialPort does
+    if (::ioctl(fd, TIOCEXCL) == -1) {
+        setError(qt_error_string(errno));
+        close();
+        return false;
+    }
+
+    // Start from the tty's own configuration and commit ours in one go
+    if (::ioctl(fd, TCGETS2, &line->tio) == -1) {
+        setError(qt_error_string(errno));
+        close();
+        return false;
+    }
+    LineConfig config = *line;
+    if (!buildLineConfig(settings, &config) || !commitLineConfig(config)) {
+        close();
+        return false;
+    }
+
+    // Start from empty queues, and from the errors counted so far
+    ::ioctl(fd, TCFLSH, TCIOFLUSH);
+    startLineErrorCount(fd);
+
+    if (!loop->add(fd, EPOLLIN, [this](quint32 events) { handleEvents(events); })) {
+        setError(qt_error_string(errno));
+        close();
+        return false;
+    }
+    return true;
+}
+
+// This function is called to build the line configuration for the settings
+// on top of the current one, without touching the tty
+bool TermiosSerialIo::buildLineConfig(const BridgeSettings &settings, LineConfig *config)
+{
+    if (!buildTermios(settings, config->tio)) {
+        setError(tr("1.5 stop bits are not supported by this backend"));
+        return false;
+    }
+    return true;
+}
+
+// This function is called to configure the line with a single ioctl
+bool TermiosSerialIo::commitLineConfig(const LineConfig &config)
+{
+    if (::ioctl(fd, TCSETS2, &config.tio) == -1) {
+        setError(qt_error_string(errno));
+        return false;
+    }
+    *line = config;
+    return true;
+}
+
+// This function is called to switch the open tty to other line settings;
+// nothing is flushed, the driver sends what it holds at the new settings
+bool TermiosSerialIo::reconfigure(const BridgeSettings &settings)
+{
+    if (fd == -1)
+        return false;
+
+    LineConfig config = *line;
+    return buildLineConfig(settings, &config) && commitLineConfig(config);
+}
+
+
+void TermiosSerialIo::close()
+{
+    if (fd == -1)
+        return;
+
+    loop->remove(fd);
+    ::close(fd);
+    fd = -1;
+    waitingForWrite = false;
+    deviceLost = false;
+}
+
+bool TermiosSerialIo::isOpen() const
+{
+    return fd != -1;
+}
+
+QString TermiosSerialIo::errorString() const
+{
+    return lastError;
+}
+
+// This function is called to read what the driver has buffered
+qint64 TermiosSerialIo::read(char *data, qint64 maxSize)
+{
+    const ssize_t size = ::read(fd, data, size_t(maxSize));
+    if (size >= 0)
+        return size;
+    if (errno == EAGAIN || errno == EINTR)
+        return 0;
+
+    // The device is gone; report it once the caller is out of its read loop
+    if (markDeviceLost(qt_error_string(errno)))
+        QMetaObject::invokeMethod(this, [this] { emit fatalError(lastError); }, Qt::QueuedConnection);
+    return -1;
+}
+
+// This function is called to hand data to the driver
+qint64 TermiosSerialIo::write(const char *data, qint64 size)
+{
+    ssize_t written = ::write(fd, data, size_t(size));
+    if (written == -1) {
+        if (errno != EAGAIN && errno != EINTR) {
+            if (markDeviceLost(qt_error_string(errno)))
+                QMetaObject::invokeMethod(this, [this] { emit fatalError(lastError); }, Qt::QueuedConnection);
+            return -1;
+        }
+        written = 0;
+    }
+
+    // The driver buffer is full; ask to be told when it has room again
+    if (written < size && !waitingForWrite) {
+        waitingForWrite = true;
+        loop->modify(fd, EPOLLIN | EPOLLOUT);
+    }
+    return written;
+}
+
+// The driver holds everything write() accepted, nothing waits in user space
+qint64 TermiosSerialIo::bytesToWrite() const
+{
+    return 0;
+}
+
+// This function is called to raise or drop RTS, independent of the flow control
+bool TermiosSerialIo::setRequestToSend(bool on)
+{
+    const int bits = TIOCM_RTS;
+    return fd != -1 && ::ioctl(fd, on ? TIOCMBIS : TIOCMBIC, &bits) == 0;
+}
+
+// This function is called to raise or drop DTR
+bool TermiosSerialIo::setDataTerminalReady(bool on)
+{
+    const int bits = TIOCM_DTR;
+    return fd != -1 && ::ioctl(fd, on ? TIOCMBIS : TIOCMBIC, &bits) == 0;
+}
+
+// This function is called to ask the UART whether its shift register is empty;
+// drivers without the line status ioctl count as empty
+bool TermiosSerialIo::isTransmitterEmpty() const
+{
+    unsigned int status = 0;
+    if (fd == -1 || ::ioctl(fd, TIOCSERGETLSR, &status) != 0)
+        return true;
+    return (status & TIOCSER_TEMT) != 0;
+}
+
+// This function is called by the epoll loop when the tty is ready
+void TermiosSerialIo::handleEvents(quint32 events)
+{
+    if (events & EPOLLIN) {
+        updateLineErrorCount(fd);
+        emit readyRead();
+    }
+
+    if (fd == -1)
+        return;
+
+    if (events & EPOLLOUT) {
+        waitingForWrite = false;
+        loop->modify(fd, EPOLLIN);
+        emit bytesWritten(0);
+    }
+
+    if (fd != -1 && (events & (EPOLLERR | EPOLLHUP))
+        && markDeviceLost(tr("The serial device was disconnected"))) {
+        emit fatalError(lastError);
+    }
+}
+
+void TermiosSerialIo::setError(const QString &message)
+{
+    lastError = message;
+}
+
+// Function to note that the device is gone; a failed read, a failed write
+// and the hangup all tell of the same loss, which is reported only once
+bool TermiosSerialIo::markDeviceLost(const QString &message)
+{
+    if (deviceLost)
+        return false;
+    deviceLost = true;
+    setError(message);
+    return true;
+}
+
+
+PtySerialIo::PtySerialIo(EpollLoop *loop, QObject *parent)
+    : SerialIo(parent)
+    , loop(loop)
+{
+}
+
+PtySerialIo::~PtySerialIo()
+{
+    close();
+}
+
+// This function is called to create the pty, link it under the configured
+// name and give the slave the settings an application finds on open
+bool PtySerialIo::open(const BridgeSettings &settings)
+{
+    close();
+
+    // Create and unlock the master; the slave is /dev/pts/<number>
+    masterFd = ::open("/dev/ptmx", O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    unsigned int number = 0;
+    const int unlock = 0;
+    if (masterFd == -1 || ::ioctl(masterFd, TIOCGPTN, &number) == -1
+        || ::ioctl(masterFd, TIOCSPTLCK, &unlock) == -1) {
+        setError(qt_error_string(errno));
+        close();
+        return false;
+    }
+    slavePath = "/dev/pts/" + QByteArray::number(number);
+
+    // Hold the slave ourselves, or the master would hang up whenever the
+    // application closes it and the settings would be lost with it
+    slaveFd = ::open(slavePath.constData(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    const int packetMode = 1;
+    if (slaveFd == -1 || ::ioctl(masterFd, TIOCPKT, &packetMode) == -1) {
+        setError(qt_error_string(errno));
+        close();
+        return false;
+    }
+
+    // See whether the kernel keeps data bits and parity on a pty; newer ones
+    // force 8N, and then only the peer's own settings can tell them
+    struct termios2 tio;
+    if (::ioctl(masterFd, TCGETS2, &tio) == -1) {
+        setError(qt_error_string(errno));
+        close();
+        return false;
+    }
+    tio.c_cflag = (tio.c_cflag & ~CSIZE) | CS7 | PARENB;
+    ::ioctl(masterFd, TCSETS2, &tio);
+    ::ioctl(masterFd, TCGETS2, &tio);
+    dataFormatVisible = (tio.c_cflag & CSIZE) == CS7 && (tio.c_cflag & PARENB) != 0;
+    if (!commitSettings(settings)) {
+        close();
+        return false;
+    }
+
+    // Follow the opens and closes of the slave; without inotify the
+    // application counts as always there
+    watchFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watchFd != -1
+        && (::inotify_add_watch(watchFd, slavePath.constData(), IN_OPEN | IN_CLOSE) == -1
+            || !loop->add(watchFd, EPOLLIN, [this](quint32) { handleOpenEvents(); }))) {
+        ::close(watchFd);
+        watchFd = -1;
+    }
+    applicationOpens = 0;
+
+    // Publish the slave under its stable name, replacing a link left behind
+    // by an earlier run but nothing else
+    linkPath = QFile::encodeName(settings.pty.link);
+    const QFileInfo existing(settings.pty.link);
+    if (existing.isSymLink()) {
+        QFile::remove(settings.pty.link);
+    } else if (existing.exists()) {
+        setError(tr("%1 exists and is not a link").arg(settings.pty.link));
+        linkPath.clear();
+        close();
+        return false;
+    }
+    QFile slave(QFile::decodeName(slavePath));
+    if (!slave.link(settings.pty.link)) {
+        setError(tr("Cannot create %1: %2").arg(settings.pty.link, slave.errorString()));
+        linkPath.clear();
+        close();
+        return false;
+    }
+
+    // The status bytes the setup above left on the master come first; they
+    // report what is taken as the initial state here
+    if (!loop->add(masterFd, EPOLLIN, [this](quint32 events) { handleMasterEvents(events); })) {
+        setError(qt_error_string(errno));
+        close();
+        return false;
+    }
+    readLineState(&state);
+    return true;
+}
+
+// This function is called to give the slave raw mode and the line settings,
+// with EXTPROC so that changes of the application are reported to us
+bool PtySerialIo::commitSettings(const BridgeSettings &settings)
+{
+    struct termios2 tio;
+    if (::ioctl(masterFd, TCGETS2, &tio) == -1) {
+        setError(qt_error_string(errno));
+        return false;
+    }
+    if (!buildTermios(settings, tio)) {
+        setError(tr("1.5 stop bits are not supported by this backend"));
+        return false;
+    }
+    tio.c_lflag |= EXTPROC;
+    if (::ioctl(masterFd, TCSETS2, &tio) == -1) {
+        setError(qt_error_string(errno));
+        return false;
+    }
+    return true;
+}
+
+// This function is called to change the settings the slave offers; the
+// application sees them, and the peer hears about them like about its own
+bool PtySerialIo::reconfigure(const BridgeSettings &settings)
+{
+    return masterFd != -1 && commitSettings(settings);
+}
+
+void PtySerialIo::close()
+{
+    // Remove the link only while it still leads to our slave
+    if (!linkPath.isEmpty()) {
+        const QString link = QFile::decodeName(linkPath);
+        if (QFile::symLinkTarget(link) == QFile::decodeName(slavePath))
+            QFile::remove(link);
+        linkPath.clear();
+    }
+
+    if (watchFd != -1) {
+        loop->remove(watchFd);
+        ::close(watchFd);
+        watchFd = -1;
+    }
+    if (slaveFd != -1) {
+        ::close(slaveFd);
+        slaveFd = -1;
+    }
+    if (masterFd != -1) {
+        loop->remove(masterFd);
+        ::close(masterFd);
+        masterFd = -1;
+    }
+    applicationOpens = 0;
+    waitingForWrite = false;
+}
+
+bool PtySerialIo::isOpen() const
+{
+    return masterFd != -1;
+}
+
+QString PtySerialIo::errorString() const
+{
+    return lastError;
+}
+
+// This function is called to read what the application wrote. In packet mode
+// every read starts with a status byte: zero before data, otherwise a lone
+// notification such as a termios change, handled here before reading on.
+qint64 PtySerialIo::read(char *data, qint64 maxSize)
+{
+    for (;;) {
+        quint8 status = 0;
+        iovec parts[2] = {{&status, 1}, {data, size_t(maxSize)}};
+        const ssize_t size = ::readv(masterFd, parts, 2);
+        if (size > 0 && status == TIOCPKT_DATA)
+            return size - 1;
+        if (size > 0) {
+            if (status & TIOCPKT_IOCTL)
+                updateLineState();
+            continue;
+        }
+
+        // EIO only means no slave is open, which our own one rules out
+        if (size == 0 || errno == EAGAIN || errno == EINTR || errno == EIO)
+            return 0;
+        setError(qt_error_string(errno));
+        QMetaObject::invokeMethod(this, [this] { emit fatalError(lastError); }, Qt::QueuedConnection);
+        return -1;
+    }
+}
+
+// This function is called to hand data to the application; while none has
+// the port open nothing is taken, see hasReader()
+qint64 PtySerialIo::write(const char *data, qint64 size)
+{
+    if (!hasReader())
+        return 0;
+
+    ssize_t written = ::write(masterFd, data, size_t(size));
+    if (written == -1) {
+        if (errno != EAGAIN && errno != EINTR) {
+            setError(qt_error_string(errno));
+            QMetaObject::invokeMethod(this, [this] { emit fatalError(lastError); }, Qt::QueuedConnection);
+            return -1;
+        }
+        written = 0;
+    }
+
+    // The application does not read fast enough; wait for room
+    if (written < size && !waitingForWrite) {
+        waitingForWrite = true;
+        loop->modify(masterFd, EPOLLIN | EPOLLOUT);
+    }
+    return written;
+}
+
+// Without inotify the opens are not known, and an application is assumed
+bool PtySerialIo::hasReader() const
+{
+    return applicationOpens != 0 || watchFd == -1;
+}
+
+// The pty holds everything write() accepted, nothing waits in user space
+qint64 PtySerialIo::bytesToWrite() const
+{
+    return 0;
+}
+
+// A pty has no modem lines to drive
+bool PtySerialIo::setRequestToSend(bool on)
+{
+    Q_UNUSED(on);
+    return false;
+}
+
+bool PtySerialIo::setDataTerminalReady(bool on)
+{
+    Q_UNUSED(on);
+    return false;
+}
+
+bool PtySerialIo::lineState(SerialLineState *lineState) const
+{
+    *lineState = state;
+    return masterFd != -1;
+}
+
+// This function is called to read the line state from the termios of the slave
+void PtySerialIo::readLineState(SerialLineState *lineState)
+{
+    struct termios2 tio;
+    if (::ioctl(masterFd, TCGETS2, &tio) == -1)
+        return;
+
+    // An application that cleared EXTPROC would not be heard from again
+    if (!(tio.c_lflag & EXTPROC)) {
+        tio.c_lflag |= EXTPROC;
+        ::ioctl(masterFd, TCSETS2, &tio);
+    }
+
+    lineState->baudRate = (tio.c_cflag & CBAUD) == B0 ? 0 : qint32(tio.c_ospeed);
+    switch (tio.c_cflag & CSIZE) {
+    case CS5: lineState->dataBits = QSerialPort::Data5; break;
+    case CS6: lineState->dataBits = QSerialPort::Data6; break;
+    case CS7: lineState->dataBits = QSerialPort::Data7; break;
+    default: lineState->dataBits = QSerialPort::Data8; break;
+    }
+    if (!(tio.c_cflag & PARENB))
+        lineState->parity = QSerialPort::NoParity;
+    else if (tio.c_cflag & CMSPAR)
+        lineState->parity = (tio.c_cflag & PARODD) ? QSerialPort::MarkParity : QSerialPort::SpaceParity;
+    else
+        lineState->parity = (tio.c_cflag & PARODD) ? QSerialPort::OddParity : QSerialPort::EvenParity;
+    lineState->hasDataFormat = dataFormatVisible;
+    lineState->stopBits = (tio.c_cflag & CSTOPB) ? QSerialPort::TwoStop : QSerialPort::OneStop;
+    if (tio.c_cflag & CRTSCTS)
+        lineState->flowControl = QSerialPort::HardwareControl;
+    else if (tio.c_iflag & (IXON | IXOFF))
+        lineState->flowControl = QSerialPort::SoftwareControl;
+    else
+        lineState->flowControl = QSerialPort::NoFlowControl;
+
+    // The lines a real port raises on open and drops on close or hang up
+    const bool raised = (applicationOpens > 0 || watchFd == -1) && lineState->baudRate != 0;
+    lineState->dataTerminalReady = raised;
+    lineState->requestToSend = raised;
+}
+
+// This function is called when the application may have changed the line state
+void PtySerialIo::updateLineState()
+{
+    SerialLineState current = state;
+    readLineState(&current);
+    if (current == state)
+        return;
+    state = current;
+    emit lineStateChanged();
+}
+
+// This function is called by the epoll loop when the master is ready
+void PtySerialIo::handleMasterEvents(quint32 events)
+{
+    if (events & EPOLLIN)
+        emit readyRead();
+
+    if (masterFd == -1)
+        return;
+
+    if (events & EPOLLOUT) {
+        waitingForWrite = false;
+        loop->modify(masterFd, EPOLLIN);
+        emit bytesWritten(0);
+    }
+}
+
+// This function is called by the epoll loop when the slave was opened or closed
+void PtySerialIo::handleOpenEvents()
+{
+    alignas(inotify_event) char buffer[4096];
+    ssize_t size;
+    while ((size = ::read(watchFd, buffer, sizeof(buffer))) > 0) {
+        for (const char *at = buffer; at < buffer + size;) {
+            const inotify_event *event = reinterpret_cast<const inotify_event *>(at);
+            if (event->mask & IN_OPEN) {
+                // A newly opened port starts without what was left in it
+                if (applicationOpens++ == 0)
+                    ::ioctl(slaveFd, TCFLSH, TCIFLUSH);
+            } else if (event->mask & IN_CLOSE) {
+                applicationOpens = qMax(0, applicationOpens - 1);
+            }
+            at += sizeof(inotify_event) + event->len;
+        }
+    }
+    updateLineState();
+}
+
+void PtySerialIo::setError(const QString &message)
+{
+    lastError = message;
+}
+
+
+// Receive and send slots with their message headers, allocated once per socket
+struct MmsgDatagramIo::Batch
+{
+    const int slotSize;
+    std::unique_ptr<char[]> buffer;
+    mmsghdr headers[BatchSize];
+    iovec vectors[BatchSize];
+    sockaddr_in addresses[BatchSize];
+
+    explicit Batch(int slotSize)
+        : slotSize(slotSize)
+        , buffer(new char[BatchSize * slotSize])
+    {
+        std::memset(headers, 0, sizeof(headers));
+        std::memset(addresses, 0, sizeof(addresses));
+        for (int i = 0; i < BatchSize; ++i) {
+            vectors[i].iov_base = buffer.get() + i * slotSize;
+            vectors[i].iov_len = size_t(slotSize);
+            headers[i].msg_hdr.msg_iov = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+};
+
+MmsgDatagramIo::MmsgDatagramIo(EpollLoop *loop, QObject *parent)
+    : NetworkIo(parent)
+    , loop(loop)
+{
+}
+
+MmsgDatagramIo::~MmsgDatagramIo()
+{
+    close();
+}
+
+// This function is called to listen on the local port, joining the group in multicast mode
+bool MmsgDatagramIo::open(const BridgeSettings &settings)
+{
+    close();
+
+    const bool multicast = settings.transport == BridgeSettings::MulticastTransport;
+    ip_mreq membership = {};
+    if (multicast) {
+        const QHostAddress group(settings.destinationIp);
+        if (!group.isMulticast()) {
+            setError(tr("%1 is not a multicast group address").arg(settings.destinationIp));
+            return false;
+        }
+        membership.imr_multiaddr.s_addr = htonl(group.toIPv4Address());
+        membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    }
+
+    fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        setError(qt_error_string(errno));
+        return false;
+    }
+
+    // Allow sending to broadcast addresses, as QUdpSocket does
+    const int on = 1;
+    const int ttl = settings.multicastTtl;
+    bool ok = ::setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on)) == 0;
+
+    // Other members may listen on the same host and port
+    if (multicast)
+        ok = ok && ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == 0;
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(settings.localPort);
+    ok = ok && ::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+
+    if (multicast) {
+        ok = ok && ::setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) == 0;
+        ok = ok && ::setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == 0;
+    }
+
+    if (!ok || !loop->add(fd, EPOLLIN, [this](quint32) { emit readyRead(); })) {
+        setError(qt_error_string(errno));
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    // Allocate the batches once; they are reused for every datagram. The
+    // slots fit what the framing and the link codec produce, not the largest
+    // possible datagram, which would cost 2 MiB per channel; larger ones take
+    // a slower path.
+    const int slotSize = qBound(MinSlotSize, qMax(settings.framing.maxSize, settings.codec.maxSize) + SlotHeadroom,
+                                MaxSlotSize);
+    if (!send || send->slotSize != slotSize)
+        send.reset(new Batch(slotSize));
+    receiveSlotSize = qMax(receiveSlotSize, slotSize);
+    receiveCount = 0;
+    receiveIndex = 0;
+    sendCount = 0;
+    return true;
+}
+
+void MmsgDatagramIo::close()
+{
+    if (fd == -1)
+        return;
+
+    // Do not lose what is still batched
+    flush();
+
+    loop->remove(fd);
+    ::close(fd);
+    fd = -1;
+    receiveCount = 0;
+    receiveIndex = 0;
+}
+
+QString MmsgDatagramIo::errorString() const
+{
+    return lastError;
+}
+
+// This function is called to fetch the next batch of datagrams
+bool MmsgDatagramIo::receiveBatch()
+{
+    receiveIndex = 0;
+    receiveCount = 0;
+
+    // The slots were made larger after a datagram did not fit
+    if (!receive || receive->slotSize != receiveSlotSize)
+        receive.reset(new Batch(receiveSlotSize));
+
+    // Have the kernel fill in the senders; it shortens the lengths each time
+    for (int i = 0; i < BatchSize; ++i) {
+        receive->headers[i].msg_hdr.msg_name = &receive->addresses[i];
+        receive->headers[i].msg_hdr.msg_namelen = sizeof(receive->addresses[i]);
+    }
+
+    const int count = recvmmsg(fd, receive->headers, BatchSize, MSG_DONTWAIT, nullptr);
+    if (count <= 0)
+        return false;
+
+    // A datagram larger than its slot was cut short and cannot be forwarded;
+    // it reads as empty, which the engine skips. The next batch makes room
+    // for the largest datagram, since a peer that sends one likely sends more.
+    int truncated = 0;
+    for (int i = 0; i < count; ++i) {
+        if (receive->headers[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            receive->headers[i].msg_len = 0;
+            ++truncated;
+        }
+    }
+    if (truncated > 0) {
+        emit datagramsTruncated(truncated);
+        if (receiveSlotSize < MaxSlotSize) {
+            emit infoMessage(tr("Datagrams larger than %1 bytes arrive, receiving up to %2 bytes from now on")
+                                 .arg(receiveSlotSize).arg(MaxSlotSize));
+            receiveSlotSize = MaxSlotSize;
+        }
+    }
+    receiveCount = count;
+    return true;
+}
+
+bool MmsgDatagramIo::hasPendingDatagrams()
+{
+    if (receiveIndex < receiveCount)
+        return true;
+    return fd != -1 && receiveBatch();
+}
+
+qint64 MmsgDatagramIo::pendingDatagramSize()
+{
+    if (!hasPendingDatagrams())
+        return -1;
+    return receive->headers[receiveIndex].msg_len;
+}
+
+// This function is called to take the next datagram of the batch
+qint64 MmsgDatagramIo::readDatagram(char *data, qint64 maxSize)
+{
+    if (!hasPendingDatagrams())
+        return -1;
+
+    const qint64 size = qMin<qint64>(receive->headers[receiveIndex].msg_len, maxSize);
+    if (size > 0)
+        std::memcpy(data, receive->vectors[receiveIndex].iov_base, size_t(size));
+    ++receiveIndex;
+    return size;
+}
+
+qint64 MmsgDatagramIo::readDatagramFrom(char *data, qint64 maxSize, NetworkPeer *from)
+{
+    *from = NetworkPeer();
+    if (!hasPendingDatagrams())
+        return -1;
+
+    const sockaddr_in &address = receive->addresses[receiveIndex];
+    from->endpoint = UdpEndpoint(QHostAddress(ntohl(address.sin_addr.s_addr)), ntohs(address.sin_port));
+    return readDatagram(data, maxSize);
+}
+
+void MmsgDatagramIo::skipDatagram()
+{
+    if (hasPendingDatagrams())
+        ++receiveIndex;
+}
+
+// This function is called to add a datagram to the send batch
+qint64 MmsgDatagramIo::writeDatagram(const char *data, qint64 size, const UdpEndpoint &to)
+{
+    if (fd == -1)
+        return -1;
+
+    // What does not fit a slot goes out on its own, after the batch so far
+    if (size > send->slotSize) {
+        flush();
+        return sendAlone(data, size, to);
+    }
+
+    // Copy the datagram into the next slot together with its destination
+    const int slot = sendCount++;
+    std::memcpy(send->vectors[slot].iov_base, data, size_t(size));
+    send->vectors[slot].iov_len = size_t(size);
+    sockaddr_in &address = send->addresses[slot];
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(to.address().toIPv4Address());
+    address.sin_port = htons(to.port());
+    send->headers[slot].msg_hdr.msg_name = &address;
+    send->headers[slot].msg_hdr.msg_namelen = sizeof(address);
+
+    // Send when the batch is full, or at the end of this event loop iteration
+    if (sendCount == BatchSize) {
+        flush();
+    } else if (!flushScheduled) {
+        flushScheduled = true;
+        QMetaObject::invokeMethod(this, &MmsgDatagramIo::flush, Qt::QueuedConnection);
+    }
+    return size;
+}
+
+// This function is called to send a datagram larger than a slot
+qint64 MmsgDatagramIo::sendAlone(const char *data, qint64 size, const UdpEndpoint &to)
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(to.address().toIPv4Address());
+    address.sin_port = htons(to.port());
+
+    ssize_t sent;
+    do {
+        sent = ::sendto(fd, data, size_t(size), MSG_DONTWAIT, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    } while (sent == -1 && errno == EINTR);
+    if (sent == -1) {
+        // Lost like a datagram of a batch the socket did not take
+        emit datagramsDropped(1);
+        return size;
+    }
+    return sent;
+}
+
+// This function is called to send the whole batch with one syscall
+void MmsgDatagramIo::flush()
+{
+    flushScheduled = false;
+
+    int sent = 0;
+    while (sent < sendCount) {
+        const int count = sendmmsg(fd, send->headers + sent, unsigned(sendCount - sent), MSG_DONTWAIT);
+        if (count <= 0) {
+            // The socket buffer is full; the rest is lost as it would be in
+            // the network, and counted as such
+            if (count == -1 && errno == EINTR)
+                continue;
+            break;
+        }
+        sent += count;
+    }
+    const int unsent = sendCount - sent;
+    sendCount = 0;
+    if (unsent > 0)
+        emit datagramsDropped(unsent);
+}
+
+void MmsgDatagramIo::setError(const QString &message)
+{
+    lastError = message;
+}
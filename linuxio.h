@@ -0,0 +1,187 @@
+#ifndef LINUXIO_H
+#define LINUXIO_H
+
+#include "networkio.h"
+#include "serialio.h"
+
+#include <QHash>
+#include <QSocketNotifier>
+
+#include <functional>
+#include <memory>
+
+// One epoll set for all the descriptors of an engine. The event loop only
+// watches the epoll descriptor, so a wakeup costs one poll entry no matter
+// how many descriptors are behind it.
+class EpollLoop : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Handler = std::function<void(quint32 events)>;
+
+    explicit EpollLoop(QObject *parent = nullptr);
+    ~EpollLoop();
+
+    bool add(int fd, quint32 events, const Handler &handler);
+    bool modify(int fd, quint32 events);
+    void remove(int fd);
+
+private slots:
+    void dispatch();
+
+private:
+    int epollFd = -1;
+    QSocketNotifier *notifier = nullptr;
+    QHash<int, Handler> handlers;
+};
+
+// Serial backend that drives the tty directly. The line configuration is
+// read once on open and kept; other settings are checked and built on that
+// copy in memory, then committed with one TCSETS2 ioctl, so switching the
+// line costs a single syscall. BOTHER allows any baud rate.
+class TermiosSerialIo : public SerialIo
+{
+    Q_OBJECT
+
+public:
+    explicit TermiosSerialIo(EpollLoop *loop, QObject *parent = nullptr);
+    ~TermiosSerialIo();
+
+    bool open(const BridgeSettings &settings) override;
+    void close() override;
+    bool reconfigure(const BridgeSettings &settings) override;
+    bool isOpen() const override;
+    QString errorString() const override;
+    qint64 read(char *data, qint64 maxSize) override;
+    qint64 write(const char *data, qint64 size) override;
+    qint64 bytesToWrite() const override;
+    bool setRequestToSend(bool on) override;
+    bool setDataTerminalReady(bool on) override;
+    bool isTransmitterEmpty() const override;
+
+private:
+    // The termios2 of the tty, kept out of this header
+    struct LineConfig;
+
+    bool buildLineConfig(const BridgeSettings &settings, LineConfig *config);
+    bool commitLineConfig(const LineConfig &config);
+    void handleEvents(quint32 events);
+    void setError(const QString &message);
+    bool markDeviceLost(const QString &message);
+
+    EpollLoop *loop;
+    int fd = -1;
+    std::unique_ptr<LineConfig> line;
+    bool waitingForWrite = false;
+    bool deviceLost = false;
+    QString lastError;
+};
+
+// Serial side as a virtual port for applications on this host: a
+// pseudo-terminal whose slave is linked under a stable name such as
+// /dev/ttyS2E0, read and written like a tty with the same calls and buffers.
+// The master runs in packet mode with EXTPROC set on the slave, so the
+// kernel reports every termios change of the application in the data
+// stream; inotify on the slave tells when the application opens or closes
+// it. A slave descriptor of our own keeps the pty and its settings alive in
+// between, as they would be on a real port. A pty has no modem lines, so DTR
+// and RTS count as raised while the application has the port open and did
+// not hang up with B0. Newer kernels force 8 data bits and no parity on a
+// pty; open() finds out whether these can be seen at all.
+class PtySerialIo : public SerialIo
+{
+    Q_OBJECT
+
+public:
+    explicit PtySerialIo(EpollLoop *loop, QObject *parent = nullptr);
+    ~PtySerialIo();
+
+    bool open(const BridgeSettings &settings) override;
+    void close() override;
+    bool reconfigure(const BridgeSettings &settings) override;
+    bool isOpen() const override;
+    QString errorString() const override;
+    qint64 read(char *data, qint64 maxSize) override;
+    qint64 write(const char *data, qint64 size) override;
+    qint64 bytesToWrite() const override;
+    bool setRequestToSend(bool on) override;
+    bool setDataTerminalReady(bool on) override;
+    bool lineState(SerialLineState *state) const override;
+    bool hasReader() const override;
+    bool countsLineErrors() const override { return true; }     // a pty has no line to fail
+
+private:
+    bool commitSettings(const BridgeSettings &settings);
+    void readLineState(SerialLineState *state);
+    void updateLineState();
+    void handleMasterEvents(quint32 events);
+    void handleOpenEvents();
+    void setError(const QString &message);
+
+    EpollLoop *loop;
+    int masterFd = -1;
+    int slaveFd = -1;
+    int watchFd = -1;
+    QByteArray slavePath;
+    QByteArray linkPath;
+
+    // Opens of the slave by applications, and what they set
+    int applicationOpens = 0;
+    bool dataFormatVisible = false;
+    SerialLineState state;
+
+    bool waitingForWrite = false;
+    QString lastError;
+};
+
+// UDP backend that moves up to BatchSize datagrams per syscall with
+// recvmmsg() and sendmmsg(). Sends made during one event loop iteration are
+// collected and leave together. Handles unicast, broadcast and multicast.
+class MmsgDatagramIo : public NetworkIo
+{
+    Q_OBJECT
+
+public:
+    explicit MmsgDatagramIo(EpollLoop *loop, QObject *parent = nullptr);
+    ~MmsgDatagramIo();
+
+    bool open(const BridgeSettings &settings) override;
+    void close() override;
+    QString errorString() const override;
+    bool hasPendingDatagrams() override;
+    qint64 pendingDatagramSize() override;
+    qint64 readDatagram(char *data, qint64 maxSize) override;
+    void skipDatagram() override;
+    qint64 writeDatagram(const char *data, qint64 size, const UdpEndpoint &to) override;
+    qint64 readDatagramFrom(char *data, qint64 maxSize, NetworkPeer *from) override;
+
+    void flush();
+
+private:
+    static constexpr int BatchSize = 16;
+    static constexpr int MinSlotSize = 1472;    // what an Ethernet frame carries
+    static constexpr int SlotHeadroom = 64;     // link codec headers on top of a payload
+    static constexpr int MaxSlotSize = 65536;
+
+    struct Batch;
+
+    bool receiveBatch();
+    qint64 sendAlone(const char *data, qint64 size, const UdpEndpoint &to);
+    void setError(const QString &message);
+
+    EpollLoop *loop;
+    int fd = -1;
+    QString lastError;
+
+    int receiveSlotSize = MinSlotSize;
+    std::unique_ptr<Batch> receive;
+    int receiveCount = 0;
+    int receiveIndex = 0;
+
+    std::unique_ptr<Batch> send;
+    int sendCount = 0;
+    bool flushScheduled = false;
+};
+
+#endif // LINUXIO_H
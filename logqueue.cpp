@@ -0,0 +1,71 @@
+#include "logqueue.h"
+
+#include <QDateTime>
+
+
+LogQueue::LogQueue(int capacity)
+{
+    quint64 size = 1;
+    while (size < quint64(qMax(2, capacity)))
+        size <<= 1;
+
+    cells.reset(new Cell[size]);
+    mask = size - 1;
+
+    // A cell is free for the producer whose position equals its sequence
+    for (quint64 i = 0; i < size; ++i)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+// This function is called from any thread to queue one log line
+bool LogQueue::push(Level level, const QString &text)
+{
+    quint64 position = tail.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;) {
+        cell = &cells[position & mask];
+        const quint64 sequence = cell->sequence.load(std::memory_order_acquire);
+        const qint64 difference = qint64(sequence - position);
+        if (difference == 0) {
+            // The cell is free, claim the position
+            if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        } else if (difference < 0) {
+            // The consumer has not caught up, drop the line
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            // Another producer took the position first
+            position = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->entry.time = QDateTime::currentMSecsSinceEpoch();
+    cell->entry.level = level;
+    cell->entry.text = text;
+
+    // Publish the entry to the consumer
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+// This function is called by the consumer to take the oldest line
+bool LogQueue::pop(Entry *entry)
+{
+    Cell &cell = cells[head & mask];
+    if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+        return false;
+
+    *entry = std::move(cell.entry);
+
+    // Hand the cell back to the producers one lap later
+    cell.sequence.store(head + mask + 1, std::memory_order_release);
+    ++head;
+    return true;
+}
+
+// This function is called by the consumer to learn how many lines were dropped
+quint64 LogQueue::takeDropped()
+{
+    return dropped.exchange(0, std::memory_order_relaxed);
+}
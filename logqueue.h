@@ -0,0 +1,48 @@
+#ifndef LOGQUEUE_H
+#define LOGQUEUE_H
+
+#include <QString>
+
+#include <atomic>
+#include <memory>
+
+// Bounded multi-producer, single-consumer queue of log lines. Any thread may
+// push without taking a lock; when the queue is full the line is counted and
+// dropped instead of making the producer wait.
+class LogQueue
+{
+public:
+    enum Level {
+        Info,
+        Error
+    };
+
+    struct Entry {
+        qint64 time = 0;
+        Level level = Info;
+        QString text;
+    };
+
+    // The capacity is rounded up to a power of two
+    explicit LogQueue(int capacity = 1024);
+
+    bool push(Level level, const QString &text);
+
+    // Consumer side only
+    bool pop(Entry *entry);
+    quint64 takeDropped();
+
+private:
+    struct Cell {
+        std::atomic<quint64> sequence{0};
+        Entry entry;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    quint64 mask;
+    std::atomic<quint64> tail{0};
+    quint64 head = 0;
+    std::atomic<quint64> dropped{0};
+};
+
+#endif // LOGQUEUE_H
@@ -0,0 +1,212 @@
+#include "lz4block.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Limits of the format: matches are at least 4 bytes, the last match starts
+// 12 bytes before the end of the block and the last 5 bytes are literals
+constexpr int MinMatch = 4;
+constexpr int MatchStartMargin = 12;
+constexpr int LastLiterals = 5;
+
+// Token nibbles saturate at 15, longer lengths continue in extra bytes
+constexpr int TokenMax = 15;
+
+quint32 read32(const char *position)
+{
+    quint32 value;
+    std::memcpy(&value, position, sizeof(value));
+    return value;
+}
+
+// Function to write what a length has beyond its token nibble
+char *writeLength(char *out, int length)
+{
+    for (; length >= 255; length -= 255)
+        *out++ = char(255);
+    *out++ = char(length);
+    return out;
+}
+
+// Function to read what a length has beyond its token nibble
+bool readLength(const quint8 *&in, const quint8 *end, int *length)
+{
+    quint8 byte;
+    do {
+        if (in == end || *length > (1 << 30))
+            return false;
+        byte = *in++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+} // namespace
+
+
+Lz4::Compressor::Compressor()
+    : dictionaryTable(size_t(1) << HashLog, -1),
+      table(size_t(1) << HashLog, -1)
+{
+}
+
+quint32 Lz4::Compressor::hash(const char *position)
+{
+    return (read32(position) * 2654435761u) >> (32 - HashLog);
+}
+
+// This function is called to load the dictionary, once per session
+void Lz4::Compressor::setDictionary(const char *data, int size)
+{
+    if (size > MaxDistance) {
+        data += size - MaxDistance;
+        size = MaxDistance;
+    }
+    window.assign(data, data + size);
+    dictionarySize = size;
+
+    // Hash every position of the dictionary, later ones win
+    std::fill(dictionaryTable.begin(), dictionaryTable.end(), -1);
+    for (int position = 0; position + MinMatch <= size; ++position)
+        dictionaryTable[hash(window.data() + position)] = int(position);
+}
+
+// This function is called to compress one block
+int Lz4::Compressor::compress(const char *source, int size, char *dest, int capacity)
+{
+    // Put the block right after the dictionary and start from its hashes;
+    // neither allocates once the buffers had their largest size
+    window.resize(size_t(dictionarySize) + size_t(size));
+    if (size > 0)
+        std::memcpy(window.data() + dictionarySize, source, size_t(size));
+    table = dictionaryTable;
+
+    const char *const base = window.data();
+    const int end = dictionarySize + size;
+    const int matchStartLimit = end - MatchStartMargin;
+    const int matchEndLimit = end - LastLiterals;
+
+    char *out = dest;
+    char *const outEnd = dest + capacity;
+    int anchor = dictionarySize;
+    int position = dictionarySize;
+
+    while (position < matchStartLimit) {
+        const quint32 slot = hash(base + position);
+        int match = table[slot];
+        table[slot] = position;
+        if (match < 0 || position - match > MaxDistance || read32(base + match) != read32(base + position)) {
+            // Step faster through data that does not compress
+            position += 1 + ((position - anchor) >> 6);
+            continue;
+        }
+
+        // Grow the match backwards over the pending literals, then forwards
+        while (position > anchor && match > 0 && base[position - 1] == base[match - 1]) {
+            --position;
+            --match;
+        }
+        int length = MinMatch;
+        while (position + length < matchEndLimit && base[position + length] == base[match + length])
+            ++length;
+
+        // Token, literal length, literals, offset and match length
+        const int literals = position - anchor;
+        const int matchLength = length - MinMatch;
+        if (outEnd - out < 1 + literals + literals / 255 + 1 + 2 + matchLength / 255 + 1)
+            return 0;
+        char *token = out++;
+        if (literals >= TokenMax)
+            out = writeLength(out, literals - TokenMax);
+        std::memcpy(out, base + anchor, size_t(literals));
+        out += literals;
+        const int offset = position - match;
+        *out++ = char(offset & 0xff);
+        *out++ = char(offset >> 8);
+        if (matchLength >= TokenMax)
+            out = writeLength(out, matchLength - TokenMax);
+        *token = char((std::min(literals, TokenMax) << 4) | std::min(matchLength, TokenMax));
+
+        position += length;
+        anchor = position;
+
+        // A position inside the match often starts the next one
+        if (position < matchStartLimit)
+            table[hash(base + position - 2)] = position - 2;
+    }
+
+    // The rest goes out as literals of a last sequence without a match
+    const int literals = end - anchor;
+    if (outEnd - out < 1 + literals + literals / 255 + 1)
+        return 0;
+    *out++ = char(std::min(literals, TokenMax) << 4);
+    if (literals >= TokenMax)
+        out = writeLength(out, literals - TokenMax);
+    std::memcpy(out, base + anchor, size_t(literals));
+    out += literals;
+    return int(out - dest);
+}
+
+// Function to decompress a block, checking every length against both buffers
+int Lz4::decompress(const char *source, int size, char *dest, int capacity,
+                    const char *dictionary, int dictionarySize)
+{
+    const quint8 *in = reinterpret_cast<const quint8 *>(source);
+    const quint8 *const inEnd = in + size;
+    char *out = dest;
+    char *const outEnd = dest + capacity;
+
+    for (;;) {
+        if (in == inEnd)
+            return -1;
+        const quint8 token = *in++;
+
+        // Literals
+        int literals = token >> 4;
+        if (literals == TokenMax && !readLength(in, inEnd, &literals))
+            return -1;
+        if (inEnd - in < literals || outEnd - out < literals)
+            return -1;
+        std::memcpy(out, in, size_t(literals));
+        in += literals;
+        out += literals;
+
+        // The last sequence ends the block after its literals
+        if (in == inEnd)
+            break;
+
+        // Match
+        if (inEnd - in < 2)
+            return -1;
+        const int offset = in[0] | (in[1] << 8);
+        in += 2;
+        int length = token & 0x0f;
+        if (length == TokenMax && !readLength(in, inEnd, &length))
+            return -1;
+        length += MinMatch;
+        const int produced = int(out - dest);
+        if (offset == 0 || offset > produced + dictionarySize || outEnd - out < length)
+            return -1;
+
+        // The part of the match that lies in the dictionary
+        if (offset > produced) {
+            const int fromDictionary = std::min(offset - produced, length);
+            std::memcpy(out, dictionary + dictionarySize - (offset - produced), size_t(fromDictionary));
+            out += fromDictionary;
+            length -= fromDictionary;
+        }
+
+        // A match closer than its length repeats what it just wrote
+        const char *match = out - offset;
+        if (offset >= length) {
+            std::memcpy(out, match, size_t(length));
+            out += length;
+        } else {
+            while (length-- > 0)
+                *out++ = *match++;
+        }
+    }
+    return int(out - dest);
+}
@@ -0,0 +1,61 @@
+#ifndef LZ4BLOCK_H
+#define LZ4BLOCK_H
+
+#include <QtGlobal>
+
+#include <vector>
+
+// Compressor and decompressor for the LZ4 block format, see
+// https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md. Blocks made
+// here decode with the reference library and the other way round, also with
+// a dictionary (LZ4_compress_fast_continue after LZ4_loadDict, and
+// LZ4_decompress_safe_usingDict). Small enough to carry instead of a
+// dependency; the compressor is the plain greedy one, tuned for the short,
+// repetitive datagrams of telemetry rather than for files.
+namespace Lz4 {
+
+// Matches reach back at most this far, into the dictionary as well
+constexpr int MaxDistance = 65535;
+
+// Largest compressed size of size input bytes
+constexpr int compressBound(int size) { return size + size / 255 + 16; }
+
+class Compressor
+{
+public:
+    Compressor();
+
+    // Data both sides know in advance, e.g. typical telemetry lines; matches
+    // may point into it as if it came right before every block. Only the
+    // last MaxDistance bytes count.
+    void setDictionary(const char *data, int size);
+
+    // Compresses size bytes into dest; returns the compressed size, or 0 when
+    // it does not fit into capacity bytes
+    int compress(const char *source, int size, char *dest, int capacity);
+
+private:
+    static constexpr int HashLog = 12;
+
+    static quint32 hash(const char *position);
+
+    // The dictionary followed by the block being compressed, so that one
+    // position space covers both
+    std::vector<char> window;
+    int dictionarySize = 0;
+
+    // Last window position of every hashed 4-byte sequence, -1 for none;
+    // the dictionary's positions are kept aside and copied in per block
+    std::vector<int> dictionaryTable;
+    std::vector<int> table;
+};
+
+// Decompresses a block into dest; returns the decompressed size, or -1 when
+// the block is corrupt or does not fit into capacity bytes. The dictionary
+// must be the one the block was compressed with.
+int decompress(const char *source, int size, char *dest, int capacity,
+               const char *dictionary = nullptr, int dictionarySize = 0);
+
+} // namespace Lz4
+
+#endif // LZ4BLOCK_H
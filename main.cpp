@@ -2,6 +2,7 @@
 #include "widget.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 
 #include <QLocale>
 #include <QTranslator>
@@ -19,7 +20,23 @@ int main(int argc, char *argv[])
             break;
         }
     }
+    // A profile given on the command line opens right away; otherwise the
+    // startup profile is shown, and opened if it was saved that way
+    QCommandLineParser parser;
+    const QCommandLineOption profileOption(QStringLiteral("profile"),
+                                           QStringLiteral("Open the bridge with the saved profile <name>."),
+                                           QStringLiteral("name"));
+    parser.addHelpOption();
+    parser.addOption(profileOption);
+    parser.process(a);
+
+    bool autostart = parser.isSet(profileOption);
+    const QString profile = autostart ? parser.value(profileOption) : Profiles::startupProfile(&autostart);
+
+    // Forwarding starts before the window is even shown
     Widget w;
+    if (!profile.isEmpty())
+        w.applyProfile(profile, autostart);
     w.show();
     return a.exec();
 }
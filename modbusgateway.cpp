@@ -0,0 +1,382 @@
+#include "modbusgateway.h"
+
+#include <QtMath>
+
+#include <algorithm>
+
+namespace {
+
+// MBAP header: transaction id, protocol id, length, then the unit address
+constexpr int MbapHeaderSize = 6;
+
+// The MBAP length counts the unit address and the PDU of at most 253 bytes
+constexpr int MinMbapLength = 2;
+constexpr int MaxMbapLength = 254;
+
+// Exception codes sent for the bus
+constexpr quint8 ServerDeviceBusy = 0x06;
+constexpr quint8 TargetFailedToRespond = 0x0b;
+
+// Upper bound of cached answers; expired ones are purged when it is reached
+constexpr int MaxCacheEntries = 1024;
+
+// Lookup table of the Modbus CRC (polynomial 0xa001, reflected)
+struct CrcTable {
+    quint16 values[256];
+
+    CrcTable()
+    {
+        for (int i = 0; i < 256; ++i) {
+            quint16 crc = quint16(i);
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc & 1) ? quint16((crc >> 1) ^ 0xa001) : quint16(crc >> 1);
+            values[i] = crc;
+        }
+    }
+};
+
+const CrcTable crcTable;
+
+quint16 readBigEndian(const char *data)
+{
+    return quint16((quint8(data[0]) << 8) | quint8(data[1]));
+}
+
+void appendBigEndian(QByteArray &buffer, quint16 value)
+{
+    buffer.append(char(value >> 8));
+    buffer.append(char(value & 0xff));
+}
+
+// Reads, and nothing else, may be answered together and from the cache
+bool isRead(const QByteArray &request)
+{
+    const quint8 function = quint8(request.at(1));
+    return request.at(0) != 0 && function >= 0x01 && function <= 0x04;
+}
+
+} // namespace
+
+
+ModbusGateway::ModbusGateway(QObject *parent)
+    : QObject(parent)
+{
+    // Fires when a slave has not answered in time
+    responseTimer = new QTimer(this);
+    responseTimer->setSingleShot(true);
+    connect(responseTimer, &QTimer::timeout, this, &ModbusGateway::handleTimeout);
+
+    // Fires when the bus has been quiet long enough for the next request
+    turnaroundTimer = new QTimer(this);
+    turnaroundTimer->setSingleShot(true);
+    turnaroundTimer->setTimerType(Qt::PreciseTimer);
+    connect(turnaroundTimer, &QTimer::timeout, this, &ModbusGateway::startNext);
+
+    frame.reserve(MbapHeaderSize + MaxRtuSize);
+}
+
+// This function is called to apply the gateway settings when the bridge opens
+void ModbusGateway::configure(const BridgeSettings &settings)
+{
+    reset();
+    limits = settings.modbus;
+    characterTime = settings.bitsPerCharacter() * 1000.0 / qMax(1, settings.baudRate);
+    count = Counters();
+    clock.start();
+}
+
+// This function is called to forget every request, when the bridge closes
+void ModbusGateway::reset()
+{
+    responseTimer->stop();
+    turnaroundTimer->stop();
+    pending.clear();
+    current = Transaction();
+    waitingForResponse = false;
+    pendingWrites.clear();
+    cache.clear();
+    streams.clear();
+}
+
+// Function to compute the CRC that ends an RTU frame
+quint16 ModbusGateway::crc16(const char *data, int size)
+{
+    quint16 crc = 0xffff;
+    for (int i = 0; i < size; ++i)
+        crc = quint16((crc >> 8) ^ crcTable.values[(crc ^ quint8(data[i])) & 0xff]);
+    return crc;
+}
+
+// This function is called with request bytes read from the network side
+void ModbusGateway::handleRequest(const NetworkPeer &from, const char *data, int size, bool stream)
+{
+    // A datagram holds exactly one ADU
+    if (!stream) {
+        handleAdu(from, data, size);
+        return;
+    }
+
+    // Cut the stream into ADUs along the MBAP length
+    QByteArray buffer = streams.take(from.connection);
+    buffer.append(data, size);
+
+    int end = 0;
+    while (buffer.size() - end > MbapHeaderSize) {
+        const int length = readBigEndian(buffer.constData() + end + 4);
+        if (length < MinMbapLength || length > MaxMbapLength) {
+            // There is no way to find the next ADU in this stream, so what
+            // the client sends next would be misread as well
+            ++count.badRequests;
+            emit connectionRejected(from.connection);
+            return;
+        }
+        if (buffer.size() - end < MbapHeaderSize + length)
+            break;
+        end += MbapHeaderSize + length;
+    }
+
+    // Keep the partial ADU before handling the complete ones, which may
+    // reply and so lose the connection
+    if (end < buffer.size())
+        streams.insert(from.connection, buffer.mid(end));
+    for (int offset = 0; offset < end; ) {
+        const int aduSize = MbapHeaderSize + readBigEndian(buffer.constData() + offset + 4);
+        handleAdu(from, buffer.constData() + offset, aduSize);
+        offset += aduSize;
+    }
+}
+
+// This function is called with one MBAP request
+void ModbusGateway::handleAdu(const NetworkPeer &from, const char *adu, int size)
+{
+    if (size < MbapHeaderSize + MinMbapLength || readBigEndian(adu + 4) != size - MbapHeaderSize) {
+        ++count.badRequests;
+        return;
+    }
+    ++count.requests;
+
+    Waiter waiter;
+    waiter.peer = from;
+    waiter.transactionId = readBigEndian(adu);
+    waiter.protocolId = readBigEndian(adu + 2);
+
+    // The unit address and the PDU go to the bus as they are
+    const QByteArray request(adu + MbapHeaderSize, size - MbapHeaderSize);
+    const quint8 unit = quint8(request.at(0));
+    const bool read = isRead(request);
+
+    if (read) {
+        // Answer from the cache while no write to the unit is on its way
+        if (limits.cacheTtl > 0 && writesPending(unit) == 0) {
+            const auto it = cache.constFind(request);
+            if (it != cache.constEnd() && it->expiry > clock.elapsed()) {
+                ++count.cacheHits;
+                const QByteArray response = it->response;
+                reply(waiter, response.constData(), response.size());
+                return;
+            }
+        }
+
+        // Ride along with the same read if it is already queued
+        if (coalesce(request, waiter))
+            return;
+    }
+
+    // Tell the client to come back later rather than queue without bound
+    if (pending.size() >= limits.queueLimit) {
+        ++count.busyReplies;
+        replyException(waiter, request, ServerDeviceBusy);
+        return;
+    }
+
+    // Anything but a read may change the unit, a broadcast every unit
+    if (!read) {
+        ++pendingWrites[unit];
+        for (auto it = cache.begin(); it != cache.end(); ) {
+            if (unit == 0 || quint8(it.key().at(0)) == unit)
+                it = cache.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    Transaction transaction;
+    transaction.request = request;
+    transaction.waiters.append(waiter);
+    transaction.cacheable = read;
+    pending.enqueue(transaction);
+    startNext();
+}
+
+// This function is called to add a client to an identical read that has not
+// been answered yet; a write to the unit queued in between rules that out
+bool ModbusGateway::coalesce(const QByteArray &request, const Waiter &waiter)
+{
+    const char unit = request.at(0);
+    for (int i = pending.size() - 1; i >= 0; --i) {
+        Transaction &transaction = pending[i];
+        if (transaction.request == request) {
+            transaction.waiters.append(waiter);
+            return true;
+        }
+        if (!transaction.cacheable && (transaction.request.at(0) == unit || transaction.request.at(0) == 0))
+            return false;
+    }
+
+    if (waitingForResponse && current.cacheable && current.request == request) {
+        current.waiters.append(waiter);
+        return true;
+    }
+    return false;
+}
+
+// This slot is called to put the next request on the bus once it is free
+void ModbusGateway::startNext()
+{
+    if (waitingForResponse || turnaroundTimer->isActive() || pending.isEmpty())
+        return;
+
+    current = pending.dequeue();
+
+    // Frame the request for RTU: address, PDU, CRC low byte first
+    const quint16 crc = crc16(current.request.constData(), current.request.size());
+    frame.resize(0);
+    frame.append(current.request);
+    frame.append(char(crc & 0xff));
+    frame.append(char(crc >> 8));
+    emit serialFrameReady(frame.constData(), frame.size());
+
+    // Nobody answers a broadcast; give the slaves time to carry it out
+    if (current.request.at(0) == 0) {
+        writeDone(current);
+        current = Transaction();
+        turnaroundTimer->start(limits.broadcastDelay);
+        return;
+    }
+
+    // The slave's time starts once the request has left the port
+    waitingForResponse = true;
+    responseTimer->start(limits.timeout + qCeil(frame.size() * characterTime));
+}
+
+// This function is called with every frame read from the serial bus
+void ModbusGateway::handleResponse(const char *data, int size)
+{
+    if (!waitingForResponse || size < 4) {
+        ++count.strayFrames;
+        return;
+    }
+
+    // A corrupted answer is ignored; the slave may repeat it before the timeout
+    const quint16 crc = quint16(quint8(data[size - 2]) | (quint8(data[size - 1]) << 8));
+    if (crc16(data, size - 2) != crc) {
+        ++count.crcErrors;
+        return;
+    }
+
+    // It must come from the addressed slave and answer the function asked for
+    if (data[0] != current.request.at(0) || (quint8(data[1]) & 0x7f) != quint8(current.request.at(1))) {
+        ++count.strayFrames;
+        return;
+    }
+
+    finish(QByteArray(data, size - 2));
+}
+
+// This function is called to answer the clients of the request on the bus
+void ModbusGateway::finish(const QByteArray &response)
+{
+    responseTimer->stop();
+    waitingForResponse = false;
+    const Transaction done = current;
+    current = Transaction();
+    writeDone(done);
+
+    // Keep the answer to a read for a little while, unless it is an exception
+    const quint8 unit = quint8(done.request.at(0));
+    if (done.cacheable && limits.cacheTtl > 0 && !(quint8(response.at(1)) & 0x80) && writesPending(unit) == 0) {
+        if (cache.size() >= MaxCacheEntries) {
+            const qint64 now = clock.elapsed();
+            for (auto it = cache.begin(); it != cache.end(); ) {
+                if (it->expiry <= now)
+                    it = cache.erase(it);
+                else
+                    ++it;
+            }
+            if (cache.size() >= MaxCacheEntries)
+                cache.clear();
+        }
+        cache.insert(done.request, CacheEntry{response, clock.elapsed() + limits.cacheTtl});
+    }
+
+    for (const Waiter &waiter : done.waiters)
+        reply(waiter, response.constData(), response.size());
+
+    turnaroundTimer->start(limits.turnaround);
+}
+
+// This slot is called when the addressed slave did not answer
+void ModbusGateway::handleTimeout()
+{
+    ++count.timeouts;
+    waitingForResponse = false;
+    const Transaction done = current;
+    current = Transaction();
+    writeDone(done);
+
+    for (const Waiter &waiter : done.waiters)
+        replyException(waiter, done.request, TargetFailedToRespond);
+
+    turnaroundTimer->start(limits.turnaround);
+}
+
+// This function is called to forget the requests of a client that has gone;
+// its writes still go to the bus
+void ModbusGateway::dropConnection(quint64 connection)
+{
+    streams.remove(connection);
+
+    const auto isGone = [connection](const Waiter &waiter) { return waiter.peer.connection == connection; };
+    for (int i = pending.size() - 1; i >= 0; --i) {
+        Transaction &transaction = pending[i];
+        transaction.waiters.erase(std::remove_if(transaction.waiters.begin(), transaction.waiters.end(), isGone),
+                                  transaction.waiters.end());
+        if (transaction.waiters.isEmpty() && transaction.cacheable)
+            pending.removeAt(i);
+    }
+    current.waiters.erase(std::remove_if(current.waiters.begin(), current.waiters.end(), isGone),
+                          current.waiters.end());
+}
+
+// This function is called to send an answer with the client's MBAP header
+void ModbusGateway::reply(const Waiter &waiter, const char *response, int size)
+{
+    frame.resize(0);
+    appendBigEndian(frame, waiter.transactionId);
+    appendBigEndian(frame, waiter.protocolId);
+    appendBigEndian(frame, quint16(size));
+    frame.append(response, size);
+    emit replyReady(waiter.peer, frame.constData(), frame.size());
+}
+
+// This function is called to answer a request with an exception of the gateway
+void ModbusGateway::replyException(const Waiter &waiter, const QByteArray &request, quint8 code)
+{
+    const char response[3] = {request.at(0), char(quint8(request.at(1)) | 0x80), char(code)};
+    reply(waiter, response, sizeof(response));
+}
+
+int ModbusGateway::writesPending(quint8 unit) const
+{
+    return pendingWrites.value(unit) + (unit != 0 ? pendingWrites.value(0) : 0);
+}
+
+void ModbusGateway::writeDone(const Transaction &transaction)
+{
+    if (transaction.cacheable || transaction.request.isEmpty())
+        return;
+
+    const quint8 unit = quint8(transaction.request.at(0));
+    if (--pendingWrites[unit] <= 0)
+        pendingWrites.remove(unit);
+}
@@ -0,0 +1,120 @@
+#ifndef MODBUSGATEWAY_H
+#define MODBUSGATEWAY_H
+
+#include "bridgesettings.h"
+#include "networkio.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QQueue>
+#include <QTimer>
+#include <QVector>
+
+// Translates between Modbus TCP/UDP (MBAP) clients on the network side and
+// Modbus RTU slaves on the serial bus. Requests from all the clients share
+// one queue and go to the bus one at a time, keeping the turnaround gap
+// between them; identical reads are answered together and, for a short
+// while, from a cache.
+class ModbusGateway : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Largest RTU frame: address, PDU and CRC
+    static constexpr int MaxRtuSize = 256;
+
+    struct Counters {
+        quint64 requests = 0;
+        quint64 cacheHits = 0;
+        quint64 timeouts = 0;
+        quint64 crcErrors = 0;
+        quint64 busyReplies = 0;    // requests refused because the queue was full
+        quint64 badRequests = 0;    // ADUs that were cut short or had an impossible length
+        quint64 strayFrames = 0;    // serial frames nobody asked for
+    };
+
+    explicit ModbusGateway(QObject *parent = nullptr);
+
+    void configure(const BridgeSettings &settings);
+    void reset();
+
+    // Request bytes from the network; on stream transports any piece of the stream
+    void handleRequest(const NetworkPeer &from, const char *data, int size, bool stream);
+
+    // A frame read from the serial bus, cut on the RTU silence
+    void handleResponse(const char *data, int size);
+
+    // Forget the requests of a client that has gone
+    void dropConnection(quint64 connection);
+
+    const Counters &counters() const { return count; }
+
+    static quint16 crc16(const char *data, int size);
+
+signals:
+    // The data is only valid during the emission
+    void serialFrameReady(const char *data, int size);
+    void replyReady(const NetworkPeer &to, const char *data, int size);
+
+    // A stream whose ADUs can no longer be told apart; its connection has to go
+    void connectionRejected(quint64 connection);
+
+private:
+    // A client waiting for an answer, with its MBAP header to echo
+    struct Waiter {
+        NetworkPeer peer;
+        quint16 transactionId;
+        quint16 protocolId;
+    };
+
+    // One request for the bus; the unit address and PDU also key the cache
+    struct Transaction {
+        QByteArray request;
+        QVector<Waiter> waiters;
+        bool cacheable;
+    };
+
+    struct CacheEntry {
+        QByteArray response;
+        qint64 expiry;
+    };
+
+    void handleAdu(const NetworkPeer &from, const char *adu, int size);
+    bool coalesce(const QByteArray &request, const Waiter &waiter);
+    void startNext();
+    void finish(const QByteArray &response);
+    void handleTimeout();
+    void reply(const Waiter &waiter, const char *response, int size);
+    void replyException(const Waiter &waiter, const QByteArray &request, quint8 code);
+    int writesPending(quint8 unit) const;
+    void writeDone(const Transaction &transaction);
+
+    BridgeSettings::Modbus limits;
+    double characterTime = 0;
+
+    QTimer *responseTimer;
+    QTimer *turnaroundTimer;
+
+    QQueue<Transaction> pending;
+    Transaction current;
+    bool waitingForResponse = false;
+
+    // Requests that may change registers, per unit, from queueing until they
+    // are done; reads of those units are neither cached nor served from cache
+    QHash<quint8, int> pendingWrites;
+
+    QHash<QByteArray, CacheEntry> cache;
+    QElapsedTimer clock;
+
+    // Partial ADUs of the stream connections
+    QHash<quint64, QByteArray> streams;
+
+    // Reused for every RTU frame and MBAP reply
+    QByteArray frame;
+
+    Counters count;
+};
+
+#endif // MODBUSGATEWAY_H
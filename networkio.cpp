@@ -0,0 +1,500 @@
+#include "networkio.h"
+
+namespace {
+
+// Largest piece of a TCP stream handed to the engine as one datagram
+constexpr qint64 MaxStreamChunk = 16384;
+
+// Bytes handed to a TCP socket ahead of the network; the rest stays shared
+// in the client queue
+constexpr qint64 TcpWriteWindow = 16384;
+
+// Bytes a TCP socket buffers ahead of the engine. Past it Qt stops reading
+// the socket, the kernel buffer fills and the peer is held back by the TCP
+// window, so a paused engine bounds the memory a stream can take.
+constexpr qint64 TcpReadBuffer = 4 * MaxStreamChunk;
+
+} // namespace
+
+
+// This function is called to read a datagram whose sender does not matter,
+// as on a connection to a single server
+qint64 NetworkIo::readDatagramFrom(char *data, qint64 maxSize, NetworkPeer *from)
+{
+    *from = NetworkPeer();
+    return readDatagram(data, maxSize);
+}
+
+qint64 NetworkIo::writeDatagramTo(const char *data, qint64 size, const NetworkPeer &to)
+{
+    return writeDatagram(data, size, to.endpoint);
+}
+
+
+UdpIo::UdpIo(QObject *parent)
+    : NetworkIo(parent)
+{
+    udpSocket = new QUdpSocket(this);
+
+    // Pass the socket notification on
+    connect(udpSocket, &QUdpSocket::readyRead, this, &NetworkIo::readyRead);
+}
+
+// This function is called to listen on the local port, joining the group in multicast mode
+bool UdpIo::open(const BridgeSettings &settings)
+{
+    lastError.clear();
+    multicastGroup = QHostAddress();
+
+    if (settings.transport != BridgeSettings::MulticastTransport)
+        return udpSocket->bind(QHostAddress::AnyIPv4, settings.localPort);
+
+    // Other members may listen on the same host and port
+    const QHostAddress group(settings.destinationIp);
+    if (!group.isMulticast()) {
+        lastError = tr("%1 is not a multicast group address").arg(settings.destinationIp);
+        return false;
+    }
+    if (!udpSocket->bind(QHostAddress::AnyIPv4, settings.localPort,
+                         QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint)
+        || !udpSocket->joinMulticastGroup(group)) {
+        lastError = udpSocket->errorString();
+        udpSocket->close();
+        return false;
+    }
+    udpSocket->setSocketOption(QAbstractSocket::MulticastTtlOption, settings.multicastTtl);
+    multicastGroup = group;
+    return true;
+}
+
+void UdpIo::close()
+{
+    if (!multicastGroup.isNull())
+        udpSocket->leaveMulticastGroup(multicastGroup);
+    multicastGroup = QHostAddress();
+    udpSocket->close();
+}
+
+QString UdpIo::errorString() const
+{
+    return lastError.isEmpty() ? udpSocket->errorString() : lastError;
+}
+
+bool UdpIo::hasPendingDatagrams()
+{
+    return udpSocket->hasPendingDatagrams();
+}
+
+qint64 UdpIo::pendingDatagramSize()
+{
+    return udpSocket->pendingDatagramSize();
+}
+
+qint64 UdpIo::readDatagram(char *data, qint64 maxSize)
+{
+    return udpSocket->readDatagram(data, maxSize);
+}
+
+qint64 UdpIo::readDatagramFrom(char *data, qint64 maxSize, NetworkPeer *from)
+{
+    QHostAddress address;
+    quint16 port = 0;
+    const qint64 size = udpSocket->readDatagram(data, maxSize, &address, &port);
+    *from = NetworkPeer();
+    from->endpoint = UdpEndpoint(address, port);
+    return size;
+}
+
+void UdpIo::skipDatagram()
+{
+    char discard;
+    udpSocket->readDatagram(&discard, 0);
+}
+
+qint64 UdpIo::writeDatagram(const char *data, qint64 size, const UdpEndpoint &to)
+{
+    return udpSocket->writeDatagram(data, size, to.address(), to.port());
+}
+
+
+TcpServerIo::TcpServerIo(QObject *parent)
+    : NetworkIo(parent)
+{
+    server = new QTcpServer(this);
+
+    // Take every new client into the fan-out
+    connect(server, &QTcpServer::newConnection, this, &TcpServerIo::acceptClients);
+}
+
+TcpServerIo::~TcpServerIo()
+{
+    close();
+}
+
+// This function is called to listen for clients on the local port
+bool TcpServerIo::open(const BridgeSettings &settings)
+{
+    clientQueueLimit = settings.tcp.clientQueueLimit;
+    return server->listen(QHostAddress::AnyIPv4, settings.localPort);
+}
+
+void TcpServerIo::close()
+{
+    server->close();
+
+    // Let go of the clients without waiting for their queues
+    const QVector<Client> closing = clients;
+    clients.clear();
+    readCursor = 0;
+    for (const Client &client : closing) {
+        client.socket->disconnect(this);
+        client.socket->abort();
+        client.socket->deleteLater();
+    }
+}
+
+QString TcpServerIo::errorString() const
+{
+    return server->errorString();
+}
+
+// This slot is called when clients have connected
+void TcpServerIo::acceptClients()
+{
+    while (QTcpSocket *socket = server->nextPendingConnection()) {
+        // Serial data is small and latency matters more than packing
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        socket->setReadBufferSize(TcpReadBuffer);
+
+        Client client;
+        client.socket = socket;
+        client.id = ++lastClientId;
+        clients.append(client);
+
+        // Keep the client queue moving as the socket drains
+        connect(socket, &QTcpSocket::bytesWritten, this, [this, socket] {
+            if (Client *client = clientOf(socket))
+                pumpClient(*client);
+        });
+        connect(socket, &QTcpSocket::readyRead, this, &NetworkIo::readyRead);
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket] {
+            dropClient(socket, tr("disconnected"));
+        });
+
+        emit infoMessage(tr("TCP client %1:%2 connected, %3 clients")
+                             .arg(socket->peerAddress().toString())
+                             .arg(socket->peerPort())
+                             .arg(clients.size()));
+    }
+}
+
+// This function is called to move a client's queue into its socket, a window at a time
+void TcpServerIo::pumpClient(Client &client)
+{
+    while (!client.queue.isEmpty() && client.socket->bytesToWrite() < TcpWriteWindow) {
+        const QByteArray &head = client.queue.head();
+        const qint64 written = client.socket->write(head.constData() + client.headOffset,
+                                                    head.size() - client.headOffset);
+        if (written <= 0)
+            break;
+
+        client.queuedBytes -= written;
+        client.headOffset += int(written);
+        if (client.headOffset == head.size()) {
+            client.queue.dequeue();
+            client.headOffset = 0;
+        }
+    }
+}
+
+// This function is called to forget a client, closing its connection
+void TcpServerIo::dropClient(QTcpSocket *socket, const QString &reason)
+{
+    for (int i = 0; i < clients.size(); ++i) {
+        if (clients.at(i).socket != socket)
+            continue;
+
+        // Name the peer before the socket forgets it
+        const QString peer = QStringLiteral("%1:%2").arg(socket->peerAddress().toString()).arg(socket->peerPort());
+
+        const quint64 id = clients.at(i).id;
+        clients.removeAt(i);
+        if (i < readCursor)
+            --readCursor;
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+
+        emit infoMessage(tr("TCP client %1 %2, %3 clients").arg(peer, reason).arg(clients.size()));
+        emit connectionClosed(id);
+        return;
+    }
+}
+
+TcpServerIo::Client *TcpServerIo::clientOf(QTcpSocket *socket)
+{
+    for (Client &client : clients) {
+        if (client.socket == socket)
+            return &client;
+    }
+    return nullptr;
+}
+
+// This function is called to find a client that has sent data, starting
+// from the one whose turn it is; it stays the same one until it was read
+QTcpSocket *TcpServerIo::readableClient()
+{
+    for (int n = 0; n < clients.size(); ++n) {
+        const int i = (readCursor + n) % clients.size();
+        if (clients.at(i).socket->bytesAvailable() > 0) {
+            readCursor = i;
+            return clients.at(i).socket;
+        }
+    }
+    return nullptr;
+}
+
+bool TcpServerIo::hasPendingDatagrams()
+{
+    return readableClient() != nullptr;
+}
+
+qint64 TcpServerIo::pendingDatagramSize()
+{
+    QTcpSocket *socket = readableClient();
+    return socket ? qMin(socket->bytesAvailable(), MaxStreamChunk) : -1;
+}
+
+// This function is called to read what one client has sent; all the clients
+// write to the same serial port
+qint64 TcpServerIo::readDatagram(char *data, qint64 maxSize)
+{
+    QTcpSocket *socket = readableClient();
+    if (!socket)
+        return -1;
+
+    // The next read goes to the next client, so none can starve the others
+    ++readCursor;
+    return socket->read(data, qMin(maxSize, MaxStreamChunk));
+}
+
+// This function is called to read what one client has sent, telling which client it was
+qint64 TcpServerIo::readDatagramFrom(char *data, qint64 maxSize, NetworkPeer *from)
+{
+    *from = NetworkPeer();
+    QTcpSocket *socket = readableClient();
+    if (!socket)
+        return -1;
+
+    from->connection = clientOf(socket)->id;
+    ++readCursor;
+    return socket->read(data, qMin(maxSize, MaxStreamChunk));
+}
+
+void TcpServerIo::skipDatagram()
+{
+    if (QTcpSocket *socket = readableClient()) {
+        ++readCursor;
+        socket->skip(qMin(socket->bytesAvailable(), MaxStreamChunk));
+    }
+}
+
+// This function is called to drop a client that broke the protocol
+void TcpServerIo::closeConnection(quint64 connection)
+{
+    for (const Client &client : qAsConst(clients)) {
+        if (client.id == connection) {
+            dropClient(client.socket, tr("sent an unreadable stream"));
+            return;
+        }
+    }
+}
+
+// This function is called to send a datagram to every client
+qint64 TcpServerIo::writeDatagram(const char *data, qint64 size, const UdpEndpoint &to)
+{
+    Q_UNUSED(to);
+
+    if (clients.isEmpty())
+        return size;
+
+    // One copy of the data, shared by all the client queues
+    const QByteArray packet(data, int(size));
+
+    for (int i = clients.size() - 1; i >= 0; --i)
+        queueToClient(clients[i], packet);
+    return size;
+}
+
+// This function is called to send a datagram to one client only
+qint64 TcpServerIo::writeDatagramTo(const char *data, qint64 size, const NetworkPeer &to)
+{
+    for (Client &client : clients) {
+        if (client.id == to.connection)
+            return queueToClient(client, QByteArray(data, int(size))) ? size : -1;
+    }
+
+    // The client has gone in the meantime
+    return -1;
+}
+
+// This function is called to queue a datagram for a client; returns false
+// when the client was dropped instead
+bool TcpServerIo::queueToClient(Client &client, const QByteArray &packet)
+{
+    // A client that lags this far behind is stalled; dropping data would
+    // corrupt its stream, so drop the connection instead
+    if (client.queuedBytes + packet.size() > clientQueueLimit) {
+        dropClient(client.socket, tr("fell %1 bytes behind and was dropped").arg(client.queuedBytes));
+        return false;
+    }
+
+    client.queue.enqueue(packet);
+    client.queuedBytes += packet.size();
+    pumpClient(client);
+    return true;
+}
+
+
+TcpClientIo::TcpClientIo(QObject *parent)
+    : NetworkIo(parent)
+{
+    socket = new QTcpSocket(this);
+    socket->setReadBufferSize(TcpReadBuffer);
+
+    reconnectTimer = new QTimer(this);
+    reconnectTimer->setSingleShot(true);
+    connect(reconnectTimer, &QTimer::timeout, this, &TcpClientIo::connectToDestination);
+
+    // Pass the socket notification on and follow the connection state
+    connect(socket, &QTcpSocket::readyRead, this, &NetworkIo::readyRead);
+    connect(socket, &QTcpSocket::connected, this, &TcpClientIo::handleConnected);
+    connect(socket, &QTcpSocket::stateChanged, this, [this](QAbstractSocket::SocketState state) {
+        if (state == QAbstractSocket::UnconnectedState)
+            handleDisconnected();
+    });
+}
+
+// This function is called to start connecting; the bridge is open even
+// while the server is not reachable yet
+bool TcpClientIo::open(const BridgeSettings &settings)
+{
+    host = settings.destinationIp;
+    port = settings.destinationPort;
+    limits = settings.tcp;
+    reconnectDelay = limits.reconnectMin;
+    opened = true;
+    connectToDestination();
+    return true;
+}
+
+void TcpClientIo::close()
+{
+    opened = false;
+    reconnectTimer->stop();
+    socket->abort();
+}
+
+QString TcpClientIo::errorString() const
+{
+    return socket->errorString();
+}
+
+// This function is called when the destination changed while the bridge runs
+void TcpClientIo::setDestination(const QString &newHost, quint16 newPort)
+{
+    if (newHost == host && newPort == port)
+        return;
+
+    host = newHost;
+    port = newPort;
+    if (!opened)
+        return;
+
+    // Start over with the new server right away
+    socket->abort();
+    reconnectTimer->stop();
+    reconnectDelay = limits.reconnectMin;
+    connectToDestination();
+}
+
+// This slot is called to (re)connect to the destination
+void TcpClientIo::connectToDestination()
+{
+    if (!opened || socket->state() != QAbstractSocket::UnconnectedState)
+        return;
+    socket->connectToHost(host, port);
+}
+
+// This slot is called once the connection is up
+void TcpClientIo::handleConnected()
+{
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    reconnectDelay = limits.reconnectMin;
+    emit infoMessage(tr("Connected to TCP server %1:%2").arg(host).arg(port));
+}
+
+// This slot is called when the connection is lost or could not be made
+void TcpClientIo::handleDisconnected()
+{
+    if (!opened || reconnectTimer->isActive())
+        return;
+
+    emit infoMessage(tr("No connection to TCP server %1:%2 (%3), retrying in %4 ms")
+                         .arg(host).arg(port).arg(socket->errorString()).arg(reconnectDelay));
+
+    // Back off exponentially so that a dead server is not hammered
+    reconnectTimer->start(reconnectDelay);
+    reconnectDelay = qMin(reconnectDelay * 2, limits.reconnectMax);
+}
+
+bool TcpClientIo::hasPendingDatagrams()
+{
+    return socket->bytesAvailable() > 0;
+}
+
+qint64 TcpClientIo::pendingDatagramSize()
+{
+    return qMin(socket->bytesAvailable(), MaxStreamChunk);
+}
+
+qint64 TcpClientIo::readDatagram(char *data, qint64 maxSize)
+{
+    return socket->read(data, qMin(maxSize, MaxStreamChunk));
+}
+
+void TcpClientIo::skipDatagram()
+{
+    socket->skip(qMin(socket->bytesAvailable(), MaxStreamChunk));
+}
+
+// This function is called when the server broke the protocol; the connection
+// is made again after the usual delay
+void TcpClientIo::closeConnection(quint64 connection)
+{
+    if (socket->state() == QAbstractSocket::UnconnectedState)
+        return;
+    socket->abort();
+    emit connectionClosed(connection);
+}
+
+// This function is called to send a datagram as part of the stream
+qint64 TcpClientIo::writeDatagram(const char *data, qint64 size, const UdpEndpoint &to)
+{
+    Q_UNUSED(to);
+
+    // Nothing can be sent until the connection is back
+    if (socket->state() != QAbstractSocket::ConnectedState)
+        return -1;
+
+    // Like a stalled server client, a stalled server gets a fresh connection
+    // rather than a stream with a hole in it
+    if (socket->bytesToWrite() + size > limits.clientQueueLimit) {
+        emit infoMessage(tr("TCP server %1:%2 fell %3 bytes behind, reconnecting")
+                             .arg(host).arg(port).arg(socket->bytesToWrite()));
+        socket->abort();
+        return -1;
+    }
+
+    return socket->write(data, size);
+}
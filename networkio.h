@@ -0,0 +1,205 @@
+#ifndef NETWORKIO_H
+#define NETWORKIO_H
+
+#include "bridgesettings.h"
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QObject>
+#include <QQueue>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUdpSocket>
+#include <QVector>
+
+// A resolved UDP destination. Never modified in place: the engine replaces it
+// as a whole, so a datagram always goes to a consistent address/port pair.
+class UdpEndpoint
+{
+public:
+    UdpEndpoint() = default;
+    UdpEndpoint(const QHostAddress &address, quint16 port)
+        : hostAddress(address), portNumber(port) {}
+
+    const QHostAddress &address() const { return hostAddress; }
+    quint16 port() const { return portNumber; }
+    bool isValid() const { return !hostAddress.isNull() && portNumber != 0; }
+
+private:
+    QHostAddress hostAddress;
+    quint16 portNumber = 0;
+};
+
+// Where a datagram came from, so that an answer can go back to it: the
+// sender's address for datagram transports, the connection for stream ones
+struct NetworkPeer {
+    UdpEndpoint endpoint;
+    quint64 connection = 0;
+};
+
+// Network side of the bridge as the engine sees it. Datagram transports keep
+// message boundaries; stream transports hand out whatever has arrived as one
+// "datagram" and send every datagram as part of the stream.
+class NetworkIo : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+    // Bind, listen or connect, depending on the transport
+    virtual bool open(const BridgeSettings &settings) = 0;
+    virtual void close() = 0;
+    virtual QString errorString() const = 0;
+
+    // Whether writeDatagram() needs a resolved destination endpoint
+    virtual bool needsEndpoint() const { return true; }
+
+    // Connection oriented transports follow destination changes here
+    virtual void setDestination(const QString &host, quint16 port) { Q_UNUSED(host); Q_UNUSED(port); }
+
+    // Whether datagrams are pieces of a byte stream rather than messages
+    virtual bool isStream() const { return false; }
+
+    virtual bool hasPendingDatagrams() = 0;
+    virtual qint64 pendingDatagramSize() = 0;
+    virtual qint64 readDatagram(char *data, qint64 maxSize) = 0;
+    virtual void skipDatagram() = 0;
+    virtual qint64 writeDatagram(const char *data, qint64 size, const UdpEndpoint &to) = 0;
+
+    // Like readDatagram(), also telling who sent the datagram
+    virtual qint64 readDatagramFrom(char *data, qint64 maxSize, NetworkPeer *from);
+
+    // Send to one peer only, such as the client that asked a question
+    virtual qint64 writeDatagramTo(const char *data, qint64 size, const NetworkPeer &to);
+
+    // Stream transports drop a connection whose stream can no longer be read
+    virtual void closeConnection(quint64 connection) { Q_UNUSED(connection); }
+
+signals:
+    void readyRead();
+    void infoMessage(const QString &message);
+
+    // Emitted when a connection reported by readDatagramFrom() is gone
+    void connectionClosed(quint64 connection);
+
+    // Emitted when datagrams that writeDatagram() accepted into a batch
+    // could not be sent after all
+    void datagramsDropped(int count);
+
+    // Emitted when received datagrams were cut short by a too small buffer
+    // and had to be discarded
+    void datagramsTruncated(int count);
+};
+
+// UDP unicast, broadcast and multicast built on QUdpSocket
+class UdpIo : public NetworkIo
+{
+    Q_OBJECT
+
+public:
+    explicit UdpIo(QObject *parent = nullptr);
+
+    bool open(const BridgeSettings &settings) override;
+    void close() override;
+    QString errorString() const override;
+    bool hasPendingDatagrams() override;
+    qint64 pendingDatagramSize() override;
+    qint64 readDatagram(char *data, qint64 maxSize) override;
+    void skipDatagram() override;
+    qint64 writeDatagram(const char *data, qint64 size, const UdpEndpoint &to) override;
+    qint64 readDatagramFrom(char *data, qint64 maxSize, NetworkPeer *from) override;
+
+private:
+    QUdpSocket *udpSocket;
+    QHostAddress multicastGroup;
+    QString lastError;
+};
+
+// TCP server that sends the serial stream to every connected client. Each
+// datagram becomes one implicitly shared buffer queued for all the clients;
+// a client that falls too far behind is disconnected instead of holding up
+// the others.
+class TcpServerIo : public NetworkIo
+{
+    Q_OBJECT
+
+public:
+    explicit TcpServerIo(QObject *parent = nullptr);
+    ~TcpServerIo();
+
+    bool open(const BridgeSettings &settings) override;
+    void close() override;
+    QString errorString() const override;
+    bool needsEndpoint() const override { return false; }
+    bool isStream() const override { return true; }
+    bool hasPendingDatagrams() override;
+    qint64 pendingDatagramSize() override;
+    qint64 readDatagram(char *data, qint64 maxSize) override;
+    void skipDatagram() override;
+    qint64 writeDatagram(const char *data, qint64 size, const UdpEndpoint &to) override;
+    qint64 readDatagramFrom(char *data, qint64 maxSize, NetworkPeer *from) override;
+    qint64 writeDatagramTo(const char *data, qint64 size, const NetworkPeer &to) override;
+    void closeConnection(quint64 connection) override;
+
+private:
+    struct Client {
+        QTcpSocket *socket;
+        quint64 id = 0;
+        QQueue<QByteArray> queue;
+        int headOffset = 0;
+        qint64 queuedBytes = 0;
+    };
+
+    void acceptClients();
+    void pumpClient(Client &client);
+    bool queueToClient(Client &client, const QByteArray &packet);
+    void dropClient(QTcpSocket *socket, const QString &reason);
+    Client *clientOf(QTcpSocket *socket);
+    QTcpSocket *readableClient();
+
+    QTcpServer *server;
+    QVector<Client> clients;
+    int readCursor = 0;
+    qint64 clientQueueLimit = 0;
+    quint64 lastClientId = 0;
+};
+
+// TCP client that keeps a connection to the destination, reconnecting with
+// an exponential backoff whenever it is lost
+class TcpClientIo : public NetworkIo
+{
+    Q_OBJECT
+
+public:
+    explicit TcpClientIo(QObject *parent = nullptr);
+
+    bool open(const BridgeSettings &settings) override;
+    void close() override;
+    QString errorString() const override;
+    bool needsEndpoint() const override { return false; }
+    bool isStream() const override { return true; }
+    void setDestination(const QString &host, quint16 port) override;
+    bool hasPendingDatagrams() override;
+    qint64 pendingDatagramSize() override;
+    qint64 readDatagram(char *data, qint64 maxSize) override;
+    void skipDatagram() override;
+    qint64 writeDatagram(const char *data, qint64 size, const UdpEndpoint &to) override;
+    void closeConnection(quint64 connection) override;
+
+private:
+    void connectToDestination();
+    void handleConnected();
+    void handleDisconnected();
+
+    QTcpSocket *socket;
+    QTimer *reconnectTimer;
+    QString host;
+    quint16 port = 0;
+    BridgeSettings::Tcp limits;
+    int reconnectDelay = 0;
+    bool opened = false;
+};
+
+#endif // NETWORKIO_H
@@ -0,0 +1,144 @@
+#include "packetizer.h"
+
+#include <QtMath>
+
+
+Packetizer::Packetizer(QObject *parent)
+    : QObject(parent)
+{
+    // Fires when the line has been quiet for the inter-character gap
+    idleTimer = new QTimer(this);
+    idleTimer->setSingleShot(true);
+    idleTimer->setTimerType(Qt::PreciseTimer);
+    connect(idleTimer, &QTimer::timeout, this, &Packetizer::flush);
+
+    // Fires when the oldest buffered byte has waited for the flush timeout
+    deadlineTimer = new QTimer(this);
+    deadlineTimer->setSingleShot(true);
+    deadlineTimer->setTimerType(Qt::PreciseTimer);
+    connect(deadlineTimer, &QTimer::timeout, this, &Packetizer::flush);
+}
+
+// This function is called to apply the framing settings when the bridge opens
+void Packetizer::configure(const BridgeSettings &settings)
+{
+    clear();
+
+    framing = settings.framing;
+    framing.maxSize = qMax(1, framing.maxSize);
+    framing.fixedLength = qBound(1, framing.fixedLength, framing.maxSize);
+    if (framing.delimiter.isEmpty())
+        framing.delimiter = QByteArray("\r\n");
+
+    // Turn the idle gap from character times into milliseconds; timers cannot
+    // go below 1 ms, which is longer than 3.5 characters above ~38400 baud
+    const double characterTime = settings.bitsPerCharacter() * 1000.0 / qMax(1, settings.baudRate);
+    idleTimer->setInterval(qMax(1, qCeil(framing.idleCharacters * characterTime)));
+    deadlineTimer->setInterval(qMax(1, framing.flushTimeout));
+
+    // Reserve room for a full datagram plus one serial read up front, so that
+    // the buffer is not reallocated while forwarding
+    const int capacity = framing.maxSize + MaxAppendSize;
+    if (pending.capacity() < capacity) {
+        pending.reserve(capacity);
+        ++allocations;
+    }
+}
+
+// This function is called with every chunk read from the serial port and
+// the time it was read at
+void Packetizer::append(const char *data, int size, qint64 readTime)
+{
+    // Raw framing forwards every read as is, split only at the size limit
+    if (framing.mode == BridgeSettings::RawFraming) {
+        emittedTime = readTime;
+        for (int offset = 0; offset < size; offset += framing.maxSize)
+            emit packetReady(data + offset, qMin(size - offset, framing.maxSize));
+        return;
+    }
+
+    // Start the flush deadline when the first byte of a packet arrives
+    if (pending.isEmpty()) {
+        pendingTime = readTime;
+        deadlineTimer->start();
+    }
+
+    // Copy into the reserved buffer; count it if it ever has to grow
+    const int capacity = pending.capacity();
+    pending.append(data, size);
+    if (pending.capacity() != capacity)
+        ++allocations;
+
+    // Emit all the packets that are complete now
+    const int pendingBefore = pending.size();
+    switch (framing.mode) {
+    case BridgeSettings::SizeFraming:
+    case BridgeSettings::IdleFraming:
+        while (pending.size() >= framing.maxSize)
+            emitPacket(framing.maxSize);
+        break;
+    case BridgeSettings::FixedFraming:
+        while (pending.size() >= framing.fixedLength)
+            emitPacket(framing.fixedLength);
+        break;
+    case BridgeSettings::DelimiterFraming:
+        for (;;) {
+            const int index = pending.indexOf(framing.delimiter);
+            if (index != -1 && index + framing.delimiter.size() <= framing.maxSize)
+                emitPacket(index + framing.delimiter.size());
+            else if (pending.size() >= framing.maxSize)
+                emitPacket(framing.maxSize);
+            else
+                break;
+        }
+        break;
+    case BridgeSettings::RawFraming:
+        break;
+    }
+
+    // The deadline and the read time belong to the oldest byte still waiting
+    if (pending.isEmpty()) {
+        deadlineTimer->stop();
+    } else if (pending.size() != pendingBefore) {
+        pendingTime = readTime;
+        deadlineTimer->start();
+    }
+
+    // In idle framing every new byte pushes the end of the packet further out
+    if (framing.mode == BridgeSettings::IdleFraming && !pending.isEmpty())
+        idleTimer->start();
+}
+
+// This slot is called to send everything that is buffered
+void Packetizer::flush()
+{
+    idleTimer->stop();
+    deadlineTimer->stop();
+
+    while (!pending.isEmpty())
+        emitPacket(qMin(pending.size(), framing.maxSize));
+}
+
+// This function is called to drop everything that is buffered
+void Packetizer::clear()
+{
+    idleTimer->stop();
+    deadlineTimer->stop();
+
+    // Keep the reserved capacity
+    pending.resize(0);
+}
+
+// This function is called to emit the first size bytes of the buffer
+void Packetizer::emitPacket(int size)
+{
+    size = qMin(size, pending.size());
+    emittedTime = pendingTime;
+    emit packetReady(pending.constData(), size);
+
+    // Shift the rest down within the same buffer
+    if (size == pending.size())
+        pending.resize(0);
+    else
+        pending.remove(0, size);
+}
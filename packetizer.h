@@ -0,0 +1,48 @@
+#ifndef PACKETIZER_H
+#define PACKETIZER_H
+
+#include "bridgesettings.h"
+
+#include <QObject>
+#include <QByteArray>
+#include <QTimer>
+
+// Cuts the serial byte stream into datagrams according to the framing
+// settings, so packet boundaries no longer depend on driver read timing.
+class Packetizer : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Largest chunk append() is called with
+    static constexpr int MaxAppendSize = 16384;
+
+    explicit Packetizer(QObject *parent = nullptr);
+
+    void configure(const BridgeSettings &settings);
+    void append(const char *data, int size, qint64 readTime = 0);
+    void flush();
+    void clear();
+
+    quint64 allocationCount() const { return allocations; }
+
+    // Read time of the first byte of the packet being emitted
+    qint64 packetTime() const { return emittedTime; }
+
+signals:
+    // The data is only valid during the emission
+    void packetReady(const char *data, int size);
+
+private:
+    void emitPacket(int size);
+
+    BridgeSettings::Framing framing;
+    QTimer *idleTimer;
+    QTimer *deadlineTimer;
+    QByteArray pending;
+    qint64 pendingTime = 0;
+    qint64 emittedTime = 0;
+    quint64 allocations = 0;
+};
+
+#endif // PACKETIZER_H
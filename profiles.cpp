@@ -0,0 +1,125 @@
+#include "profiles.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStandardPaths>
+
+namespace {
+
+const QString Suffix = QStringLiteral(".ini");
+
+// The startup choice lives next to the profiles, not in any one of them; its
+// suffix keeps it out of the profile list
+QString startupFile()
+{
+    return QDir(Profiles::directory()).filePath(QStringLiteral("startup.conf"));
+}
+
+} // namespace
+
+
+// Function to find the profile directory; SER2ETHER_PROFILE_DIR overrides it,
+// e.g. for a daemon running under its own user
+QString Profiles::directory()
+{
+    const QString overridden = qEnvironmentVariable("SER2ETHER_PROFILE_DIR");
+    if (!overridden.isEmpty())
+        return overridden;
+
+    // Not AppConfigLocation: the GUI and the daemon have different application names
+    return QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation)
+           + QStringLiteral("/ser2ether/profiles");
+}
+
+QString Profiles::path(const QString &name)
+{
+    return QDir(directory()).filePath(name + Suffix);
+}
+
+// Function to list the saved profiles by name
+QStringList Profiles::names()
+{
+    QStringList result;
+    const QStringList files = QDir(directory()).entryList({QStringLiteral("*") + Suffix}, QDir::Files, QDir::Name);
+    for (const QString &file : files)
+        result.append(QFileInfo(file).completeBaseName());
+    return result;
+}
+
+bool Profiles::isValidName(const QString &name)
+{
+    return !name.trimmed().isEmpty() && !name.contains(QLatin1Char('/')) && !name.contains(QLatin1Char('\\'))
+           && !name.startsWith(QLatin1Char('.'));
+}
+
+// Function to read a profile into the settings
+bool Profiles::load(const QString &name, BridgeSettings *settings, QString *errorString)
+{
+    if (!isValidName(name) || !QFileInfo::exists(path(name))) {
+        if (errorString)
+            *errorString = QCoreApplication::translate("Profiles", "There is no profile \"%1\"").arg(name);
+        return false;
+    }
+
+    QSettings store(path(name), QSettings::IniFormat);
+    if (store.status() != QSettings::NoError) {
+        if (errorString)
+            *errorString = QCoreApplication::translate("Profiles", "Cannot read %1").arg(path(name));
+        return false;
+    }
+
+    // Start from the defaults so that nothing leaks over from other settings
+    BridgeSettings loaded;
+    if (!loaded.load(store, errorString))
+        return false;
+    *settings = loaded;
+    return true;
+}
+
+// Function to write a profile; the file is rewritten as a whole, so keys of
+// older versions do not linger
+bool Profiles::save(const QString &name, const BridgeSettings &settings, QString *errorString)
+{
+    if (!isValidName(name)) {
+        if (errorString)
+            *errorString = QCoreApplication::translate("Profiles", "\"%1\" is not a valid profile name").arg(name);
+        return false;
+    }
+    QDir().mkpath(directory());
+
+    QSettings store(path(name), QSettings::IniFormat);
+    store.clear();
+    settings.save(store);
+    store.sync();
+    if (store.status() != QSettings::NoError) {
+        if (errorString)
+            *errorString = QCoreApplication::translate("Profiles", "Cannot write %1").arg(path(name));
+        return false;
+    }
+    return true;
+}
+
+bool Profiles::remove(const QString &name)
+{
+    return isValidName(name) && QFile::remove(path(name));
+}
+
+QString Profiles::startupProfile(bool *autostart)
+{
+    QSettings store(startupFile(), QSettings::IniFormat);
+    if (autostart)
+        *autostart = store.value(QStringLiteral("startup/autostart"), false).toBool();
+    return store.value(QStringLiteral("startup/profile")).toString();
+}
+
+void Profiles::setStartupProfile(const QString &name, bool autostart)
+{
+    QDir().mkpath(directory());
+
+    QSettings store(startupFile(), QSettings::IniFormat);
+    store.setValue(QStringLiteral("startup/profile"), name);
+    store.setValue(QStringLiteral("startup/autostart"), autostart);
+}
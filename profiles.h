@@ -0,0 +1,32 @@
+#ifndef PROFILES_H
+#define PROFILES_H
+
+#include "bridgesettings.h"
+
+#include <QString>
+#include <QStringList>
+
+// Named bridge settings saved as INI files in one directory shared by the GUI
+// and the daemon, by default ser2ether/profiles under the user's config
+// location. A profile is an ordinary config file: `ser2etherd --config`
+// reads it as well as `--profile`.
+namespace Profiles {
+
+QString directory();
+QString path(const QString &name);
+QStringList names();
+
+// A name is used as the file name, so it must not contain path separators
+bool isValidName(const QString &name);
+
+bool load(const QString &name, BridgeSettings *settings, QString *errorString = nullptr);
+bool save(const QString &name, const BridgeSettings &settings, QString *errorString = nullptr);
+bool remove(const QString &name);
+
+// Profile brought up when the GUI starts, and whether the bridge opens right away
+QString startupProfile(bool *autostart = nullptr);
+void setStartupProfile(const QString &name, bool autostart);
+
+} // namespace Profiles
+
+#endif // PROFILES_H
@@ -0,0 +1,366 @@
+#include "bridgesettings.h"
+#include "tracefile.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHostAddress>
+#include <QSerialPort>
+#include <QTimer>
+#include <QUdpSocket>
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Print an error to stderr and return the tool's exit code
+int fail(const QString &message)
+{
+    std::fprintf(stderr, "ser2ether-replay: %s\n", qPrintable(message));
+    return 1;
+}
+
+// One segment file of the trace, mapped into memory and walked in place
+struct Segment {
+    std::unique_ptr<QFile> file;
+    const uchar *data = nullptr;
+    qint64 size = 0;
+    qint64 firstRecord = 0;
+};
+
+// This function is called to map a segment file and check its header
+bool mapSegment(const QString &path, Segment *segment, QString *errorString)
+{
+    segment->file.reset(new QFile(path));
+    if (!segment->file->open(QIODevice::ReadOnly)) {
+        *errorString = QStringLiteral("Cannot open %1: %2").arg(path, segment->file->errorString());
+        return false;
+    }
+
+    TraceFile::FileHeader header;
+    segment->size = segment->file->size();
+    if (segment->size < qint64(sizeof(header))) {
+        *errorString = QStringLiteral("%1 is not a ser2ether trace").arg(path);
+        return false;
+    }
+    segment->data = segment->file->map(0, segment->size);
+    if (!segment->data) {
+        *errorString = QStringLiteral("Cannot map %1: %2").arg(path, segment->file->errorString());
+        return false;
+    }
+
+    std::memcpy(&header, segment->data, sizeof(header));
+    if (std::memcmp(header.magic, TraceFile::Magic, sizeof(header.magic)) != 0
+        || header.version != TraceFile::Version
+        || header.headerSize < sizeof(header) || header.headerSize > segment->size) {
+        *errorString = QStringLiteral("%1 is not a ser2ether trace of version %2").arg(path).arg(TraceFile::Version);
+        return false;
+    }
+    segment->firstRecord = header.headerSize;
+    return true;
+}
+
+// Sends the records of one direction to a serial port or a UDP socket,
+// keeping the gaps between them, scaled by the speed factor
+class Replayer
+{
+public:
+    // Bytes left to the serial driver before waiting for it to drain, so
+    // that the line follows the trace timing rather than a buffer
+    static constexpr qint64 MaxSerialBacklog = 4096;
+
+    // Records sent in one go at full speed before the event loop gets a turn
+    static constexpr int MaxBurst = 256;
+
+    std::vector<Segment> segments;
+    TraceFile::Direction direction = TraceFile::NetworkToSerial;
+    double speed = 1.0;
+    bool loop = false;
+
+    QSerialPort *serialPort = nullptr;
+    QUdpSocket *udpSocket = nullptr;
+    QHostAddress destination;
+    quint16 destinationPort = 0;
+
+    void start();
+
+private:
+    bool nextRecord();
+    void rewind();
+    void sendDue();
+    void finish();
+
+    QTimer timer;
+    QElapsedTimer clock;
+
+    // Position in the trace and the record up next
+    size_t segmentIndex = 0;
+    qint64 offset = 0;
+    TraceFile::RecordHeader current;
+    const char *payload = nullptr;
+    qint64 firstStamp = 0;
+
+    quint64 sentRecords = 0;
+    quint64 sentBytes = 0;
+    quint64 failedRecords = 0;
+};
+
+// This function is called once the sink is open
+void Replayer::start()
+{
+    timer.setSingleShot(true);
+    timer.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&timer, &QTimer::timeout, [this] { sendDue(); });
+
+    // Resume once the serial driver took what was written so far
+    if (serialPort) {
+        QObject::connect(serialPort, &QSerialPort::bytesWritten, [this] {
+            if (!timer.isActive())
+                sendDue();
+        });
+    }
+
+    rewind();
+    if (!payload) {
+        std::fprintf(stderr, "ser2ether-replay: the trace has no records in that direction\n");
+        QCoreApplication::exit(1);
+        return;
+    }
+    sendDue();
+}
+
+// This function is called to go back to the first record of the trace
+void Replayer::rewind()
+{
+    segmentIndex = 0;
+    offset = segments.empty() ? 0 : segments.front().firstRecord;
+    payload = nullptr;
+    if (nextRecord())
+        firstStamp = current.stamp;
+    clock.start();
+}
+
+// This function is called to find the next record of the replayed direction
+bool Replayer::nextRecord()
+{
+    payload = nullptr;
+    while (segmentIndex < segments.size()) {
+        const Segment &segment = segments[segmentIndex];
+
+        // A segment cut short by a crash simply ends early
+        if (offset + qint64(sizeof(current)) > segment.size) {
+            if (++segmentIndex < segments.size())
+                offset = segments[segmentIndex].firstRecord;
+            continue;
+        }
+        std::memcpy(&current, segment.data + offset, sizeof(current));
+        if (offset + qint64(sizeof(current)) + current.size > segment.size) {
+            offset = segment.size;
+            continue;
+        }
+
+        const char *data = reinterpret_cast<const char *>(segment.data + offset + sizeof(current));
+        offset += qint64(sizeof(current)) + current.size;
+        if (current.direction == direction) {
+            payload = data;
+            return true;
+        }
+    }
+    return false;
+}
+
+// This function is called to send every record that is due, then to wait for the next one
+void Replayer::sendDue()
+{
+    int burst = 0;
+    while (payload) {
+        if (serialPort && serialPort->bytesToWrite() > MaxSerialBacklog)
+            return;
+
+        // Wait for the record's time, relative to the first one
+        if (speed > 0) {
+            const qint64 due = qint64(double(current.stamp - firstStamp) / speed);
+            const qint64 wait = due - clock.nsecsElapsed();
+            if (wait > 0) {
+                timer.start(int((wait + 999999) / 1000000));
+                return;
+            }
+        } else if (++burst > MaxBurst) {
+            timer.start(0);
+            return;
+        }
+
+        qint64 written;
+        if (serialPort)
+            written = serialPort->write(payload, current.size);
+        else
+            written = udpSocket->writeDatagram(payload, current.size, destination, destinationPort);
+        if (written == qint64(current.size)) {
+            ++sentRecords;
+            sentBytes += current.size;
+        } else {
+            ++failedRecords;
+        }
+
+        if (!nextRecord()) {
+            if (!loop) {
+                finish();
+                return;
+            }
+            rewind();
+        }
+    }
+}
+
+// This function is called at the end of the trace
+void Replayer::finish()
+{
+    // Let the serial driver send what it still holds
+    if (serialPort) {
+        while (serialPort->bytesToWrite() > 0 && serialPort->waitForBytesWritten(1000)) {
+        }
+    }
+
+    std::fprintf(stderr, "ser2ether-replay: sent %llu records, %llu bytes in %lld ms, %llu failed\n",
+                 static_cast<unsigned long long>(sentRecords),
+                 static_cast<unsigned long long>(sentBytes),
+                 static_cast<long long>(clock.elapsed()),
+                 static_cast<unsigned long long>(failedRecords));
+    QCoreApplication::exit(failedRecords == 0 ? 0 : 1);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("ser2ether-replay"));
+    QCoreApplication::setApplicationVersion(QStringLiteral("1.0.0"));
+
+    // Describe the command line
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Feed a recorded ser2ether trace into a serial port or a UDP socket"));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument(QStringLiteral("segments"),
+                                 QStringLiteral("Segment files of the trace, in order."),
+                                 QStringLiteral("segment..."));
+
+    const QCommandLineOption portOption({QStringLiteral("p"), QStringLiteral("port")},
+                                        QStringLiteral("Replay into this serial port, e.g. ttyUSB0."),
+                                        QStringLiteral("name"));
+    const QCommandLineOption baudOption({QStringLiteral("b"), QStringLiteral("baud")},
+                                        QStringLiteral("Baud rate."),
+                                        QStringLiteral("rate"));
+    const QCommandLineOption dataBitsOption(QStringLiteral("data-bits"),
+                                            QStringLiteral("Data bits: 5, 6, 7 or 8."),
+                                            QStringLiteral("bits"));
+    const QCommandLineOption parityOption(QStringLiteral("parity"),
+                                          QStringLiteral("Parity: none, even, odd, mark or space."),
+                                          QStringLiteral("parity"));
+    const QCommandLineOption stopBitsOption(QStringLiteral("stop-bits"),
+                                            QStringLiteral("Stop bits: 1, 1.5 or 2."),
+                                            QStringLiteral("bits"));
+    const QCommandLineOption flowControlOption(QStringLiteral("flow-control"),
+                                               QStringLiteral("Flow control: none, rtscts or xonxoff."),
+                                               QStringLiteral("mode"));
+    const QCommandLineOption destinationIpOption(QStringLiteral("destination-ip"),
+                                                 QStringLiteral("Replay as UDP datagrams to this address."),
+                                                 QStringLiteral("address"));
+    const QCommandLineOption destinationPortOption(QStringLiteral("destination-port"),
+                                                   QStringLiteral("Destination UDP port."),
+                                                   QStringLiteral("port"));
+    const QCommandLineOption directionOption(QStringLiteral("direction"),
+                                             QStringLiteral("Records to replay: serial-to-network or network-to-serial. "
+                                                            "Defaults to what went into the serial port for --port "
+                                                            "and to what came out of it for --destination-ip."),
+                                             QStringLiteral("direction"));
+    const QCommandLineOption speedOption(QStringLiteral("speed"),
+                                         QStringLiteral("Timing factor, 2 replays twice as fast, 0 as fast as possible."),
+                                         QStringLiteral("factor"));
+    const QCommandLineOption loopOption(QStringLiteral("loop"),
+                                        QStringLiteral("Start over at the end of the trace."));
+    parser.addOptions({portOption, baudOption, dataBitsOption, parityOption, stopBitsOption,
+                       flowControlOption, destinationIpOption, destinationPortOption,
+                       directionOption, speedOption, loopOption});
+    parser.process(a);
+
+    const QStringList paths = parser.positionalArguments();
+    if (paths.isEmpty())
+        return fail(QStringLiteral("No trace given"));
+    if (parser.isSet(portOption) == parser.isSet(destinationIpOption))
+        return fail(QStringLiteral("Give either --port or --destination-ip"));
+
+    Replayer replayer;
+    replayer.loop = parser.isSet(loopOption);
+
+    // Map the segments in the order given
+    QString errorString;
+    for (const QString &path : paths) {
+        Segment segment;
+        if (!mapSegment(path, &segment, &errorString))
+            return fail(errorString);
+        replayer.segments.push_back(std::move(segment));
+    }
+
+    bool ok = true;
+    if (parser.isSet(speedOption)) {
+        replayer.speed = parser.value(speedOption).toDouble(&ok);
+        if (!ok || replayer.speed < 0)
+            return fail(QStringLiteral("Invalid speed %1").arg(parser.value(speedOption)));
+    }
+
+    // Replay the traffic the other end of the sink saw by default
+    replayer.direction = parser.isSet(portOption) ? TraceFile::NetworkToSerial : TraceFile::SerialToNetwork;
+    if (parser.isSet(directionOption)) {
+        const QString value = parser.value(directionOption).trimmed().toLower();
+        if (value == QLatin1String("serial-to-network"))
+            replayer.direction = TraceFile::SerialToNetwork;
+        else if (value == QLatin1String("network-to-serial"))
+            replayer.direction = TraceFile::NetworkToSerial;
+        else
+            return fail(QStringLiteral("Invalid direction %1").arg(parser.value(directionOption)));
+    }
+
+    // Open the sink
+    QSerialPort serialPort;
+    QUdpSocket udpSocket;
+    if (parser.isSet(portOption)) {
+        BridgeSettings settings;
+        if (parser.isSet(baudOption)) {
+            settings.baudRate = parser.value(baudOption).toInt(&ok);
+            if (!ok || settings.baudRate <= 0)
+                return fail(QStringLiteral("Invalid baud rate %1").arg(parser.value(baudOption)));
+        }
+        if ((parser.isSet(dataBitsOption) && !BridgeSettings::parseDataBits(parser.value(dataBitsOption), &settings.dataBits))
+            || (parser.isSet(parityOption) && !BridgeSettings::parseParity(parser.value(parityOption), &settings.parity))
+            || (parser.isSet(stopBitsOption) && !BridgeSettings::parseStopBits(parser.value(stopBitsOption), &settings.stopBits))
+            || (parser.isSet(flowControlOption) && !BridgeSettings::parseFlowControl(parser.value(flowControlOption), &settings.flowControl)))
+            return fail(QStringLiteral("Invalid serial port settings"));
+
+        serialPort.setPortName(parser.value(portOption));
+        serialPort.setBaudRate(settings.baudRate);
+        serialPort.setDataBits(settings.dataBits);
+        serialPort.setParity(settings.parity);
+        serialPort.setStopBits(settings.stopBits);
+        serialPort.setFlowControl(settings.flowControl);
+        if (!serialPort.open(QIODevice::WriteOnly))
+            return fail(QStringLiteral("Cannot open serial port %1: %2").arg(serialPort.portName(), serialPort.errorString()));
+        replayer.serialPort = &serialPort;
+    } else {
+        if (!replayer.destination.setAddress(parser.value(destinationIpOption)))
+            return fail(QStringLiteral("Invalid destination address %1").arg(parser.value(destinationIpOption)));
+        replayer.destinationPort = parser.value(destinationPortOption).toUShort(&ok);
+        if (!ok || replayer.destinationPort == 0)
+            return fail(QStringLiteral("Invalid destination port %1").arg(parser.value(destinationPortOption)));
+        replayer.udpSocket = &udpSocket;
+    }
+
+    // Start once the event loop runs
+    QTimer::singleShot(0, [&replayer] { replayer.start(); });
+    return a.exec();
+}
@@ -0,0 +1,225 @@
+#include "serialio.h"
+
+#ifdef Q_OS_LINUX
+#include <linux/serial.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace {
+
+// Function to read the line errors the driver behind a tty counted, or -1
+// where it keeps no counts
+qint64 readDriverLineErrors(int fd)
+{
+#ifdef Q_OS_LINUX
+    serial_icounter_struct counters = {};
+    if (fd != -1 && ::ioctl(fd, TIOCGICOUNT, &counters) == 0)
+        return qint64(counters.frame) + counters.parity + counters.brk;
+#else
+    Q_UNUSED(fd);
+#endif
+    return -1;
+}
+
+} // namespace
+
+
+bool SerialLineState::operator==(const SerialLineState &other) const
+{
+    return baudRate == other.baudRate && hasDataFormat == other.hasDataFormat
+           && (!hasDataFormat || (dataBits == other.dataBits && parity == other.parity))
+           && stopBits == other.stopBits && flowControl == other.flowControl
+           && dataTerminalReady == other.dataTerminalReady && requestToSend == other.requestToSend;
+}
+
+// Function to describe the line state in the usual 8N1 notation
+QString SerialLineState::toString() const
+{
+    QString text = baudRate != 0 ? QString::number(baudRate) : QStringLiteral("hung up");
+
+    // Data bits and parity, where the port let us see them
+    const char *stop = stopBits == QSerialPort::TwoStop ? "2" : stopBits == QSerialPort::OneAndHalfStop ? "1.5" : "1";
+    if (hasDataFormat) {
+        const char *parityLetter;
+        switch (parity) {
+        case QSerialPort::EvenParity: parityLetter = "E"; break;
+        case QSerialPort::OddParity: parityLetter = "O"; break;
+        case QSerialPort::MarkParity: parityLetter = "M"; break;
+        case QSerialPort::SpaceParity: parityLetter = "S"; break;
+        default: parityLetter = "N"; break;
+        }
+        text += QString::asprintf(" %d%s%s", int(dataBits), parityLetter, stop);
+    } else {
+        text += QString::asprintf(" %s stop", stop);
+    }
+
+    if (flowControl == QSerialPort::HardwareControl)
+        text += QStringLiteral(", RTS/CTS");
+    else if (flowControl == QSerialPort::SoftwareControl)
+        text += QStringLiteral(", XON/XOFF");
+    if (dataTerminalReady)
+        text += QStringLiteral(", DTR");
+    if (requestToSend)
+        text += QStringLiteral(", RTS");
+    return text;
+}
+
+// This function is called once the tty is open to count from its current errors
+bool SerialIo::startLineErrorCount(int fd)
+{
+    driverLineErrors = readDriverLineErrors(fd);
+    return driverLineErrors >= 0;
+}
+
+// This function is called when data arrived, which line errors come with, to
+// report the errors counted meanwhile
+bool SerialIo::updateLineErrorCount(int fd)
+{
+    if (driverLineErrors < 0)
+        return false;
+    const qint64 count = readDriverLineErrors(fd);
+    if (count < 0)
+        return false;
+    for (; driverLineErrors < count; ++driverLineErrors)
+        emit lineError();
+    return true;
+}
+
+
+QtSerialIo::QtSerialIo(QObject *parent)
+    : SerialIo(parent)
+{
+    serialPort = new QSerialPort(this);
+
+#ifdef Q_OS_LINUX
+    // Count the line errors of the data before the engine reads it
+    connect(serialPort, &QSerialPort::readyRead, this, [this] {
+        updateLineErrorCount(int(serialPort->handle()));
+    });
+#endif
+
+    // Pass the port notifications on
+    connect(serialPort, &QSerialPort::readyRead, this, &SerialIo::readyRead);
+    connect(serialPort, &QSerialPort::bytesWritten, this, &SerialIo::bytesWritten);
+    connect(serialPort, &QSerialPort::errorOccurred, this, &QtSerialIo::handleError);
+}
+
+// This function is called to apply the settings and open the port
+bool QtSerialIo::open(const BridgeSettings &settings)
+{
+    serialPort->setPortName(settings.portName);
+    serialPort->setBaudRate(settings.baudRate);
+    serialPort->setDataBits(settings.dataBits);
+    serialPort->setParity(settings.parity);
+    serialPort->setStopBits(settings.stopBits);
+    serialPort->setFlowControl(settings.flowControl);
+
+    if (!serialPort->open(QIODevice::ReadWrite))
+        return false;
+#ifdef Q_OS_LINUX
+    startLineErrorCount(int(serialPort->handle()));
+#endif
+    return true;
+}
+
+void QtSerialIo::close()
+{
+    serialPort->close();
+}
+
+// This function is called to change the line settings of the open port;
+// QSerialPort commits each of them on its own
+bool QtSerialIo::reconfigure(const BridgeSettings &settings)
+{
+    const qint32 baudRate = serialPort->baudRate();
+    const QSerialPort::DataBits dataBits = serialPort->dataBits();
+    const QSerialPort::Parity parity = serialPort->parity();
+    const QSerialPort::StopBits stopBits = serialPort->stopBits();
+    const QSerialPort::FlowControl flowControl = serialPort->flowControl();
+
+    if (serialPort->setBaudRate(settings.baudRate) && serialPort->setDataBits(settings.dataBits)
+        && serialPort->setParity(settings.parity) && serialPort->setStopBits(settings.stopBits)
+        && serialPort->setFlowControl(settings.flowControl))
+        return true;
+
+    // Put back what was already changed
+    serialPort->setBaudRate(baudRate);
+    serialPort->setDataBits(dataBits);
+    serialPort->setParity(parity);
+    serialPort->setStopBits(stopBits);
+    serialPort->setFlowControl(flowControl);
+    return false;
+}
+
+bool QtSerialIo::isOpen() const
+{
+    return serialPort->isOpen();
+}
+
+QString QtSerialIo::errorString() const
+{
+    return serialPort->errorString();
+}
+
+qint64 QtSerialIo::read(char *data, qint64 maxSize)
+{
+    return serialPort->read(data, maxSize);
+}
+
+qint64 QtSerialIo::write(const char *data, qint64 size)
+{
+    return serialPort->write(data, size);
+}
+
+qint64 QtSerialIo::bytesToWrite() const
+{
+    return serialPort->bytesToWrite();
+}
+
+bool QtSerialIo::setRequestToSend(bool on)
+{
+    return serialPort->setRequestToSend(on);
+}
+
+bool QtSerialIo::setDataTerminalReady(bool on)
+{
+    return serialPort->setDataTerminalReady(on);
+}
+
+// The driver counts line errors on Linux; elsewhere only Qt 5 reports them,
+// and only with its deprecated API
+bool QtSerialIo::countsLineErrors() const
+{
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0) && QT_DEPRECATED_SINCE(5, 6)
+    return true;
+#else
+    return SerialIo::countsLineErrors();
+#endif
+}
+
+// This slot is called when there is an error on the serial port
+void QtSerialIo::handleError(QSerialPort::SerialPortError error)
+{
+    switch (error) {
+    // The device is gone
+    case QSerialPort::ResourceError:
+        emit fatalError(serialPort->errorString());
+        break;
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0) && QT_DEPRECATED_SINCE(5, 6)
+    // Errors on the line itself, where the driver does not count them; Qt 6
+    // no longer reports them
+    QT_WARNING_PUSH
+    QT_WARNING_DISABLE_DEPRECATED
+    case QSerialPort::ParityError:
+    case QSerialPort::FramingError:
+    case QSerialPort::BreakConditionError:
+        if (!SerialIo::countsLineErrors())
+            emit lineError();
+        break;
+    QT_WARNING_POP
+#endif
+    // The rest belong to a single call, which reports them itself
+    default:
+        break;
+    }
+}
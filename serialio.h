@@ -0,0 +1,126 @@
+#ifndef SERIALIO_H
+#define SERIALIO_H
+
+#include "bridgesettings.h"
+
+#include <QObject>
+#include <QtSerialPort>
+
+// Line settings and modem lines of a port as an application set them, the
+// way a virtual port reports them and the peer applies them
+struct SerialLineState
+{
+    qint32 baudRate = 0;        // 0 after the application hung up with B0
+    QSerialPort::DataBits dataBits = QSerialPort::Data8;
+    QSerialPort::Parity parity = QSerialPort::NoParity;
+    bool hasDataFormat = false; // whether dataBits and parity are known
+    QSerialPort::StopBits stopBits = QSerialPort::OneStop;
+    QSerialPort::FlowControl flowControl = QSerialPort::NoFlowControl;
+    bool dataTerminalReady = false;
+    bool requestToSend = false;
+
+    bool operator==(const SerialLineState &other) const;
+    bool operator!=(const SerialLineState &other) const { return !(*this == other); }
+
+    // Short form for the log, e.g. "115200 8N1, DTR RTS"
+    QString toString() const;
+};
+
+// Serial side of the bridge as the engine sees it. The default implementation
+// wraps QSerialPort; on Linux a raw termios backend can be selected instead.
+class SerialIo : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+    virtual bool open(const BridgeSettings &settings) = 0;
+    virtual void close() = 0;
+
+    // Switches the open port to other line settings (baud rate, data bits,
+    // parity, stop bits, flow control) without closing it; what is buffered
+    // either way stays. On failure the port keeps its previous settings.
+    virtual bool reconfigure(const BridgeSettings &settings) = 0;
+
+    virtual bool isOpen() const = 0;
+    virtual QString errorString() const = 0;
+
+    // Non-blocking; both return 0 when nothing can be transferred right now
+    virtual qint64 read(char *data, qint64 maxSize) = 0;
+    virtual qint64 write(const char *data, qint64 size) = 0;
+
+    // Bytes accepted by write() that have not reached the driver yet
+    virtual qint64 bytesToWrite() const = 0;
+
+    // Drives the RTS line, e.g. the direction input of an RS-485 transceiver
+    virtual bool setRequestToSend(bool on) = 0;
+    virtual bool setDataTerminalReady(bool on) = 0;
+
+    // Whether the UART has shifted out its last bit; backends that cannot
+    // tell always say yes
+    virtual bool isTransmitterEmpty() const { return true; }
+
+    // Whether anything takes what is written; only a virtual port nobody has
+    // open says no, and its write() then accepts nothing
+    virtual bool hasReader() const { return true; }
+
+    // Whether lineError() is emitted at all, so that a count of zero means
+    // a clean line rather than errors nobody could see
+    virtual bool countsLineErrors() const { return driverLineErrors >= 0; }
+
+    // What the application on a virtual port set; real ports have no
+    // application behind them and return false
+    virtual bool lineState(SerialLineState *state) const { Q_UNUSED(state); return false; }
+
+signals:
+    void readyRead();
+    void bytesWritten(qint64 bytes);
+    void fatalError(const QString &message);
+
+    // A recoverable error such as a parity or framing error
+    void lineError();
+
+    // The application on a virtual port changed the line settings, opened
+    // or closed the port; see lineState()
+    void lineStateChanged();
+
+protected:
+    // For backends on a tty: the parity, framing and break counts its Linux
+    // driver keeps (TIOCGICOUNT). The update emits lineError() for those new
+    // since the last call. Both return false where the driver keeps none.
+    bool startLineErrorCount(int fd);
+    bool updateLineErrorCount(int fd);
+
+private:
+    qint64 driverLineErrors = -1;
+};
+
+// Serial backend built on QSerialPort
+class QtSerialIo : public SerialIo
+{
+    Q_OBJECT
+
+public:
+    explicit QtSerialIo(QObject *parent = nullptr);
+
+    bool open(const BridgeSettings &settings) override;
+    void close() override;
+    bool reconfigure(const BridgeSettings &settings) override;
+    bool isOpen() const override;
+    QString errorString() const override;
+    qint64 read(char *data, qint64 maxSize) override;
+    qint64 write(const char *data, qint64 size) override;
+    qint64 bytesToWrite() const override;
+    bool setRequestToSend(bool on) override;
+    bool setDataTerminalReady(bool on) override;
+
+    bool countsLineErrors() const override;
+
+private:
+    void handleError(QSerialPort::SerialPortError error);
+
+    QSerialPort *serialPort;
+};
+
+#endif // SERIALIO_H
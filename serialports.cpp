@@ -0,0 +1,112 @@
+#include "serialports.h"
+
+#include <QFileSystemWatcher>
+#include <QTimer>
+
+namespace {
+
+// Device nodes show up in several steps when a device is plugged in
+constexpr int SettleDelay = 250;
+
+// Where there is no /dev to follow
+constexpr int PollInterval = 2000;
+
+} // namespace
+
+
+// Function to find the stable name of a device
+QString serialPortIdentity(const QSerialPortInfo &info)
+{
+    if (!info.serialNumber().isEmpty())
+        return info.serialNumber();
+    if (info.hasVendorIdentifier() && info.hasProductIdentifier()) {
+        return QStringLiteral("%1:%2").arg(info.vendorIdentifier(), 4, 16, QLatin1Char('0'))
+                                      .arg(info.productIdentifier(), 4, 16, QLatin1Char('0'));
+    }
+    return QString();
+}
+
+// Function to find the port a device is on
+QString findSerialPort(const QString &identity, const QString &preferredName)
+{
+    const QString wanted = identity.trimmed().toLower();
+    QString found;
+
+    const auto serialPortInfos = QSerialPortInfo::availablePorts();
+    for (const QSerialPortInfo &serialPortInfo : serialPortInfos) {
+        if (serialPortIdentity(serialPortInfo).toLower() != wanted)
+            continue;
+        if (serialPortInfo.portName() == preferredName)
+            return preferredName;
+        if (found.isEmpty())
+            found = serialPortInfo.portName();
+    }
+    return found;
+}
+
+
+PortWatcher::PortWatcher(QObject *parent)
+    : QObject(parent)
+{
+    // Collapse a burst of changes into one notification
+    settleTimer = new QTimer(this);
+    settleTimer->setSingleShot(true);
+    settleTimer->setInterval(SettleDelay);
+    connect(settleTimer, &QTimer::timeout, this, &PortWatcher::changed);
+
+    pollTimer = new QTimer(this);
+    pollTimer->setInterval(PollInterval);
+    connect(pollTimer, &QTimer::timeout, this, &PortWatcher::changed);
+}
+
+// This slot is called to start following the devices
+void PortWatcher::start()
+{
+    if (watcher || pollTimer->isActive())
+        return;
+
+    // Created here so that inotify is set up on the watcher's own thread
+    watcher = new QFileSystemWatcher(this);
+    if (watcher->addPath(QStringLiteral("/dev"))) {
+        connect(watcher, &QFileSystemWatcher::directoryChanged, settleTimer, [this] {
+            settleTimer->start();
+        });
+        return;
+    }
+
+    delete watcher;
+    watcher = nullptr;
+    pollTimer->start();
+}
+
+// This slot is called to stop following the devices
+void PortWatcher::stop()
+{
+    delete watcher;
+    watcher = nullptr;
+    settleTimer->stop();
+    pollTimer->stop();
+}
+
+// This slot is called to list the serial ports
+void PortWatcher::scan()
+{
+    QVector<SerialPortEntry> ports;
+
+    const auto serialPortInfos = QSerialPortInfo::availablePorts();
+    for (const QSerialPortInfo &serialPortInfo : serialPortInfos) {
+        SerialPortEntry entry;
+        entry.portName = serialPortInfo.portName();
+        entry.identity = serialPortIdentity(serialPortInfo);
+        entry.description = serialPortInfo.description();
+        ports.append(entry);
+    }
+    emit portsChanged(ports);
+}
+
+// This slot is called to look up the port a device is on; the answer carries
+// the lookup it belongs to, as the asker may have moved on meanwhile
+void PortWatcher::find(quint64 lookup, const QString &identity, const QString &preferredName)
+{
+    emit portFound(lookup, findSerialPort(identity, preferredName));
+}
@@ -0,0 +1,61 @@
+#ifndef SERIALPORTS_H
+#define SERIALPORTS_H
+
+#include <QMetaType>
+#include <QObject>
+#include <QSerialPortInfo>
+#include <QString>
+#include <QVector>
+
+class QFileSystemWatcher;
+class QTimer;
+
+// A serial port as listed to the user
+struct SerialPortEntry {
+    QString portName;
+    QString identity;       // see serialPortIdentity(), empty when the device has none
+    QString description;
+};
+
+Q_DECLARE_METATYPE(QVector<SerialPortEntry>)
+
+// Name of a device that survives replugging: its serial number, or else its
+// USB vendor and product id as "vid:pid" in hex
+QString serialPortIdentity(const QSerialPortInfo &info);
+
+// Port the device with the given identity is on right now, empty when it is
+// not plugged in; preferredName breaks ties between devices sharing an identity
+QString findSerialPort(const QString &identity, const QString &preferredName = QString());
+
+// Tells when serial devices come or go. Follows /dev with inotify (through
+// QFileSystemWatcher) where there is one, and polls slowly elsewhere; the
+// port enumeration itself only runs in scan() and find(), on the watcher's
+// thread.
+class PortWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PortWatcher(QObject *parent = nullptr);
+
+public slots:
+    void start();
+    void stop();
+    void scan();
+    void find(quint64 lookup, const QString &identity, const QString &preferredName);
+
+signals:
+    // Emitted once a burst of device changes has settled
+    void changed();
+    void portsChanged(const QVector<SerialPortEntry> &ports);
+
+    // Answer to find(), the port name is empty when the device is not plugged in
+    void portFound(quint64 lookup, const QString &portName);
+
+private:
+    QFileSystemWatcher *watcher = nullptr;
+    QTimer *settleTimer;
+    QTimer *pollTimer;
+};
+
+#endif // SERIALPORTS_H
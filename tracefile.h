@@ -0,0 +1,45 @@
+#ifndef TRACEFILE_H
+#define TRACEFILE_H
+
+#include <QtGlobal>
+
+// On-disk layout of a bridge trace, shared by the recorder and the replay
+// tool. A recording is one or more segment files; each starts with a
+// FileHeader and continues with records, a RecordHeader followed by the
+// payload. Everything is in host byte order (little endian on every target
+// we build for), so the writer can copy its ring buffer to disk as is.
+// Payloads are not padded, so a record header may sit at any offset; the
+// reader copies each one out before looking at it.
+namespace TraceFile {
+
+constexpr char Magic[8] = {'S', '2', 'E', 'T', 'R', 'A', 'C', 'E'};
+constexpr quint16 Version = 1;
+
+// Which way the payload went through the bridge
+enum Direction : quint8 {
+    SerialToNetwork,
+    NetworkToSerial
+};
+
+struct FileHeader {
+    char magic[8];
+    quint16 version;
+    quint16 headerSize;     // records start here, newer versions may grow the header
+    quint32 segment;        // index of this file in the recording, from 0
+    qint64 startTime;       // ms since the epoch when the recording started
+    qint64 startStamp;      // monotonic ns at the same moment
+};
+
+struct RecordHeader {
+    qint64 stamp;           // monotonic ns when the bridge read the payload
+    quint32 size;           // payload bytes following the header
+    quint8 direction;
+    quint8 reserved[3];
+};
+
+static_assert(sizeof(FileHeader) == 32, "the trace file header layout is fixed");
+static_assert(sizeof(RecordHeader) == 16, "the trace record header layout is fixed");
+
+} // namespace TraceFile
+
+#endif // TRACEFILE_H
@@ -0,0 +1,175 @@
+#include "tracerecorder.h"
+
+#include "bridgestats.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QThread>
+
+#include <cstring>
+
+namespace {
+
+// Segment files are numbered, e.g. capture.s2et is recorded as
+// capture-0000.s2et, capture-0001.s2et and so on
+QString segmentPath(const QString &path, int index)
+{
+    const QFileInfo info(path);
+    const QString number = QStringLiteral("-%1").arg(index, 4, 10, QLatin1Char('0'));
+    if (info.suffix().isEmpty())
+        return path + number;
+    return info.dir().filePath(info.completeBaseName() + number + QLatin1Char('.') + info.suffix());
+}
+
+} // namespace
+
+
+TraceRecorder::TraceRecorder(QObject *parent)
+    : QObject(parent)
+{
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    stop();
+}
+
+// This function is called on the engine thread when the bridge opens with a trace path
+bool TraceRecorder::start(const BridgeSettings::Record &newSettings, QString *errorString)
+{
+    stop();
+
+    settings = newSettings;
+    startTime = QDateTime::currentMSecsSinceEpoch();
+    startStamp = BridgeStats::now();
+
+    // Open the first segment here so that a bad path is reported right away
+    if (!openSegment(0)) {
+        *errorString = segmentFile.errorString();
+        return false;
+    }
+
+    // The ring is only allocated while recording
+    if (!ring)
+        ring.reset(new char[RingSize]);
+    writePosition.store(0, std::memory_order_relaxed);
+    readPosition.store(0, std::memory_order_relaxed);
+    dropped.store(0, std::memory_order_relaxed);
+    stopRequested.store(false, std::memory_order_relaxed);
+
+    writer = QThread::create([this] { writeLoop(); });
+    writer->setObjectName(QStringLiteral("trace-writer"));
+    writer->start();
+
+    recording = true;
+    return true;
+}
+
+// This function is called on the engine thread to write out what is left and stop
+void TraceRecorder::stop()
+{
+    if (!writer)
+        return;
+
+    recording = false;
+    stopRequested.store(true, std::memory_order_release);
+    writer->wait();
+    delete writer;
+    writer = nullptr;
+}
+
+// This function is called on the engine thread with every packet while recording
+void TraceRecorder::record(TraceFile::Direction direction, const char *data, int size, qint64 stamp)
+{
+    TraceFile::RecordHeader header;
+    header.stamp = stamp;
+    header.size = quint32(size);
+    header.direction = direction;
+    std::memset(header.reserved, 0, sizeof(header.reserved));
+
+    // Drop the record rather than wait when the disk is behind
+    const quint64 write = writePosition.load(std::memory_order_relaxed);
+    const quint64 needed = sizeof(header) + quint64(size);
+    if (RingSize - (write - readPosition.load(std::memory_order_acquire)) < needed) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    copyIn(write, &header, sizeof(header));
+    copyIn(write + sizeof(header), data, size);
+    writePosition.store(write + needed, std::memory_order_release);
+}
+
+// This function is called to copy into the ring, wrapping around its end
+void TraceRecorder::copyIn(quint64 position, const void *data, int size)
+{
+    const quint64 offset = position % RingSize;
+    const int first = int(qMin(quint64(size), RingSize - offset));
+    std::memcpy(ring.get() + offset, data, size_t(first));
+    std::memcpy(ring.get(), static_cast<const char *>(data) + first, size_t(size - first));
+}
+
+// This function runs on the writer thread until stop() and the ring is empty
+void TraceRecorder::writeLoop()
+{
+    for (;;) {
+        // Look at the stop flag first so that nothing published before it is lost
+        const bool stopping = stopRequested.load(std::memory_order_acquire);
+        const quint64 read = readPosition.load(std::memory_order_relaxed);
+        const quint64 write = writePosition.load(std::memory_order_acquire);
+        if (read == write) {
+            if (stopping)
+                break;
+            QThread::msleep(WriterIdleMs);
+            continue;
+        }
+
+        // The batch ends on a record boundary, so rotating between batches
+        // never splits a record
+        if (segmentFile.size() >= settings.segmentSize && !openSegment(segment + 1)) {
+            emit errorMessage(tr("Trace recording stopped, cannot open %1: %2")
+                                  .arg(segmentFile.fileName(), segmentFile.errorString()));
+            break;
+        }
+
+        // Everything that accumulated goes out in at most two writes, the
+        // second one only when the batch wraps around the end of the ring
+        const quint64 offset = read % RingSize;
+        const qint64 first = qint64(qMin(write - read, RingSize - offset));
+        const qint64 second = qint64(write - read) - first;
+        if (segmentFile.write(ring.get() + offset, first) != first
+            || (second > 0 && segmentFile.write(ring.get(), second) != second)) {
+            emit errorMessage(tr("Trace recording stopped, cannot write %1: %2")
+                                  .arg(segmentFile.fileName(), segmentFile.errorString()));
+            break;
+        }
+        readPosition.store(write, std::memory_order_release);
+    }
+    segmentFile.close();
+}
+
+// This function is called to start a new segment file and remove the oldest one
+bool TraceRecorder::openSegment(int index)
+{
+    segmentFile.close();
+    segmentFile.setFileName(segmentPath(settings.path, index));
+    if (!segmentFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+        return false;
+    segment = index;
+
+    TraceFile::FileHeader header;
+    std::memcpy(header.magic, TraceFile::Magic, sizeof(header.magic));
+    header.version = TraceFile::Version;
+    header.headerSize = sizeof(header);
+    header.segment = quint32(index);
+    header.startTime = startTime;
+    header.startStamp = startStamp;
+    if (segmentFile.write(reinterpret_cast<const char *>(&header), sizeof(header)) != qint64(sizeof(header)))
+        return false;
+
+    // Keep only the newest segments when a limit is set
+    if (settings.segments > 0 && index >= settings.segments)
+        QFile::remove(segmentPath(settings.path, index - settings.segments));
+    return true;
+}
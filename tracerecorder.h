@@ -0,0 +1,68 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include "bridgesettings.h"
+#include "tracefile.h"
+
+#include <QFile>
+#include <QObject>
+
+#include <atomic>
+#include <memory>
+
+class QThread;
+
+// Records every packet of a channel into a binary trace (see tracefile.h).
+// The engine thread only copies records into a single-producer,
+// single-consumer ring; a writer thread moves whatever has accumulated to
+// the current segment file in one write per pass and rotates the segments.
+class TraceRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TraceRecorder(QObject *parent = nullptr);
+    ~TraceRecorder();
+
+    // Engine thread only; the hot path checks isEnabled() and nothing else
+    // while nothing is recorded
+    bool isEnabled() const { return recording; }
+    bool start(const BridgeSettings::Record &settings, QString *errorString);
+    void stop();
+    void record(TraceFile::Direction direction, const char *data, int size, qint64 stamp);
+
+    // Records lost because the writer fell behind, since start()
+    quint64 droppedRecords() const { return dropped.load(std::memory_order_relaxed); }
+
+signals:
+    // Emitted from the writer thread
+    void errorMessage(const QString &message);
+
+private:
+    static constexpr quint64 RingSize = 4 * 1024 * 1024;
+
+    // How long the writer sleeps when the ring was empty
+    static constexpr unsigned long WriterIdleMs = 10;
+
+    void copyIn(quint64 position, const void *data, int size);
+    void writeLoop();
+    bool openSegment(int index);
+
+    bool recording = false;
+    BridgeSettings::Record settings;
+    qint64 startTime = 0;
+    qint64 startStamp = 0;
+
+    std::unique_ptr<char[]> ring;
+    std::atomic<quint64> writePosition{0};
+    std::atomic<quint64> readPosition{0};
+    std::atomic<quint64> dropped{0};
+
+    // Writer thread only
+    QThread *writer = nullptr;
+    std::atomic<bool> stopRequested{false};
+    QFile segmentFile;
+    int segment = 0;
+};
+
+#endif // TRACERECORDER_H
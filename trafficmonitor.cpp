@@ -0,0 +1,206 @@
+#include "trafficmonitor.h"
+
+#include <QDateTime>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Lookup tables for the dump: two hex digits per byte, and the byte itself
+// or a dot for the ASCII column
+struct DumpTable {
+    char hex[256][2];
+    char ascii[256];
+
+    DumpTable()
+    {
+        static const char digits[] = "0123456789abcdef";
+        for (int i = 0; i < 256; ++i) {
+            hex[i][0] = digits[i >> 4];
+            hex[i][1] = digits[i & 0x0f];
+            ascii[i] = (i >= 0x20 && i < 0x7f) ? char(i) : '.';
+        }
+    }
+};
+
+const DumpTable dumpTable;
+
+constexpr int BytesPerLine = 16;
+
+} // namespace
+
+
+TrafficTap::TrafficTap()
+    : ring(new char[RingSize])
+{
+}
+
+// This function is called on the engine thread to open, close or resample the monitor
+void TrafficTap::configure(bool enable, const Sampling &newSampling)
+{
+    sampling = newSampling;
+    sampling.everyNth = qMax(1, sampling.everyNth);
+    sampling.maxBytes = qBound(1, sampling.maxBytes, int(MaxCaptureBytes));
+    packetCount[SerialToUdp] = 0;
+    packetCount[UdpToSerial] = 0;
+    enabled = enable;
+}
+
+// This function is called on the engine thread with every packet while the monitor is open
+void TrafficTap::capture(Direction direction, const char *data, int size)
+{
+    // Apply the trigger, then keep every Nth of the packets that passed it
+    if (!sampling.trigger.isEmpty()
+        && std::search(data, data + size, sampling.trigger.constData(),
+                       sampling.trigger.constData() + sampling.trigger.size())
+               == data + size)
+        return;
+    if (packetCount[direction]++ % quint64(sampling.everyNth) != 0)
+        return;
+
+    Header header;
+    header.time = QDateTime::currentMSecsSinceEpoch();
+    header.size = quint32(size);
+    header.captured = quint16(qMin(size, sampling.maxBytes));
+    header.direction = direction;
+
+    // Drop the record rather than wait when the formatter is behind
+    const quint64 write = writePosition.load(std::memory_order_relaxed);
+    const quint64 needed = sizeof(Header) + header.captured;
+    if (RingSize - (write - readPosition.load(std::memory_order_acquire)) < needed) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    copyIn(write, &header, sizeof(Header));
+    copyIn(write + sizeof(Header), data, header.captured);
+    writePosition.store(write + needed, std::memory_order_release);
+}
+
+// This function is called on the formatter thread to take the oldest record
+bool TrafficTap::take(Header *header, char *data)
+{
+    const quint64 read = readPosition.load(std::memory_order_relaxed);
+    if (read == writePosition.load(std::memory_order_acquire))
+        return false;
+
+    copyOut(read, header, sizeof(Header));
+    copyOut(read + sizeof(Header), data, header->captured);
+    readPosition.store(read + sizeof(Header) + header->captured, std::memory_order_release);
+    return true;
+}
+
+// This function is called on the formatter thread to learn how many records were dropped
+quint64 TrafficTap::takeDropped()
+{
+    return dropped.exchange(0, std::memory_order_relaxed);
+}
+
+// This function is called to copy into the ring, wrapping around its end
+void TrafficTap::copyIn(quint64 position, const void *data, int size)
+{
+    const quint64 offset = position % RingSize;
+    const int first = int(qMin(quint64(size), RingSize - offset));
+    std::memcpy(ring.get() + offset, data, size_t(first));
+    std::memcpy(ring.get(), static_cast<const char *>(data) + first, size_t(size - first));
+}
+
+// This function is called to copy out of the ring, wrapping around its end
+void TrafficTap::copyOut(quint64 position, void *data, int size) const
+{
+    const quint64 offset = position % RingSize;
+    const int first = int(qMin(quint64(size), RingSize - offset));
+    std::memcpy(data, ring.get() + offset, size_t(first));
+    std::memcpy(static_cast<char *>(data) + first, ring.get(), size_t(size - first));
+}
+
+
+TrafficFormatter::TrafficFormatter(TrafficTap *tap, QObject *parent)
+    : QObject(parent)
+    , tap(tap)
+{
+    // Poll the tap instead of being woken per packet; the timer follows the
+    // formatter to its thread
+    timer = new QTimer(this);
+    timer->setInterval(50);
+    connect(timer, &QTimer::timeout, this, &TrafficFormatter::drain);
+
+    text.reserve(TextReserve);
+}
+
+// This slot is called when the monitor pane opens
+void TrafficFormatter::start()
+{
+    // Forget what was dropped while nobody was watching
+    tap->takeDropped();
+    timer->start();
+}
+
+// This slot is called when the monitor pane closes
+void TrafficFormatter::stop()
+{
+    timer->stop();
+    drain();
+}
+
+// This slot is called periodically to format the records captured since the last pass
+void TrafficFormatter::drain()
+{
+    // Truncating keeps the reserved buffer, where clear() would free it
+    text.truncate(0);
+
+    TrafficTap::Header header;
+    int records = 0;
+    while (records < MaxRecordsPerPass && tap->take(&header, record)) {
+        appendRecord(header, record);
+        ++records;
+    }
+
+    const quint64 dropped = tap->takeDropped();
+    if (dropped != 0)
+        text += tr("%1 packets were not captured, the monitor fell behind\n").arg(dropped).toLatin1();
+
+    if (text.isEmpty())
+        return;
+
+    text.chop(1);
+    emit dumpReady(QString::fromLatin1(text));
+}
+
+// This function is called to append the dump of one record to the text
+void TrafficFormatter::appendRecord(const TrafficTap::Header &header, const char *data)
+{
+    // Title line with the time, the direction and the sizes
+    text += QDateTime::fromMSecsSinceEpoch(header.time).toString(QStringLiteral("hh:mm:ss.zzz")).toLatin1();
+    text += header.direction == TrafficTap::SerialToUdp ? " serial > udp, " : " udp > serial, ";
+    text += QByteArray::number(header.size);
+    text += " bytes";
+    if (header.captured < header.size)
+        text += ", first " + QByteArray::number(header.captured);
+    text += '\n';
+
+    // Sixteen bytes per line: offset, hex column and ASCII column, filled
+    // from the tables straight into the reserved line
+    char line[6 + BytesPerLine * 3 + 1 + BytesPerLine + 1];
+    for (int offset = 0; offset < header.captured; offset += BytesPerLine) {
+        const int count = qMin(BytesPerLine, int(header.captured) - offset);
+        std::memset(line, ' ', sizeof(line));
+
+        line[0] = dumpTable.hex[(offset >> 8) & 0xff][0];
+        line[1] = dumpTable.hex[(offset >> 8) & 0xff][1];
+        line[2] = dumpTable.hex[offset & 0xff][0];
+        line[3] = dumpTable.hex[offset & 0xff][1];
+
+        char *hex = line + 6;
+        char *ascii = line + 6 + BytesPerLine * 3 + 1;
+        for (int i = 0; i < count; ++i) {
+            const uchar byte = uchar(data[offset + i]);
+            hex[i * 3] = dumpTable.hex[byte][0];
+            hex[i * 3 + 1] = dumpTable.hex[byte][1];
+            ascii[i] = dumpTable.ascii[byte];
+        }
+        ascii[count] = '\n';
+        text.append(line, int(ascii + count + 1 - line));
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef TRAFFICMONITOR_H
+#define TRAFFICMONITOR_H
+
+#include <QByteArray>
+#include <QMetaType>
+#include <QObject>
+#include <QTimer>
+
+#include <atomic>
+#include <memory>
+
+// Capture side of the traffic monitor, owned by the engine. Sampling and
+// copying happen on the engine thread; the captured records wait in a
+// single-producer, single-consumer ring for the formatter thread.
+class TrafficTap
+{
+public:
+    enum Direction : quint8 {
+        SerialToUdp,
+        UdpToSerial
+    };
+
+    struct Sampling {
+        // Keep every Nth packet that passed the trigger
+        int everyNth = 1;
+
+        // Bytes kept from the start of each packet
+        int maxBytes = 64;
+
+        // Only packets containing these bytes are kept; empty keeps all
+        QByteArray trigger;
+    };
+
+    struct Header {
+        qint64 time;
+        quint32 size;
+        quint16 captured;
+        Direction direction;
+    };
+
+    static constexpr int MaxCaptureBytes = 4096;
+
+    TrafficTap();
+
+    // Engine thread only; the hot path checks isEnabled() and nothing else
+    // while the monitor is closed
+    bool isEnabled() const { return enabled; }
+    void configure(bool enabled, const Sampling &sampling);
+    void capture(Direction direction, const char *data, int size);
+
+    // Formatter thread only; data must have room for MaxCaptureBytes
+    bool take(Header *header, char *data);
+    quint64 takeDropped();
+
+private:
+    static constexpr quint64 RingSize = 128 * 1024;
+
+    void copyIn(quint64 position, const void *data, int size);
+    void copyOut(quint64 position, void *data, int size) const;
+
+    bool enabled = false;
+    Sampling sampling;
+    quint64 packetCount[2] = {};
+
+    std::unique_ptr<char[]> ring;
+    std::atomic<quint64> writePosition{0};
+    std::atomic<quint64> readPosition{0};
+    std::atomic<quint64> dropped{0};
+};
+
+Q_DECLARE_METATYPE(TrafficTap::Sampling)
+
+// Turns the captured records into timestamped hex/ASCII dumps. Meant to run
+// on its own thread so that formatting never competes with forwarding.
+class TrafficFormatter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TrafficFormatter(TrafficTap *tap, QObject *parent = nullptr);
+
+public slots:
+    void start();
+    void stop();
+
+signals:
+    void dumpReady(const QString &text);
+
+private:
+    void drain();
+    void appendRecord(const TrafficTap::Header &header, const char *data);
+
+    // Upper bound of records formatted per pass, the rest waits for the next one
+    static constexpr int MaxRecordsPerPass = 512;
+
+    // Initial capacity of the text, reserved once and kept across passes
+    static constexpr int TextReserve = 64 * 1024;
+
+    TrafficTap *tap;
+    QTimer *timer;
+    QByteArray text;
+    char record[TrafficTap::MaxCaptureBytes];
+};
+
+#endif // TRAFFICMONITOR_H
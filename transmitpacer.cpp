@@ -0,0 +1,245 @@
+#include "transmitpacer.h"
+
+#include <QSocketNotifier>
+
+#ifdef SER2ETHER_LINUX_FASTPATH
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+#include <climits>
+
+
+DeadlineTimer::DeadlineTimer(QObject *parent)
+    : QObject(parent)
+{
+#ifdef SER2ETHER_LINUX_FASTPATH
+    // The timerfd becomes readable when the deadline passed
+    timerFd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd != -1) {
+        notifier = new QSocketNotifier(timerFd, QSocketNotifier::Read, this);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+        connect(notifier, &QSocketNotifier::activated, this, &DeadlineTimer::expire);
+#else
+        connect(notifier, SIGNAL(activated(int)), this, SLOT(expire()));
+#endif
+        return;
+    }
+#endif
+
+    fallbackTimer = new QTimer(this);
+    fallbackTimer->setSingleShot(true);
+    fallbackTimer->setTimerType(Qt::PreciseTimer);
+    connect(fallbackTimer, &QTimer::timeout, this, &DeadlineTimer::expire);
+}
+
+DeadlineTimer::~DeadlineTimer()
+{
+#ifdef SER2ETHER_LINUX_FASTPATH
+    if (timerFd != -1)
+        ::close(timerFd);
+#endif
+}
+
+// This function is called to (re)arm the timer for a deadline in BridgeStats::now() time
+void DeadlineTimer::start(qint64 deadline)
+{
+    active = true;
+
+#ifdef SER2ETHER_LINUX_FASTPATH
+    // steady_clock is CLOCK_MONOTONIC, so the deadline goes in as it is; a
+    // zero time would disarm the timer, a past one fires right away
+    if (timerFd != -1) {
+        const qint64 at = qMax<qint64>(deadline, 1);
+        itimerspec spec = {};
+        spec.it_value.tv_sec = time_t(at / 1000000000);
+        spec.it_value.tv_nsec = long(at % 1000000000);
+        ::timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+        return;
+    }
+#endif
+
+    // Round up, the timer must not fire before the deadline
+    const qint64 delay = (deadline - BridgeStats::now() + 999999) / 1000000;
+    fallbackTimer->start(int(qBound<qint64>(0, delay, INT_MAX)));
+}
+
+void DeadlineTimer::stop()
+{
+    active = false;
+
+#ifdef SER2ETHER_LINUX_FASTPATH
+    if (timerFd != -1) {
+        const itimerspec spec = {};
+        ::timerfd_settime(timerFd, 0, &spec, nullptr);
+        return;
+    }
+#endif
+
+    fallbackTimer->stop();
+}
+
+// This slot is called when the timerfd or the fallback timer fired
+void DeadlineTimer::expire()
+{
+#ifdef SER2ETHER_LINUX_FASTPATH
+    // Take the expiration off the timerfd, or it stays readable
+    if (timerFd != -1) {
+        quint64 expirations;
+        if (::read(timerFd, &expirations, sizeof(expirations)) <= 0)
+            return;
+    }
+#endif
+
+    if (!active)
+        return;
+    active = false;
+    emit timeout();
+}
+
+
+TransmitPacer::TransmitPacer(QObject *parent)
+    : QObject(parent)
+{
+    timer = new DeadlineTimer(this);
+    connect(timer, &DeadlineTimer::timeout, this, &TransmitPacer::handleTimeout);
+}
+
+// This function is called when the bridge opens or its settings change
+bool TransmitPacer::configure(const BridgeSettings &settings, SerialIo *newSerialIo,
+                              BridgeStats::Pacing *newCounters)
+{
+    const bool wasRs485 = enabled && transmit.rs485;
+
+    enabled = settings.transmit.isEnabled();
+    transmit = settings.transmit;
+    characterTime = qMax<qint64>(1, qint64(settings.bitsPerCharacter() * 1e9 / qMax(1, settings.baudRate)));
+    serialIo = newSerialIo;
+    counters = newCounters;
+
+    // Leave the line to the devices until there is something to send, and
+    // give RTS back when RS-485 mode was switched off
+    if (transmit.rs485 || wasRs485) {
+        rtsOn = false;
+        rtsDropAt = 0;
+        if (!serialIo->setRequestToSend(false) && transmit.rs485)
+            return false;
+    }
+    return true;
+}
+
+// This function is called when the port closed or reopened; the line is idle again
+void TransmitPacer::reset()
+{
+    timer->stop();
+    timerDeadline = 0;
+    lineFreeAt = 0;
+    nextFrameAt = 0;
+    inFrame = false;
+    rtsOn = false;
+    rtsReadyAt = 0;
+    rtsDropAt = 0;
+}
+
+// This function is called by the engine before it hands data to the driver
+int TransmitPacer::allowance(qint64 now, bool frameStart)
+{
+    if (frameStart) {
+        // A frame the queue dropped half written ends where it was cut off
+        if (inFrame)
+            endFrame();
+
+        // Keep the line idle for the gap after the previous frame
+        if (now < nextFrameAt) {
+            schedule(nextFrameAt);
+            return 0;
+        }
+        inFrame = true;
+
+        // Take the bus; a frame that follows before RTS went down keeps it
+        if (transmit.rs485) {
+            rtsDropAt = 0;
+            if (!rtsOn) {
+                serialIo->setRequestToSend(true);
+                rtsOn = true;
+                rtsReadyAt = now + qint64(transmit.rtsBefore) * 1000;
+            }
+        }
+    }
+
+    // Give the transceiver its time to turn around
+    if (transmit.rs485 && now < rtsReadyAt) {
+        schedule(rtsReadyAt);
+        return 0;
+    }
+
+    if (transmit.fifoSize <= 0)
+        return INT_MAX;
+
+    // Room left in the FIFO: its size less what the line has not sent yet
+    const qint64 ahead = qMax<qint64>(0, lineFreeAt - now);
+    const int queued = int((ahead + characterTime - 1) / characterTime);
+    if (queued < transmit.fifoSize)
+        return transmit.fifoSize - queued;
+
+    // Come back once half of the FIFO went out, not for every character
+    schedule(lineFreeAt - qint64(transmit.fifoSize / 2) * characterTime);
+    return 0;
+}
+
+// This function is called by the engine after the driver took data
+void TransmitPacer::sent(qint64 now, int bytes, bool frameEnd)
+{
+    lineFreeAt = qMax(lineFreeAt, now) + qint64(bytes) * characterTime;
+    if (frameEnd)
+        endFrame();
+}
+
+// Function to start the gap, and in RS-485 mode the wait for the bus release,
+// at the end of the frame on the line
+void TransmitPacer::endFrame()
+{
+    inFrame = false;
+    if (transmit.frameGap > 0)
+        nextFrameAt = lineFreeAt + qint64(transmit.frameGap) * 1000;
+    if (transmit.rs485) {
+        rtsDropAt = lineFreeAt + qint64(transmit.rtsAfter) * 1000;
+        schedule(rtsDropAt);
+    }
+}
+
+// Function to wake up at a deadline; only the earliest one is armed, later
+// ones are asked for again when the engine comes back to allowance()
+void TransmitPacer::schedule(qint64 deadline)
+{
+    if (timer->isActive() && deadline >= timerDeadline)
+        return;
+    timerDeadline = deadline;
+    timer->start(deadline);
+}
+
+// This slot is called when a deadline of the pacer passed
+void TransmitPacer::handleTimeout()
+{
+    // Measure how late the timer fired; this is what the pacing accuracy comes down to
+    const qint64 now = BridgeStats::now();
+    counters->wakeups.add();
+    counters->lateness.add(quint64(qMax<qint64>(0, now - timerDeadline)) / 1000);
+
+    // Release the bus once the frame is out. The model only knows when the
+    // driver took the bytes, so a UART still sending gets another character time.
+    if (rtsDropAt != 0 && now >= rtsDropAt) {
+        if (serialIo->isTransmitterEmpty()) {
+            serialIo->setRequestToSend(false);
+            rtsOn = false;
+            rtsDropAt = 0;
+        } else {
+            counters->lineBusy.add();
+            rtsDropAt = now + characterTime;
+        }
+    }
+    if (rtsDropAt != 0)
+        schedule(rtsDropAt);
+
+    emit wakeup();
+}
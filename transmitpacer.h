@@ -0,0 +1,101 @@
+#ifndef TRANSMITPACER_H
+#define TRANSMITPACER_H
+
+#include "bridgesettings.h"
+#include "bridgestats.h"
+#include "serialio.h"
+
+#include <QObject>
+#include <QTimer>
+
+class QSocketNotifier;
+
+// One-shot timer for an absolute BridgeStats::now() deadline. With the Linux
+// fast path it is a timerfd on the monotonic clock, which the kernel fires
+// with hrtimer precision on the engine's own thread; otherwise a precise
+// QTimer, which only has millisecond resolution.
+class DeadlineTimer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DeadlineTimer(QObject *parent = nullptr);
+    ~DeadlineTimer();
+
+    void start(qint64 deadline);
+    void stop();
+    bool isActive() const { return active; }
+
+signals:
+    void timeout();
+
+private slots:
+    void expire();
+
+private:
+    bool active = false;
+    int timerFd = -1;
+    QSocketNotifier *notifier = nullptr;
+    QTimer *fallbackTimer = nullptr;
+};
+
+// Schedules the serial egress of the engine's queue for slow devices. A
+// model of the line, fed with the character time of the line settings,
+// tells when what was handed to the driver has gone out: frames start only
+// after the inter-frame gap, and no more than the FIFO size is ever ahead of
+// the line, like a token bucket that refills at the line rate. In RS-485
+// mode RTS goes up before a frame and down once it left the line; the UART
+// has the last word on that where the backend can ask it, since the model
+// cannot see the bytes the driver or QSerialPort still buffer.
+class TransmitPacer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TransmitPacer(QObject *parent = nullptr);
+
+    // Takes over the transmit and line settings; returns false when RTS
+    // cannot be driven on the port, which RS-485 mode needs
+    bool configure(const BridgeSettings &settings, SerialIo *serialIo, BridgeStats::Pacing *counters);
+
+    // Forgets the line state, for a port that was closed or reopened
+    void reset();
+
+    bool isEnabled() const { return enabled; }
+
+    // Bytes of the head frame that may go to the driver now, where frameStart
+    // says none of it went yet; with 0 the caller waits for wakeup()
+    int allowance(qint64 now, bool frameStart);
+
+    // Called with what the driver took, and whether that finished the frame
+    void sent(qint64 now, int bytes, bool frameEnd);
+
+signals:
+    void wakeup();
+
+private:
+    void schedule(qint64 deadline);
+    void handleTimeout();
+    void endFrame();
+
+    bool enabled = false;
+    BridgeSettings::Transmit transmit;
+    qint64 characterTime = 0;       // ns per character on the line
+    SerialIo *serialIo = nullptr;
+    BridgeStats::Pacing *counters = nullptr;
+
+    DeadlineTimer *timer;
+    qint64 timerDeadline = 0;
+
+    // Line model, all in BridgeStats::now() time
+    qint64 lineFreeAt = 0;          // when the line sent the last byte handed to the driver
+    qint64 nextFrameAt = 0;         // earliest start of the next frame, after the gap
+    bool inFrame = false;
+
+    // RS-485 direction
+    bool rtsOn = false;
+    qint64 rtsReadyAt = 0;          // when the first bit of the frame may go
+    qint64 rtsDropAt = 0;           // when RTS goes down, 0 while it stays up
+};
+
+#endif // TRANSMITPACER_H
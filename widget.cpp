@@ -1,4 +1,3 @@
-
 #include "widget.h"
 #include "ui_widget.h"
 
@@ -9,182 +8,380 @@ Widget::Widget(QWidget *parent)
 {
     ui->setupUi(this);
 
-    // Initialize the GUI
+    // Initialize the GUI; initGui() also makes all the signal connections
     initGui();
-
-    // Connect the signals and slots
-    connect(openSerialButton, SIGNAL(clicked()), this, SLOT(openSerialPort()));
-    connect(closeSerialButton, SIGNAL(clicked()), this, SLOT(closeSerialPort()));
-    connect(serialPort, SIGNAL(readyRead()), this, SLOT(readSerialData()));
-    connect(udpSocket, SIGNAL(readyRead()), this, SLOT(readUdpData()));
-    connect(serialPort, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(handleError(QSerialPort::SerialPortError)));
 }
 
 Widget::~Widget()
 {
+    // Stop the formatter first, it reads from the engine
+    monitorThread->quit();
+    monitorThread->wait();
+    portThread->quit();
+    portThread->wait();
+
+    // Stop the engine thread; the engine closes the bridge when it is deleted
+    delete bridgeManager;
+
     delete ui;
 }
 
-// This slot is called when the user clicks the "Open" button in the GUI
-void Widget::openSerialPort()
+// This function is called to collect the settings from the widgets; reports
+// and returns false on a bad value
+bool Widget::readSettings(BridgeSettings *result)
 {
-    // If the serial port is already open, do nothing
-    if (serialPort->isOpen())
-        return;
-
-    // Get the selected serial port name from the combo box
-    QString portName = serialPortComboBox->currentText();
+    BridgeSettings settings = shownSettings;
 
-    // Set the serial port name
-    serialPort->setPortName(portName);
+    // Get the selected serial port name from the combo box, and the device
+    // identity so that the bridge finds the device again after a replug
+    settings.portName = serialPortComboBox->currentText();
+    settings.deviceId = serialPortComboBox->currentData().toString();
 
     // Get the selected baud rate from the combo box
-    qint32 baudRate = baudRateComboBox->currentText().toInt();
-
-    // Set the baud rate
-    serialPort->setBaudRate(baudRate);
+    settings.baudRate = baudRateComboBox->currentText().toInt();
 
     // Get the selected data bits from the combo box
-    QSerialPort::DataBits dataBits = static_cast<QSerialPort::DataBits>(
+    settings.dataBits = static_cast<QSerialPort::DataBits>(
         dataBitsComboBox->itemData(dataBitsComboBox->currentIndex()).toInt());
 
-    // Set the data bits
-    serialPort->setDataBits(dataBits);
-
     // Get the selected parity from the combo box
-    QSerialPort::Parity parity = static_cast<QSerialPort::Parity>(
+    settings.parity = static_cast<QSerialPort::Parity>(
         parityComboBox->itemData(parityComboBox->currentIndex()).toInt());
 
-    // Set the parity
-    serialPort->setParity(parity);
-
     // Get the selected stop bits from the combo box
-    QSerialPort::StopBits stopBits = static_cast<QSerialPort::StopBits>(
+    settings.stopBits = static_cast<QSerialPort::StopBits>(
         stopBitsComboBox->itemData(stopBitsComboBox->currentIndex()).toInt());
 
-    // Set the stop bits
-    serialPort->setStopBits(stopBits);
-
     // Get the selected flow control from the combo box
-    QSerialPort::FlowControl flowControl = static_cast<QSerialPort::FlowControl>(
+    settings.flowControl = static_cast<QSerialPort::FlowControl>(
         flowControlComboBox->itemData(flowControlComboBox->currentIndex()).toInt());
 
-    // Set the flow control
-    serialPort->setFlowControl(flowControl);
-
-    // Try to open the serial port
-    if (serialPort->open(QIODevice::ReadWrite)) {
-        // If the serial port was successfully opened, update the GUI
-        openSerialButton->setEnabled(false);
-        closeSerialButton->setEnabled(true);
-        serialPortComboBox->setEnabled(false);
-        baudRateComboBox->setEnabled(false);
-        dataBitsComboBox->setEnabled(false);
-        parityComboBox->setEnabled(false);
-        stopBitsComboBox->setEnabled(false);
-        flowControlComboBox->setEnabled(false);
-        udpLocalPortLineEdit->setEnabled(false);
-        udpPortLineEdit->setEnabled(false);
-        destinationIpLineEdit->setEnabled(false);
-        processInfo(tr("Serial port %1 opened").arg(portName));
-    } else {
-        // If the serial port could not be opened, display an error message
-        processError(tr("Failed to open serial port %1, error: %2")
-                         .arg(portName).arg(serialPort->errorString()));
+    // Get the selected I/O backend from the combo box
+    settings.backend = static_cast<BridgeSettings::Backend>(
+        backendComboBox->itemData(backendComboBox->currentIndex()).toInt());
+
+    // Get the virtual port and the line control from their widgets
+    settings.pty.enabled = ptyCheckBox->isChecked();
+    settings.pty.link = ptyLinkLineEdit->text().trimmed();
+    if (settings.pty.enabled && settings.pty.link.isEmpty()) {
+        processError(tr("Invalid virtual port link"));
+        return false;
+    }
+    settings.lineControl = lineControlCheckBox->isChecked();
+
+    // Get the network transport from the combo box
+    settings.transport = static_cast<BridgeSettings::Transport>(
+        transportComboBox->itemData(transportComboBox->currentIndex()).toInt());
+
+    // Get the local port, the destination port and address from the line edits
+    settings.localPort = udpLocalPortLineEdit->text().toUShort();
+    settings.destinationPort = udpPortLineEdit->text().toUShort();
+    settings.destinationIp = destinationIpLineEdit->text();
+
+    // Get the limit and the overflow policy of the serial queue
+    settings.queue.highWater = queueLimitLineEdit->text().toInt();
+    settings.queue.policy = static_cast<BridgeSettings::QueuePolicy>(
+        queuePolicyComboBox->itemData(queuePolicyComboBox->currentIndex()).toInt());
+    if (settings.queue.highWater <= 0) {
+        processError(tr("Invalid queue limit %1").arg(queueLimitLineEdit->text()));
+        return false;
+    }
+
+    // Get the framing of the serial stream
+    settings.framing.mode = static_cast<BridgeSettings::FramingMode>(
+        framingModeComboBox->itemData(framingModeComboBox->currentIndex()).toInt());
+    settings.framing.maxSize = framingMaxSizeLineEdit->text().toInt();
+    settings.framing.idleCharacters = framingIdleLineEdit->text().toDouble();
+    settings.framing.fixedLength = framingFixedLengthLineEdit->text().toInt();
+    settings.framing.flushTimeout = framingTimeoutLineEdit->text().toInt();
+    if (settings.framing.maxSize <= 0 || settings.framing.maxSize > 65507
+        || settings.framing.idleCharacters <= 0 || settings.framing.fixedLength <= 0
+        || settings.framing.flushTimeout <= 0) {
+        processError(tr("Invalid framing parameters"));
+        return false;
+    }
+    if (!BridgeSettings::parseDelimiter(framingDelimiterLineEdit->text(), &settings.framing.delimiter)) {
+        processError(tr("Invalid delimiter \"%1\", use hex bytes like 0D 0A")
+                         .arg(framingDelimiterLineEdit->text()));
+        return false;
     }
+
+    // Get the protocol; a Modbus gateway frames the serial side by itself
+    settings.protocol = static_cast<BridgeSettings::Protocol>(
+        protocolComboBox->itemData(protocolComboBox->currentIndex()).toInt());
+    settings.modbus.timeout = modbusTimeoutLineEdit->text().toInt();
+    settings.modbus.cacheTtl = modbusCacheTtlLineEdit->text().toInt();
+    if (settings.modbus.timeout <= 0 || settings.modbus.cacheTtl < 0) {
+        processError(tr("Invalid Modbus parameters"));
+        return false;
+    }
+
+    // Get the link codec; its size limit and dictionary come from the profile
+    settings.codec.aggregate = codecAggregateCheckBox->isChecked();
+    settings.codec.compress = codecCompressCheckBox->isChecked();
+    settings.codec.maxDelay = codecDelayLineEdit->text().toInt();
+    settings.codec.sequence = codecSequenceCheckBox->isChecked();
+    if (settings.codec.maxDelay < 0) {
+        processError(tr("Invalid codec delay %1").arg(codecDelayLineEdit->text()));
+        return false;
+    }
+
+    // Get the transmit pacing; the RTS timing comes from the profile
+    settings.transmit.rs485 = rs485CheckBox->isChecked();
+    settings.transmit.frameGap = frameGapLineEdit->text().toInt();
+    settings.transmit.fifoSize = txFifoLineEdit->text().toInt();
+    if (settings.transmit.frameGap < 0 || settings.transmit.fifoSize < 0) {
+        processError(tr("Invalid transmit pacing parameters"));
+        return false;
+    }
+
+    // Get the trace file, recording is off while it is empty
+    settings.record.path = recordLineEdit->text().trimmed();
+    settings.tracing.path = latencyTraceLineEdit->text().trimmed();
+
+    *result = settings;
+    return true;
 }
 
-// This slot is called when the user clicks the "Close" button in the GUI
-void Widget::closeSerialPort()
+// This function is called to show settings in the widgets, e.g. from a profile
+void Widget::showSettings(const BridgeSettings &settings)
 {
-    // If the serial port is not open, do nothing
-    if (!serialPort->isOpen())
-        return;
+    // A port that is not plugged in (or not listed yet) is still shown, so
+    // that the profile opens it once it is there
+    int index = serialPortComboBox->findText(settings.portName);
+    if (index < 0 && !settings.portName.isEmpty()) {
+        serialPortComboBox->addItem(settings.portName, settings.deviceId);
+        index = serialPortComboBox->count() - 1;
+    }
+    if (index >= 0)
+        serialPortComboBox->setCurrentIndex(index);
+
+    // Baud rates outside the list are added to it
+    const QString baudRate = QString::number(settings.baudRate);
+    if (baudRateComboBox->findText(baudRate) < 0)
+        baudRateComboBox->addItem(baudRate, settings.baudRate);
+    baudRateComboBox->setCurrentIndex(baudRateComboBox->findText(baudRate));
+
+    // The other combo boxes hold the enum values as their item data
+    auto select = [](QComboBox *comboBox, int value) {
+        const int index = comboBox->findData(value);
+        if (index >= 0)
+            comboBox->setCurrentIndex(index);
+    };
+    select(dataBitsComboBox, settings.dataBits);
+    select(parityComboBox, settings.parity);
+    select(stopBitsComboBox, settings.stopBits);
+    select(flowControlComboBox, settings.flowControl);
+    select(backendComboBox, settings.backend);
+    ptyCheckBox->setChecked(settings.pty.enabled);
+    ptyLinkLineEdit->setText(settings.pty.link);
+    lineControlCheckBox->setChecked(settings.lineControl);
+    select(transportComboBox, settings.transport);
+    select(queuePolicyComboBox, settings.queue.policy);
+    select(framingModeComboBox, settings.framing.mode);
+    select(protocolComboBox, settings.protocol);
+
+    udpLocalPortLineEdit->setText(QString::number(settings.localPort));
+    udpPortLineEdit->setText(QString::number(settings.destinationPort));
+    destinationIpLineEdit->setText(settings.destinationIp);
+    queueLimitLineEdit->setText(QString::number(settings.queue.highWater));
+    framingMaxSizeLineEdit->setText(QString::number(settings.framing.maxSize));
+    framingIdleLineEdit->setText(QString::number(settings.framing.idleCharacters));
+    framingDelimiterLineEdit->setText(QString::fromLatin1(settings.framing.delimiter.toHex(' ')));
+    framingFixedLengthLineEdit->setText(QString::number(settings.framing.fixedLength));
+    framingTimeoutLineEdit->setText(QString::number(settings.framing.flushTimeout));
+    modbusTimeoutLineEdit->setText(QString::number(settings.modbus.timeout));
+    modbusCacheTtlLineEdit->setText(QString::number(settings.modbus.cacheTtl));
+    codecAggregateCheckBox->setChecked(settings.codec.aggregate);
+    codecCompressCheckBox->setChecked(settings.codec.compress);
+    codecDelayLineEdit->setText(QString::number(settings.codec.maxDelay));
+    codecSequenceCheckBox->setChecked(settings.codec.sequence);
+    rs485CheckBox->setChecked(settings.transmit.rs485);
+    frameGapLineEdit->setText(QString::number(settings.transmit.frameGap));
+    txFifoLineEdit->setText(QString::number(settings.transmit.fifoSize));
+    recordLineEdit->setText(settings.record.path);
+    latencyTraceLineEdit->setText(settings.tracing.path);
+
+    // Settings the GUI has no widgets for ride along unchanged
+    shownSettings = settings;
+}
 
-    // Close the serial port
-    serialPort->close();
+// This slot is called when the user clicks the "Open" button in the GUI
+void Widget::openSerialPort()
+{
+    BridgeSettings settings;
+    if (!readSettings(&settings))
+        return;
 
-    // Update the GUI
-    openSerialButton->setEnabled(true);
-    closeSerialButton->setEnabled(false);
-    serialPortComboBox->setEnabled(true);
-    baudRateComboBox->setEnabled(true);
-    dataBitsComboBox->setEnabled(true);
-    parityComboBox->setEnabled(true);
-    stopBitsComboBox->setEnabled(true);
-    flowControlComboBox->setEnabled(true);
-    udpLocalPortLineEdit->setEnabled(true);
-    udpPortLineEdit->setEnabled(true);
-    destinationIpLineEdit->setEnabled(true);
-    processInfo(tr("Serial port closed"));
+    // Ask the engine to open the bridge; the GUI is updated once it answers
+    emit openBridgeRequested(settings);
 }
 
-// This slot is called when data is available on the serial port
-void Widget::readSerialData()
+// This function is called to bring up a saved profile, opening the bridge
+// with it if asked to; a running bridge switches over, reopening only what changed
+void Widget::applyProfile(const QString &name, bool open)
 {
-    // Read the data from the serial port
-    serialData = serialPort->readAll();
+    BridgeSettings settings;
+    QString errorString;
+    if (!Profiles::load(name, &settings, &errorString)) {
+        processError(errorString);
+        return;
+    }
+
+    showSettings(settings);
+    profileComboBox->setCurrentText(name);
+    processInfo(tr("Profile %1 loaded").arg(name));
 
-    // Write the data to the UDP socket
-    writeUdpData(serialData);
+    if (bridgeRunning)
+        emit reconfigureBridgeRequested(settings);
+    else if (open)
+        emit openBridgeRequested(settings);
 }
 
-// This function is called to write data to the serial port
-void Widget::writeSerialData(const QByteArray &data)
+// This slot is called when the user clicks the "Load" profile button
+void Widget::loadProfile()
 {
-    // Write the data to the serial port
-    serialPort->write(data);
+    const QString name = profileComboBox->currentText().trimmed();
+    applyProfile(name, false);
+    Profiles::setStartupProfile(name, autostartCheckBox->isChecked());
 }
 
-// This slot is called when data is available on the UDP socket
-void Widget::readUdpData()
+// This slot is called when the user clicks the "Save" profile button
+void Widget::saveProfile()
 {
-    // Read the data from the UDP socket
-    udpData.resize(udpSocket->pendingDatagramSize());
-    udpSocket->readDatagram(udpData.data(), udpData.size());
+    BridgeSettings settings;
+    if (!readSettings(&settings))
+        return;
 
-    // Write the data to the serial port
-    writeSerialData(udpData);
+    const QString name = profileComboBox->currentText().trimmed();
+    QString errorString;
+    if (!Profiles::save(name, settings, &errorString)) {
+        processError(errorString);
+        return;
+    }
+    processInfo(tr("Profile %1 saved to %2").arg(name, Profiles::path(name)));
+
+    // List the new profile and bring it up again next time
+    if (profileComboBox->findText(name) < 0)
+        profileComboBox->addItem(name);
+    Profiles::setStartupProfile(name, autostartCheckBox->isChecked());
 }
 
-// This function is called to write data to the UDP socket
-void Widget::writeUdpData(const QByteArray &data)
+// This slot is called when the user clicks the "Close" button in the GUI
+void Widget::closeSerialPort()
 {
-    // Get the destination IP address and port number from the GUI
-    QString destinationIp = destinationIpLineEdit->text();
-    quint16 udpPort = udpPortLineEdit->text().toUShort();
+    // Ask the engine to close the bridge; the GUI is updated once it answers
+    emit closeBridgeRequested();
+}
 
-    // Set the destination IP address and port number for the UDP socket
-    udpSocket->writeDatagram(data, QHostAddress(destinationIp), udpPort);
+// This slot is called when the engine has opened the bridge
+void Widget::handleBridgeOpened(const QString &portName)
+{
+    // Lock the settings while the bridge is running; profiles still switch it
+    bridgeRunning = true;
+    setSettingsEnabled(false);
+    processInfo(tr("Serial port %1 opened").arg(portName));
+
+    // Start refreshing the statistics panel; the engine counts from zero
+    lastSnapshot = BridgeStats::Snapshot();
+    lastSnapshot.time = BridgeStats::now();
+    statsTimer->start();
 }
 
-// This slot is called when there is an error on the serial port
-void Widget::handleError(QSerialPort::SerialPortError error)
+// This slot is called when the engine has closed the bridge
+void Widget::handleBridgeClosed()
 {
-    if (error == QSerialPort::ResourceError) {
-        // If there is a resource error on the serial port, close it and update the GUI
-        processError(tr("Serial port error: %1").arg(serialPort->errorString()));
-        closeSerialPort();
-    }
+    // Unlock the settings again
+    bridgeRunning = false;
+    setSettingsEnabled(true);
+    processInfo(tr("Serial port closed"));
+
+    // Show the final counters and stop refreshing
+    updateStatistics();
+    statsTimer->stop();
+}
+
+// This function is called to enable or disable the settings widgets
+void Widget::setSettingsEnabled(bool enabled)
+{
+    openSerialButton->setEnabled(enabled);
+    closeSerialButton->setEnabled(!enabled);
+    serialPortComboBox->setEnabled(enabled);
+    baudRateComboBox->setEnabled(enabled);
+    dataBitsComboBox->setEnabled(enabled);
+    parityComboBox->setEnabled(enabled);
+    stopBitsComboBox->setEnabled(enabled);
+    flowControlComboBox->setEnabled(enabled);
+    backendComboBox->setEnabled(enabled);
+    ptyCheckBox->setEnabled(enabled);
+    ptyLinkLineEdit->setEnabled(enabled);
+    lineControlCheckBox->setEnabled(enabled);
+    udpLocalPortLineEdit->setEnabled(enabled);
+    transportComboBox->setEnabled(enabled);
+    queueLimitLineEdit->setEnabled(enabled);
+    queuePolicyComboBox->setEnabled(enabled);
+    framingGroupBox->setEnabled(enabled);
+    recordLineEdit->setEnabled(enabled);
+    latencyTraceLineEdit->setEnabled(enabled);
+
+    // The destination stays editable, it is applied while the bridge runs
+}
+
+// This slot is called when the user has edited the destination IP or port
+void Widget::updateDestination()
+{
+    // Hand the new destination to the engine, it resolves it off the hot path
+    emit destinationChangeRequested(destinationIpLineEdit->text(),
+                                    udpPortLineEdit->text().toUShort());
 }
 
 // This function is called to initialize the GUI
 void Widget::initGui()
 {
-    // Create the serial port object
-    serialPort = new QSerialPort(this);
     setWindowTitle("ser2ether 1.0.0");
 
-    // Create the UDP socket object
-    udpSocket = new QUdpSocket(this);
-
-    // Create the serial port combo box
+    // Create the bridge engine on its own thread so that forwarding never
+    // waits for the GUI
+    bridgeManager = new BridgeManager(1, this);
+    engine = bridgeManager->addChannel();
+
+    // Create the profile combo box with the saved profiles; typing a new
+    // name and saving creates a profile
+    profileComboBox = new QComboBox(this);
+    profileComboBox->setEditable(true);
+    profileComboBox->addItems(Profiles::names());
+    profileComboBox->setToolTip(Profiles::directory());
+    loadProfileButton = new QPushButton(tr("Load"), this);
+    connect(loadProfileButton, &QPushButton::clicked, this, &Widget::loadProfile);
+    saveProfileButton = new QPushButton(tr("Save"), this);
+    connect(saveProfileButton, &QPushButton::clicked, this, &Widget::saveProfile);
+
+    // Remember whether the last profile opens the bridge on the next start
+    bool autostart = false;
+    const QString startupProfile = Profiles::startupProfile(&autostart);
+    profileComboBox->setCurrentText(startupProfile);
+    autostartCheckBox = new QCheckBox(tr("Open on startup"), this);
+    autostartCheckBox->setChecked(autostart);
+    connect(autostartCheckBox, &QCheckBox::toggled, this, [this](bool checked) {
+        Profiles::setStartupProfile(profileComboBox->currentText().trimmed(), checked);
+    });
+
+    // Create the serial port combo box; the port watcher fills it
     serialPortComboBox = new QComboBox(this);
 
-    // Add the available serial ports to the combo box
-    foreach (const QSerialPortInfo &serialPortInfo, QSerialPortInfo::availablePorts()) {
-        serialPortComboBox->addItem(serialPortInfo.portName());
-    }
+    // List the serial ports on a thread of their own, now and whenever
+    // devices are plugged in or out
+    qRegisterMetaType<QVector<SerialPortEntry>>("QVector<SerialPortEntry>");
+    portThread = new QThread(this);
+    portThread->setObjectName(QStringLiteral("port-watcher"));
+    portWatcher = new PortWatcher;
+    portWatcher->moveToThread(portThread);
+    connect(portThread, &QThread::finished, portWatcher, &QObject::deleteLater);
+    connect(portWatcher, &PortWatcher::changed, portWatcher, &PortWatcher::scan);
+    connect(portWatcher, &PortWatcher::portsChanged, this, &Widget::updateSerialPortInfo);
+    portThread->start();
+    QMetaObject::invokeMethod(portWatcher, &PortWatcher::start, Qt::QueuedConnection);
+    QMetaObject::invokeMethod(portWatcher, &PortWatcher::scan, Qt::QueuedConnection);
 
     // Create the baud rate combo box
     baudRateComboBox = new QComboBox(this);
@@ -234,25 +431,44 @@ void Widget::initGui()
     flowControlComboBox->addItem(tr("RTS/CTS"), QSerialPort::HardwareControl);
     flowControlComboBox->addItem(tr("XON/XOFF"), QSerialPort::SoftwareControl);
 
+    // Create the I/O backend combo box
+    backendComboBox = new QComboBox(this);
+    backendComboBox->addItem(tr("Qt I/O"), BridgeSettings::QtBackend);
+#ifdef SER2ETHER_LINUX_FASTPATH
+    backendComboBox->addItem(tr("Linux fast path"), BridgeSettings::LinuxBackend);
+#endif
+
+    // Create the virtual port controls; the port combo box is not used then
+    ptyCheckBox = new QCheckBox(tr("Virtual port"), this);
+    ptyCheckBox->setToolTip(tr("Create a pseudo-terminal for applications on this host instead of opening a port"));
+    ptyLinkLineEdit = new QLineEdit(BridgeSettings().pty.link, this);
+    lineControlCheckBox = new QCheckBox(tr("Line control"), this);
+    lineControlCheckBox->setToolTip(tr("Send the line settings of the virtual port to the peer, or apply the peer's to this port"));
+
     // Create the open serial button
     openSerialButton = new QPushButton(tr("Open"), this);
 
     // Connect the open serial button to the openSerialPort() slot
     connect(openSerialButton, &QPushButton::clicked, this, &Widget::openSerialPort);
-    connect(openSerialButton, &QPushButton::clicked, this, &Widget::updateUdpPortInfo);
 
     // Create the close serial button
     closeSerialButton = new QPushButton(tr("Close"), this);
 
     // Connect the close serial button to the closeSerialPort() slot
     connect(closeSerialButton, &QPushButton::clicked, this, &Widget::closeSerialPort);
-    connect(closeSerialButton, &QPushButton::clicked, this, &Widget::updateUdpClose);
 
     // Disable the close serial button initially
     closeSerialButton->setEnabled(false);
 
-    // Create the UDP group box
-    udpGroupBox = new QGroupBox(tr("UDP"), this);
+    // Create the network group box
+    udpGroupBox = new QGroupBox(tr("Network"), this);
+
+    // Create the network transport combo box
+    transportComboBox = new QComboBox(this);
+    transportComboBox->addItem(tr("UDP"), BridgeSettings::UdpTransport);
+    transportComboBox->addItem(tr("UDP multicast"), BridgeSettings::MulticastTransport);
+    transportComboBox->addItem(tr("TCP server"), BridgeSettings::TcpServerTransport);
+    transportComboBox->addItem(tr("TCP client"), BridgeSettings::TcpClientTransport);
 
     // Create the UDP port label
     udpPortLabel = new QLabel(tr("target Port:"), this);
@@ -281,18 +497,53 @@ void Widget::initGui()
     // Set the default destination IP address
     destinationIpLineEdit->setText(QStringLiteral("127.0.0.1"));
 
+    // Create the serial queue limit label and line edit
+    queueLimitLabel = new QLabel(tr("Queue (bytes):"), this);
+    queueLimitLineEdit = new QLineEdit(QString::number(BridgeSettings().queue.highWater), this);
+
+    // Create the serial queue policy combo box
+    queuePolicyComboBox = new QComboBox(this);
+    queuePolicyComboBox->addItem(tr("Drop oldest"), BridgeSettings::DropOldest);
+    queuePolicyComboBox->addItem(tr("Drop newest"), BridgeSettings::DropNewest);
+    queuePolicyComboBox->addItem(tr("Pause UDP"), BridgeSettings::PauseReads);
+
+    // Create the framing group box
+    createFramingGroupBox();
+
+    // Create the statistics group box
+    createStatsGroupBox();
+
+    // Create the traffic monitor group box
+    createMonitorGroupBox();
+
     // Create the log group box
     logGroupBox = new QGroupBox(tr("Log"), this);
 
-    // Create the log text edit
-    logTextEdit = new QTextEdit(this);
-
-    // Set the log text edit to read-only
+    // Create the log view; a plain text document with a block limit keeps
+    // memory flat and appending cheap however long the bridge runs
+    logTextEdit = new QPlainTextEdit(this);
     logTextEdit->setReadOnly(true);
+    logTextEdit->setUndoRedoEnabled(false);
+    logTextEdit->setMaximumBlockCount(MaxLogLines);
+
+    // Move the queued log lines into the view in batches
+    logTimer = new QTimer(this);
+    logTimer->setInterval(100);
+    connect(logTimer, &QTimer::timeout, this, &Widget::flushLog);
+    logTimer->start();
 
     // Create the main layout
     QVBoxLayout *mainLayout = new QVBoxLayout(this);
 
+    // Create the profile layout
+    QHBoxLayout *profileLayout = new QHBoxLayout();
+    profileLayout->addWidget(new QLabel(tr("Profile:"), this));
+    profileLayout->addWidget(profileComboBox, 1);
+    profileLayout->addWidget(loadProfileButton);
+    profileLayout->addWidget(saveProfileButton);
+    profileLayout->addWidget(autostartCheckBox);
+    mainLayout->addLayout(profileLayout);
+
     // Create the serial port layout
     QGridLayout *serialPortLayout = new QGridLayout();
     serialPortLayout->addWidget(serialPortComboBox, 0, 0);
@@ -301,21 +552,38 @@ void Widget::initGui()
     serialPortLayout->addWidget(parityComboBox, 0, 3);
     serialPortLayout->addWidget(stopBitsComboBox, 0, 4);
     serialPortLayout->addWidget(flowControlComboBox, 0, 5);
-    serialPortLayout->addWidget(openSerialButton, 0, 6);
-    serialPortLayout->addWidget(closeSerialButton, 0, 7);
+    serialPortLayout->addWidget(backendComboBox, 0, 6);
+    serialPortLayout->addWidget(openSerialButton, 0, 7);
+    serialPortLayout->addWidget(closeSerialButton, 0, 8);
+    serialPortLayout->addWidget(ptyCheckBox, 1, 0);
+    serialPortLayout->addWidget(ptyLinkLineEdit, 1, 1, 1, 2);
+    serialPortLayout->addWidget(lineControlCheckBox, 1, 3, 1, 2);
     mainLayout->addLayout(serialPortLayout);
 
     // Create the UDP layout
     QGridLayout *udpLayout = new QGridLayout();
-    udpLayout->addWidget(udpLocalPortLabel, 0, 0);
-    udpLayout->addWidget(udpLocalPortLineEdit, 0, 1);
-    udpLayout->addWidget(udpPortLabel, 0, 2);
-    udpLayout->addWidget(udpPortLineEdit, 0, 3);
-    udpLayout->addWidget(destinationIpLabel, 0, 4);
-    udpLayout->addWidget(destinationIpLineEdit, 0, 5);
+    udpLayout->addWidget(transportComboBox, 0, 0);
+    udpLayout->addWidget(udpLocalPortLabel, 0, 1);
+    udpLayout->addWidget(udpLocalPortLineEdit, 0, 2);
+    udpLayout->addWidget(udpPortLabel, 0, 3);
+    udpLayout->addWidget(udpPortLineEdit, 0, 4);
+    udpLayout->addWidget(destinationIpLabel, 0, 5);
+    udpLayout->addWidget(destinationIpLineEdit, 0, 6);
+    udpLayout->addWidget(queueLimitLabel, 0, 7);
+    udpLayout->addWidget(queueLimitLineEdit, 0, 8);
+    udpLayout->addWidget(queuePolicyComboBox, 0, 9);
     udpGroupBox->setLayout(udpLayout);
     mainLayout->addWidget(udpGroupBox);
 
+    // Add the framing group box
+    mainLayout->addWidget(framingGroupBox);
+
+    // Add the statistics group box
+    mainLayout->addWidget(statsGroupBox);
+
+    // Add the traffic monitor group box
+    mainLayout->addWidget(monitorGroupBox);
+
     // Create the log layout
     QVBoxLayout *logLayout = new QVBoxLayout();
     logLayout->addWidget(logTextEdit);
@@ -325,181 +593,353 @@ void Widget::initGui()
     // Set the main layout
     setLayout(mainLayout);
 
-    // Connect the serial port to the readSerialData() slot
-    connect(serialPort, &QSerialPort::readyRead, this, &Widget::readSerialData);
-
-    // Connect the UDP socket to the readUdpData() slot
-    connect(udpSocket, &QUdpSocket::readyRead, this, &Widget::readUdpData);
-
-    // Connect the serial port to the handleError() slot
-    connect(serialPort, &QSerialPort::errorOccurred, this, &Widget::handleError);
+    // Connect the controller requests to the engine (queued across threads)
+    connect(this, &Widget::openBridgeRequested, engine, &BridgeEngine::openBridge);
+    connect(this, &Widget::reconfigureBridgeRequested, engine, &BridgeEngine::reconfigureBridge);
+    connect(this, &Widget::closeBridgeRequested, engine, &BridgeEngine::closeBridge);
+    connect(this, &Widget::destinationChangeRequested, engine, &BridgeEngine::setDestination);
+    connect(this, &Widget::trafficMonitorChangeRequested, engine, &BridgeEngine::setTrafficMonitor);
+
+    // Apply destination edits once the user is done typing
+    connect(destinationIpLineEdit, &QLineEdit::editingFinished, this, &Widget::updateDestination);
+    connect(udpPortLineEdit, &QLineEdit::editingFinished, this, &Widget::updateDestination);
+
+    // Connect the engine notifications back to the GUI
+    connect(engine, &BridgeEngine::bridgeOpened, this, &Widget::handleBridgeOpened);
+    connect(engine, &BridgeEngine::bridgeClosed, this, &Widget::handleBridgeClosed);
+
+    // Log lines go straight into the lock-free queue from the engine thread,
+    // without an event per line
+    connect(engine, &BridgeEngine::infoMessage, this, [this](const QString &message) {
+        logQueue.push(LogQueue::Info, message);
+    }, Qt::DirectConnection);
+    connect(engine, &BridgeEngine::errorMessage, this, [this](const QString &message) {
+        logQueue.push(LogQueue::Error, message);
+    }, Qt::DirectConnection);
 }
 
-// Function to create the serial port group box
-void Widget::createSerialGroupBox()
+// Function to create the framing group box
+void Widget::createFramingGroupBox()
 {
-    // Create the serial port combo box
-    serialPortComboBox = new QComboBox(this);
-
-    // Fill the available serial ports in the combo box
-    fillPortsInfo();
-
-    // Fill the available serial port parameters in the combo box
-    fillPortsParameters();
-
-    // Create the serial port group box
-    serialGroupBox = new QGroupBox(tr("Serial Port"), this);
-
-    // Create the layout for the serial port group box
-    QGridLayout *serialLayout = new QGridLayout();
-    serialLayout->addWidget(serialPortComboBox, 0, 0);
-    serialLayout->addWidget(baudRateComboBox, 0, 1);
-    serialLayout->addWidget(dataBitsComboBox, 0, 2);
-    serialLayout->addWidget(parityComboBox, 0, 3);
-    serialLayout->addWidget(stopBitsComboBox, 0, 4);
-    serialLayout->addWidget(flowControlComboBox, 0, 5);
-    serialLayout->addWidget(openSerialButton, 0, 6);
-    serialLayout->addWidget(closeSerialButton, 0, 7);
-    serialGroupBox->setLayout(serialLayout);
+    // Create the framing group box
+    framingGroupBox = new QGroupBox(tr("Framing"), this);
+
+    // Create the framing mode combo box
+    framingModeComboBox = new QComboBox(this);
+    framingModeComboBox->addItem(tr("Raw"), BridgeSettings::RawFraming);
+    framingModeComboBox->addItem(tr("Max size"), BridgeSettings::SizeFraming);
+    framingModeComboBox->addItem(tr("Idle gap"), BridgeSettings::IdleFraming);
+    framingModeComboBox->addItem(tr("Delimiter"), BridgeSettings::DelimiterFraming);
+    framingModeComboBox->addItem(tr("Fixed length"), BridgeSettings::FixedFraming);
+
+    // Create the framing parameter line edits with their defaults
+    const BridgeSettings defaults;
+    framingMaxSizeLabel = new QLabel(tr("Max size:"), this);
+    framingMaxSizeLineEdit = new QLineEdit(QString::number(defaults.framing.maxSize), this);
+    framingIdleLabel = new QLabel(tr("Idle (chars):"), this);
+    framingIdleLineEdit = new QLineEdit(QString::number(defaults.framing.idleCharacters), this);
+    framingDelimiterLabel = new QLabel(tr("Delimiter (hex):"), this);
+    framingDelimiterLineEdit = new QLineEdit(QString::fromLatin1(defaults.framing.delimiter.toHex(' ')), this);
+    framingFixedLengthLabel = new QLabel(tr("Length:"), this);
+    framingFixedLengthLineEdit = new QLineEdit(QString::number(defaults.framing.fixedLength), this);
+    framingTimeoutLabel = new QLabel(tr("Flush (ms):"), this);
+    framingTimeoutLineEdit = new QLineEdit(QString::number(defaults.framing.flushTimeout), this);
+
+    // Create the protocol combo box and the Modbus gateway parameters
+    protocolComboBox = new QComboBox(this);
+    protocolComboBox->addItem(tr("Raw bytes"), BridgeSettings::RawProtocol);
+    protocolComboBox->addItem(tr("Modbus gateway"), BridgeSettings::ModbusProtocol);
+    protocolComboBox->setItemData(1, tr("Modbus TCP/UDP clients on the network, Modbus RTU slaves on the serial port"),
+                                  Qt::ToolTipRole);
+    modbusTimeoutLabel = new QLabel(tr("Timeout (ms):"), this);
+    modbusTimeoutLineEdit = new QLineEdit(QString::number(defaults.modbus.timeout), this);
+    modbusCacheTtlLabel = new QLabel(tr("Cache (ms):"), this);
+    modbusCacheTtlLineEdit = new QLineEdit(QString::number(defaults.modbus.cacheTtl), this);
+
+    // Create the link codec check boxes and its delay; the peer needs the codec as well
+    codecAggregateCheckBox = new QCheckBox(tr("Aggregate"), this);
+    codecAggregateCheckBox->setToolTip(tr("Pack several serial packets into one datagram"));
+    codecCompressCheckBox = new QCheckBox(tr("Compress"), this);
+    codecCompressCheckBox->setToolTip(tr("LZ4 compress the datagrams"));
+    codecDelayLabel = new QLabel(tr("Delay (ms):"), this);
+    codecDelayLineEdit = new QLineEdit(QString::number(defaults.codec.maxDelay), this);
+    codecSequenceCheckBox = new QCheckBox(tr("Sequence"), this);
+    codecSequenceCheckBox->setToolTip(tr("Number the datagrams so that the peer detects losses and restores their order"));
+
+    // Create the transmit pacing controls for slow serial devices
+    rs485CheckBox = new QCheckBox(tr("RS-485"), this);
+    rs485CheckBox->setToolTip(tr("Raise RTS while a frame is sent, for the direction of the transceiver"));
+    frameGapLabel = new QLabel(tr("Frame gap (us):"), this);
+    frameGapLineEdit = new QLineEdit(QString::number(defaults.transmit.frameGap), this);
+    txFifoLabel = new QLabel(tr("TX FIFO:"), this);
+    txFifoLineEdit = new QLineEdit(QString::number(defaults.transmit.fifoSize), this);
+    txFifoLineEdit->setToolTip(tr("Bytes handed to the driver ahead of the line; 0 does not pace"));
+
+    // Create the layout for the framing group box
+    QGridLayout *framingLayout = new QGridLayout();
+    framingLayout->addWidget(framingModeComboBox, 0, 0);
+    framingLayout->addWidget(framingMaxSizeLabel, 0, 1);
+    framingLayout->addWidget(framingMaxSizeLineEdit, 0, 2);
+    framingLayout->addWidget(framingIdleLabel, 0, 3);
+    framingLayout->addWidget(framingIdleLineEdit, 0, 4);
+    framingLayout->addWidget(framingDelimiterLabel, 0, 5);
+    framingLayout->addWidget(framingDelimiterLineEdit, 0, 6);
+    framingLayout->addWidget(framingFixedLengthLabel, 0, 7);
+    framingLayout->addWidget(framingFixedLengthLineEdit, 0, 8);
+    framingLayout->addWidget(framingTimeoutLabel, 0, 9);
+    framingLayout->addWidget(framingTimeoutLineEdit, 0, 10);
+    framingLayout->addWidget(protocolComboBox, 1, 0);
+    framingLayout->addWidget(modbusTimeoutLabel, 1, 1);
+    framingLayout->addWidget(modbusTimeoutLineEdit, 1, 2);
+    framingLayout->addWidget(modbusCacheTtlLabel, 1, 3);
+    framingLayout->addWidget(modbusCacheTtlLineEdit, 1, 4);
+    framingLayout->addWidget(codecAggregateCheckBox, 1, 5);
+    framingLayout->addWidget(codecCompressCheckBox, 1, 6);
+    framingLayout->addWidget(codecDelayLabel, 1, 7);
+    framingLayout->addWidget(codecDelayLineEdit, 1, 8);
+    framingLayout->addWidget(codecSequenceCheckBox, 1, 9);
+    framingLayout->addWidget(rs485CheckBox, 2, 0);
+    framingLayout->addWidget(frameGapLabel, 2, 1);
+    framingLayout->addWidget(frameGapLineEdit, 2, 2);
+    framingLayout->addWidget(txFifoLabel, 2, 3);
+    framingLayout->addWidget(txFifoLineEdit, 2, 4);
+    framingGroupBox->setLayout(framingLayout);
 }
 
-// Function to create the UDP group box
-void Widget::createUdpGroupBox()
+// Function to create the statistics group box
+void Widget::createStatsGroupBox()
 {
-    // Create the UDP group box
-    udpGroupBox = new QGroupBox(tr("UDP"), this);
-
-    // Create the UDP port label
-    udpPortLabel = new QLabel(tr("Port:"), this);
-
-    // Create the UDP port line edit
-    udpPortLineEdit = new QLineEdit(this);
-
-    // Set the default UDP port number
-    udpPortLineEdit->setText(QStringLiteral("1234"));
-
-    // Create the destination IP label
-    destinationIpLabel = new QLabel(tr("Destination IP:"), this);
-
-    // Create the destination IP line edit
-    destinationIpLineEdit = new QLineEdit(this);
-
-    // Set the default destination IP address
-    destinationIpLineEdit->setText(QStringLiteral("127.0.0.1"));
-
-    // Create the layout for the UDP group box
-    QGridLayout *udpLayout = new QGridLayout();
-    udpLayout->addWidget(udpPortLabel, 0, 0);
-    udpLayout->addWidget(udpPortLineEdit, 0, 1);
-    udpLayout->addWidget(destinationIpLabel, 0, 2);
-    udpLayout->addWidget(destinationIpLineEdit, 0, 3);
-    udpGroupBox->setLayout(udpLayout);
+    // Create the statistics group box
+    statsGroupBox = new QGroupBox(tr("Statistics"), this);
+
+    // Create one line per direction and one for the serial queue
+    serialToUdpStatsLabel = new QLabel(this);
+    udpToSerialStatsLabel = new QLabel(this);
+    queueStatsLabel = new QLabel(this);
+
+    // Create the layout for the statistics group box
+    QVBoxLayout *statsLayout = new QVBoxLayout();
+    statsLayout->addWidget(serialToUdpStatsLabel);
+    statsLayout->addWidget(udpToSerialStatsLabel);
+    statsLayout->addWidget(queueStatsLabel);
+    statsGroupBox->setLayout(statsLayout);
+
+    // Refresh once a second while the bridge is open; the counters are
+    // atomics, so reading them never stalls the engine thread
+    statsTimer = new QTimer(this);
+    statsTimer->setInterval(1000);
+    connect(statsTimer, &QTimer::timeout, this, &Widget::updateStatistics);
+
+    updateStatistics();
 }
 
-// Function to create the log group box
-void Widget::createLogGroupBox()
+// Function to create the traffic monitor group box
+void Widget::createMonitorGroupBox()
 {
-    // Create the log group box
-    logGroupBox = new QGroupBox(tr("Log"), this);
-
-    // Create the log text edit
-    logTextEdit = new QTextEdit(this);
-
-    // Set the log text edit to read-only
-    logTextEdit->setReadOnly(true);
-
-    // Create the layout for the log group box
-    QVBoxLayout *logLayout = new QVBoxLayout();
-    logLayout->addWidget(logTextEdit);
-    logGroupBox->setLayout(logLayout);
+    // Create the traffic monitor group box
+    monitorGroupBox = new QGroupBox(tr("Traffic monitor"), this);
+
+    // Create the switch and the sampling parameters with their defaults
+    const TrafficTap::Sampling defaults;
+    monitorCheckBox = new QCheckBox(tr("Monitor"), this);
+    monitorEveryLabel = new QLabel(tr("Every Nth packet:"), this);
+    monitorEveryLineEdit = new QLineEdit(QString::number(defaults.everyNth), this);
+    monitorBytesLabel = new QLabel(tr("First bytes:"), this);
+    monitorBytesLineEdit = new QLineEdit(QString::number(defaults.maxBytes), this);
+    monitorTriggerLabel = new QLabel(tr("Trigger (hex):"), this);
+    monitorTriggerLineEdit = new QLineEdit(this);
+
+    // Create the dump view, only shown while the monitor is open
+    monitorTextEdit = new QPlainTextEdit(this);
+    monitorTextEdit->setReadOnly(true);
+    monitorTextEdit->setUndoRedoEnabled(false);
+    monitorTextEdit->setMaximumBlockCount(MaxLogLines);
+    monitorTextEdit->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    monitorTextEdit->setVisible(false);
+
+    // Create the trace file line edit, applied when the bridge opens
+    recordLabel = new QLabel(tr("Record trace to:"), this);
+    recordLineEdit = new QLineEdit(this);
+    recordLineEdit->setPlaceholderText(tr("not recording"));
+    latencyTraceLabel = new QLabel(tr("Latency trace to:"), this);
+    latencyTraceLineEdit = new QLineEdit(this);
+    latencyTraceLineEdit->setPlaceholderText(tr("not tracing"));
+    latencyTraceLineEdit->setToolTip(tr("A .json file opens in chrome://tracing or Perfetto, anything else is binary"));
+
+    // Create the layout for the traffic monitor group box
+    QGridLayout *monitorLayout = new QGridLayout();
+    monitorLayout->addWidget(monitorCheckBox, 0, 0);
+    monitorLayout->addWidget(monitorEveryLabel, 0, 1);
+    monitorLayout->addWidget(monitorEveryLineEdit, 0, 2);
+    monitorLayout->addWidget(monitorBytesLabel, 0, 3);
+    monitorLayout->addWidget(monitorBytesLineEdit, 0, 4);
+    monitorLayout->addWidget(monitorTriggerLabel, 0, 5);
+    monitorLayout->addWidget(monitorTriggerLineEdit, 0, 6);
+    monitorLayout->addWidget(monitorTextEdit, 1, 0, 1, 7);
+    monitorLayout->addWidget(recordLabel, 2, 0);
+    monitorLayout->addWidget(recordLineEdit, 2, 1, 1, 6);
+    monitorLayout->addWidget(latencyTraceLabel, 3, 0);
+    monitorLayout->addWidget(latencyTraceLineEdit, 3, 1, 1, 6);
+    monitorGroupBox->setLayout(monitorLayout);
+
+    // Format the dumps on their own thread so that neither the engine nor the
+    // GUI spends time on it
+    monitorThread = new QThread(this);
+    monitorThread->setObjectName(QStringLiteral("traffic-monitor"));
+    trafficFormatter = new TrafficFormatter(engine->trafficTap());
+    trafficFormatter->moveToThread(monitorThread);
+    connect(monitorThread, &QThread::finished, trafficFormatter, &QObject::deleteLater);
+    connect(trafficFormatter, &TrafficFormatter::dumpReady, monitorTextEdit, &QPlainTextEdit::appendPlainText);
+    monitorThread->start();
+
+    // Apply the sampling whenever the switch or a parameter changes
+    connect(monitorCheckBox, &QCheckBox::toggled, this, &Widget::updateTrafficMonitor);
+    connect(monitorEveryLineEdit, &QLineEdit::editingFinished, this, &Widget::updateTrafficMonitor);
+    connect(monitorBytesLineEdit, &QLineEdit::editingFinished, this, &Widget::updateTrafficMonitor);
+    connect(monitorTriggerLineEdit, &QLineEdit::editingFinished, this, &Widget::updateTrafficMonitor);
 }
 
-// Function to update the available serial ports
-void Widget::updateSerialPortInfo()
+// This slot is called to open, close or resample the traffic monitor
+void Widget::updateTrafficMonitor()
 {
-    // Clear the current serial port combo box
-    serialPortComboBox->clear();
+    const bool enabled = monitorCheckBox->isChecked();
+
+    // Get the sampling parameters from the line edits
+    TrafficTap::Sampling sampling;
+    bool everyOk = false;
+    bool bytesOk = false;
+    sampling.everyNth = monitorEveryLineEdit->text().toInt(&everyOk);
+    sampling.maxBytes = monitorBytesLineEdit->text().toInt(&bytesOk);
+    if (!everyOk || sampling.everyNth <= 0 || !bytesOk || sampling.maxBytes <= 0
+        || sampling.maxBytes > TrafficTap::MaxCaptureBytes) {
+        processError(tr("Invalid monitor sampling, use a positive packet interval and 1 to %1 bytes")
+                         .arg(TrafficTap::MaxCaptureBytes));
+        return;
+    }
+    if (!monitorTriggerLineEdit->text().trimmed().isEmpty()
+        && !BridgeSettings::parseDelimiter(monitorTriggerLineEdit->text(), &sampling.trigger)) {
+        processError(tr("Invalid trigger \"%1\", use hex bytes like 01 03")
+                         .arg(monitorTriggerLineEdit->text()));
+        return;
+    }
 
-    // Fill the available serial ports in the combo box
-    fillPortsInfo();
+    // The engine only captures while the monitor is open; the formatter only
+    // polls while there is something to show
+    emit trafficMonitorChangeRequested(enabled, sampling);
+    QMetaObject::invokeMethod(trafficFormatter, enabled ? &TrafficFormatter::start : &TrafficFormatter::stop,
+                              Qt::QueuedConnection);
+    monitorTextEdit->setVisible(enabled);
 }
 
-// Function to fill the available serial port parameters in the combo box
-void Widget::fillPortsParameters()
+// This slot is called periodically to refresh the statistics panel
+void Widget::updateStatistics()
 {
-    // Add the available baud rates to the combo box
-    baudRateComboBox->addItem(QStringLiteral("9600"), QSerialPort::Baud9600);
-    baudRateComboBox->addItem(QStringLiteral("19200"), QSerialPort::Baud19200);
-    baudRateComboBox->addItem(QStringLiteral("38400"), QSerialPort::Baud38400);
-    baudRateComboBox->addItem(QStringLiteral("57600"), QSerialPort::Baud57600);
-    baudRateComboBox->addItem(QStringLiteral("115200"), QSerialPort::Baud115200);
-
-    // Add the available data bits to the combo box
-    dataBitsComboBox->addItem(QStringLiteral("5"), QSerialPort::Data5);
-    dataBitsComboBox->addItem(QStringLiteral("6"), QSerialPort::Data6);
-    dataBitsComboBox->addItem(QStringLiteral("7"), QSerialPort::Data7);
-    dataBitsComboBox->addItem(QStringLiteral("8"), QSerialPort::Data8);
-
-    // Add the available parity options to the combo box
-    parityComboBox->addItem(tr("None"), QSerialPort::NoParity);
-    parityComboBox->addItem(tr("Even"), QSerialPort::EvenParity);
-    parityComboBox->addItem(tr("Odd"), QSerialPort::OddParity);
-    parityComboBox->addItem(tr("Mark"), QSerialPort::MarkParity);
-    parityComboBox->addItem(tr("Space"), QSerialPort::SpaceParity);
+    const BridgeStats::Snapshot snapshot = engine->statistics().snapshot();
+    const double seconds = qMax(1e-3, (snapshot.time - lastSnapshot.time) / 1e9);
+
+    serialToUdpStatsLabel->setText(tr("Serial to UDP: %1")
+                                       .arg(describeDirection(snapshot.serialToUdp, lastSnapshot.serialToUdp, seconds)));
+    udpToSerialStatsLabel->setText(tr("UDP to serial: %1")
+                                       .arg(describeDirection(snapshot.udpToSerial, lastSnapshot.udpToSerial, seconds)));
+    QString queueStats = tr("Serial queue: %1 bytes in %2 frames, peak %3 bytes; serial errors: %4, line errors: %5")
+                             .arg(snapshot.queueBytes)
+                             .arg(snapshot.queueFrames)
+                             .arg(snapshot.queuePeakBytes)
+                             .arg(snapshot.serialErrors)
+                             .arg(snapshot.lineErrorsCounted ? QString::number(snapshot.lineErrors) : tr("n/a"));
+
+    // Only a sequenced peer fills in the sequence counters
+    const BridgeStats::SequenceSnapshot &sequence = snapshot.sequence;
+    if (sequence.lost + sequence.late + sequence.duplicates + sequence.reordered + sequence.jitter != 0) {
+        queueStats += tr("; sequence: %1 lost, %2 late, %3 duplicates, %4 reordered, jitter %5 us")
+                          .arg(sequence.lost).arg(sequence.late).arg(sequence.duplicates)
+                          .arg(sequence.reordered).arg(sequence.jitter);
+    }
 
-    // Add the available stop bits to the combo box
-    stopBitsComboBox->addItem(QStringLiteral("1"), QSerialPort::OneStop);
-    stopBitsComboBox->addItem(QStringLiteral("1.5"), QSerialPort::OneAndHalfStop);
-    stopBitsComboBox->addItem(QStringLiteral("2"), QSerialPort::TwoStop);
+    // Only the transmit pacer wakes up on its own timer
+    if (snapshot.pacing.wakeups != 0) {
+        queueStats += tr("; pacing timer late by %1 us (p99)")
+                          .arg(BridgeStats::percentile(snapshot.pacing.lateness, BridgeStats::LatencyBuckets, 0.99));
+    }
+    queueStatsLabel->setText(queueStats);
 
-    // Add the available flow control options to the combo box
-    flowControlComboBox->addItem(tr("None"), QSerialPort::NoFlowControl);
-    flowControlComboBox->addItem(tr("RTS/CTS"), QSerialPort::HardwareControl);
-    flowControlComboBox->addItem(tr("XON/XOFF"), QSerialPort::SoftwareControl);
+    lastSnapshot = snapshot;
 }
 
-// Function to fill the available serial ports in the combo box
-void Widget::fillPortsInfo()
+// This function is called to summarize one direction of the bridge in one line
+QString Widget::describeDirection(const BridgeStats::DirectionSnapshot &now,
+                                  const BridgeStats::DirectionSnapshot &before,
+                                  double seconds) const
 {
-    // Clear the current serial port combo box
-    serialPortComboBox->clear();
-
-    // Get the available serial ports
-    const auto serialPortInfos = QSerialPortInfo::availablePorts();
-
-    // Add the available serial ports to the combo box
-    for (const QSerialPortInfo &serialPortInfo : serialPortInfos)
-        serialPortComboBox->addItem(serialPortInfo.portName());
+    const quint64 chunks = now.chunks - before.chunks;
+    const quint64 bytes = now.bytes - before.bytes;
+    return tr("%1 B/s, %2 datagrams/s, %3 serial chunks/s (avg %4 B), %5 drops total, "
+              "latency p50 %6 us / p99 %7 us")
+        .arg(qRound64(bytes / seconds))
+        .arg(qRound64((now.datagrams - before.datagrams) / seconds))
+        .arg(qRound64(chunks / seconds))
+        .arg(chunks == 0 ? 0 : qRound64(double(bytes) / chunks))
+        .arg(now.drops)
+        .arg(BridgeStats::percentile(now.latency, BridgeStats::LatencyBuckets, 0.5))
+        .arg(BridgeStats::percentile(now.latency, BridgeStats::LatencyBuckets, 0.99));
 }
 
-// Function to update the UDP port information
-void Widget::updateUdpPortInfo()
+// This slot is called with the serial ports whenever devices came or went
+void Widget::updateSerialPortInfo(const QVector<SerialPortEntry> &ports)
 {
-    // Get the current UDP port number
-    const quint16 udpLocalPort = udpLocalPortLineEdit->text().toInt();
+    // Keep the selection across the update
+    const QString current = serialPortComboBox->currentText();
 
-    // Set the UDP socket to listen on the current port
-    udpSocket->bind(QHostAddress::AnyIPv4, udpLocalPort);
-}
+    serialPortComboBox->clear();
+    for (const SerialPortEntry &port : ports) {
+        serialPortComboBox->addItem(port.portName, port.identity);
+        serialPortComboBox->setItemData(serialPortComboBox->count() - 1,
+                                        port.identity.isEmpty() ? port.description
+                                                                : QStringLiteral("%1 (%2)").arg(port.description, port.identity),
+                                        Qt::ToolTipRole);
+    }
 
-// Function to update the UDP port information
-void Widget::updateUdpClose()
-{
-    // Get the current UDP port number
-    // Set the UDP socket to listen on the current port
-    udpSocket->close();
+    const int index = serialPortComboBox->findText(current);
+    if (index >= 0)
+        serialPortComboBox->setCurrentIndex(index);
 }
 
 // Function to process information messages
 void Widget::processInfo(const QString &info)
 {
-    // Append the information message to the log text edit
-    logTextEdit->append(tr("[INFO] %1").arg(info));
+    // Queue the information message, flushLog() shows it
+    logQueue.push(LogQueue::Info, info);
 }
 
 // Function to process error messages
 void Widget::processError(const QString &error)
 {
-    // Append the error message to the log text edit
-    logTextEdit->append(tr("[ERROR] %1").arg(error));
+    // Queue the error message, flushLog() shows it
+    logQueue.push(LogQueue::Error, error);
+}
+
+// This slot is called periodically to move the queued log lines into the view
+void Widget::flushLog()
+{
+    // Build one block of text so that the view lays out once per batch
+    QString batch;
+    LogQueue::Entry entry;
+    while (logQueue.pop(&entry)) {
+        if (!batch.isEmpty())
+            batch += QLatin1Char('\n');
+        batch += QDateTime::fromMSecsSinceEpoch(entry.time).toString(QStringLiteral("hh:mm:ss.zzz "));
+        batch += entry.level == LogQueue::Error ? tr("[ERROR] %1").arg(entry.text)
+                                                : tr("[INFO] %1").arg(entry.text);
+    }
+
+    // Tell how many lines did not fit into the queue
+    const quint64 dropped = logQueue.takeDropped();
+    if (dropped != 0) {
+        if (!batch.isEmpty())
+            batch += QLatin1Char('\n');
+        batch += tr("[ERROR] %1 log lines were dropped").arg(dropped);
+    }
+
+    if (!batch.isEmpty())
+        logTextEdit->appendPlainText(batch);
 }
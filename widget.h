@@ -2,17 +2,25 @@
 #ifndef WIDGET_H
 #define WIDGET_H
 
+#include "bridgemanager.h"
+#include "logqueue.h"
+#include "profiles.h"
+
 #include <QWidget>
 #include <QtSerialPort>
-#include <QUdpSocket>
 #include <QLabel>
 #include <QGroupBox>
 #include <QComboBox>
 #include <QPushButton>
 #include <QLineEdit>
-#include <QTextEdit>
+#include <QPlainTextEdit>
+#include <QDateTime>
 #include <QVBoxLayout>
 #include <QGridLayout>
+#include <QTimer>
+#include <QCheckBox>
+#include <QThread>
+#include <QFontDatabase>
 
 namespace Ui { class Widget; }
 
@@ -22,34 +30,55 @@ class Widget : public QWidget
     Q_OBJECT
 
 public:
-    Widget(QWidget *parent = nullptr);kj
+    Widget(QWidget *parent = nullptr);
     ~Widget();
 
     void openSerialPort();
     void closeSerialPort();
-    void readSerialData();
-    void writeSerialData(const QByteArray &data);
-    void readUdpData();
-    void writeUdpData(const QByteArray &data);
-    void handleError(QSerialPort::SerialPortError error);
+    void applyProfile(const QString &name, bool open);
+
+signals:
+    void openBridgeRequested(const BridgeSettings &settings);
+    void reconfigureBridgeRequested(const BridgeSettings &settings);
+    void closeBridgeRequested();
+    void destinationChangeRequested(const QString &host, quint16 port);
+    void trafficMonitorChangeRequested(bool enabled, const TrafficTap::Sampling &sampling);
 
 private:
     Ui::Widget *ui;
 
-    void createSerialGroupBox();
-    void createUdpGroupBox();
-    void createLogGroupBox();
-    void updateSerialPortInfo();
-    void fillPortsParameters();
-    void fillPortsInfo();
-    void updateUdpPortInfo();
-    void updateUdpClose();
+    void createFramingGroupBox();
+    void createStatsGroupBox();
+    void createMonitorGroupBox();
+    void updateTrafficMonitor();
+    void updateStatistics();
+    QString describeDirection(const BridgeStats::DirectionSnapshot &now,
+                              const BridgeStats::DirectionSnapshot &before,
+                              double seconds) const;
+    void updateSerialPortInfo(const QVector<SerialPortEntry> &ports);
+    bool readSettings(BridgeSettings *settings);
+    void showSettings(const BridgeSettings &settings);
+    void loadProfile();
+    void saveProfile();
+    void setSettingsEnabled(bool enabled);
+    void updateDestination();
+    void handleBridgeOpened(const QString &portName);
+    void handleBridgeClosed();
     void processError(const QString &s);
     void processWarning(const QString &s);
     void processInfo(const QString &s);
+    void flushLog();
     void initGui();
 
-    QGroupBox *serialGroupBox;
+    QComboBox *profileComboBox;
+    QPushButton *loadProfileButton;
+    QPushButton *saveProfileButton;
+    QCheckBox *autostartCheckBox;
+
+    // Last settings shown, so that those without widgets survive a round trip
+    BridgeSettings shownSettings;
+    bool bridgeRunning = false;
+
     QLabel *serialPortLabel;
     QComboBox *serialPortComboBox;
     QLabel *baudRateLabel;
@@ -62,6 +91,10 @@ private:
     QComboBox *stopBitsComboBox;
     QLabel *flowControlLabel;
     QComboBox *flowControlComboBox;
+    QComboBox *backendComboBox;
+    QCheckBox *ptyCheckBox;
+    QLineEdit *ptyLinkLineEdit;
+    QCheckBox *lineControlCheckBox;
     QPushButton *openSerialButton;
     QPushButton *closeSerialButton;
 
@@ -72,14 +105,76 @@ private:
     QLineEdit *udpLocalPortLineEdit;
     QLabel *destinationIpLabel;
     QLineEdit *destinationIpLineEdit;
+    QLabel *queueLimitLabel;
+    QLineEdit *queueLimitLineEdit;
+    QComboBox *queuePolicyComboBox;
+    QComboBox *transportComboBox;
+
+    QGroupBox *framingGroupBox;
+    QComboBox *framingModeComboBox;
+    QLabel *framingMaxSizeLabel;
+    QLineEdit *framingMaxSizeLineEdit;
+    QLabel *framingIdleLabel;
+    QLineEdit *framingIdleLineEdit;
+    QLabel *framingDelimiterLabel;
+    QLineEdit *framingDelimiterLineEdit;
+    QLabel *framingFixedLengthLabel;
+    QLineEdit *framingFixedLengthLineEdit;
+    QLabel *framingTimeoutLabel;
+    QLineEdit *framingTimeoutLineEdit;
+    QComboBox *protocolComboBox;
+    QLabel *modbusTimeoutLabel;
+    QLineEdit *modbusTimeoutLineEdit;
+    QLabel *modbusCacheTtlLabel;
+    QLineEdit *modbusCacheTtlLineEdit;
+    QCheckBox *codecAggregateCheckBox;
+    QCheckBox *codecCompressCheckBox;
+    QLabel *codecDelayLabel;
+    QLineEdit *codecDelayLineEdit;
+    QCheckBox *codecSequenceCheckBox;
+    QCheckBox *rs485CheckBox;
+    QLabel *frameGapLabel;
+    QLineEdit *frameGapLineEdit;
+    QLabel *txFifoLabel;
+    QLineEdit *txFifoLineEdit;
+
+    QGroupBox *statsGroupBox;
+    QLabel *serialToUdpStatsLabel;
+    QLabel *udpToSerialStatsLabel;
+    QLabel *queueStatsLabel;
+    QTimer *statsTimer;
+    BridgeStats::Snapshot lastSnapshot;
+
+    QGroupBox *monitorGroupBox;
+    QCheckBox *monitorCheckBox;
+    QLabel *monitorEveryLabel;
+    QLineEdit *monitorEveryLineEdit;
+    QLabel *monitorBytesLabel;
+    QLineEdit *monitorBytesLineEdit;
+    QLabel *monitorTriggerLabel;
+    QLineEdit *monitorTriggerLineEdit;
+    QPlainTextEdit *monitorTextEdit;
+    QLabel *recordLabel;
+    QLineEdit *recordLineEdit;
+    QLabel *latencyTraceLabel;
+    QLineEdit *latencyTraceLineEdit;
+    QThread *monitorThread;
+    TrafficFormatter *trafficFormatter;
+
+    // Lists the serial ports off the GUI thread whenever devices come or go
+    QThread *portThread;
+    PortWatcher *portWatcher;
+
+    // Lines kept in the log view; older ones are dropped
+    static constexpr int MaxLogLines = 5000;
 
     QGroupBox *logGroupBox;
-    QTextEdit *logTextEdit;
+    QPlainTextEdit *logTextEdit;
+    QTimer *logTimer;
+    LogQueue logQueue;
 
-    QSerialPort *serialPort;
-    QUdpSocket *udpSocket;
-    QByteArray serialData;
-    QByteArray udpData;
+    BridgeManager *bridgeManager;
+    BridgeEngine *engine;
 };
 
 #endif // WIDGET_H